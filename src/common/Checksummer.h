@@ -4,8 +4,11 @@
 #ifndef CEPH_OS_BLUESTORE_CHECKSUMMER
 #define CEPH_OS_BLUESTORE_CHECKSUMMER
 
+#include <algorithm>
+
 #include "xxHash/xxhash.h"
 #include "include/byteorder.h"
+#include "include/crc32c.h"
 
 class Checksummer {
 public:
@@ -87,6 +90,17 @@ public:
       ) {
       return p.crc32c(len, init_value);
     }
+    static void calc_blocks(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      size_t count,
+      const char *data,
+      init_value_t *out
+      ) {
+      ceph_crc32c_blocks(init_value, (const unsigned char*)data, len, count,
+			 out);
+    }
   };
 
   struct crc32c_16 {
@@ -108,6 +122,20 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xffff;
     }
+    static void calc_blocks(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      size_t count,
+      const char *data,
+      init_value_t *out
+      ) {
+      ceph_crc32c_blocks(init_value, (const unsigned char*)data, len, count,
+			 out);
+      for (size_t i = 0; i < count; ++i) {
+	out[i] &= 0xffff;
+      }
+    }
   };
 
   struct crc32c_8 {
@@ -129,6 +157,20 @@ public:
       ) {
       return p.crc32c(len, init_value) & 0xff;
     }
+    static void calc_blocks(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      size_t count,
+      const char *data,
+      init_value_t *out
+      ) {
+      ceph_crc32c_blocks(init_value, (const unsigned char*)data, len, count,
+			 out);
+      for (size_t i = 0; i < count; ++i) {
+	out[i] &= 0xff;
+      }
+    }
   };
 
   struct xxhash32 {
@@ -158,6 +200,18 @@ public:
       }
       return XXH32_digest(state);
     }
+    static void calc_blocks(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      size_t count,
+      const char *data,
+      init_value_t *out
+      ) {
+      for (size_t i = 0; i < count; ++i, data += len) {
+	out[i] = XXH32(data, len, init_value);
+      }
+    }
   };
 
   struct xxhash64 {
@@ -187,8 +241,58 @@ public:
       }
       return XXH64_digest(state);
     }
+    static void calc_blocks(
+      state_t state,
+      init_value_t init_value,
+      size_t len,
+      size_t count,
+      const char *data,
+      init_value_t *out
+      ) {
+      for (size_t i = 0; i < count; ++i, data += len) {
+	out[i] = XXH64(data, len, init_value);
+      }
+    }
   };
 
+  /*
+   * Checksum the length / csum_block_size blocks at the front of bl and
+   * pass the values to f(first block, count, values), a batch at a time,
+   * until f returns false.  Runs of blocks that sit inside one buffer go
+   * through Alg::calc_blocks in one call; only a block that straddles two
+   * buffers is done on its own with Alg::calc.
+   */
+  template<class Alg, class F>
+  static void _calc_batches(
+    typename Alg::state_t state,
+    typename Alg::init_value_t init_value,
+    size_t csum_block_size,
+    size_t length,
+    const bufferlist &bl,
+    F&& f) {
+    static constexpr size_t max_batch = 64;
+    typename Alg::init_value_t v[max_batch];
+    bufferlist::const_iterator p = bl.begin();
+    size_t blocks = length / csum_block_size;
+    for (size_t i = 0; i < blocks; ) {
+      size_t n = std::min(blocks - i, max_batch);
+      size_t contiguous = p.get_current_ptr().length();
+      if (contiguous >= csum_block_size) {
+	n = std::min(n, contiguous / csum_block_size);
+	const char *data;
+	p.get_ptr_and_advance(n * csum_block_size, &data);
+	Alg::calc_blocks(state, init_value, csum_block_size, n, data, v);
+      } else {
+	n = 1;
+	v[0] = Alg::calc(state, init_value, csum_block_size, p);
+      }
+      if (!f(i, n, v)) {
+	return;
+      }
+      i += n;
+    }
+  }
+
   template<class Alg>
   static int calculate(
     size_t csum_block_size,
@@ -209,8 +313,6 @@ public:
       const bufferlist &bl,
       bufferptr* csum_data) {
     ceph_assert(length % csum_block_size == 0);
-    size_t blocks = length / csum_block_size;
-    bufferlist::const_iterator p = bl.begin();
     ceph_assert(bl.length() >= length);
 
     typename Alg::state_t state;
@@ -222,10 +324,14 @@ public:
     typename Alg::value_t *pv =
       reinterpret_cast<typename Alg::value_t*>(csum_data->c_str());
     pv += offset / csum_block_size;
-    while (blocks--) {
-      *pv = Alg::calc(state, init_value, csum_block_size, p);
-      ++pv;
-    }
+    _calc_batches<Alg>(
+      state, init_value, csum_block_size, length, bl,
+      [pv](size_t first, size_t n, const typename Alg::init_value_t *v) {
+	for (size_t i = 0; i < n; ++i) {
+	  pv[first + i] = v[i];
+	}
+	return true;
+      });
     Alg::fini(&state);
     return 0;
   }
@@ -240,7 +346,6 @@ public:
     uint64_t *bad_csum=0
     ) {
     ceph_assert(length % csum_block_size == 0);
-    bufferlist::const_iterator p = bl.begin();
     ceph_assert(bl.length() >= length);
 
     typename Alg::state_t state;
@@ -249,22 +354,23 @@ public:
     const typename Alg::value_t *pv =
       reinterpret_cast<const typename Alg::value_t*>(csum_data.c_str());
     pv += offset / csum_block_size;
-    size_t pos = offset;
-    while (length > 0) {
-      typename Alg::init_value_t v = Alg::calc(state, -1, csum_block_size, p);
-      if (*pv != v) {
-	if (bad_csum) {
-	  *bad_csum = v;
+    int r = -1;  // no errors
+    _calc_batches<Alg>(
+      state, -1, csum_block_size, length, bl,
+      [&](size_t first, size_t n, const typename Alg::init_value_t *v) {
+	for (size_t i = 0; i < n; ++i) {
+	  if (pv[first + i] != v[i]) {
+	    if (bad_csum) {
+	      *bad_csum = v[i];
+	    }
+	    r = offset + (first + i) * csum_block_size;
+	    return false;
+	  }
 	}
-	Alg::fini(&state);
-	return pos;
-      }
-      ++pv;
-      pos += csum_block_size;
-      length -= csum_block_size;
-    }
+	return true;
+      });
     Alg::fini(&state);
-    return -1;  // no errors
+    return r;
   }
 };
 
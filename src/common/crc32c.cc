@@ -52,6 +52,40 @@ ceph_crc32c_func_t ceph_choose_crc32(void)
  */
 ceph_crc32c_func_t ceph_crc32c_func = ceph_choose_crc32();
 
+static void ceph_crc32c_blocks_serial(uint32_t crc, unsigned char const *data,
+				      unsigned block_len, unsigned count,
+				      uint32_t *out)
+{
+  for (unsigned i = 0; i < count; ++i) {
+    out[i] = ceph_crc32c_func(crc, data, block_len);
+    data += block_len;
+  }
+}
+
+/*
+ * choose the multi-block implementation; without a crc32c instruction
+ * to interleave we just go through ceph_crc32c_func block by block.
+ */
+ceph_crc32c_blocks_func_t ceph_choose_crc32c_blocks(void)
+{
+  ceph_arch_probe();
+
+#if defined(__x86_64__)
+  if (ceph_arch_intel_sse42) {
+    return ceph_crc32c_intel_blocks;
+  }
+#elif defined(__arm__) || defined(__aarch64__)
+# if defined(HAVE_ARMV8_CRC)
+  if (ceph_arch_aarch64_crc32) {
+    return ceph_crc32c_aarch64_blocks;
+  }
+# endif
+#endif
+  return ceph_crc32c_blocks_serial;
+}
+
+ceph_crc32c_blocks_func_t ceph_crc32c_blocks_func = ceph_choose_crc32c_blocks();
+
 
 /*
  * Look: http://crcutil.googlecode.com/files/crc-doc.1.0.pdf
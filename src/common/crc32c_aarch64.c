@@ -270,3 +270,46 @@ uint32_t ceph_crc32c_aarch64(uint32_t crc, unsigned char const *buffer, unsigned
 	}
 	return crc;
 }
+
+/*
+ * crc32c of count adjacent blocks of block_len bytes each.  Four blocks
+ * are done at a time so that four independent crc32cx are in flight;
+ * a single stream is bound by the latency of the instruction.
+ */
+void ceph_crc32c_aarch64_blocks(uint32_t crc, unsigned char const *buffer,
+				unsigned block_len, unsigned count,
+				uint32_t *out)
+{
+	unsigned words = block_len / sizeof(uint64_t);
+	unsigned i, j;
+
+	for (; count >= 4; count -= 4, out += 4) {
+		const uint64_t *p0 = (const uint64_t *)buffer;
+		const uint64_t *p1 = (const uint64_t *)(buffer + block_len);
+		const uint64_t *p2 = (const uint64_t *)(buffer + block_len * 2);
+		const uint64_t *p3 = (const uint64_t *)(buffer + block_len * 3);
+		uint32_t crc0 = crc, crc1 = crc, crc2 = crc, crc3 = crc;
+
+		for (i = 0; i < words; i++) {
+			CRC32CX(crc0, p0[i]);
+			CRC32CX(crc1, p1[i]);
+			CRC32CX(crc2, p2[i]);
+			CRC32CX(crc3, p3[i]);
+		}
+		for (j = words * sizeof(uint64_t); j < block_len; j++) {
+			CRC32CB(crc0, buffer[j]);
+			CRC32CB(crc1, buffer[block_len + j]);
+			CRC32CB(crc2, buffer[block_len * 2 + j]);
+			CRC32CB(crc3, buffer[block_len * 3 + j]);
+		}
+		out[0] = crc0;
+		out[1] = crc1;
+		out[2] = crc2;
+		out[3] = crc3;
+		buffer += block_len * 4;
+	}
+	for (; count > 0; count--, out++) {
+		*out = ceph_crc32c_aarch64(crc, buffer, block_len);
+		buffer += block_len;
+	}
+}
@@ -1,5 +1,11 @@
 #include "acconfig.h"
 #include "common/crc32c_intel_baseline.h"
+#include "include/crc32c.h"
+
+#ifdef __x86_64__
+#include <string.h>
+#include <nmmintrin.h>
+#endif
 
 extern unsigned int crc32_iscsi_00(unsigned char const *buffer, uint64_t len, uint64_t crc) asm("crc32_iscsi_00");
 extern unsigned int crc32_iscsi_zero_00(unsigned char const *buffer, uint64_t len, uint64_t crc) asm("crc32_iscsi_zero_00");
@@ -49,3 +55,57 @@ uint32_t ceph_crc32c_intel_fast(uint32_t crc, unsigned char const *buffer, unsig
 }
 
 #endif
+
+#ifdef __x86_64__
+
+/*
+ * crc32c of count adjacent blocks of block_len bytes each.  Four blocks
+ * are done at a time so that four independent crc32 instructions are in
+ * flight; a single stream is bound by the latency of the instruction.
+ * Only called when ceph_arch_intel_sse42 is set.
+ */
+__attribute__((target("sse4.2")))
+void ceph_crc32c_intel_blocks(uint32_t crc, unsigned char const *buffer,
+			      unsigned block_len, unsigned count,
+			      uint32_t *out)
+{
+	unsigned words = block_len / sizeof(uint64_t);
+	unsigned i, j;
+
+	for (; count >= 4; count -= 4, out += 4) {
+		unsigned char const *p0 = buffer;
+		unsigned char const *p1 = buffer + block_len;
+		unsigned char const *p2 = buffer + block_len * 2;
+		unsigned char const *p3 = buffer + block_len * 3;
+		uint64_t crc0 = crc, crc1 = crc, crc2 = crc, crc3 = crc;
+		uint64_t v0, v1, v2, v3;
+
+		for (i = 0; i < words; i++) {
+			memcpy(&v0, p0 + i * sizeof(uint64_t), sizeof(uint64_t));
+			memcpy(&v1, p1 + i * sizeof(uint64_t), sizeof(uint64_t));
+			memcpy(&v2, p2 + i * sizeof(uint64_t), sizeof(uint64_t));
+			memcpy(&v3, p3 + i * sizeof(uint64_t), sizeof(uint64_t));
+			crc0 = _mm_crc32_u64(crc0, v0);
+			crc1 = _mm_crc32_u64(crc1, v1);
+			crc2 = _mm_crc32_u64(crc2, v2);
+			crc3 = _mm_crc32_u64(crc3, v3);
+		}
+		for (j = words * sizeof(uint64_t); j < block_len; j++) {
+			crc0 = _mm_crc32_u8((uint32_t)crc0, p0[j]);
+			crc1 = _mm_crc32_u8((uint32_t)crc1, p1[j]);
+			crc2 = _mm_crc32_u8((uint32_t)crc2, p2[j]);
+			crc3 = _mm_crc32_u8((uint32_t)crc3, p3[j]);
+		}
+		out[0] = crc0;
+		out[1] = crc1;
+		out[2] = crc2;
+		out[3] = crc3;
+		buffer += block_len * 4;
+	}
+	for (; count > 0; count--, out++) {
+		*out = ceph_crc32c_func(crc, buffer, block_len);
+		buffer += block_len;
+	}
+}
+
+#endif
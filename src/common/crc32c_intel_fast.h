@@ -11,6 +11,7 @@ extern int ceph_crc32c_intel_fast_exists(void);
 #ifdef __x86_64__
 
 extern uint32_t ceph_crc32c_intel_fast(uint32_t crc, unsigned char const *buffer, unsigned len);
+extern void ceph_crc32c_intel_blocks(uint32_t crc, unsigned char const *buffer, unsigned block_len, unsigned count, uint32_t *out);
 
 #else
 
@@ -19,6 +20,10 @@ static inline uint32_t ceph_crc32c_intel_fast(uint32_t crc, unsigned char const
 	return 0;
 }
 
+static inline void ceph_crc32c_intel_blocks(uint32_t crc, unsigned char const *buffer, unsigned block_len, unsigned count, uint32_t *out)
+{
+}
+
 #endif
 
 #ifdef __cplusplus
@@ -2832,6 +2832,26 @@ std::vector<Option> get_global_options() {
     .set_description("")
     .add_see_also("osd_op_num_shards"),
 
+    Option("osd_fast_read", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Run small client reads right on the messenger thread when possible")
+    .set_long_description("A read of an active, clean, replicated pg with nothing queued for it, of an object whose context is cached and that no other op is using, skips the op queue and is run by the messenger thread that received it, if the object store reports the data it reads as cached. Anything else is queued as usual.")
+    .add_see_also("osd_fast_read_max_bytes"),
+
+    Option("osd_fast_read_max_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(64_K)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Largest read osd_fast_read runs on the messenger thread")
+    .add_see_also("osd_fast_read"),
+
+    Option("osd_op_steal_scan", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(4)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("How many queued ops an idle op thread looks through on another shard for one it can process; 0 disables work stealing")
+    .set_long_description("A thread whose shard has nothing queued takes an op from the shard with the longest queue, as long as no other thread is about to process the same PG, so a few hot PGs do not leave the threads of the other shards idle. Ops it looks at and does not take are put back in order. Shards using mclock_scheduler are never stolen from, as mclock cannot put an op back in its place.")
+    .add_see_also("osd_op_num_shards"),
+
     Option("osd_skip_data_digest", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .set_description("Do not store full-object checksums if the backend (bluestore) does its own checksums.  Only usable with all BlueStore OSDs."),
@@ -2921,6 +2941,12 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("osd_ec_parity_delta_writes", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("update the coding chunks of an EC stripe by delta on partial overwrites")
+    .set_long_description("When a write to a pool with allow_ec_overwrites changes part of a single stripe and the erasure code plugin supports it (jerasure, isa), read and rewrite only the data chunks written and the coding chunks, rather than reading the whole stripe and rewriting every chunk. Falls back to a full stripe read-modify-write when other writes are in flight on the PG or the object is degraded. Until such a write commits, later writes to the same object that need to read it wait for it, as what it wrote is not in the PG's stripe cache.")
+    .add_service("osd"),
+
     // Only use clone_overlap for recovery if there are fewer than
     // osd_recover_clone_overlap_limit entries in the overlap set
     Option("osd_recover_clone_overlap_limit", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
@@ -3368,6 +3394,14 @@ std::vector<Option> get_global_options() {
     .add_see_also("osd_min_pg_log_entries")
     .add_see_also("osd_max_pg_log_entries"),
 
+    Option("osd_pg_log_trim_max_per_op", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(200)
+    .set_description("maximum number of PG log entries and dups to remove in a single transaction while the OSD is busy")
+    .set_long_description("Trimming is spread over the PG's subsequent writes instead of landing in one commit. The limit doubles for every op fewer queued per op shard, up to osd_pg_log_trim_max when the shards are idle. 0 trims everything due at once.")
+    .add_service("osd")
+    .add_see_also("osd_pg_log_trim_max")
+    .add_see_also("osd_pg_log_dups_tracked"),
+
     Option("osd_op_complaint_time", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
     .set_default(30)
     .set_description(""),
@@ -3606,6 +3640,11 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description(""),
 
+    Option("memdb_skiplist", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(false)
+    .set_description("Keep memdb in a concurrent skiplist")
+    .set_long_description("Readers of the skiplist take no lock and iterators read a snapshot taken when they are created; writers are still serialized.  Without it memdb is a std::map behind a single mutex."),
+
     Option("rocksdb_log_to_ceph_log", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(true)
     .set_description(""),
@@ -3881,6 +3920,13 @@ std::vector<Option> get_global_options() {
     .set_default(64_K)
     .set_description(""),
 
+    Option("memstore_page_set_huge_pages", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_flag(Option::FLAG_STARTUP)
+    .add_see_also("memstore_page_set")
+    .set_description("Back page set objects with 2MB huge page slabs")
+    .set_long_description("Pages are carved from 2MB slabs (huge pages where the system provides them), indexed by a radix tree that readers walk without locking, and allocated or freed under a lock per 2MB range of the object, so threads working on different parts of one large object don't serialize."),
+
     Option("memstore_debug_omit_block_device_write", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .add_see_also("bluestore_debug_omit_block_device_write")
@@ -4130,6 +4176,70 @@ std::vector<Option> get_global_options() {
     .add_see_also("bluestore_block_wal_path")
     .add_see_also("bluestore_block_wal_size"),
 
+    Option("bluestore_tier_path", Option::TYPE_STR, Option::LEVEL_ADVANCED)
+    .set_default("")
+    .set_flag(Option::FLAG_CREATE)
+    .set_description("Path for the data tier block device")
+    .set_long_description("A fast device (e.g. an NVMe partition) that new object data is written to, and that cold data is migrated off to the main device in the background.  Like the main device it has to be a kernel block device or file.  It is linked as block.tier in the OSD data directory, and can be added to an existing OSD by creating that link.")
+    .add_see_also("bluestore_tier_high_ratio"),
+
+    Option("bluestore_tier_size", Option::TYPE_SIZE, Option::LEVEL_DEV)
+    .set_default(0)
+    .set_flag(Option::FLAG_CREATE)
+    .set_description("Size of file to create for bluestore_tier_path"),
+
+    Option("bluestore_tier_create", Option::TYPE_BOOL, Option::LEVEL_DEV)
+    .set_default(false)
+    .set_flag(Option::FLAG_CREATE)
+    .set_description("Create bluestore_tier_path if it doesn't exist")
+    .add_see_also("bluestore_tier_path")
+    .add_see_also("bluestore_tier_size"),
+
+    Option("bluestore_tier_max_write_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(1_M)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Writes allocating more than this go straight to the main device")
+    .add_see_also("bluestore_tier_path"),
+
+    Option("bluestore_tier_high_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.8)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_min_max(0.0, 1.0)
+    .set_description("Fraction of the data tier in use past which cold objects are migrated to the main device")
+    .set_long_description("Writes stop being placed on the data tier once it is (bluestore_tier_high_ratio + 1) / 2 full.")
+    .add_see_also("bluestore_tier_low_ratio"),
+
+    Option("bluestore_tier_low_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.6)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_min_max(0.0, 1.0)
+    .set_description("Fraction of the data tier in use that migrating cold objects off it aims for")
+    .add_see_also("bluestore_tier_high_ratio"),
+
+    Option("bluestore_tier_migrate_interval", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(5)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Seconds between looking for objects to migrate between the data tier and the main device"),
+
+    Option("bluestore_tier_migrate_scan", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(4096)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Objects on the data tier to consider for migration at a time")
+    .set_long_description("The coldest of them are migrated first; the next pass picks up where this one stopped."),
+
+    Option("bluestore_tier_heat_half_life", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(300)
+    .set_flag(Option::FLAG_STARTUP)
+    .set_description("Seconds after which the accesses counted towards an object's heat count half")
+    .set_long_description("Heat is only tracked while an object is cached; an object that is not counts as cold."),
+
+    Option("bluestore_tier_promote_heat", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(16)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Heat at which an object read from the main device is migrated to the data tier")
+    .set_long_description("Only while the data tier is less than bluestore_tier_low_ratio full.  0 disables promotion.")
+    .add_see_also("bluestore_tier_heat_half_life"),
+
     Option("bluestore_block_preallocate_file", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
     .set_flag(Option::FLAG_CREATE)
@@ -4208,6 +4318,11 @@ std::vector<Option> get_global_options() {
     .set_description("Default compression algorithm to use when writing object data")
     .set_long_description("This controls the default compressor to use (if any) if the per-pool property is not set.  Note that zstd is *not* recommended for bluestore due to high CPU overhead when compressing small amounts of data."),
 
+    Option("bluestore_compression_threads", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(2)
+    .set_description("Threads that compress the blobs of a write in parallel")
+    .set_long_description("When a write produces several blobs to compress, they are compressed by these threads and the thread doing the write at the same time.  0 compresses every blob in the thread doing the write."),
+
     Option("bluestore_compression_min_blob_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(0)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4308,8 +4423,21 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_cache_type", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("2q")
-    .set_enum_allowed({"2q", "lru"})
-    .set_description("Cache replacement algorithm"),
+    .set_enum_allowed({"2q", "lru", "tinylfu"})
+    .set_description("Cache replacement algorithm")
+    .set_long_description("2q only applies to the buffer cache, the onode cache is an LRU in that case.  tinylfu (W-TinyLFU) applies to both and resists eviction of the working set by scans such as deep-scrub or backfill."),
+
+    Option("bluestore_tinylfu_window_ratio", Option::TYPE_FLOAT, Option::LEVEL_DEV)
+    .set_default(.01)
+    .set_min_max(0.0, 1.0)
+    .set_description("Share of the tinylfu cache used as an admission window for new entries")
+    .add_see_also("bluestore_cache_type"),
+
+    Option("bluestore_tinylfu_protected_ratio", Option::TYPE_FLOAT, Option::LEVEL_DEV)
+    .set_default(.8)
+    .set_min_max(0.0, 1.0)
+    .set_description("Share of the tinylfu main cache reserved for entries hit more than once")
+    .add_see_also("bluestore_cache_type"),
 
     Option("bluestore_2q_cache_kin_ratio", Option::TYPE_FLOAT, Option::LEVEL_DEV)
     .set_default(.5)
@@ -4362,10 +4490,15 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_allocator", Option::TYPE_STR, Option::LEVEL_ADVANCED)
     .set_default("bitmap")
-    .set_enum_allowed({"bitmap", "stupid", "avl"})
+    .set_enum_allowed({"bitmap", "stupid", "avl", "hybrid"})
     .set_description("Allocator policy")
     .set_long_description("Allocator to use for bluestore.  Stupid should only be used for testing."),
 
+    Option("bluestore_allocator_snapshot", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Save the allocator state to BlueFS on clean umount and load it on mount")
+    .set_long_description("Mount normally rebuilds the allocator by walking every freelist key, which can take minutes on large devices. With this enabled the free extents are written to a BlueFS file on umount and loaded directly on the next mount; the freelist is still walked if the snapshot is missing or stale (e.g. after a crash)."),
+
     Option("bluestore_freelist_blocks_per_key", Option::TYPE_SIZE, Option::LEVEL_DEV)
     .set_default(128)
     .set_description("Block (and bits) per database key"),
@@ -4396,7 +4529,8 @@ std::vector<Option> get_global_options() {
 
     Option("bluestore_rocksdb_cfs", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("M= P= L=")
-    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options"),
+    .set_description("List of whitespace-separate key/value pairs where key is CF name and value is CF options")
+    .set_long_description("A name P(N) spreads prefix P over N column families by key hash, P(N,L-H) hashes key bytes L to H only. The layout of an existing OSD is changed with 'ceph-bluestore-tool reshard'."),
 
     Option("bluestore_fsck_on_mount", Option::TYPE_BOOL, Option::LEVEL_DEV)
     .set_default(false)
@@ -4430,6 +4564,13 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description("Try to submit metadata transaction to rocksdb in queuing thread context"),
 
+    Option("bluestore_kv_sync_lanes", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1)
+    .set_min_max(1, 64)
+    .set_description("Number of threads committing metadata transactions to rocksdb")
+    .set_long_description("Collections are spread over this many kv commit lanes by sequencer id.  Each lane batches, submits and syncs the transactions of its sequencers independently, so ordering is preserved per sequencer while commits from different lanes overlap.  The first lane is the kv_sync_thread, which also retires deferred writes.  A value of 1 keeps the single kv_sync_thread behavior.")
+    .add_see_also("bluestore_sync_submit_transaction"),
+
     Option("bluestore_fsck_read_bytes_cap", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(64_M)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4439,6 +4580,11 @@ std::vector<Option> get_global_options() {
       .set_default(2)
       .set_description("Number of additional threads to perform quick-fix (shallow fsck) command"),
 
+    Option("bluestore_fsck_threads", Option::TYPE_INT, Option::LEVEL_ADVANCED)
+      .set_default(0)
+      .set_description("Number of threads to walk the object keyspace with in regular and deep fsck")
+      .set_long_description("The onode keyspace is split at collection boundaries and the ranges are handed out to this many threads; used blocks, nids and shared blob references are merged at the end. Each thread keeps its own used blocks bitmap. 0 or 1 walks the keyspace in the calling thread."),
+
     Option("bluestore_throttle_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
     .set_default(64_M)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4501,6 +4647,27 @@ std::vector<Option> get_global_options() {
     .set_flag(Option::FLAG_RUNTIME)
     .set_description("Cache read results by default (unless hinted NOCACHE or WONTNEED)"),
 
+    Option("bluestore_readahead_min_sequential", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(2)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Number of back-to-back sequential reads of an object before BlueStore prefetches ahead of the reader")
+    .set_long_description("0 disables readahead.  Reads hinted FADVISE_SEQUENTIAL start prefetching immediately; reads hinted RANDOM, DONTNEED or NOCACHE never do.")
+    .add_see_also("bluestore_readahead_max_bytes"),
+
+    Option("bluestore_readahead_max_bytes", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(4_M)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Maximum readahead window per sequentially read object")
+    .set_long_description("The window starts at twice the size of the triggering read and doubles each time it is refilled, up to this size.")
+    .add_see_also("bluestore_readahead_min_sequential"),
+
+    Option("bluestore_readahead_cache_ratio", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(.1)
+    .set_min_max(0.0, 1.0)
+    .set_flag(Option::FLAG_RUNTIME)
+    .set_description("Fraction of the data cache that may be used by readahead that is still in flight")
+    .add_see_also("bluestore_cache_meta_ratio"),
+
     Option("bluestore_default_buffered_write", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
     .set_default(false)
     .set_flag(Option::FLAG_RUNTIME)
@@ -4602,6 +4769,18 @@ std::vector<Option> get_global_options() {
     .set_default(60)
     .set_description("log collection list operation if it's slower than this age (seconds)"),
 
+    Option("bluestore_collection_list_cursors", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(2)
+    .set_description("Number of collection listing positions to keep per collection")
+    .set_long_description("A collection_list call that starts where an earlier one stopped, as PG backfill and scrub do page by page, resumes from the iterator that call left there instead of seeking to its start again.  Creating or removing objects in the collection, or splitting or merging it, drops the kept positions.  0 disables this.")
+    .add_see_also("bluestore_collection_list_cursor_age"),
+
+    Option("bluestore_collection_list_cursor_age", Option::TYPE_FLOAT, Option::LEVEL_ADVANCED)
+    .set_default(10)
+    .set_description("Seconds a kept collection listing position lives unless the next page picks it up")
+    .set_long_description("A kept position holds an open db iterator, which keeps the memtables and sst files it reads from alive.  Positions older than this are dropped, also for collections that are not listed again.  0 keeps them until they are outdated.")
+    .add_see_also("bluestore_collection_list_cursors"),
+
     Option("bluestore_debug_enforce_settings", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("default")
     .set_enum_allowed({"default", "hdd", "ssd"})
@@ -4616,6 +4795,11 @@ std::vector<Option> get_global_options() {
     .set_default(4)
     .set_description(""),
 
+    Option("bluestore_hybrid_alloc_bf_frag_threshold", Option::TYPE_FLOAT, Option::LEVEL_DEV)
+    .set_default(.05)
+    .set_description("Fragmentation above which the hybrid allocator switches from first-fit to best-fit")
+    .set_long_description("Fragmentation is the number of free extents relative to the number of free blocks (0 when all free space is contiguous, 1 when no two free blocks are adjacent). Below the threshold allocations are first-fit by offset; above it they are best-fit by size class to preserve large free extents."),
+
     Option("bluestore_volume_selection_policy", Option::TYPE_STR, Option::LEVEL_DEV)
     .set_default("rocksdb_original")
     .set_enum_allowed({ "rocksdb_original", "use_some_extra" })
@@ -4636,6 +4820,35 @@ std::vector<Option> get_global_options() {
     .set_default(false)
     .set_description("Enables Linux io_uring API instead of libaio"),
 
+    Option("bdev_ioring_hipri", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Use polled io completions with io_uring (IORING_SETUP_IOPOLL)")
+    .add_see_also("bluestore_ioring"),
+
+    Option("bdev_ioring_sqthread_poll", Option::TYPE_BOOL, Option::LEVEL_ADVANCED)
+    .set_default(false)
+    .set_description("Use a kernel thread to poll the io_uring submission queue (IORING_SETUP_SQPOLL)")
+    .set_long_description("A kernel thread polls the submission queue, so submitting io does not take a system call while the thread is awake.  It needs CAP_SYS_ADMIN (or CAP_SYS_NICE on newer kernels).")
+    .add_see_also("bluestore_ioring"),
+
+    Option("bdev_ioring_sqthread_idle_ms", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(1000)
+    .set_description("Time the io_uring submission thread keeps polling before it sleeps")
+    .add_see_also("bdev_ioring_sqthread_poll"),
+
+    Option("bdev_ioring_fixed_buffers", Option::TYPE_UINT, Option::LEVEL_ADVANCED)
+    .set_default(0)
+    .set_description("Number of buffers registered with io_uring for reads")
+    .set_long_description("Reads are issued into buffers registered with the kernel once at startup, avoiding the per-io page pinning.  Writes use them when their payload already lives in one.  Registration is limited by RLIMIT_MEMLOCK; when it fails or all buffers are in use, regular buffers are used.  0 disables.")
+    .add_see_also("bluestore_ioring")
+    .add_see_also("bdev_ioring_fixed_buffer_size"),
+
+    Option("bdev_ioring_fixed_buffer_size", Option::TYPE_SIZE, Option::LEVEL_ADVANCED)
+    .set_default(64_K)
+    .set_description("Size of each buffer registered with io_uring")
+    .set_long_description("Reads larger than this use regular buffers.  The number of buffers is capped so that no more than 1G is registered.")
+    .add_see_also("bdev_ioring_fixed_buffers"),
+
     // -----------------------------------------
     // kstore
 
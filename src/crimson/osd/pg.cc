@@ -218,6 +218,12 @@ unsigned PG::get_target_pg_log_entries() const
   }
 }
 
+unsigned PG::get_pg_log_trim_budget() const
+{
+  // no op queue to judge the load by; always trim as if busy
+  return local_conf().get_val<uint64_t>("osd_pg_log_trim_max_per_op");
+}
+
 void PG::on_activate(interval_set<snapid_t>)
 {
   projected_last_update = peering_state.get_info().last_update;
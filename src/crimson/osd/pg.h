@@ -240,6 +240,7 @@ public:
   void recheck_readable() final;
 
   unsigned get_target_pg_log_entries() const final;
+  unsigned get_pg_log_trim_budget() const final;
 
   void on_pool_change() final {
     // Not needed yet
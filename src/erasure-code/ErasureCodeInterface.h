@@ -169,6 +169,26 @@ namespace ceph {
 
   class ErasureCodeInterface {
   public:
+    /**
+     * Optimizations an implementation may support, for
+     * **get_supported_optimizations()**.
+     */
+    enum {
+      /**
+       * The coding chunks are a linear function of the data chunks,
+       * with XOR as addition: encoding data chunks that are the XOR
+       * of two sets of data chunks gives coding chunks that are the
+       * XOR of the coding chunks of the two sets.
+       *
+       * A write to some of the data chunks of a stripe can then
+       * update the coding chunks from the old contents of the
+       * chunks it changes, without the rest of the stripe: the new
+       * coding chunks are the old ones XOR the encoding of (old XOR
+       * new data) with zeroes for the unchanged data chunks.
+       */
+      FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION = 1 << 0,
+    };
+
     virtual ~ErasureCodeInterface() {}
 
     /**
@@ -258,6 +278,14 @@ namespace ceph {
      */
     virtual int get_sub_chunk_count() = 0;
 
+    /**
+     * Return the optimizations of the code the caller may rely on,
+     * as a bitmask of FLAG_EC_PLUGIN_* values.
+     *
+     * @return bitmask of supported optimizations
+     */
+    virtual uint64_t get_supported_optimizations() const = 0;
+
     /**
      * Return the size (in bytes) of a single chunk created by a call
      * to the **decode** method. The returned size multiplied by
@@ -56,6 +56,12 @@ public:
 
   unsigned int get_chunk_size(unsigned int object_size) const override;
 
+  uint64_t get_supported_optimizations() const override {
+    // all the techniques are linear over GF(2^w), or GF(2) for the
+    // bit matrix ones
+    return FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION;
+  }
+
   int encode_chunks(const std::set<int> &want_to_encode,
 		    std::map<int, ceph::buffer::list> *encoded) override;
 
@@ -50,6 +50,37 @@ static inline uint32_t ceph_crc32c(uint32_t crc, unsigned char const *data, unsi
   return ceph_crc32c_func(crc, data, length);
 }
 
+typedef void (*ceph_crc32c_blocks_func_t)(uint32_t crc, unsigned char const *data, unsigned block_len, unsigned count, uint32_t *out);
+
+/*
+ * the chosen implementation of ceph_crc32c_blocks(); like
+ * ceph_crc32c_func it only depends on the CPU architecture.
+ */
+extern ceph_crc32c_blocks_func_t ceph_crc32c_blocks_func;
+
+extern ceph_crc32c_blocks_func_t ceph_choose_crc32c_blocks(void);
+
+/**
+ * calculate crc32c of count adjacent blocks, each on its own
+ *
+ * out[i] gets the crc32c of data[i * block_len, (i + 1) * block_len),
+ * seeded with crc.  Where the CPU has a crc32c instruction several
+ * blocks are run through it interleaved, which hides the latency of
+ * the instruction that a single block is bound by.
+ *
+ * @param crc initial value for every block
+ * @param data pointer to count * block_len bytes, must not be NULL
+ * @param block_len length of each block
+ * @param count number of blocks
+ * @param out array of count crcs
+ */
+static inline void ceph_crc32c_blocks(uint32_t crc, unsigned char const *data,
+				      unsigned block_len, unsigned count,
+				      uint32_t *out)
+{
+  ceph_crc32c_blocks_func(crc, data, block_len, count, out);
+}
+
 #ifdef __cplusplus
 }
 #endif
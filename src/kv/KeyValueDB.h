@@ -7,7 +7,9 @@
 #include <ostream>
 #include <set>
 #include <map>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <boost/scoped_ptr.hpp>
 #include "include/encoding.h"
 #include "common/Formatter.h"
@@ -144,6 +146,12 @@ public:
       const ceph::buffer::list  &value     ///< [in] value to be merged into key
     ) { ceph_abort_msg("Not implemented"); }
 
+    /// Approximate number of bytes this transaction will write, or 0 if
+    /// the backend does not track it
+    virtual uint64_t get_size_bytes() const {
+      return 0;
+    }
+
     virtual ~TransactionImpl() {}
   };
   typedef std::shared_ptr< TransactionImpl > Transaction;
@@ -204,6 +212,66 @@ public:
     return get(prefix, string(key, keylen), value);
   }
 
+  /**
+   * Entries read in one go by an iterator's next_batch().  Keys and
+   * values are copied back to back into a single arena; key(i) and
+   * value(i) are views into it that stay valid until the batch is
+   * cleared or added to.
+   */
+  class IteratorBatch {
+    struct entry_t {
+      uint32_t key_off, key_len;
+      uint32_t value_off, value_len;
+    };
+    std::string arena;
+    std::vector<entry_t> entries;
+  public:
+    void add(const char *key, size_t key_len,
+	     const char *value, size_t value_len) {
+      entry_t e;
+      e.key_off = arena.size();
+      e.key_len = key_len;
+      arena.append(key, key_len);
+      e.value_off = arena.size();
+      e.value_len = value_len;
+      arena.append(value, value_len);
+      entries.push_back(e);
+    }
+    void add(std::string_view key, std::string_view value) {
+      add(key.data(), key.size(), value.data(), value.size());
+    }
+    /// drop the first n bytes (e.g. a key prefix) of the keys from entry i on
+    void trim_keys(size_t i, size_t n) {
+      for (; i < entries.size(); ++i) {
+	ceph_assert(entries[i].key_len >= n);
+	entries[i].key_off += n;
+	entries[i].key_len -= n;
+      }
+    }
+    void clear() {
+      arena.clear();
+      entries.clear();
+    }
+    bool empty() const {
+      return entries.empty();
+    }
+    size_t size() const {
+      return entries.size();
+    }
+    /// bytes of keys and values held
+    size_t bytes() const {
+      return arena.size();
+    }
+    std::string_view key(size_t i) const {
+      return std::string_view(arena.data() + entries[i].key_off,
+			      entries[i].key_len);
+    }
+    std::string_view value(size_t i) const {
+      return std::string_view(arena.data() + entries[i].value_off,
+			      entries[i].value_len);
+    }
+  };
+
   // This superclass is used both by kv iterators *and* by the ObjectMap
   // omap iterator.  The class hierarchies are unfortunately tied together
   // by the legacy DBOjectMap implementation :(.
@@ -220,6 +288,27 @@ public:
     }
     virtual ceph::buffer::list value() = 0;
     virtual int status() = 0;
+    /**
+     * Copy the entries from the current position on into *batch and
+     * move past them, until the iterator is no longer valid, max_entries
+     * were added or batch->bytes() reached max_bytes.  Returns the number
+     * of entries added.
+     *
+     * This default costs the same key()/value()/next() per entry a
+     * caller would do; iterators that can walk their entries in place
+     * override it.
+     */
+    virtual size_t next_batch(size_t max_entries, size_t max_bytes,
+			      IteratorBatch *batch) {
+      size_t n = 0;
+      for (; n < max_entries && batch->bytes() < max_bytes && valid();
+	   ++n, next()) {
+	std::string k = key();
+	ceph::buffer::list v = value();
+	batch->add(k, std::string_view(v.c_str(), v.length()));
+      }
+      return n;
+    }
     virtual ~SimplestIteratorImpl() {}
   };
 
@@ -229,6 +318,29 @@ public:
     virtual int seek_to_last() = 0;
     virtual int prev() = 0;
     virtual std::pair<std::string, std::string> raw_key() = 0;
+    /**
+     * next_batch() that also stops before the first key that isn't less
+     * than end.  An empty end doesn't bound the batch.
+     */
+    virtual size_t next_batch_until(const std::string &end,
+				    size_t max_entries, size_t max_bytes,
+				    IteratorBatch *batch) {
+      size_t n = 0;
+      for (; n < max_entries && batch->bytes() < max_bytes && valid();
+	   ++n, next()) {
+	std::string k = key();
+	if (!end.empty() && k >= end) {
+	  break;
+	}
+	ceph::buffer::list v = value();
+	batch->add(k, std::string_view(v.c_str(), v.length()));
+      }
+      return n;
+    }
+    size_t next_batch(size_t max_entries, size_t max_bytes,
+		      IteratorBatch *batch) override {
+      return next_batch_until(std::string(), max_entries, max_bytes, batch);
+    }
     virtual ceph::buffer::ptr value_as_ptr() {
       ceph::buffer::list bl = value();
       if (bl.length() == 1) {
@@ -267,6 +379,27 @@ public:
       }
     }
     virtual int status() = 0;
+    /**
+     * IteratorImpl::next_batch_until() for the entries under prefix;
+     * the keys added don't include the prefix.
+     */
+    virtual size_t next_batch(const std::string &prefix,
+			      const std::string &end,
+			      size_t max_entries, size_t max_bytes,
+			      IteratorBatch *batch) {
+      size_t n = 0;
+      for (; n < max_entries && batch->bytes() < max_bytes && valid() &&
+	     raw_key_is_prefixed(prefix);
+	   ++n, next()) {
+	std::string k = key();
+	if (!end.empty() && k >= end) {
+	  break;
+	}
+	ceph::buffer::list v = value();
+	batch->add(k, std::string_view(v.c_str(), v.length()));
+      }
+      return n;
+    }
     virtual size_t key_size() {
       return 0;
     }
@@ -277,7 +410,7 @@ public:
   };
   typedef std::shared_ptr< WholeSpaceIteratorImpl > WholeSpaceIterator;
 
-private:
+protected:
   // This class filters a WholeSpaceIterator by a prefix.
   class PrefixIteratorImpl : public IteratorImpl {
     const std::string prefix;
@@ -325,15 +458,37 @@ private:
     int status() override {
       return generic_iter->status();
     }
+    size_t next_batch_until(const std::string &end,
+			    size_t max_entries, size_t max_bytes,
+			    IteratorBatch *batch) override {
+      return generic_iter->next_batch(prefix, end, max_entries, max_bytes,
+				      batch);
+    }
   };
 public:
 
+  /// keys within a prefix that an iterator will be confined to
+  struct IteratorBounds {
+    std::optional<std::string> lower_bound;  ///< inclusive
+    std::optional<std::string> upper_bound;  ///< exclusive
+  };
+
   virtual WholeSpaceIterator get_wholespace_iterator() = 0;
   virtual Iterator get_iterator(const std::string &prefix) {
     return std::make_shared<PrefixIteratorImpl>(
       prefix,
       get_wholespace_iterator());
   }
+  /**
+   * get an iterator over prefix that stops at the given bounds, which
+   * lets a backend avoid reading (and stepping through the tombstones
+   * of) whatever lies past them.  Backends that cannot bound an iterator
+   * ignore them, so callers still have to check the keys they get.
+   */
+  virtual Iterator get_iterator(const std::string &prefix,
+				IteratorBounds bounds) {
+    return get_iterator(prefix);
+  }
 
   void add_column_family(const std::string& cf_name, void *handle) {
     cf_handles.insert(std::make_pair(cf_name, handle));
@@ -79,6 +79,18 @@ void MemDB::_save()
     return;
   }
   bufferlist bl;
+  if (m_skiplist) {
+    SkipList::read_guard g(m_skiplist.get());
+    uint64_t seq = m_skiplist->visible_seq();
+    for (auto n = m_skiplist->first(); n; n = m_skiplist->next(n)) {
+      auto v = m_skiplist->find_version(n, seq);
+      if (v && !v->deleted) {
+	dout(10) << __func__ << " Key:"<< n->key << dendl;
+	encode(n->key, bl);
+	encode(v->value, bl);
+      }
+    }
+  }
   mdb_iter_t iter = m_map.begin();
   while (iter != m_map.end()) {
     dout(10) << __func__ << " Key:"<< iter->first << dendl;
@@ -117,6 +129,7 @@ int MemDB::_load()
 
   ssize_t file_size = st.st_size;
   ssize_t bytes_done = 0;
+  uint64_t seq = m_skiplist ? m_skiplist->visible_seq() + 1 : 0;
   while (bytes_done < file_size) {
     string key;
     bufferptr datap;
@@ -125,9 +138,16 @@ int MemDB::_load()
     bytes_done += ::decode_file(fd, datap);
 
     dout(10) << __func__ << " Key:"<< key << dendl;
-    m_map[key] = datap;
+    if (m_skiplist) {
+      m_skiplist->put(key, datap, false, seq, seq);
+    } else {
+      m_map[key] = datap;
+    }
     m_total_bytes += datap.length();
   }
+  if (m_skiplist) {
+    m_skiplist->publish(seq);
+  }
   VOID_TEMP_FAILURE_RETRY(::close(fd));
   return 0;
 }
@@ -173,6 +193,10 @@ int MemDB::do_open(ostream &out, bool create)
 {
   m_total_bytes = 0;
   m_allocated_bytes = 1;
+  if (m_cct->_conf.get_val<bool>("memdb_skiplist")) {
+    dout(1) << __func__ << " using skiplist" << dendl;
+    m_skiplist.reset(new SkipList);
+  }
 
   return _init(create);
 }
@@ -214,17 +238,29 @@ int MemDB::submit_transaction(KeyValueDB::Transaction t)
   MDBTransactionImpl* mt =  static_cast<MDBTransactionImpl*>(t.get());
 
   dtrace << __func__ << " " << mt->get_ops().size() << dendl;
-  for(auto& op : mt->get_ops()) {
-    if(op.first == MDBTransactionImpl::WRITE) {
-      ms_op_t set_op = op.second;
-      _setkey(set_op);
-    } else if (op.first == MDBTransactionImpl::MERGE) {
-      ms_op_t merge_op = op.second;
-      _merge(merge_op);
-    } else {
-      ms_op_t rm_op = op.second;
-      ceph_assert(op.first == MDBTransactionImpl::DELETE);
-      _rmkey(rm_op);
+  if (m_skiplist) {
+    std::lock_guard<std::mutex> l(m_lock);
+    uint64_t seq = m_skiplist->visible_seq() + 1;
+    uint64_t min_snap = m_skiplist->min_snapshot();
+    m_skiplist->unlink_deleted(min_snap);
+    for (auto& op : mt->get_ops()) {
+      ms_op_t o = op.second;
+      _sl_apply(o, op.first, seq, min_snap);
+    }
+    m_skiplist->publish(seq);
+  } else {
+    for (auto& op : mt->get_ops()) {
+      if (op.first == MDBTransactionImpl::WRITE) {
+	ms_op_t set_op = op.second;
+	_setkey(set_op);
+      } else if (op.first == MDBTransactionImpl::MERGE) {
+	ms_op_t merge_op = op.second;
+	_merge(merge_op);
+      } else {
+	ms_op_t rm_op = op.second;
+	ceph_assert(op.first == MDBTransactionImpl::DELETE);
+	_rmkey(rm_op);
+      }
     }
   }
 
@@ -336,6 +372,50 @@ int MemDB::_rmkey(ms_op_t &op)
   return m_map.erase(key);
 }
 
+/*
+ * Caller takes m_lock; the whole transaction goes in at seq.
+ */
+void MemDB::_sl_apply(ms_op_t &op, int type, uint64_t seq, uint64_t min_snap)
+{
+  std::string key = make_key(op.first.first, op.first.second);
+  bufferlist &bl = op.second;
+
+  // we are the only writer, so what we read here can't be freed under us
+  bufferlist bl_old;
+  auto n = m_skiplist->lower_bound(key);
+  auto v = (n && n->key == key) ? m_skiplist->find_version(n, seq) : nullptr;
+  bool exists = v && !v->deleted;
+  if (exists) {
+    bl_old.push_back(v->value);
+    ceph_assert(m_total_bytes >= bl_old.length());
+    m_total_bytes -= bl_old.length();
+  }
+
+  if (type == MDBTransactionImpl::WRITE) {
+    m_skiplist->put(key, bufferptr(bl.c_str(), bl.length()), false,
+		    seq, min_snap);
+    m_total_bytes += bl.length();
+  } else if (type == MDBTransactionImpl::MERGE) {
+    std::shared_ptr<MergeOperator> mop = _find_merge_op(op.first.first);
+    ceph_assert(mop);
+    std::string new_val;
+    if (exists) {
+      mop->merge(bl_old.c_str(), bl_old.length(), bl.c_str(), bl.length(),
+		 &new_val);
+    } else {
+      mop->merge_nonexistent(bl.c_str(), bl.length(), &new_val);
+    }
+    m_skiplist->put(key, bufferptr(new_val.c_str(), new_val.length()), false,
+		    seq, min_snap);
+    m_total_bytes += new_val.length();
+  } else {
+    ceph_assert(type == MDBTransactionImpl::DELETE);
+    if (exists) {
+      m_skiplist->put(key, bufferptr(), true, seq, min_snap);
+    }
+  }
+}
+
 std::shared_ptr<KeyValueDB::MergeOperator> MemDB::_find_merge_op(const std::string &prefix)
 {
   for (const auto& i : merge_ops) {
@@ -409,6 +489,9 @@ bool MemDB::_get(const string &prefix, const string &k, bufferlist *out)
 
 bool MemDB::_get_locked(const string &prefix, const string &k, bufferlist *out)
 {
+  if (m_skiplist) {
+    return m_skiplist->get(make_key(prefix, k), out);
+  }
   std::lock_guard<std::mutex> l(m_lock);
   return _get(prefix, k, out);
 }
@@ -641,3 +724,394 @@ int MemDB::MDBWholeSpaceIteratorImpl::lower_bound(const std::string &prefix,
   }
   return -1;
 }
+
+// ---------------------------------------------------------
+// SkipList
+
+MemDB::SkipList::SkipList()
+  : head(new Node(std::string(), MAX_HEIGHT))
+{
+}
+
+MemDB::SkipList::~SkipList()
+{
+  for (Node *n = head; n; ) {
+    Node *next = n->next[0];
+    free_versions(n->versions);
+    delete n;
+    n = next;
+  }
+  for (auto& r : retired) {
+    free_retired(r);
+  }
+}
+
+void MemDB::SkipList::free_versions(Version *v)
+{
+  while (v) {
+    Version *older = v->older;
+    delete v;
+    v = older;
+  }
+}
+
+void MemDB::SkipList::free_retired(retired_t& r)
+{
+  for (auto v : r.versions) {
+    free_versions(v);
+  }
+  r.versions.clear();
+  for (auto n : r.nodes) {
+    free_versions(n->versions);
+    delete n;
+  }
+  r.nodes.clear();
+}
+
+uint64_t MemDB::SkipList::read_enter() const
+{
+  while (true) {
+    uint64_t e = epoch;
+    ++readers[e & 1];
+    if (epoch == e) {
+      return e;
+    }
+    // raced with the writer moving to the next epoch
+    --readers[e & 1];
+  }
+}
+
+MemDB::SkipList::Node *MemDB::SkipList::find_ge(
+  const std::string& k, Node **prev) const
+{
+  Node *x = head;
+  int level = max_height - 1;
+  while (true) {
+    Node *next = x->next[level];
+    if (next && next->key < k) {
+      x = next;
+    } else {
+      if (prev) {
+	prev[level] = x;
+      }
+      if (level == 0) {
+	return next;
+      }
+      --level;
+    }
+  }
+}
+
+MemDB::SkipList::Node *MemDB::SkipList::lower_bound(const std::string& k) const
+{
+  return find_ge(k, nullptr);
+}
+
+MemDB::SkipList::Node *MemDB::SkipList::upper_bound(const std::string& k) const
+{
+  Node *n = find_ge(k, nullptr);
+  if (n && n->key == k) {
+    n = n->next[0];
+  }
+  return n;
+}
+
+MemDB::SkipList::Node *MemDB::SkipList::less_than(const std::string& k) const
+{
+  Node *x = head;
+  int level = max_height - 1;
+  while (true) {
+    Node *next = x->next[level];
+    if (next && next->key < k) {
+      x = next;
+    } else if (level == 0) {
+      return x == head ? nullptr : x;
+    } else {
+      --level;
+    }
+  }
+}
+
+MemDB::SkipList::Node *MemDB::SkipList::last() const
+{
+  Node *x = head;
+  int level = max_height - 1;
+  while (true) {
+    Node *next = x->next[level];
+    if (next) {
+      x = next;
+    } else if (level == 0) {
+      return x == head ? nullptr : x;
+    } else {
+      --level;
+    }
+  }
+}
+
+MemDB::SkipList::Version *MemDB::SkipList::find_version(
+  const Node *n, uint64_t seq, bool *trimmed) const
+{
+  for (Version *v = n->versions; v; ) {
+    if (v->seq <= seq) {
+      return v;
+    }
+    Version *older = v->older;
+    if (!older && v->trimmed) {
+      if (trimmed) {
+	*trimmed = true;
+      }
+      return nullptr;
+    }
+    v = older;
+  }
+  return nullptr;
+}
+
+bool MemDB::SkipList::get(const std::string& k, bufferlist *out) const
+{
+  read_guard g(this);
+  Node *n = lower_bound(k);
+  if (!n || n->key != k) {
+    return false;
+  }
+  while (true) {
+    // a get holds no snapshot: if the writer trimmed the version we were
+    // after, a newer one is visible by now
+    bool trimmed = false;
+    Version *v = find_version(n, visible, &trimmed);
+    if (trimmed) {
+      continue;
+    }
+    if (!v || v->deleted) {
+      return false;
+    }
+    out->push_back(v->value.clone());
+    return true;
+  }
+}
+
+uint64_t MemDB::SkipList::snapshot_get()
+{
+  std::lock_guard<std::mutex> l(snap_lock);
+  uint64_t seq = visible;
+  snaps.insert(seq);
+  return seq;
+}
+
+void MemDB::SkipList::snapshot_put(uint64_t seq)
+{
+  std::lock_guard<std::mutex> l(snap_lock);
+  auto p = snaps.find(seq);
+  ceph_assert(p != snaps.end());
+  snaps.erase(p);
+}
+
+uint64_t MemDB::SkipList::min_snapshot()
+{
+  std::lock_guard<std::mutex> l(snap_lock);
+  uint64_t seq = visible;
+  if (!snaps.empty()) {
+    seq = std::min(seq, *snaps.begin());
+  }
+  return seq;
+}
+
+void MemDB::SkipList::put(const std::string& k, bufferptr value, bool deleted,
+			  uint64_t seq, uint64_t min_snap)
+{
+  Node *prev[MAX_HEIGHT];
+  Node *n = find_ge(k, prev);
+  Version *v = new Version(seq, deleted, value);
+  if (n && n->key == k) {
+    v->older = n->versions.load();
+    n->versions = v;
+    trim(v, min_snap);
+    if (deleted) {
+      tombstones.emplace_back(seq, n);
+    }
+    return;
+  }
+  ceph_assert(!deleted);
+
+  int height = 1;
+  while (height < MAX_HEIGHT && (rng() & 3) == 0) {
+    ++height;
+  }
+  if (height > max_height) {
+    for (int i = max_height; i < height; ++i) {
+      prev[i] = head;
+    }
+    // readers seeing the new height before the node just find nullptr
+    max_height = height;
+  }
+  n = new Node(k, height);
+  n->versions = v;
+  for (int i = 0; i < height; ++i) {
+    n->next[i] = prev[i]->next[i].load();
+    prev[i]->next[i] = n;
+  }
+}
+
+void MemDB::SkipList::trim(Version *v, uint64_t min_snap)
+{
+  // keep the newest version min_snap can see, drop what is older
+  for (; v; v = v->older) {
+    if (v->seq <= min_snap) {
+      Version *older = v->older;
+      if (older) {
+	v->trimmed = true;
+	v->older = nullptr;
+	retired[epoch & 1].versions.push_back(older);
+      }
+      return;
+    }
+  }
+}
+
+/*
+ * Unlink the nodes whose newest version is a tombstone every snapshot
+ * sees.  Readers standing on one still find their way forward through
+ * its next pointers until it is freed.  Iterators keep no such node
+ * between calls: their snapshot is at least min_snap, so to them the
+ * key is gone.
+ */
+void MemDB::SkipList::unlink_deleted(uint64_t min_snap)
+{
+  while (!tombstones.empty() && tombstones.front().first <= min_snap) {
+    auto [seq, n] = tombstones.front();
+    tombstones.pop_front();
+    // the key was written again since, or deleted again later on
+    Version *v = n->versions;
+    if (!v->deleted || v->seq != seq) {
+      continue;
+    }
+    Node *prev[MAX_HEIGHT];
+    ceph_assert(find_ge(n->key, prev) == n);
+    for (int i = n->height - 1; i >= 0; --i) {
+      prev[i]->next[i] = n->next[i].load();
+    }
+    retired[epoch & 1].nodes.push_back(n);
+  }
+}
+
+void MemDB::SkipList::publish(uint64_t seq)
+{
+  visible = seq;
+
+  // what is retired in epoch e is freed when we move on to e + 2: by
+  // then every reader that entered in e (or before) has left
+  uint64_t e = epoch;
+  if (readers[(e + 1) & 1] == 0) {
+    epoch = e + 1;
+    free_retired(retired[(e + 1) & 1]);
+  }
+}
+
+// ---------------------------------------------------------
+// MDBSkipListIteratorImpl
+
+int MemDB::MDBSkipListIteratorImpl::_fill_forward(SkipList::Node *n)
+{
+  m_key_value.first.clear();
+  m_key_value.second.clear();
+  for (; n; n = m_sl->next(n)) {
+    auto v = m_sl->find_version(n, m_seq);
+    if (v && !v->deleted) {
+      m_node = n;
+      m_key_value.first = n->key;
+      m_key_value.second.push_back(v->value.clone());
+      return 0;
+    }
+  }
+  m_node = nullptr;
+  return -1;
+}
+
+int MemDB::MDBSkipListIteratorImpl::_fill_backward(SkipList::Node *n)
+{
+  m_key_value.first.clear();
+  m_key_value.second.clear();
+  for (; n; n = m_sl->less_than(n->key)) {
+    auto v = m_sl->find_version(n, m_seq);
+    if (v && !v->deleted) {
+      m_node = n;
+      m_key_value.first = n->key;
+      m_key_value.second.push_back(v->value.clone());
+      return 0;
+    }
+  }
+  m_node = nullptr;
+  return -1;
+}
+
+int MemDB::MDBSkipListIteratorImpl::seek_to_first(const std::string &k)
+{
+  SkipList::read_guard g(m_sl);
+  return _fill_forward(k.empty() ? m_sl->first() : m_sl->lower_bound(k));
+}
+
+int MemDB::MDBSkipListIteratorImpl::seek_to_last(const std::string &k)
+{
+  SkipList::read_guard g(m_sl);
+  if (k.empty()) {
+    return _fill_backward(m_sl->last());
+  }
+  // last key under prefix k: everything below k + (KEY_DELIM + 1)
+  string end = k;
+  end.push_back(KEY_DELIM + 1);
+  return _fill_backward(m_sl->less_than(end));
+}
+
+int MemDB::MDBSkipListIteratorImpl::upper_bound(const std::string &prefix,
+    const std::string &after)
+{
+  SkipList::read_guard g(m_sl);
+  return _fill_forward(m_sl->upper_bound(make_key(prefix, after)));
+}
+
+int MemDB::MDBSkipListIteratorImpl::lower_bound(const std::string &prefix,
+    const std::string &to)
+{
+  SkipList::read_guard g(m_sl);
+  return _fill_forward(m_sl->lower_bound(make_key(prefix, to)));
+}
+
+int MemDB::MDBSkipListIteratorImpl::next()
+{
+  if (!m_node) {
+    return -1;
+  }
+  SkipList::read_guard g(m_sl);
+  return _fill_forward(m_sl->next(m_node));
+}
+
+int MemDB::MDBSkipListIteratorImpl::prev()
+{
+  if (!m_node) {
+    return -1;
+  }
+  SkipList::read_guard g(m_sl);
+  return _fill_backward(m_sl->less_than(m_node->key));
+}
+
+string MemDB::MDBSkipListIteratorImpl::key()
+{
+  string prefix, key;
+  split_key(m_key_value.first, &prefix, &key);
+  return key;
+}
+
+pair<string,string> MemDB::MDBSkipListIteratorImpl::raw_key()
+{
+  string prefix, key;
+  split_key(m_key_value.first, &prefix, &key);
+  return make_pair(prefix, key);
+}
+
+bool MemDB::MDBSkipListIteratorImpl::raw_key_is_prefixed(
+    const string &prefix)
+{
+  string p, k;
+  split_key(m_key_value.first, &p, &k);
+  return (p == prefix);
+}
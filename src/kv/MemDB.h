@@ -10,8 +10,11 @@
 
 #include "include/buffer.h"
 #include <ostream>
+#include <atomic>
+#include <deque>
 #include <set>
 #include <map>
+#include <random>
 #include <string>
 #include <memory>
 #include <boost/scoped_ptr.hpp>
@@ -47,6 +50,111 @@ class MemDB : public KeyValueDB
 
   mdb_map_t m_map;
 
+  /*
+   * Ordered map with lock-free readers, used instead of m_map when
+   * memdb_skiplist is set.  Writers are serialized by m_lock and every
+   * submitted transaction becomes visible at once, under one sequence
+   * number.  Each node keeps a chain of versions, newest first, so an
+   * iterator reads the snapshot it was created at.
+   *
+   * A removed key leaves a tombstone version behind, reused if the key
+   * comes back.  Once every snapshot sees the tombstone, the node is
+   * unlinked.  Versions no snapshot can see any more are cut off the
+   * chain when the key is next written.  Both are freed two epochs
+   * later, once no reader can still hold them.
+   */
+  class SkipList {
+  public:
+    struct Version {
+      uint64_t seq;
+      bool deleted;
+      bufferptr value;
+      std::atomic<Version*> older = {nullptr};
+      std::atomic<bool> trimmed = {false};  ///< older versions were cut off
+      Version(uint64_t seq, bool deleted, bufferptr value)
+	: seq(seq), deleted(deleted), value(value) {}
+    };
+    struct Node {
+      const std::string key;
+      std::atomic<Version*> versions = {nullptr};
+      const int height;
+      std::unique_ptr<std::atomic<Node*>[]> next;
+      Node(const std::string& key, int height)
+	: key(key), height(height), next(new std::atomic<Node*>[height]) {
+	for (int i = 0; i < height; ++i) {
+	  next[i] = nullptr;
+	}
+      }
+    };
+    static constexpr int MAX_HEIGHT = 16;
+
+    /// pins everything a reader reaches until it goes out of scope
+    class read_guard {
+      const SkipList *sl;
+      uint64_t e;
+    public:
+      explicit read_guard(const SkipList *sl) : sl(sl), e(sl->read_enter()) {}
+      ~read_guard() { sl->read_exit(e); }
+    };
+
+    SkipList();
+    ~SkipList();
+
+    // readers, within a read_guard
+    uint64_t visible_seq() const { return visible; }
+    Node *first() const { return head->next[0]; }
+    Node *next(const Node *n) const { return n->next[0]; }
+    Node *last() const;
+    Node *lower_bound(const std::string& k) const;  ///< first >= k
+    Node *upper_bound(const std::string& k) const;  ///< first > k
+    Node *less_than(const std::string& k) const;    ///< last < k
+    /// newest version visible at seq, if any; *trimmed is set when the
+    /// ones seq needs were cut off under us
+    Version *find_version(const Node *n, uint64_t seq,
+			  bool *trimmed = nullptr) const;
+    bool get(const std::string& k, bufferlist *out) const;
+
+    // snapshots for iterators
+    uint64_t snapshot_get();
+    void snapshot_put(uint64_t seq);
+
+    // writer, under MemDB::m_lock
+    uint64_t min_snapshot();
+    void unlink_deleted(uint64_t min_snap);
+    void put(const std::string& k, bufferptr value, bool deleted,
+	     uint64_t seq, uint64_t min_snap);
+    void publish(uint64_t seq);
+
+  private:
+    Node *head;
+    std::atomic<int> max_height = {1};
+    std::atomic<uint64_t> visible = {0};  ///< seq of the last transaction
+    std::minstd_rand rng;
+
+    std::mutex snap_lock;
+    std::multiset<uint64_t> snaps;  ///< seqs of live iterators
+
+    /// (seq, node) of tombstones put, oldest first
+    std::deque<std::pair<uint64_t, Node*>> tombstones;
+
+    // epoch based reclamation of trimmed versions and unlinked nodes
+    std::atomic<uint64_t> epoch = {0};
+    mutable std::atomic<int64_t> readers[2] = {{0}, {0}};
+    struct retired_t {
+      std::vector<Version*> versions;
+      std::vector<Node*> nodes;
+    };
+    retired_t retired[2];
+
+    uint64_t read_enter() const;
+    void read_exit(uint64_t e) const { --readers[e & 1]; }
+    Node *find_ge(const std::string& k, Node **prev) const;
+    void trim(Version *v, uint64_t min_snap);
+    static void free_versions(Version *v);
+    static void free_retired(retired_t& r);
+  };
+  std::unique_ptr<SkipList> m_skiplist;
+
   CephContext *m_cct;
   PerfCounters *logger;
   void* m_priv;
@@ -60,6 +168,7 @@ class MemDB : public KeyValueDB
   bool _get_locked(const string &prefix, const string &k, bufferlist *out);
   std::string _get_data_fn();
   void _encode(mdb_iter_t iter, bufferlist &bl);
+  void _sl_apply(ms_op_t &op, int type, uint64_t seq, uint64_t min_snap);
   void _save();
   int _load();
   uint64_t iterator_seq_no;
@@ -198,6 +307,42 @@ public:
     ~MDBWholeSpaceIteratorImpl() override;
   };
 
+  class MDBSkipListIteratorImpl : public KeyValueDB::WholeSpaceIteratorImpl {
+    SkipList *m_sl;
+    uint64_t m_seq;               ///< snapshot we read
+    SkipList::Node *m_node = nullptr;
+    std::pair<string, bufferlist> m_key_value;
+
+    int _fill_forward(SkipList::Node *n);
+    int _fill_backward(SkipList::Node *n);
+
+  public:
+    explicit MDBSkipListIteratorImpl(SkipList *sl)
+      : m_sl(sl), m_seq(sl->snapshot_get()) {}
+    ~MDBSkipListIteratorImpl() override {
+      m_sl->snapshot_put(m_seq);
+    }
+
+    int seek_to_first(const std::string &k) override;
+    int seek_to_last(const std::string &k) override;
+
+    int seek_to_first() override { return seek_to_first(std::string()); };
+    int seek_to_last() override { return seek_to_last(std::string()); };
+
+    int upper_bound(const std::string &prefix, const std::string &after) override;
+    int lower_bound(const std::string &prefix, const std::string &to) override;
+    bool valid() override { return m_node != nullptr; }
+
+    int next() override;
+    int prev() override;
+    int status() override { return 0; };
+
+    std::string key() override;
+    std::pair<std::string,std::string> raw_key() override;
+    bool raw_key_is_prefixed(const std::string &prefix) override;
+    bufferlist value() override { return m_key_value.second; }
+  };
+
   uint64_t get_estimated_size(std::map<std::string,uint64_t> &extra) override {
       std::lock_guard<std::mutex> l(m_lock);
       return m_allocated_bytes;
@@ -213,6 +358,9 @@ public:
   }
 
   WholeSpaceIterator get_wholespace_iterator() override {
+    if (m_skiplist) {
+      return std::make_shared<MDBSkipListIteratorImpl>(m_skiplist.get());
+    }
     return std::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
       new MDBWholeSpaceIteratorImpl(&m_map, &m_lock, &iterator_seq_no, m_using_btree));
   }
@@ -18,10 +18,13 @@
 #include "rocksdb/filter_policy.h"
 #include "rocksdb/utilities/convenience.h"
 #include "rocksdb/merge_operator.h"
+#include "rocksdb/listener.h"
 
 using std::string;
 #include "common/perf_counters.h"
 #include "common/PriorityCache.h"
+#include "common/strtol.h"
+#include "include/ceph_hash.h"
 #include "include/str_list.h"
 #include "include/stringify.h"
 #include "include/str_map.h"
@@ -35,6 +38,15 @@ using std::string;
 #undef dout_prefix
 #define dout_prefix *_dout << "rocksdb: "
 
+// where the layout of sharded prefixes is kept, in the default CF
+static const string SHARDING_PREFIX = "_sharding";
+static const string SHARDING_DEF_KEY = "def";
+static const string SHARDING_RESHARDING_KEY = "resharding";
+
+// reshard() moves keys in write batches of about this size
+static constexpr unsigned RESHARD_BATCH_KEYS = 10000;
+static constexpr size_t RESHARD_BATCH_BYTES = 16 << 20;
+
 static bufferlist to_bufferlist(rocksdb::Slice in) {
   bufferlist bl;
   bl.append(bufferptr(in.data(), in.size()));
@@ -77,6 +89,9 @@ public:
     for (auto& p : store.cf_handles) {
       names.erase(p.first);
     }
+    for (auto& p : store.cf_shards) {
+      names.erase(p.first);
+    }
     for (auto& p : names) {
       store.assoc_name += '.';
       store.assoc_name += p.first;
@@ -147,6 +162,25 @@ public:
   }
 };
 
+//
+// Feeds the per column family counters with finished compactions.
+//
+class RocksDBStore::CompactionListener : public rocksdb::EventListener
+{
+  RocksDBStore& store;
+public:
+  explicit CompactionListener(RocksDBStore &_store) : store(_store) {}
+
+  void OnCompactionCompleted(rocksdb::DB *db,
+			     const rocksdb::CompactionJobInfo& ci) override {
+    if (ci.status.ok()) {
+      store.note_compaction(ci.cf_name, ci.stats.elapsed_micros,
+			    ci.stats.total_input_bytes,
+			    ci.stats.total_output_bytes);
+    }
+  }
+};
+
 int RocksDBStore::set_merge_operator(
   const string& prefix,
   std::shared_ptr<KeyValueDB::MergeOperator> mop)
@@ -330,6 +364,193 @@ int RocksDBStore::install_cf_mergeop(
   return 0;
 }
 
+string RocksDBStore::cf_def_t::to_str() const
+{
+  if (shards == 1) {
+    return prefix;
+  }
+  string s = prefix + "(" + stringify(shards);
+  if (hash_l != 0 || hash_h != std::numeric_limits<uint32_t>::max()) {
+    s += "," + stringify(hash_l) + "-";
+    if (hash_h != std::numeric_limits<uint32_t>::max()) {
+      s += stringify(hash_h);
+    }
+  }
+  return s + ")";
+}
+
+int RocksDBStore::parse_cf_def(const string& name, const string& options,
+			       cf_def_t *def)
+{
+  auto p = name.find('(');
+  def->prefix = name.substr(0, p);
+  def->options = options;
+  // a '-' would make "<prefix>-<shard>" ambiguous
+  if (def->prefix.empty() ||
+      def->prefix.find_first_of("-)") != string::npos) {
+    return -EINVAL;
+  }
+  if (p == string::npos) {
+    return 0;
+  }
+  if (name.back() != ')') {
+    return -EINVAL;
+  }
+  string shards = name.substr(p + 1, name.size() - p - 2);
+  string range;
+  if (auto comma = shards.find(','); comma != string::npos) {
+    range = shards.substr(comma + 1);
+    shards.resize(comma);
+  }
+  string err;
+  int n = strict_strtol(shards.c_str(), 10, &err);
+  if (!err.empty() || n < 1) {
+    return -EINVAL;
+  }
+  def->shards = n;
+  if (!range.empty()) {
+    auto dash = range.find('-');
+    if (dash == string::npos) {
+      return -EINVAL;
+    }
+    long long l = strict_strtoll(range.substr(0, dash).c_str(), 10, &err);
+    long long h = std::numeric_limits<uint32_t>::max();
+    if (err.empty() && dash + 1 < range.size()) {
+      h = strict_strtoll(range.substr(dash + 1).c_str(), 10, &err);
+    }
+    if (!err.empty() || l < 0 || h <= l ||
+	h > std::numeric_limits<uint32_t>::max()) {
+      return -EINVAL;
+    }
+    def->hash_l = l;
+    def->hash_h = h;
+  }
+  return 0;
+}
+
+int RocksDBStore::parse_sharding(const string& spec, vector<cf_def_t> *defs)
+{
+  map<string,string> m;
+  int r = get_str_map(spec, &m, " \t");
+  if (r < 0) {
+    return r;
+  }
+  set<string> prefixes;
+  for (auto& [name, options] : m) {
+    cf_def_t def;
+    r = parse_cf_def(name, options, &def);
+    if (r < 0) {
+      return r;
+    }
+    if (!prefixes.insert(def.prefix).second) {
+      return -EINVAL;
+    }
+    defs->push_back(def);
+  }
+  return 0;
+}
+
+static string sharding_to_str(const map<string, RocksDBStore::cf_def_t>& defs)
+{
+  string s;
+  for (auto& p : defs) {
+    if (p.second.shards > 1) {
+      if (!s.empty()) {
+	s += ' ';
+      }
+      s += p.second.to_str();
+    }
+  }
+  return s;
+}
+
+/// split a column family name "<prefix>-<n>"
+static bool split_shard_name(const string& name, string *prefix, unsigned *n)
+{
+  auto dash = name.rfind('-');
+  if (dash == string::npos || dash == 0 || dash + 1 == name.size() ||
+      name.find_first_not_of("0123456789", dash + 1) != string::npos) {
+    return false;
+  }
+  *prefix = name.substr(0, dash);
+  *n = atoi(name.c_str() + dash + 1);
+  return true;
+}
+
+rocksdb::ColumnFamilyHandle *RocksDBStore::prefix_shards::get(
+  const char *key, size_t keylen) const
+{
+  size_t l = std::min<size_t>(hash_l, keylen);
+  size_t h = std::min<size_t>(hash_h, keylen);
+  return handles[ceph_str_hash_rjenkins(key + l, h - l) % handles.size()];
+}
+
+int RocksDBStore::create_cf_group(const cf_def_t& def,
+				  const rocksdb::ColumnFamilyOptions& base)
+{
+  // user input options will override the base options
+  rocksdb::ColumnFamilyOptions cf_opt(base);
+  auto status = rocksdb::GetColumnFamilyOptionsFromString(
+    cf_opt, def.options, &cf_opt);
+  if (!status.ok()) {
+    derr << __func__ << " invalid db column family option string for CF: "
+	 << def.prefix << dendl;
+    return -EINVAL;
+  }
+  install_cf_mergeop(def.prefix, &cf_opt);
+  if (def.shards == 1) {
+    rocksdb::ColumnFamilyHandle *cf;
+    status = db->CreateColumnFamily(cf_opt, def.prefix, &cf);
+    if (!status.ok()) {
+      derr << __func__ << " Failed to create rocksdb column family: "
+	   << def.prefix << dendl;
+      return -EINVAL;
+    }
+    add_column_family(def.prefix, static_cast<void*>(cf));
+    return 0;
+  }
+  auto& shards = cf_shards[def.prefix];
+  shards.hash_l = def.hash_l;
+  shards.hash_h = def.hash_h;
+  for (unsigned i = 0; i < def.shards; ++i) {
+    string name = def.prefix + "-" + stringify(i);
+    rocksdb::ColumnFamilyHandle *cf;
+    status = db->CreateColumnFamily(cf_opt, name, &cf);
+    if (!status.ok()) {
+      derr << __func__ << " Failed to create rocksdb column family: "
+	   << name << dendl;
+      return -EINVAL;
+    }
+    shards.handles.push_back(cf);
+  }
+  return 0;
+}
+
+int RocksDBStore::persist_sharding(bool in_progress)
+{
+  rocksdb::WriteBatch bat;
+  string def_key = combine_strings(SHARDING_PREFIX, SHARDING_DEF_KEY);
+  string marker_key = combine_strings(SHARDING_PREFIX, SHARDING_RESHARDING_KEY);
+  if (sharding_def.empty()) {
+    bat.Delete(default_cf, def_key);
+  } else {
+    bat.Put(default_cf, def_key, sharding_def);
+  }
+  if (in_progress) {
+    bat.Put(default_cf, marker_key, rocksdb::Slice());
+  } else {
+    bat.Delete(default_cf, marker_key);
+  }
+  rocksdb::WriteOptions woptions;
+  woptions.sync = true;
+  auto status = db->Write(woptions, &bat);
+  if (!status.ok()) {
+    derr << __func__ << " " << status.ToString() << dendl;
+    return -EIO;
+  }
+  return 0;
+}
+
 int RocksDBStore::create_and_open(ostream &out,
 				  const vector<ColumnFamily>& cfs)
 {
@@ -481,6 +702,7 @@ int RocksDBStore::load_rocksdb_options(bool create_if_missing, rocksdb::Options&
 	   << dendl;
 
   opt.merge_operator.reset(new MergeOperatorRouter(*this));
+  opt.listeners.push_back(std::make_shared<CompactionListener>(*this));
 
   return 0;
 }
@@ -497,6 +719,18 @@ int RocksDBStore::do_open(ostream &out,
     dout(1) << __func__ << " load rocksdb options failed" << dendl;
     return r;
   }
+  map<string, cf_def_t> defs;
+  if (cfs) {
+    for (auto& p : *cfs) {
+      cf_def_t def;
+      if (parse_cf_def(p.name, p.option, &def) < 0) {
+	derr << __func__ << " invalid column family definition: " << p.name
+	     << dendl;
+	return -EINVAL;
+      }
+      defs[def.prefix] = def;
+    }
+  }
   rocksdb::Status status;
   if (create_if_missing) {
     status = rocksdb::DB::Open(opt, path, &db);
@@ -504,33 +738,23 @@ int RocksDBStore::do_open(ostream &out,
       derr << status.ToString() << dendl;
       return -EINVAL;
     }
+    default_cf = db->DefaultColumnFamily();
     // create and open column families
-    if (cfs) {
-      for (auto& p : *cfs) {
-	// copy default CF settings, block cache, merge operators as
-	// the base for new CF
-	rocksdb::ColumnFamilyOptions cf_opt(opt);
-	// user input options will override the base options
-	status = rocksdb::GetColumnFamilyOptionsFromString(
-	  cf_opt, p.option, &cf_opt);
-	if (!status.ok()) {
-	  derr << __func__ << " invalid db column family option string for CF: "
-	       << p.name << dendl;
-	  return -EINVAL;
-	}
-	install_cf_mergeop(p.name, &cf_opt);
-	rocksdb::ColumnFamilyHandle *cf;
-	status = db->CreateColumnFamily(cf_opt, p.name, &cf);
-	if (!status.ok()) {
-	  derr << __func__ << " Failed to create rocksdb column family: "
-	       << p.name << dendl;
-	  return -EINVAL;
-	}
-	// store the new CF handle
-	add_column_family(p.name, static_cast<void*>(cf));
+    for (auto& p : defs) {
+      // copy default CF settings, block cache, merge operators as
+      // the base for new CF
+      r = create_cf_group(p.second, opt);
+      if (r < 0) {
+	return r;
+      }
+    }
+    sharding_def = sharding_to_str(defs);
+    if (!sharding_def.empty()) {
+      r = persist_sharding(false);
+      if (r < 0) {
+	return r;
       }
     }
-    default_cf = db->DefaultColumnFamily();
   } else {
     std::vector<string> existing_cfs;
     status = rocksdb::DB::ListColumnFamilies(
@@ -558,26 +782,28 @@ int RocksDBStore::do_open(ostream &out,
 	// copy default CF settings, block cache, merge operators as
 	// the base for new CF
 	rocksdb::ColumnFamilyOptions cf_opt(opt);
-	bool found = false;
-	if (cfs) {
-	  for (auto& i : *cfs) {
-	    if (i.name == n) {
-	      found = true;
-	      status = rocksdb::GetColumnFamilyOptionsFromString(
-		cf_opt, i.option, &cf_opt);
-	      if (!status.ok()) {
-		derr << __func__ << " invalid db column family options for CF '"
-		     << i.name << "': " << i.option << dendl;
-		return -EINVAL;
-	      }
-	    }
+	string prefix = n;
+	unsigned shard;
+	auto i = defs.find(n);
+	if (i == defs.end() && split_shard_name(n, &prefix, &shard)) {
+	  i = defs.find(prefix);
+	}
+	if (i == defs.end()) {
+	  prefix = n;
+	} else {
+	  status = rocksdb::GetColumnFamilyOptionsFromString(
+	    cf_opt, i->second.options, &cf_opt);
+	  if (!status.ok()) {
+	    derr << __func__ << " invalid db column family options for CF '"
+		 << n << "': " << i->second.options << dendl;
+	    return -EINVAL;
 	  }
 	}
 	if (n != rocksdb::kDefaultColumnFamilyName) {
-	  install_cf_mergeop(n, &cf_opt);
+	  install_cf_mergeop(prefix, &cf_opt);
 	}
 	column_families.push_back(rocksdb::ColumnFamilyDescriptor(n, cf_opt));
-	if (!found && n != rocksdb::kDefaultColumnFamilyName) {
+	if (i == defs.end() && n != rocksdb::kDefaultColumnFamilyName) {
 	  dout(1) << __func__ << " column family '" << n
 		  << "' exists but not expected" << dendl;
 	}
@@ -599,13 +825,82 @@ int RocksDBStore::do_open(ostream &out,
 	if (existing_cfs[i] == rocksdb::kDefaultColumnFamilyName) {
 	  default_cf = handles[i];
 	  must_close_default_cf = true;
+	}
+      }
+      ceph_assert(default_cf != nullptr);
+
+      // the column families of a sharded prefix are named "<prefix>-<n>";
+      // which prefixes are sharded (and how) is kept in the db
+      string v;
+      status = db->Get(rocksdb::ReadOptions(), default_cf,
+		       combine_strings(SHARDING_PREFIX, SHARDING_DEF_KEY), &v);
+      if (status.ok()) {
+	sharding_def = v;
+      }
+      vector<cf_def_t> sharded;
+      if (parse_sharding(sharding_def, &sharded) < 0) {
+	derr << __func__ << " invalid sharding '" << sharding_def << "'" << dendl;
+	r = -EIO;
+      }
+      for (auto& d : sharded) {
+	auto& shards = cf_shards[d.prefix];
+	shards.hash_l = d.hash_l;
+	shards.hash_h = d.hash_h;
+	shards.handles.resize(d.shards);
+	auto i = defs.find(d.prefix);
+	if (i != defs.end() && !i->second.same_layout(d)) {
+	  dout(1) << __func__ << " prefix " << d.prefix << " is sharded as "
+		  << d.to_str() << ", not " << i->second.to_str()
+		  << "; see ceph-bluestore-tool reshard" << dendl;
+	}
+      }
+      for (unsigned i = 0; i < existing_cfs.size(); ++i) {
+	if (existing_cfs[i] == rocksdb::kDefaultColumnFamilyName) {
+	  continue;
+	}
+	string prefix;
+	unsigned shard;
+	if (split_shard_name(existing_cfs[i], &prefix, &shard) &&
+	    cf_shards.count(prefix) &&
+	    shard < cf_shards[prefix].handles.size()) {
+	  cf_shards[prefix].handles[shard] = handles[i];
 	} else {
 	  add_column_family(existing_cfs[i], static_cast<void*>(handles[i]));
 	}
       }
+      // reshard() copes with shards it has already dropped
+      for (auto& p : cf_shards) {
+	for (unsigned i = 0; i < p.second.handles.size(); ++i) {
+	  if (!p.second.handles[i] && !resharding) {
+	    derr << __func__ << " column family " << p.first << "-" << i
+		 << " is missing" << dendl;
+	    r = -EIO;
+	  }
+	}
+      }
+      status = db->Get(rocksdb::ReadOptions(), default_cf,
+		       combine_strings(SHARDING_PREFIX, SHARDING_RESHARDING_KEY),
+		       &v);
+      if (status.ok() && !resharding) {
+	derr << __func__ << " an earlier reshard did not complete" << dendl;
+	out << "an earlier reshard did not complete; run "
+	    << "'ceph-bluestore-tool reshard' again" << std::endl;
+	r = -EBUSY;
+      }
+      if (r < 0) {
+	return r;
+      }
     }
   }
   ceph_assert(default_cf != nullptr);
+
+  add_cf_logger(rocksdb::kDefaultColumnFamilyName);
+  for (auto& p : cf_handles) {
+    add_cf_logger(p.first);
+  }
+  for (auto& p : cf_shards) {
+    add_cf_logger(p.first);
+  }
   
   PerfCountersBuilder plb(g_ceph_context, "rocksdb", l_rocksdb_first, l_rocksdb_last);
   plb.add_u64_counter(l_rocksdb_gets, "get", "Gets");
@@ -649,6 +944,9 @@ RocksDBStore::~RocksDBStore()
 {
   close();
   delete logger;
+  for (auto& p : cf_loggers) {
+    delete p.second;
+  }
 
   // Ensure db is destroyed before dependent db_cache and filterpolicy
   for (auto& p : cf_handles) {
@@ -656,6 +954,14 @@ RocksDBStore::~RocksDBStore()
       static_cast<rocksdb::ColumnFamilyHandle*>(p.second));
     p.second = nullptr;
   }
+  for (auto& p : cf_shards) {
+    for (auto& cf : p.second.handles) {
+      if (cf) {
+	db->DestroyColumnFamilyHandle(cf);
+	cf = nullptr;
+      }
+    }
+  }
   if (must_close_default_cf) {
     db->DestroyColumnFamilyHandle(default_cf);
     must_close_default_cf = false;
@@ -686,6 +992,58 @@ void RocksDBStore::close()
 
   if (logger)
     cct->get_perfcounters_collection()->remove(logger);
+  for (auto& p : cf_loggers) {
+    cct->get_perfcounters_collection()->remove(p.second);
+  }
+}
+
+void RocksDBStore::add_cf_logger(const string& prefix)
+{
+  std::lock_guard l(cf_loggers_lock);
+  auto& cf_logger = cf_loggers[prefix];
+  if (!cf_logger) {
+    PerfCountersBuilder plb(cct, "rocksdb-cf-" + prefix,
+			    l_rocksdb_cf_first, l_rocksdb_cf_last);
+    plb.add_u64_counter(l_rocksdb_cf_gets, "get", "Gets");
+    plb.add_time_avg(l_rocksdb_cf_get_latency, "get_latency", "Get latency");
+    plb.add_u64_counter(l_rocksdb_cf_compact, "compact",
+			"Compactions finished");
+    plb.add_time_avg(l_rocksdb_cf_compact_lat, "compact_lat",
+		     "Average compaction duration");
+    plb.add_u64_counter(l_rocksdb_cf_compact_read_bytes, "compact_read_bytes",
+			"Bytes read by compactions", NULL, 0,
+			unit_t(UNIT_BYTES));
+    plb.add_u64_counter(l_rocksdb_cf_compact_write_bytes,
+			"compact_write_bytes",
+			"Bytes written by compactions", NULL, 0,
+			unit_t(UNIT_BYTES));
+    cf_logger = plb.create_perf_counters();
+    cct->get_perfcounters_collection()->add(cf_logger);
+  }
+  if (prefix == rocksdb::kDefaultColumnFamilyName) {
+    default_cf_logger = cf_logger;
+    cf_name_loggers[prefix] = cf_logger;
+  } else if (auto shards = get_cf_shards(prefix)) {
+    for (unsigned i = 0; i < shards->handles.size(); ++i) {
+      cf_name_loggers[prefix + "-" + stringify(i)] = cf_logger;
+    }
+  } else {
+    cf_name_loggers[prefix] = cf_logger;
+  }
+}
+
+void RocksDBStore::note_compaction(const string& cf_name, uint64_t usec,
+				   uint64_t read_bytes, uint64_t write_bytes)
+{
+  std::lock_guard l(cf_loggers_lock);
+  auto p = cf_name_loggers.find(cf_name);
+  if (p == cf_name_loggers.end()) {
+    return;
+  }
+  p->second->inc(l_rocksdb_cf_compact);
+  p->second->tinc(l_rocksdb_cf_compact_lat, std::chrono::microseconds(usec));
+  p->second->inc(l_rocksdb_cf_compact_read_bytes, read_bytes);
+  p->second->inc(l_rocksdb_cf_compact_write_bytes, write_bytes);
 }
 
 int RocksDBStore::repair(std::ostream &out)
@@ -726,6 +1084,7 @@ int64_t RocksDBStore::estimate_prefix_size(const string& prefix,
 					   const string& key_prefix)
 {
   auto cf = get_cf_handle(prefix);
+  auto shards = get_cf_shards(prefix);
   uint64_t size = 0;
   uint8_t flags =
     //rocksdb::DB::INCLUDE_MEMTABLES |  // do not include memtables...
@@ -735,6 +1094,15 @@ int64_t RocksDBStore::estimate_prefix_size(const string& prefix,
     string limit = key_prefix + string("\xff\xff\xff\xff");
     rocksdb::Range r(start, limit);
     db->GetApproximateSizes(cf, &r, 1, &size, flags);
+  } else if (shards) {
+    string start = key_prefix + string(1, '\x00');
+    string limit = key_prefix + string("\xff\xff\xff\xff");
+    rocksdb::Range r(start, limit);
+    for (auto shard : shards->handles) {
+      uint64_t shard_size = 0;
+      db->GetApproximateSizes(shard, &r, 1, &shard_size, flags);
+      size += shard_size;
+    }
   } else {
     string start = combine_strings(prefix , key_prefix);
     string limit = combine_strings(prefix , key_prefix + "\xff\xff\xff\xff");
@@ -911,7 +1279,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     put_bat(bat, cf, k, to_set_bl);
   } else {
@@ -925,7 +1293,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
   const char *k, size_t keylen,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k, keylen);
   if (cf) {
     string key(k, keylen);  // fixme?
     put_bat(bat, cf, key, to_set_bl);
@@ -939,7 +1307,7 @@ void RocksDBStore::RocksDBTransactionImpl::set(
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const string &k)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     bat.Delete(cf, rocksdb::Slice(k));
   } else {
@@ -951,7 +1319,7 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const char *k,
 						 size_t keylen)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k, keylen);
   if (cf) {
     bat.Delete(cf, rocksdb::Slice(k, keylen));
   } else {
@@ -964,7 +1332,7 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 					                 const string &k)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     bat.SingleDelete(cf, k);
   } else {
@@ -975,6 +1343,7 @@ void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
   auto cf = db->get_cf_handle(prefix);
+  auto shards = db->get_cf_shards(prefix);
   uint64_t cnt = db->delete_range_threshold;
   bat.SetSavePoint();
   auto it = db->get_iterator(prefix);
@@ -984,6 +1353,11 @@ void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix
       if (cf) {
         string endprefix = "\xff\xff\xff\xff";  // FIXME: this is cheating...
         bat.DeleteRange(cf, string(), endprefix);
+      } else if (shards) {
+        string endprefix = "\xff\xff\xff\xff";
+        for (auto shard : shards->handles) {
+          bat.DeleteRange(shard, string(), endprefix);
+        }
       } else {
         string endprefix = prefix;
         endprefix.push_back('\x01');
@@ -995,6 +1369,9 @@ void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix
     }
     if (cf) {
       bat.Delete(cf, rocksdb::Slice(it->key()));
+    } else if (shards) {
+      string k = it->key();
+      bat.Delete(shards->get(k.data(), k.size()), rocksdb::Slice(k));
     } else {
       bat.Delete(db->default_cf, combine_strings(prefix, it->key()));
     }
@@ -1008,6 +1385,7 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
                                                          const string &end)
 {
   auto cf = db->get_cf_handle(prefix);
+  auto shards = db->get_cf_shards(prefix);
 
   uint64_t cnt = db->delete_range_threshold;
   auto it = db->get_iterator(prefix);
@@ -1021,6 +1399,10 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
       bat.RollbackToSavePoint();
       if (cf) {
         bat.DeleteRange(cf, rocksdb::Slice(start), rocksdb::Slice(end));
+      } else if (shards) {
+        for (auto shard : shards->handles) {
+          bat.DeleteRange(shard, rocksdb::Slice(start), rocksdb::Slice(end));
+        }
       } else {
         bat.DeleteRange(db->default_cf,
                         rocksdb::Slice(combine_strings(prefix, start)),
@@ -1030,6 +1412,9 @@ void RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
     }
     if (cf) {
       bat.Delete(cf, rocksdb::Slice(it->key()));
+    } else if (shards) {
+      string k = it->key();
+      bat.Delete(shards->get(k.data(), k.size()), rocksdb::Slice(k));
     } else {
       bat.Delete(db->default_cf, combine_strings(prefix, it->key()));
     }
@@ -1044,7 +1429,7 @@ void RocksDBStore::RocksDBTransactionImpl::merge(
   const string &k,
   const bufferlist &to_set_bl)
 {
-  auto cf = db->get_cf_handle(prefix);
+  auto cf = db->get_cf_handle(prefix, k);
   if (cf) {
     // bufferlist::c_str() is non-constant, so we can't call c_str()
     if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
@@ -1086,11 +1471,12 @@ int RocksDBStore::get(
 {
   utime_t start = ceph_clock_now();
   auto cf = get_cf_handle(prefix);
-  if (cf) {
+  auto shards = get_cf_shards(prefix);
+  if (cf || shards) {
     for (auto& key : keys) {
       std::string value;
       auto status = db->Get(rocksdb::ReadOptions(),
-			    cf,
+			    shards ? shards->get(key.data(), key.size()) : cf,
 			    rocksdb::Slice(key),
 			    &value);
       if (status.ok()) {
@@ -1117,6 +1503,9 @@ int RocksDBStore::get(
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_rocksdb_gets);
   logger->tinc(l_rocksdb_get_latency, lat);
+  auto cf_logger = get_cf_logger(prefix);
+  cf_logger->inc(l_rocksdb_cf_gets);
+  cf_logger->tinc(l_rocksdb_cf_get_latency, lat);
   return 0;
 }
 
@@ -1130,7 +1519,7 @@ int RocksDBStore::get(
   int r = 0;
   string value;
   rocksdb::Status s;
-  auto cf = get_cf_handle(prefix);
+  auto cf = get_cf_handle(prefix, key);
   if (cf) {
     s = db->Get(rocksdb::ReadOptions(),
 		cf,
@@ -1153,6 +1542,9 @@ int RocksDBStore::get(
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_rocksdb_gets);
   logger->tinc(l_rocksdb_get_latency, lat);
+  auto cf_logger = get_cf_logger(prefix);
+  cf_logger->inc(l_rocksdb_cf_gets);
+  cf_logger->tinc(l_rocksdb_cf_get_latency, lat);
   return r;
 }
 
@@ -1167,7 +1559,7 @@ int RocksDBStore::get(
   int r = 0;
   string value;
   rocksdb::Status s;
-  auto cf = get_cf_handle(prefix);
+  auto cf = get_cf_handle(prefix, key, keylen);
   if (cf) {
     s = db->Get(rocksdb::ReadOptions(),
 		cf,
@@ -1191,6 +1583,9 @@ int RocksDBStore::get(
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_rocksdb_gets);
   logger->tinc(l_rocksdb_get_latency, lat);
+  auto cf_logger = get_cf_logger(prefix);
+  cf_logger->inc(l_rocksdb_cf_gets);
+  cf_logger->tinc(l_rocksdb_cf_get_latency, lat);
   return r;
 }
 
@@ -1225,6 +1620,40 @@ void RocksDBStore::compact()
       static_cast<rocksdb::ColumnFamilyHandle*>(cf.second),
       nullptr, nullptr);
   }
+  for (auto& p : cf_shards) {
+    for (auto cf : p.second.handles) {
+      db->CompactRange(options, cf, nullptr, nullptr);
+    }
+  }
+}
+
+void RocksDBStore::compact_prefix(const string& prefix)
+{
+  if (auto cf = get_cf_handle(prefix)) {
+    db->CompactRange(rocksdb::CompactRangeOptions(), cf, nullptr, nullptr);
+  } else if (auto shards = get_cf_shards(prefix)) {
+    for (auto cf : shards->handles) {
+      db->CompactRange(rocksdb::CompactRangeOptions(), cf, nullptr, nullptr);
+    }
+  } else {
+    compact_range(prefix, past_prefix(prefix));
+  }
+}
+
+void RocksDBStore::compact_range(const string& prefix,
+				 const string& start, const string& end)
+{
+  rocksdb::Slice cstart(start);
+  rocksdb::Slice cend(end);
+  if (auto cf = get_cf_handle(prefix)) {
+    db->CompactRange(rocksdb::CompactRangeOptions(), cf, &cstart, &cend);
+  } else if (auto shards = get_cf_shards(prefix)) {
+    for (auto cf : shards->handles) {
+      db->CompactRange(rocksdb::CompactRangeOptions(), cf, &cstart, &cend);
+    }
+  } else {
+    compact_range(combine_strings(prefix, start), combine_strings(prefix, end));
+  }
 }
 
 
@@ -1435,6 +1864,33 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::status()
   return dbiter->status().ok() ? 0 : -1;
 }
 
+size_t RocksDBStore::RocksDBWholeSpaceIteratorImpl::next_batch(
+  const string &prefix,
+  const string &end,
+  size_t max_entries,
+  size_t max_bytes,
+  IteratorBatch *batch)
+{
+  // copy straight out of the slices instead of a key() and value() per entry
+  size_t n = 0;
+  for (; n < max_entries && batch->bytes() < max_bytes && dbiter->Valid();
+       ++n, dbiter->Next()) {
+    rocksdb::Slice key = dbiter->key();
+    if (key.size() <= prefix.length() ||
+	key[prefix.length()] != '\0' ||
+	memcmp(key.data(), prefix.c_str(), prefix.length()) != 0) {
+      break;
+    }
+    key.remove_prefix(prefix.length() + 1);
+    if (!end.empty() && key.compare(rocksdb::Slice(end)) >= 0) {
+      break;
+    }
+    rocksdb::Slice value = dbiter->value();
+    batch->add(key.data(), key.size(), value.data(), value.size());
+  }
+  return n;
+}
+
 string RocksDBStore::past_prefix(const string &prefix)
 {
   string limit = prefix;
@@ -1452,10 +1908,12 @@ class CFIteratorImpl : public KeyValueDB::IteratorImpl {
 protected:
   string prefix;
   rocksdb::Iterator *dbiter;
+  std::unique_ptr<RocksDBStore::iterate_bounds_t> bounds;
 public:
   explicit CFIteratorImpl(const std::string& p,
-				 rocksdb::Iterator *iter)
-    : prefix(p), dbiter(iter) { }
+			  rocksdb::Iterator *iter,
+			  std::unique_ptr<RocksDBStore::iterate_bounds_t> b = nullptr)
+    : prefix(p), dbiter(iter), bounds(std::move(b)) { }
   ~CFIteratorImpl() {
     delete dbiter;
   }
@@ -1511,6 +1969,157 @@ public:
   int status() override {
     return dbiter->status().ok() ? 0 : -1;
   }
+  size_t next_batch_until(const string &end,
+			  size_t max_entries, size_t max_bytes,
+			  KeyValueDB::IteratorBatch *batch) override {
+    size_t n = 0;
+    for (; n < max_entries && batch->bytes() < max_bytes && dbiter->Valid();
+	 ++n, dbiter->Next()) {
+      rocksdb::Slice key = dbiter->key();
+      if (!end.empty() && key.compare(rocksdb::Slice(end)) >= 0) {
+	break;
+      }
+      rocksdb::Slice value = dbiter->value();
+      batch->add(key.data(), key.size(), value.data(), value.size());
+    }
+    return n;
+  }
+};
+
+//
+// Merges the iterators of all shards of a prefix.  Every key lives in
+// exactly one shard, so the current key is simply the smallest (or, when
+// going backwards, largest) of the keys the shard iterators are at.
+//
+class ShardMergeIteratorImpl : public KeyValueDB::IteratorImpl {
+protected:
+  string prefix;
+  std::vector<rocksdb::Iterator*> iters;
+  rocksdb::Iterator *cur = nullptr;
+  bool forward = true;
+  std::unique_ptr<RocksDBStore::iterate_bounds_t> bounds;
+
+  void pick() {
+    cur = nullptr;
+    for (auto it : iters) {
+      if (!it->Valid()) {
+	continue;
+      }
+      if (!cur ||
+	  (forward ? it->key().compare(cur->key()) < 0 :
+	             it->key().compare(cur->key()) > 0)) {
+	cur = it;
+      }
+    }
+  }
+public:
+  ShardMergeIteratorImpl(const std::string& p,
+			 std::vector<rocksdb::Iterator*>&& iters,
+			 std::unique_ptr<RocksDBStore::iterate_bounds_t> b = nullptr)
+    : prefix(p), iters(std::move(iters)), bounds(std::move(b)) { }
+  ~ShardMergeIteratorImpl() {
+    for (auto it : iters) {
+      delete it;
+    }
+  }
+
+  int seek_to_first() override {
+    forward = true;
+    for (auto it : iters) {
+      it->SeekToFirst();
+    }
+    pick();
+    return status();
+  }
+  int seek_to_last() override {
+    forward = false;
+    for (auto it : iters) {
+      it->SeekToLast();
+    }
+    pick();
+    return status();
+  }
+  int upper_bound(const string &after) override {
+    lower_bound(after);
+    if (valid() && (key() == after)) {
+      next();
+    }
+    return status();
+  }
+  int lower_bound(const string &to) override {
+    forward = true;
+    rocksdb::Slice slice_bound(to);
+    for (auto it : iters) {
+      it->Seek(slice_bound);
+    }
+    pick();
+    return status();
+  }
+  int next() override {
+    if (!valid()) {
+      return status();
+    }
+    if (!forward) {
+      // the other shards are behind the current key; move them past it
+      string k = cur->key().ToString();
+      for (auto it : iters) {
+	if (it != cur) {
+	  it->Seek(k);
+	}
+      }
+      forward = true;
+    }
+    cur->Next();
+    pick();
+    return status();
+  }
+  int prev() override {
+    if (!valid()) {
+      return status();
+    }
+    if (forward) {
+      // the other shards are past the current key; move them before it
+      string k = cur->key().ToString();
+      for (auto it : iters) {
+	if (it != cur) {
+	  it->Seek(k);
+	  if (it->Valid()) {
+	    it->Prev();
+	  } else {
+	    it->SeekToLast();
+	  }
+	}
+      }
+      forward = false;
+    }
+    cur->Prev();
+    pick();
+    return status();
+  }
+  bool valid() override {
+    return cur != nullptr;
+  }
+  string key() override {
+    return cur->key().ToString();
+  }
+  std::pair<std::string, std::string> raw_key() override {
+    return make_pair(prefix, key());
+  }
+  bufferlist value() override {
+    return to_bufferlist(cur->value());
+  }
+  bufferptr value_as_ptr() override {
+    rocksdb::Slice val = cur->value();
+    return bufferptr(val.data(), val.size());
+  }
+  int status() override {
+    for (auto it : iters) {
+      if (!it->status().ok()) {
+	return -1;
+      }
+    }
+    return 0;
+  }
 };
 
 KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix)
@@ -1521,7 +2130,249 @@ KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix)
     return std::make_shared<CFIteratorImpl>(
       prefix,
       db->NewIterator(rocksdb::ReadOptions(), cf_handle));
+  } else if (auto shards = get_cf_shards(prefix)) {
+    std::vector<rocksdb::Iterator*> iters;
+    auto status = db->NewIterators(rocksdb::ReadOptions(), shards->handles,
+				   &iters);
+    ceph_assert(status.ok());
+    return std::make_shared<ShardMergeIteratorImpl>(prefix, std::move(iters));
   } else {
     return KeyValueDB::get_iterator(prefix);
   }
 }
+
+RocksDBStore::iterate_bounds_t::iterate_bounds_t(
+  IteratorBounds&& bounds,
+  const std::string& key_prefix)
+{
+  if (bounds.lower_bound) {
+    lower = key_prefix + *bounds.lower_bound;
+    lower_slice = rocksdb::Slice(lower);
+    options.iterate_lower_bound = &lower_slice;
+  }
+  if (bounds.upper_bound) {
+    upper = key_prefix + *bounds.upper_bound;
+    upper_slice = rocksdb::Slice(upper);
+    options.iterate_upper_bound = &upper_slice;
+  }
+}
+
+KeyValueDB::Iterator RocksDBStore::get_iterator(const std::string& prefix,
+						IteratorBounds bounds)
+{
+  rocksdb::ColumnFamilyHandle *cf_handle =
+    static_cast<rocksdb::ColumnFamilyHandle*>(get_cf_handle(prefix));
+  if (cf_handle) {
+    auto b = std::make_unique<iterate_bounds_t>(std::move(bounds), string());
+    auto dbiter = db->NewIterator(b->options, cf_handle);
+    return std::make_shared<CFIteratorImpl>(prefix, dbiter, std::move(b));
+  } else if (auto shards = get_cf_shards(prefix)) {
+    auto b = std::make_unique<iterate_bounds_t>(std::move(bounds), string());
+    std::vector<rocksdb::Iterator*> iters;
+    auto status = db->NewIterators(b->options, shards->handles, &iters);
+    ceph_assert(status.ok());
+    return std::make_shared<ShardMergeIteratorImpl>(prefix, std::move(iters),
+						    std::move(b));
+  } else {
+    auto b = std::make_unique<iterate_bounds_t>(std::move(bounds),
+						combine_strings(prefix, string()));
+    auto dbiter = db->NewIterator(b->options, default_cf);
+    return std::make_shared<PrefixIteratorImpl>(
+      prefix,
+      std::make_shared<RocksDBWholeSpaceIteratorImpl>(dbiter, std::move(b)));
+  }
+}
+
+int RocksDBStore::reshard_move_out(const string& prefix,
+				   rocksdb::ColumnFamilyHandle *cf)
+{
+  rocksdb::WriteOptions woptions;
+  woptions.sync = true;
+  std::unique_ptr<rocksdb::Iterator> it(
+    db->NewIterator(rocksdb::ReadOptions(), cf));
+  rocksdb::WriteBatch bat;
+  for (it->SeekToFirst(); it->Valid(); it->Next()) {
+    bat.Put(default_cf, combine_strings(prefix, it->key().ToString()),
+	    it->value());
+    bat.Delete(cf, it->key());
+    if (bat.Count() >= RESHARD_BATCH_KEYS * 2 ||
+	bat.GetDataSize() >= RESHARD_BATCH_BYTES) {
+      if (!db->Write(woptions, &bat).ok()) {
+	return -EIO;
+      }
+      bat.Clear();
+    }
+  }
+  if (!it->status().ok()) {
+    return -EIO;
+  }
+  if (bat.Count() && !db->Write(woptions, &bat).ok()) {
+    return -EIO;
+  }
+  return 0;
+}
+
+int RocksDBStore::reshard_move_in(const string& prefix)
+{
+  rocksdb::WriteOptions woptions;
+  woptions.sync = true;
+  string start = combine_strings(prefix, string());
+  string end = past_prefix(prefix);
+  std::unique_ptr<rocksdb::Iterator> it(
+    db->NewIterator(rocksdb::ReadOptions(), default_cf));
+  rocksdb::WriteBatch bat;
+  for (it->Seek(start);
+       it->Valid() && it->key().compare(rocksdb::Slice(end)) < 0;
+       it->Next()) {
+    rocksdb::Slice key = it->key();
+    key.remove_prefix(start.size());
+    bat.Put(get_cf_handle(prefix, key.data(), key.size()), key, it->value());
+    bat.Delete(default_cf, it->key());
+    if (bat.Count() >= RESHARD_BATCH_KEYS * 2 ||
+	bat.GetDataSize() >= RESHARD_BATCH_BYTES) {
+      if (!db->Write(woptions, &bat).ok()) {
+	return -EIO;
+      }
+      bat.Clear();
+    }
+  }
+  if (!it->status().ok()) {
+    return -EIO;
+  }
+  if (bat.Count() && !db->Write(woptions, &bat).ok()) {
+    return -EIO;
+  }
+  return 0;
+}
+
+int RocksDBStore::reshard(const string& new_sharding, ostream& out)
+{
+  vector<cf_def_t> new_defs;
+  if (parse_sharding(new_sharding, &new_defs) < 0) {
+    out << "invalid sharding '" << new_sharding << "'" << std::endl;
+    return -EINVAL;
+  }
+  map<string, cf_def_t> target;
+  for (auto& d : new_defs) {
+    target[d.prefix] = d;
+  }
+
+  resharding = true;
+  int r = do_open(out, false, false);
+  resharding = false;
+  if (r < 0) {
+    return r;
+  }
+  string v;
+  bool resume = db->Get(
+    rocksdb::ReadOptions(), default_cf,
+    combine_strings(SHARDING_PREFIX, SHARDING_RESHARDING_KEY), &v).ok();
+  if (resume) {
+    out << "resuming an earlier reshard" << std::endl;
+  }
+  r = persist_sharding(true);
+  if (r < 0) {
+    return r;
+  }
+
+  // what is in the db now
+  map<string, cf_def_t> current;
+  for (auto& p : cf_handles) {
+    current[p.first].prefix = p.first;
+  }
+  map<string, cf_def_t> persisted;
+  for (auto& p : cf_shards) {
+    auto& d = current[p.first];
+    d.prefix = p.first;
+    d.shards = p.second.handles.size();
+    d.hash_l = p.second.hash_l;
+    d.hash_h = p.second.hash_h;
+    persisted[p.first] = d;
+  }
+
+  // first move every prefix whose layout changes to the default CF.  on
+  // resume we don't know how far that got, so everything goes.
+  for (auto& [prefix, d] : current) {
+    auto t = target.find(prefix);
+    if (!resume && t != target.end() && t->second.same_layout(d)) {
+      out << "keeping " << d.to_str() << std::endl;
+      continue;
+    }
+    out << "moving " << d.to_str() << " to the default column family"
+	<< std::endl;
+    vector<rocksdb::ColumnFamilyHandle*> handles;
+    if (auto cf = get_cf_handle(prefix)) {
+      handles.push_back(cf);
+    } else {
+      for (auto cf : cf_shards[prefix].handles) {
+	if (cf) {
+	  handles.push_back(cf);
+	}
+      }
+    }
+    for (auto cf : handles) {
+      r = reshard_move_out(prefix, cf);
+      if (r < 0) {
+	out << "failed to move keys of " << prefix << std::endl;
+	return r;
+      }
+      {
+	std::lock_guard l(cf_loggers_lock);
+	cf_name_loggers.erase(cf->GetName());
+      }
+      auto status = db->DropColumnFamily(cf);
+      if (!status.ok()) {
+	out << "failed to drop column family " << cf->GetName() << ": "
+	    << status.ToString() << std::endl;
+	return -EIO;
+      }
+      db->DestroyColumnFamilyHandle(cf);
+    }
+    cf_handles.erase(prefix);
+    cf_shards.erase(prefix);
+    // the shards are gone
+    if (persisted.erase(prefix)) {
+      sharding_def = sharding_to_str(persisted);
+      r = persist_sharding(true);
+      if (r < 0) {
+	return r;
+      }
+    }
+  }
+
+  // then spread each new prefix over its column families
+  rocksdb::ColumnFamilyOptions base(db->GetOptions(default_cf));
+  for (auto& [prefix, d] : target) {
+    if (get_cf_handle(prefix) || get_cf_shards(prefix)) {
+      continue;
+    }
+    out << "moving " << prefix << " to " << d.to_str() << std::endl;
+    if (d.shards > 1) {
+      // before the shards exist, so that a resume recognizes them
+      persisted[prefix] = d;
+      sharding_def = sharding_to_str(persisted);
+      r = persist_sharding(true);
+      if (r < 0) {
+	return r;
+      }
+    }
+    r = create_cf_group(d, base);
+    if (r < 0) {
+      out << "failed to create column families for " << prefix << std::endl;
+      return r;
+    }
+    add_cf_logger(prefix);
+    r = reshard_move_in(prefix);
+    if (r < 0) {
+      out << "failed to move keys of " << prefix << std::endl;
+      return r;
+    }
+  }
+
+  r = persist_sharding(false);
+  if (r < 0) {
+    return r;
+  }
+  out << "reshard to '" << new_sharding << "' done" << std::endl;
+  return 0;
+}
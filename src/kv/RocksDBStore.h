@@ -10,6 +10,8 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <limits>
+#include <unordered_map>
 #include <boost/scoped_ptr.hpp>
 #include "rocksdb/write_batch.h"
 #include "rocksdb/perf_context.h"
@@ -47,6 +49,18 @@ enum {
   l_rocksdb_last,
 };
 
+// one set per column family (or group of shards), "rocksdb-cf-<prefix>"
+enum {
+  l_rocksdb_cf_first = 34400,
+  l_rocksdb_cf_gets,
+  l_rocksdb_cf_get_latency,
+  l_rocksdb_cf_compact,
+  l_rocksdb_cf_compact_lat,
+  l_rocksdb_cf_compact_read_bytes,
+  l_rocksdb_cf_compact_write_bytes,
+  l_rocksdb_cf_last,
+};
+
 namespace rocksdb{
   class DB;
   class Env;
@@ -62,6 +76,7 @@ namespace rocksdb{
   struct BlockBasedTableOptions;
   struct DBOptions;
   struct ColumnFamilyOptions;
+  class EventListener;
 }
 
 extern rocksdb::Logger *create_rocksdb_ceph_logger();
@@ -87,12 +102,81 @@ class RocksDBStore : public KeyValueDB {
   bool must_close_default_cf = false;
   rocksdb::ColumnFamilyHandle *default_cf = nullptr;
 
+public:
+  /**
+   * A column family definition, as given in bluestore_rocksdb_cfs or to
+   * reshard():
+   *
+   *   P         prefix P in its own column family "P"
+   *   P(N)      prefix P spread over N column families "P-0" .. "P-<N-1>"
+   *             by a hash of the key
+   *   P(N,L-H)  as above, but only key bytes [L, H) are hashed, so keys
+   *             that share them (e.g. the omap of one object) share a shard
+   *
+   * followed by "=<rocksdb column family options>".
+   */
+  struct cf_def_t {
+    string prefix;
+    unsigned shards = 1;
+    uint32_t hash_l = 0;
+    uint32_t hash_h = std::numeric_limits<uint32_t>::max();
+    string options;
+
+    bool same_layout(const cf_def_t& o) const {
+      return shards == o.shards &&
+	(shards == 1 || (hash_l == o.hash_l && hash_h == o.hash_h));
+    }
+    string to_str() const;
+  };
+  static int parse_cf_def(const string& name, const string& options,
+			  cf_def_t *def);
+  static int parse_sharding(const string& spec, vector<cf_def_t> *defs);
+
+private:
+  /// a prefix spread over several column families
+  struct prefix_shards {
+    uint32_t hash_l = 0;
+    uint32_t hash_h = std::numeric_limits<uint32_t>::max();
+    std::vector<rocksdb::ColumnFamilyHandle*> handles;
+
+    rocksdb::ColumnFamilyHandle *get(const char *key, size_t keylen) const;
+  };
+  /// sharded prefixes; plain column families stay in cf_handles
+  std::unordered_map<string, prefix_shards> cf_shards;
+  /// sharded prefixes as persisted in the db, see parse_sharding()
+  string sharding_def;
+  /// set while reshard() is opening a db it may have left half done
+  bool resharding = false;
+
+  /// per column family counters, by prefix
+  std::unordered_map<string, PerfCounters*> cf_loggers;
+  PerfCounters *default_cf_logger = nullptr;
+  /// ... and by column family name, for the compaction listener
+  ceph::mutex cf_loggers_lock =
+    ceph::make_mutex("RocksDBStore::cf_loggers_lock");
+  std::map<string, PerfCounters*> cf_name_loggers;
+  class CompactionListener;
+  friend class CompactionListener;
+  void add_cf_logger(const string& prefix);
+  PerfCounters *get_cf_logger(const string& prefix) {
+    auto p = cf_loggers.find(prefix);
+    return p == cf_loggers.end() ? default_cf_logger : p->second;
+  }
+  void note_compaction(const string& cf_name, uint64_t usec,
+		       uint64_t read_bytes, uint64_t write_bytes);
+
   int submit_common(rocksdb::WriteOptions& woptions, KeyValueDB::Transaction t);
   int install_cf_mergeop(const string &cf_name, rocksdb::ColumnFamilyOptions *cf_opt);
+  int create_cf_group(const cf_def_t& def,
+		      const rocksdb::ColumnFamilyOptions& base);
+  int persist_sharding(bool in_progress);
   int create_db_dir();
   int do_open(ostream &out, bool create_if_missing, bool open_readonly,
 	      const vector<ColumnFamily>* cfs = nullptr);
   int load_rocksdb_options(bool create_if_missing, rocksdb::Options& opt);
+  int reshard_move_out(const string& prefix,
+		       rocksdb::ColumnFamilyHandle *cf);
+  int reshard_move_in(const string& prefix);
 
   // manage async compactions
   ceph::mutex compact_queue_lock =
@@ -137,16 +221,12 @@ public:
   static int _test_init(const string& dir);
   int init(string options_str) override;
   /// compact rocksdb for all keys with a given prefix
-  void compact_prefix(const string& prefix) override {
-    compact_range(prefix, past_prefix(prefix));
-  }
+  void compact_prefix(const string& prefix) override;
   void compact_prefix_async(const string& prefix) override {
     compact_range_async(prefix, past_prefix(prefix));
   }
 
-  void compact_range(const string& prefix, const string& start, const string& end) override {
-    compact_range(combine_strings(prefix, start), combine_strings(prefix, end));
-  }
+  void compact_range(const string& prefix, const string& start, const string& end) override;
   void compact_range_async(const string& prefix, const string& start, const string& end) override {
     compact_range_async(combine_strings(prefix, start), combine_strings(prefix, end));
   }
@@ -184,6 +264,15 @@ public:
 
   void close() override;
 
+  /**
+   * Move an existing (closed) db to a new set of column families, see
+   * cf_def_t.  Keys of every prefix whose layout changes go through the
+   * default column family.  A marker is kept in the db for the duration,
+   * and a db with the marker set won't open until reshard() is run on it
+   * again and finishes.
+   */
+  int reshard(const string& new_sharding, ostream& out);
+
   rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& cf_name) {
     auto iter = cf_handles.find(cf_name);
     if (iter == cf_handles.end())
@@ -191,6 +280,26 @@ public:
     else
       return static_cast<rocksdb::ColumnFamilyHandle*>(iter->second);
   }
+  /// column family that holds key of prefix, nullptr for the default one
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& prefix,
+					     const char *key, size_t keylen) {
+    if (auto cf = get_cf_handle(prefix); cf || cf_shards.empty()) {
+      return cf;
+    }
+    auto p = cf_shards.find(prefix);
+    return p == cf_shards.end() ? nullptr : p->second.get(key, keylen);
+  }
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& prefix,
+					     const std::string& key) {
+    return get_cf_handle(prefix, key.data(), key.size());
+  }
+  const prefix_shards *get_cf_shards(const std::string& prefix) const {
+    if (cf_shards.empty()) {
+      return nullptr;
+    }
+    auto p = cf_shards.find(prefix);
+    return p == cf_shards.end() ? nullptr : &p->second;
+  }
   int repair(std::ostream &out) override;
   void split_stats(const std::string &s, char delim, std::vector<std::string> &elems);
   void get_statistics(Formatter *f) override;
@@ -341,6 +450,9 @@ public:
       const string& prefix,
       const string& k,
       const bufferlist &bl) override;
+    uint64_t get_size_bytes() const override {
+      return bat.GetDataSize();
+    }
   };
 
   KeyValueDB::Transaction get_transaction() override {
@@ -366,13 +478,28 @@ public:
     bufferlist *out) override;
 
 
+  /// the bounds of an iterator, which rocksdb::ReadOptions only point at
+  struct iterate_bounds_t {
+    std::string lower, upper;
+    rocksdb::Slice lower_slice, upper_slice;
+    rocksdb::ReadOptions options;
+
+    /// key_prefix is prepended to the bounds, for the default column family
+    iterate_bounds_t(IteratorBounds&& bounds, const std::string& key_prefix);
+    iterate_bounds_t(const iterate_bounds_t&) = delete;
+    iterate_bounds_t& operator=(const iterate_bounds_t&) = delete;
+  };
+
   class RocksDBWholeSpaceIteratorImpl :
     public KeyValueDB::WholeSpaceIteratorImpl {
   protected:
     rocksdb::Iterator *dbiter;
+    std::unique_ptr<iterate_bounds_t> bounds;
   public:
-    explicit RocksDBWholeSpaceIteratorImpl(rocksdb::Iterator *iter) :
-      dbiter(iter) { }
+    explicit RocksDBWholeSpaceIteratorImpl(
+      rocksdb::Iterator *iter,
+      std::unique_ptr<iterate_bounds_t> b = nullptr) :
+      dbiter(iter), bounds(std::move(b)) { }
     //virtual ~RocksDBWholeSpaceIteratorImpl() { }
     ~RocksDBWholeSpaceIteratorImpl() override;
 
@@ -391,11 +518,16 @@ public:
     bufferlist value() override;
     bufferptr value_as_ptr() override;
     int status() override;
+    size_t next_batch(const string &prefix, const string &end,
+		      size_t max_entries, size_t max_bytes,
+		      IteratorBatch *batch) override;
     size_t key_size() override;
     size_t value_size() override;
   };
 
   Iterator get_iterator(const std::string& prefix) override;
+  Iterator get_iterator(const std::string& prefix,
+			IteratorBounds bounds) override;
 
   /// Utility
   static string combine_strings(const string &prefix, const string &value) {
@@ -1180,7 +1180,13 @@ void PGMap::apply_incremental(CephContext *cct, const Incremental& inc)
       if (pool_statfs_iter == pool_statfs.end()) {
         pool_statfs.emplace(std::make_pair(update_pool, update_osd), statfs_inc);
       } else {
-        pool_sum_ref.sub(pool_statfs_iter->second);
+        // an osd restart starts the io_* counters over; the pool sum
+        // keeps what they had counted, so that it never goes back
+        store_statfs_t prev = pool_statfs_iter->second;
+        if (statfs_inc.io_restarted_since(prev)) {
+          prev.clear_io();
+        }
+        pool_sum_ref.sub(prev);
         pool_statfs_iter->second = statfs_inc;
       }
       pool_sum_ref.add(statfs_inc);
@@ -1228,7 +1234,10 @@ void PGMap::apply_incremental(CephContext *cct, const Incremental& inc)
     }
     for (auto i = pool_statfs.begin();  i != pool_statfs.end(); ++i) {
       if (i->first.second == *p) {
-	pg_pool_sum[i->first.first].sub(i->second);
+	// as above, the io_* counted so far stay in the pool sum
+	store_statfs_t prev = i->second;
+	prev.clear_io();
+	pg_pool_sum[i->first.first].sub(prev);
 	pool_statfs.erase(i);
       }
     }
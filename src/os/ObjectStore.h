@@ -468,6 +468,26 @@ public:
      ceph::buffer::list& bl,
      uint32_t op_flags = 0) = 0;
 
+  /**
+   * is_cached -- check whether a read can be served without device io
+   *
+   * A hint only: the answer may be stale by the time the read is
+   * issued.  Must not block, so stores that cannot tell say false.
+   *
+   * @param cid collection for object
+   * @param oid oid of object
+   * @param offset location offset of first byte to be read
+   * @param len number of bytes to be read (0 means to the end of the object)
+   * @returns true if the object and the range are in the store's cache
+   */
+  virtual bool is_cached(
+    CollectionHandle &c,
+    const ghobject_t& oid,
+    uint64_t offset,
+    size_t len) {
+    return false;
+  }
+
   /**
    * fiemap -- get extent std::map of data of an object
    *
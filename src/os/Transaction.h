@@ -787,6 +787,21 @@ private:
   }
 
 public:
+  /**
+   * reserve
+   *
+   * Preallocate room for num_ops ops, and for data_bytes of the small
+   * arguments they encode (names, keys, offsets, lengths), so that a
+   * transaction of known shape is built into one buffer of each kind
+   * rather than a chain of OPS_PER_PTR and append sized chunks.  Write
+   * payloads, attr values and omap values are shared by reference.
+   * encode() shares these buffers by reference as well.
+   */
+  void reserve(uint32_t num_ops, uint32_t data_bytes) {
+    op_bl.reserve(sizeof(Op) * num_ops);
+    data_bl.reserve(data_bytes);
+  }
+
   /// noop. 'nuf said
   void nop() {
     Op* _op = _get_next_op();
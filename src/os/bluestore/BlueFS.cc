@@ -233,6 +233,28 @@ void BlueFS::_init_logger()
 		    "Bytes requested in prefetch read mode", NULL,
 		    PerfCountersBuilder::PRIO_USEFUL, unit_t(UNIT_BYTES));
 
+  // Lock hold axis configuration, values are in nanoseconds
+  PerfHistogramCommon::axis_config_d lock_hist_x_axis_config{
+    "Lock hold time (usec)",
+    PerfHistogramCommon::SCALE_LOG2, ///< Hold time in logarithmic scale
+    0,                               ///< Start at 0
+    1000,                            ///< Quantization unit is 1usec
+    32,                              ///< Enough to cover stalls of seconds
+  };
+  // Compacted log size axis configuration, values are in bytes
+  PerfHistogramCommon::axis_config_d lock_hist_y_axis_config{
+    "Compacted log size (bytes)",
+    PerfHistogramCommon::SCALE_LOG2, ///< Size in logarithmic scale
+    0,                               ///< Start at 0
+    4096,                            ///< Quantization unit is 4KB
+    24,                              ///< Enough to cover tens of GB
+  };
+  b.add_u64_counter_histogram(
+    l_bluefs_log_compaction_lock_lat, "log_compaction_lock_lat",
+    lock_hist_x_axis_config, lock_hist_y_axis_config,
+    "Histogram of time async log compaction holds the BlueFS lock "
+    "(nanoseconds) vs. compacted log size");
+
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -755,10 +777,8 @@ int BlueFS::fsck()
   return 0;
 }
 
-int BlueFS::_write_super(int dev)
+void BlueFS::_encode_super(bufferlist& bl)
 {
-  // build superblock
-  bufferlist bl;
   encode(super, bl);
   uint32_t crc = bl.crc32c(-1);
   encode(crc, bl);
@@ -767,12 +787,18 @@ int BlueFS::_write_super(int dev)
   dout(10) << __func__ << " log_fnode " << super.log_fnode << dendl;
   ceph_assert_always(bl.length() <= get_super_length());
   bl.append_zero(get_super_length() - bl.length());
-
-  bdev[dev]->write(get_super_offset(), bl, false, WRITE_LIFE_SHORT);
   dout(20) << __func__ << " v " << super.version
            << " crc 0x" << std::hex << crc
            << " offset 0x" << get_super_offset() << std::dec
            << dendl;
+}
+
+int BlueFS::_write_super(int dev)
+{
+  // build superblock
+  bufferlist bl;
+  _encode_super(bl);
+  bdev[dev]->write(get_super_offset(), bl, false, WRITE_LIFE_SHORT);
   return 0;
 }
 
@@ -2082,6 +2108,10 @@ uint64_t BlueFS::_estimate_log_size()
 void BlueFS::compact_log()
 {
   std::unique_lock l(lock);
+  while (new_log) {
+    // an async compaction is already in flight
+    log_cond.wait(l);
+  }
   if (cct->_conf->bluefs_compact_log_sync) {
      _compact_log_sync();
   } else {
@@ -2300,30 +2330,37 @@ void BlueFS::_rewrite_log_and_layout_sync(bool allocate_with_fallback,
  * 2. While still holding the lock, encode a bufferlist that dumps all of the
  * in-memory fnodes and names.  This will become the new beginning of the
  * log.  The last event will jump to the log continuation extent from #1.
+ * Allocate the extents for the new beginning.
  *
- * 3. Queue a write to a new extent for the new beginnging of the log.
+ * 3. Drop the lock, write the new beginning of the log and wait for it to
+ * be stable.  Nobody else touches the new extents, so foreground log
+ * flushes (e.g. RocksDB WAL fsyncs) proceed meanwhile; only those that
+ * need more log runway wait for us.
  *
- * 4. Drop lock and wait
+ * 4. Retake the lock, update the log_fnode to splice in the new beginning
+ * and encode the new superblock.
  *
- * 5. Retake the lock.
+ * 5. Drop the lock and write the superblock.
  *
- * 6. Update the log_fnode to splice in the new beginning.
+ * 6. Retake the lock, release the old log space.  Clean up.
  *
- * 7. Write the new superblock.
- *
- * 8. Release the old log space.  Clean up.
+ * The time spent holding the lock in #1, #2, #4 and #6 is recorded in the
+ * log_compaction_lock_lat histogram.
  */
 void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
 {
   dout(10) << __func__ << dendl;
   File *log_file = log_writer->file.get();
   ceph_assert(!new_log);
-  ceph_assert(!new_log_writer);
 
-  // create a new log [writer] so that we know compaction is in progress
+  // create a new log so that we know compaction is in progress
   // (see _should_compact_log)
   new_log = ceph::make_ref<File>();
-  new_log->fnode.ino = 0;   // so that _flush_range won't try to log the fnode
+  new_log->fnode.ino = 0;
+
+  lock.unlock();
+  flush_bdev();  // FIXME?
+  lock.lock();
 
   // 0. wait for any racing flushes to complete.  (We do not want to block
   // in _flush_sync_log with jump_to set or else a racing thread might flush
@@ -2333,6 +2370,7 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
     log_cond.wait(l);
   }
 
+  auto locked = mono_clock::now();
   vselector->sub_usage(log_file->vselector_hint, log_file->fnode);
 
   // 1. allocate new log space and jump to it.
@@ -2352,11 +2390,11 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
   log_t.op_file_update(log_file->fnode);
   log_t.op_jump(log_seq, old_log_jump_to);
 
-  flush_bdev();  // FIXME?
-
   _flush_and_sync_log(l, 0, old_log_jump_to);
+  _note_compaction_lock_hold(locked, 0);
 
   // 2. prepare compacted log
+  locked = mono_clock::now();
   bluefs_transaction_t t;
   //avoid record two times in log_t and _compact_log_dump_metadata.
   log_t.clear();
@@ -2380,26 +2418,42 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
   // we might have some more ops in log_t due to _allocate call
   t.claim_ops(log_t);
 
-  bufferlist bl;
-  encode(t, bl);
-  _pad_bl(bl);
-
   dout(10) << __func__ << " new_log_jump_to 0x" << std::hex << new_log_jump_to
 	   << std::dec << dendl;
+  const uint64_t dump_len = t.op_bl.length();
+  _note_compaction_lock_hold(locked, dump_len);
 
-  new_log_writer = _create_writer(new_log);
-  new_log_writer->append(bl);
-
-  // 3. flush
-  r = _flush(new_log_writer, true);
-  ceph_assert(r == 0);
+  // 3. write the new beginning of the log.  the extents are ours alone
+  // until the switchover below, so this does not need the lock.
+  lock.unlock();
+  bufferlist bl;
+  encode(t, bl);
+  _pad_bl(bl);
+  ceph_assert(bl.length() <= new_log_jump_to);
+  uint64_t pos = 0;
+  for (auto& e : new_log->fnode.extents) {
+    if (pos >= bl.length()) {
+      break;
+    }
+    uint64_t len = std::min<uint64_t>(e.length, bl.length() - pos);
+    bufferlist chunk;
+    chunk.substr_of(bl, pos, len);
+    r = bdev[e.bdev]->write(e.offset, chunk, false, WRITE_LIFE_SHORT);
+    ceph_assert(r == 0);
+    pos += len;
+  }
+  flush_bdev();
+  lock.lock();
 
-  // 4. wait
-  _flush_bdev_safely(new_log_writer);
+  // 4. update our log fnode
+  // the log must not move under us while we splice it
+  while (log_flushing) {
+    dout(10) << __func__ << " log is currently flushing, waiting" << dendl;
+    log_cond.wait(l);
+  }
+  locked = mono_clock::now();
 
-  // 5. update our log fnode
   // discard first old_log_jump_to extents
-
   dout(10) << __func__ << " remove 0x" << std::hex << old_log_jump_to << std::dec
 	   << " of " << log_file->fnode.extents << dendl;
   uint64_t discarded = 0;
@@ -2442,35 +2496,40 @@ void BlueFS::_compact_log_async(std::unique_lock<ceph::mutex>& l)
 
   vselector->add_usage(log_file->vselector_hint, log_file->fnode);
 
-  // 6. write the super block to reflect the changes
+  // 5. write the super block to reflect the changes
   dout(10) << __func__ << " writing super" << dendl;
   super.log_fnode = log_file->fnode;
   ++super.version;
-  _write_super(BDEV_DB);
+  bufferlist super_bl;
+  _encode_super(super_bl);
+  _note_compaction_lock_hold(locked, dump_len);
 
   lock.unlock();
+  bdev[BDEV_DB]->write(get_super_offset(), super_bl, false, WRITE_LIFE_SHORT);
   flush_bdev();
   lock.lock();
 
-  // 7. release old space
+  // 6. release old space
+  locked = mono_clock::now();
   dout(10) << __func__ << " release old log extents " << old_extents << dendl;
   for (auto& r : old_extents) {
     pending_release[r.bdev].insert(r.offset, r.length);
   }
 
-  // delete the new log, remove from the dirty files list
-  _close_writer(new_log_writer);
-  if (new_log->dirty_seq) {
-    ceph_assert(dirty_files.count(new_log->dirty_seq));
-    auto it = dirty_files[new_log->dirty_seq].iterator_to(*new_log);
-    dirty_files[new_log->dirty_seq].erase(it);
-  }
-  new_log_writer = nullptr;
   new_log = nullptr;
   log_cond.notify_all();
 
   dout(10) << __func__ << " log extents " << log_file->fnode.extents << dendl;
   logger->inc(l_bluefs_log_compactions);
+  _note_compaction_lock_hold(locked, dump_len);
+}
+
+void BlueFS::_note_compaction_lock_hold(mono_time locked, uint64_t dump_len)
+{
+  auto held = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    mono_clock::now() - locked).count();
+  dout(20) << __func__ << " held lock for " << held << " ns" << dendl;
+  logger->hinc(l_bluefs_log_compaction_lock_lat, held, dump_len);
 }
 
 void BlueFS::_pad_bl(bufferlist& bl)
@@ -2533,7 +2592,7 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<ceph::mutex>& l,
   if (runway < (int64_t)cct->_conf->bluefs_min_log_runway) {
     dout(10) << __func__ << " allocating more log runway (0x"
 	     << std::hex << runway << std::dec  << " remaining)" << dendl;
-    while (new_log_writer) {
+    while (new_log) {
       dout(10) << __func__ << " waiting for async compaction" << dendl;
       log_cond.wait(l);
     }
@@ -2633,7 +2692,8 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<ceph::mutex>& l,
   return 0;
 }
 
-int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
+int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length,
+			 std::unique_lock<ceph::mutex> *l)
 {
   dout(10) << __func__ << " " << h << " pos 0x" << std::hex << h->pos
 	   << " 0x" << offset << "~" << length << std::dec
@@ -2746,12 +2806,6 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
     x_off -= partial;
     offset -= partial;
     length += partial;
-    dout(20) << __func__ << " waiting for previous aio to complete" << dendl;
-    for (auto p : h->iocv) {
-      if (p) {
-	p->aio_wait();
-      }
-    }
   }
   if (length == partial + h->buffer.length() || clear_upto != 0) {
     /* in case of inital allocation and need to zero, limited flush is unacceptable */
@@ -2805,20 +2859,21 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
   bl.hexdump(*_dout);
   *_dout << dendl;
 
+  // map the buffer onto the device while fnode.extents is stable
+  struct chunk_t {
+    unsigned bdev;
+    uint64_t offset;
+    bufferlist bl;
+  };
+  std::vector<chunk_t> chunks;
   uint64_t bloff = 0;
   uint64_t bytes_written_slow = 0;
   while (length > 0) {
     uint64_t x_len = std::min(p->length - x_off, length);
-    bufferlist t;
-    t.substr_of(bl, bloff, x_len);
-    if (cct->_conf->bluefs_sync_write) {
-      bdev[p->bdev]->write(p->offset + x_off, t, buffered, h->write_hint);
-    } else {
-      bdev[p->bdev]->aio_write(p->offset + x_off, t, h->iocv[p->bdev], buffered, h->write_hint);
-    }
-    h->dirty_devs[p->bdev] = true;
+    chunks.push_back(chunk_t{p->bdev, p->offset + x_off, bufferlist()});
+    chunks.back().bl.substr_of(bl, bloff, x_len);
     if (p->bdev == BDEV_SLOW) {
-      bytes_written_slow += t.length();
+      bytes_written_slow += x_len;
     }
 
     bloff += x_len;
@@ -2827,6 +2882,33 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
     x_off = 0;
   }
   logger->inc(l_bluefs_bytes_written_slow, bytes_written_slow);
+  vselector->add_usage(h->file->vselector_hint, h->file->fnode);
+
+  // The metadata is updated; what is left only touches h (serialized by
+  // h->lock) and extents owned by h->file, so regular files do their IO
+  // without the global lock.  The log files (ino 0/1) are written by
+  // whoever holds it and keep it.
+  bool unlocked = false;
+  if (l && h->file->fnode.ino > 1) {
+    l->unlock();
+    unlocked = true;
+  }
+  if (partial) {
+    dout(20) << __func__ << " waiting for previous aio to complete" << dendl;
+    for (auto p : h->iocv) {
+      if (p) {
+	p->aio_wait();
+      }
+    }
+  }
+  for (auto& c : chunks) {
+    if (cct->_conf->bluefs_sync_write) {
+      bdev[c.bdev]->write(c.offset, c.bl, buffered, h->write_hint);
+    } else {
+      bdev[c.bdev]->aio_write(c.offset, c.bl, h->iocv[c.bdev], buffered, h->write_hint);
+    }
+    h->dirty_devs[c.bdev] = true;
+  }
   for (unsigned i = 0; i < MAX_BDEV; ++i) {
     if (bdev[i]) {
       if (h->iocv[i] && h->iocv[i]->has_pending_aios()) {
@@ -2834,7 +2916,9 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
       }
     }
   }
-  vselector->add_usage(h->file->vselector_hint, h->file->fnode);
+  if (unlocked) {
+    l->lock();
+  }
   dout(20) << __func__ << " h " << h << " pos now 0x"
            << std::hex << h->pos << std::dec << dendl;
   return 0;
@@ -2868,7 +2952,7 @@ void BlueFS::wait_for_aio(FileWriter *h)
 }
 #endif
 
-int BlueFS::_flush(FileWriter *h, bool force)
+int BlueFS::_flush(FileWriter *h, bool force, std::unique_lock<ceph::mutex> *l)
 {
   h->buffer_appender.flush();
   uint64_t length = h->buffer.length();
@@ -2889,7 +2973,7 @@ int BlueFS::_flush(FileWriter *h, bool force)
            << std::hex << offset << "~" << length << std::dec
 	   << " to " << h->file->fnode << dendl;
   ceph_assert(h->pos <= h->file->fnode.size);
-  return _flush_range(h, offset, length);
+  return _flush_range(h, offset, length, l);
 }
 
 int BlueFS::_truncate(FileWriter *h, uint64_t offset)
@@ -2938,7 +3022,7 @@ int BlueFS::_truncate(FileWriter *h, uint64_t offset)
 int BlueFS::_fsync(FileWriter *h, std::unique_lock<ceph::mutex>& l)
 {
   dout(10) << __func__ << " " << h << " " << h->file->fnode << dendl;
-  int r = _flush(h, true);
+  int r = _flush(h, true, &l);
   if (r < 0)
      return r;
   uint64_t old_dirty_seq = h->file->dirty_seq;
@@ -52,6 +52,7 @@ enum {
   l_bluefs_read_bytes,
   l_bluefs_read_prefetch_count,
   l_bluefs_read_prefetch_bytes,
+  l_bluefs_log_compaction_lock_lat,
 
   l_bluefs_last,
 };
@@ -304,8 +305,7 @@ private:
 
   uint64_t new_log_jump_to = 0;
   uint64_t old_log_jump_to = 0;
-  FileRef new_log = nullptr;
-  FileWriter *new_log_writer = nullptr;
+  FileRef new_log = nullptr;   ///< set while an async compaction is running
 
   /*
    * There are up to 3 block devices:
@@ -350,8 +350,11 @@ private:
   int _allocate_without_fallback(uint8_t id, uint64_t len,
 				 PExtentVector* extents);
 
-  int _flush_range(FileWriter *h, uint64_t offset, uint64_t length);
-  int _flush(FileWriter *h, bool force);
+  /// if l is given, the global lock is dropped for the data IO of regular files
+  int _flush_range(FileWriter *h, uint64_t offset, uint64_t length,
+		   std::unique_lock<ceph::mutex> *l = nullptr);
+  int _flush(FileWriter *h, bool force,
+	     std::unique_lock<ceph::mutex> *l = nullptr);
   int _fsync(FileWriter *h, std::unique_lock<ceph::mutex>& l);
 
 #ifdef HAVE_LIBAIO
@@ -375,6 +378,7 @@ private:
 				  int flags);
   void _compact_log_sync();
   void _compact_log_async(std::unique_lock<ceph::mutex>& l);
+  void _note_compaction_lock_hold(mono_time locked, uint64_t dump_len);
 
   void _rewrite_log_and_layout_sync(bool allocate_with_fallback,
 				    int super_dev,
@@ -408,6 +412,7 @@ private:
   void _invalidate_cache(FileRef f, uint64_t offset, uint64_t length);
 
   int _open_super();
+  void _encode_super(bufferlist& bl);
   int _write_super(int dev);
   int _check_new_allocations(const bluefs_fnode_t& fnode,
     size_t dev_count,
@@ -549,15 +554,22 @@ public:
   // handler for discard event
   void handle_discard(unsigned dev, interval_set<uint64_t>& to_release);
 
+  // Writers are serialized by h->lock, taken before the global lock.  The
+  // global lock covers the namespace, the allocators and the log; it is
+  // dropped while file data is written so that independent files (e.g.
+  // the WAL and SSTs being flushed or compacted) write in parallel.
   void flush(FileWriter *h) {
-    std::lock_guard l(lock);
-    _flush(h, false);
+    std::lock_guard hl(h->lock);
+    std::unique_lock l(lock);
+    _flush(h, false, &l);
   }
   void flush_range(FileWriter *h, uint64_t offset, uint64_t length) {
-    std::lock_guard l(lock);
-    _flush_range(h, offset, length);
+    std::lock_guard hl(h->lock);
+    std::unique_lock l(lock);
+    _flush_range(h, offset, length, &l);
   }
   int fsync(FileWriter *h) {
+    std::lock_guard hl(h->lock);
     std::unique_lock l(lock);
     return _fsync(h, l);
   }
@@ -584,6 +596,7 @@ public:
     return _preallocate(f, offset, len);
   }
   int truncate(FileWriter *h, uint64_t offset) {
+    std::lock_guard hl(h->lock);
     std::lock_guard l(lock);
     return _truncate(h, offset);
   }
@@ -91,9 +91,16 @@ const string PREFIX_DEFERRED = "L";    // id -> deferred_transaction_t
 const string PREFIX_ALLOC = "B";       // u64 offset -> u64 length (freelist)
 const string PREFIX_ALLOC_BITMAP = "b";// (see BitmapFreelistManager)
 const string PREFIX_SHARED_BLOB = "X"; // u64 offset -> shared_blob_t
+const string PREFIX_TIER = "t";        // onode key -> nothing (on data tier)
+const string PREFIX_TIER_ALLOC = "U";  // (data tier freelist, see _open_tier)
 
 const string BLUESTORE_GLOBAL_STATFS_KEY = "bluestore_statfs";
 
+// allocator snapshot, see _write_alloc_snapshot()
+const string ALLOC_SNAPSHOT_DIR = "alloc";
+const string ALLOC_SNAPSHOT_FILE = "snapshot";
+const string ALLOC_SNAPSHOT_SEQ_KEY = "alloc_snapshot_seq";
+
 // write a label in the first block.  always use this size.  note that
 // bluefs makes a matching assumption about the location of its
 // superblock (always the second block of the device).
@@ -947,6 +954,280 @@ struct LruOnodeCacheShard : public BlueStore::OnodeCacheShard {
   }
 };
 
+// FrequencySketch
+
+/*
+ * Count-min sketch of 4-bit access counters, as used by W-TinyLFU to
+ * estimate how popular a key has been recently, whether or not it is
+ * still cached.  Every counter is halved once 10x the expected number
+ * of entries have been sampled, so that stale popularity fades away.
+ */
+struct FrequencySketch {
+  static constexpr unsigned DEPTH = 4;
+  std::vector<uint64_t> table;  ///< DEPTH rows of width counters, 16 per word
+  uint64_t width = 0;           ///< counters per row, power of 2
+  uint64_t samples = 0;
+  uint64_t sample_size = 0;
+
+  /// size for about entries distinct keys; clears history if width changes
+  void resize(uint64_t entries) {
+    // 16 counters (8 bytes) per entry keeps collisions rare enough
+    uint64_t w = 64;
+    while (w < entries * 4) {
+      w <<= 1;
+    }
+    sample_size = std::max<uint64_t>(entries, 1) * 10;
+    if (w == width) {
+      return;
+    }
+    width = w;
+    table.assign(DEPTH * width / 16, 0);
+    samples = 0;
+  }
+
+  uint64_t _index(uint64_t h, unsigned row) const {
+    static const uint64_t seeds[DEPTH] = {
+      0xc3a5c85c97cb3127ull, 0xb492b66fbe98f273ull,
+      0x9ae16a3b2f90404full, 0xcbf29ce484222325ull };
+    uint64_t x = (h + seeds[row]) * 0x9e3779b97f4a7c15ull;
+    x ^= x >> 29;
+    return row * width + (x & (width - 1));
+  }
+  unsigned _get(uint64_t i) const {
+    return (table[i / 16] >> ((i % 16) * 4)) & 0xf;
+  }
+
+  unsigned estimate(uint64_t h) const {
+    if (!width) {
+      return 0;
+    }
+    unsigned r = 15;
+    for (unsigned row = 0; row < DEPTH; ++row) {
+      r = std::min(r, _get(_index(h, row)));
+    }
+    return r;
+  }
+
+  void increment(uint64_t h) {
+    if (!width) {
+      return;
+    }
+    // conservative update: only bump the counters holding the minimum
+    unsigned min = estimate(h);
+    if (min == 15) {
+      return;
+    }
+    for (unsigned row = 0; row < DEPTH; ++row) {
+      uint64_t i = _index(h, row);
+      if (_get(i) == min) {
+	table[i / 16] += 1ull << ((i % 16) * 4);
+      }
+    }
+    if (++samples >= sample_size) {
+      for (auto& w : table) {
+	w = (w >> 1) & 0x7777777777777777ull;
+      }
+      samples /= 2;
+    }
+  }
+};
+
+// TinyLfuOnodeCacheShard
+
+/*
+ * W-TinyLFU: new entries land in a small LRU window; entries falling
+ * off the window have to beat the LRU victim of the main segmented LRU
+ * (probation + protected) on sketch frequency to be admitted.  A scan
+ * touches each object once and so cannot push out the hot working set.
+ */
+struct TinyLfuOnodeCacheShard : public BlueStore::OnodeCacheShard {
+  typedef boost::intrusive::list<
+    BlueStore::Onode,
+    boost::intrusive::member_hook<
+      BlueStore::Onode,
+      boost::intrusive::list_member_hook<>,
+      &BlueStore::Onode::lru_item> > list_t;
+  typedef boost::intrusive::list<
+    BlueStore::Onode,
+    boost::intrusive::member_hook<
+      BlueStore::Onode,
+      boost::intrusive::list_member_hook<>,
+      &BlueStore::Onode::pin_item> > pin_list_t;
+
+  enum {
+    ONODE_NEW = 0,
+    ONODE_WINDOW,
+    ONODE_PROBATION,
+    ONODE_PROTECTED,
+  };
+
+  list_t window, probation, protected_lru;
+  pin_list_t pin_list;
+  FrequencySketch sketch;
+  double window_ratio;
+  double protected_ratio;
+
+  explicit TinyLfuOnodeCacheShard(CephContext *cct)
+    : BlueStore::OnodeCacheShard(cct),
+      window_ratio(cct->_conf.get_val<double>("bluestore_tinylfu_window_ratio")),
+      protected_ratio(cct->_conf.get_val<double>("bluestore_tinylfu_protected_ratio")) {}
+
+  static uint64_t _key(const BlueStore::Onode& o) {
+    return std::hash<ghobject_t>()(o.oid);
+  }
+  list_t& _list(const BlueStore::Onode& o) {
+    switch (o.cache_private) {
+    case ONODE_WINDOW:
+      return window;
+    case ONODE_PROBATION:
+      return probation;
+    case ONODE_PROTECTED:
+      return protected_lru;
+    default:
+      ceph_abort_msg("bad cache_private");
+    }
+  }
+  void _update_num() {
+    num = window.size() + probation.size() + protected_lru.size();
+    num_pinned = pin_list.size();
+  }
+
+  void _add(BlueStore::OnodeRef& o, int level) override
+  {
+    ceph_assert(o->s == nullptr);
+    o->s = this;
+    uint64_t h = _key(*o);
+    if (sketch.estimate(h) && logger) {
+      logger->inc(l_bluestore_onode_ghost_hits);
+    }
+    sketch.increment(h);
+    o->cache_private = ONODE_WINDOW;
+    if (o->nref > 1) {
+      pin_list.push_front(*o);
+      o->pinned = true;
+    } else {
+      (level > 0) ? window.push_front(*o) : window.push_back(*o);
+    }
+    _update_num();
+  }
+  void _rm(BlueStore::OnodeRef& o) override
+  {
+    o->s = nullptr;
+    if (o->pinned) {
+      o->pinned = false;
+      pin_list.erase(pin_list.iterator_to(*o));
+    } else {
+      _list(*o).erase(_list(*o).iterator_to(*o));
+    }
+    o->cache_private = ONODE_NEW;
+    _update_num();
+  }
+  void _touch(BlueStore::OnodeRef& o) override
+  {
+    sketch.increment(_key(*o));
+    if (o->pinned) {
+      // promote once it is unpinned
+      if (o->cache_private == ONODE_PROBATION) {
+	o->cache_private = ONODE_PROTECTED;
+      }
+      return;
+    }
+    _list(*o).erase(_list(*o).iterator_to(*o));
+    if (o->cache_private == ONODE_PROBATION) {
+      o->cache_private = ONODE_PROTECTED;
+    }
+    _list(*o).push_front(*o);
+  }
+  void _pin(BlueStore::Onode& o) override
+  {
+    if (o.pinned == true) {
+      return;
+    }
+    _list(o).erase(_list(o).iterator_to(o));
+    pin_list.push_front(o);
+    o.pinned = true;
+    _update_num();
+    dout(30) << __func__ << " " << o.oid << " pinned" << dendl;
+  }
+  void _unpin(BlueStore::Onode& o) override
+  {
+    if (o.pinned == false) {
+      return;
+    }
+    pin_list.erase(pin_list.iterator_to(o));
+    _list(o).push_front(o);
+    o.pinned = false;
+    _update_num();
+    dout(30) << __func__ << " " << o.oid << " unpinned" << dendl;
+  }
+
+  void _evict(BlueStore::Onode *o)
+  {
+    dout(30) << __func__ << "  rm " << o->oid << dendl;
+    _list(*o).erase(_list(*o).iterator_to(*o));
+    o->cache_private = ONODE_NEW;
+    o->s = nullptr;
+    o->get();  // paranoia
+    o->c->onode_map.remove(o->oid);
+    o->put();
+  }
+  void _trim_to(uint64_t new_size) override
+  {
+    if (new_size) {
+      sketch.resize(new_size);
+    }
+    uint64_t window_max = std::max<uint64_t>(new_size * window_ratio,
+					     new_size ? 1 : 0);
+    uint64_t protected_max = (new_size - window_max) * protected_ratio;
+    while (protected_lru.size() > protected_max) {
+      BlueStore::Onode *o = &protected_lru.back();
+      protected_lru.pop_back();
+      o->cache_private = ONODE_PROBATION;
+      probation.push_front(*o);
+    }
+    while (window.size() > window_max) {
+      BlueStore::Onode *candidate = &window.back();
+      window.pop_back();
+      candidate->cache_private = ONODE_PROBATION;
+      probation.push_front(*candidate);
+      if (window.size() + probation.size() + protected_lru.size() <=
+	  new_size) {
+	continue;
+      }
+      // main is full; admit the candidate only if it is more popular
+      // than whatever it would displace
+      BlueStore::Onode *victim = nullptr;
+      if (&probation.back() != candidate) {
+	victim = &probation.back();
+      } else if (!protected_lru.empty()) {
+	victim = &protected_lru.back();
+      }
+      if (victim &&
+	  sketch.estimate(_key(*candidate)) > sketch.estimate(_key(*victim))) {
+	_evict(victim);
+      } else {
+	_evict(candidate);
+      }
+    }
+    while (window.size() + probation.size() + protected_lru.size() >
+	   new_size) {
+      if (!probation.empty()) {
+	_evict(&probation.back());
+      } else if (!protected_lru.empty()) {
+	_evict(&protected_lru.back());
+      } else {
+	_evict(&window.back());
+      }
+    }
+    _update_num();
+  }
+  void add_stats(uint64_t *onodes, uint64_t *pinned_onodes) override
+  {
+    *onodes += num + num_pinned;
+    *pinned_onodes += num_pinned;
+  }
+};
+
 // OnodeCacheShard
 BlueStore::OnodeCacheShard *BlueStore::OnodeCacheShard::create(
     CephContext* cct,
@@ -954,8 +1235,11 @@ BlueStore::OnodeCacheShard *BlueStore::OnodeCacheShard::create(
     PerfCounters *logger)
 {
   BlueStore::OnodeCacheShard *c = nullptr;
-  // Currently we only implement an LRU cache for onodes
-  c = new LruOnodeCacheShard(cct);
+  // 2q is only implemented for buffers; onodes use an LRU in that case
+  if (type == "tinylfu")
+    c = new TinyLfuOnodeCacheShard(cct);
+  else
+    c = new LruOnodeCacheShard(cct);
   c->logger = logger;
   return c;
 }
@@ -1371,6 +1655,227 @@ public:
 #endif
 };
 
+// TinyLfuBufferCacheShard
+
+/*
+ * W-TinyLFU over buffers, see TinyLfuOnodeCacheShard.  Segments are
+ * sized in bytes; a buffer is keyed by the BufferSpace it belongs to
+ * and its offset within the blob.
+ */
+struct TinyLfuBufferCacheShard : public BlueStore::BufferCacheShard {
+  typedef boost::intrusive::list<
+    BlueStore::Buffer,
+    boost::intrusive::member_hook<
+      BlueStore::Buffer,
+      boost::intrusive::list_member_hook<>,
+      &BlueStore::Buffer::lru_item> > list_t;
+
+  enum {
+    BUFFER_NEW = 0,
+    BUFFER_WINDOW,
+    BUFFER_PROBATION,
+    BUFFER_PROTECTED,
+    BUFFER_TYPE_MAX
+  };
+
+  list_t lists[BUFFER_TYPE_MAX];               ///< BUFFER_NEW is unused
+  uint64_t list_bytes[BUFFER_TYPE_MAX] = {0};  ///< bytes per type
+  FrequencySketch sketch;
+  double window_ratio;
+  double protected_ratio;
+
+public:
+  explicit TinyLfuBufferCacheShard(CephContext *cct)
+    : BufferCacheShard(cct),
+      window_ratio(cct->_conf.get_val<double>("bluestore_tinylfu_window_ratio")),
+      protected_ratio(cct->_conf.get_val<double>("bluestore_tinylfu_protected_ratio")) {}
+
+  static uint64_t _key(const BlueStore::Buffer *b) {
+    return std::hash<uint64_t>()(
+      reinterpret_cast<uintptr_t>(b->space) ^ ((uint64_t)b->offset << 32));
+  }
+  void _update_num() {
+    num = lists[BUFFER_WINDOW].size() + lists[BUFFER_PROBATION].size() +
+      lists[BUFFER_PROTECTED].size();
+  }
+  void _link(BlueStore::Buffer *b, bool front) {
+    auto& l = lists[b->cache_private];
+    front ? l.push_front(*b) : l.push_back(*b);
+    buffer_bytes += b->length;
+    list_bytes[b->cache_private] += b->length;
+  }
+  void _unlink(BlueStore::Buffer *b) {
+    ceph_assert(buffer_bytes >= b->length);
+    buffer_bytes -= b->length;
+    ceph_assert(list_bytes[b->cache_private] >= b->length);
+    list_bytes[b->cache_private] -= b->length;
+    auto& l = lists[b->cache_private];
+    l.erase(l.iterator_to(*b));
+  }
+
+  void _add(BlueStore::Buffer *b, int level, BlueStore::Buffer *near) override
+  {
+    dout(20) << __func__ << " level " << level << " near " << near
+             << " on " << *b
+             << " which has cache_private " << b->cache_private << dendl;
+    if (near) {
+      b->cache_private = near->cache_private;
+      auto& l = lists[b->cache_private];
+      l.insert(l.iterator_to(*near), *b);
+      buffer_bytes += b->length;
+      list_bytes[b->cache_private] += b->length;
+    } else if (b->cache_private == BUFFER_NEW) {
+      uint64_t h = _key(b);
+      if (sketch.estimate(h) && logger) {
+	logger->inc(l_bluestore_buffer_ghost_hits);
+      }
+      sketch.increment(h);
+      b->cache_private = BUFFER_WINDOW;
+      _link(b, level > 0);
+    } else {
+      // we got a hint from discard: this replaces cached data, keep
+      // it in the same segment
+      ceph_assert(b->cache_private < BUFFER_TYPE_MAX);
+      _link(b, true);
+    }
+    _update_num();
+  }
+
+  void _rm(BlueStore::Buffer *b) override
+  {
+    dout(20) << __func__ << " " << *b << dendl;
+    _unlink(b);
+    _update_num();
+  }
+
+  void _move(BlueStore::BufferCacheShard *srcc, BlueStore::Buffer *b) override
+  {
+    TinyLfuBufferCacheShard *src = static_cast<TinyLfuBufferCacheShard*>(srcc);
+    src->_rm(b);
+    // preserve which list we're on (even if we can't preserve the order!)
+    _link(b, false);
+    _update_num();
+  }
+
+  void _adjust_size(BlueStore::Buffer *b, int64_t delta) override
+  {
+    dout(20) << __func__ << " delta " << delta << " on " << *b << dendl;
+    ceph_assert((int64_t)buffer_bytes + delta >= 0);
+    buffer_bytes += delta;
+    ceph_assert((int64_t)list_bytes[b->cache_private] + delta >= 0);
+    list_bytes[b->cache_private] += delta;
+  }
+
+  void _touch(BlueStore::Buffer *b) override {
+    sketch.increment(_key(b));
+    _unlink(b);
+    if (b->cache_private == BUFFER_PROBATION) {
+      b->cache_private = BUFFER_PROTECTED;
+    }
+    _link(b, true);
+    _audit("_touch_buffer end");
+  }
+
+  void _evict(BlueStore::Buffer *b) {
+    ceph_assert(b->is_clean());
+    dout(20) << __func__ << " rm " << *b << dendl;
+    b->space->_rm_buffer(this, b);
+  }
+
+  void _trim_to(uint64_t max) override
+  {
+    auto& window = lists[BUFFER_WINDOW];
+    auto& probation = lists[BUFFER_PROBATION];
+    auto& protected_lru = lists[BUFFER_PROTECTED];
+    if (max) {
+      uint64_t n = lists[BUFFER_WINDOW].size() + lists[BUFFER_PROBATION].size() +
+	lists[BUFFER_PROTECTED].size();
+      uint64_t avg_size = n ? std::max<uint64_t>(buffer_bytes / n, 1) : 4096;
+      sketch.resize(max / avg_size);
+    }
+    uint64_t window_max = max * window_ratio;
+    uint64_t protected_max = (max - window_max) * protected_ratio;
+    while (list_bytes[BUFFER_PROTECTED] > protected_max) {
+      BlueStore::Buffer *b = &protected_lru.back();
+      _unlink(b);
+      b->cache_private = BUFFER_PROBATION;
+      _link(b, true);
+    }
+    while (list_bytes[BUFFER_WINDOW] > window_max) {
+      BlueStore::Buffer *candidate = &window.back();
+      _unlink(candidate);
+      candidate->cache_private = BUFFER_PROBATION;
+      _link(candidate, true);
+      if (buffer_bytes <= max) {
+	continue;
+      }
+      // main is full; admit the candidate only if it is more popular
+      // than whatever it would displace
+      BlueStore::Buffer *victim = nullptr;
+      if (&probation.back() != candidate) {
+	victim = &probation.back();
+      } else if (!protected_lru.empty()) {
+	victim = &protected_lru.back();
+      }
+      if (victim &&
+	  sketch.estimate(_key(candidate)) > sketch.estimate(_key(victim))) {
+	_evict(victim);
+      } else {
+	_evict(candidate);
+      }
+    }
+    while (buffer_bytes > max) {
+      if (!probation.empty()) {
+	_evict(&probation.back());
+      } else if (!protected_lru.empty()) {
+	_evict(&protected_lru.back());
+      } else if (!window.empty()) {
+	_evict(&window.back());
+      } else {
+	break;
+      }
+    }
+    _update_num();
+  }
+
+  void add_stats(uint64_t *extents,
+                 uint64_t *blobs,
+                 uint64_t *buffers,
+                 uint64_t *bytes) override {
+    *extents += num_extents;
+    *blobs += num_blobs;
+    *buffers += num;
+    *bytes += buffer_bytes;
+  }
+
+#ifdef DEBUG_CACHE
+  void _audit(const char *when) override
+  {
+    dout(10) << __func__ << " " << when << " start" << dendl;
+    uint64_t s = 0;
+    for (int t = BUFFER_WINDOW; t < BUFFER_TYPE_MAX; ++t) {
+      uint64_t ls = 0;
+      for (auto& b : lists[t]) {
+	ls += b.length;
+      }
+      if (ls != list_bytes[t]) {
+	derr << __func__ << " list " << t << " bytes " << list_bytes[t]
+	     << " != actual " << ls << dendl;
+	ceph_assert(ls == list_bytes[t]);
+      }
+      s += ls;
+    }
+    if (s != buffer_bytes) {
+      derr << __func__ << " buffer_bytes " << buffer_bytes << " actual " << s
+           << dendl;
+      ceph_assert(s == buffer_bytes);
+    }
+    dout(20) << __func__ << " " << when << " buffer_bytes " << buffer_bytes
+             << " ok" << dendl;
+  }
+#endif
+};
+
 // BuferCacheShard
 
 BlueStore::BufferCacheShard *BlueStore::BufferCacheShard::create(
@@ -1383,6 +1888,8 @@ BlueStore::BufferCacheShard *BlueStore::BufferCacheShard::create(
     c = new LruBufferCacheShard(cct);
   else if (type == "2q")
     c = new TwoQBufferCacheShard(cct);
+  else if (type == "tinylfu")
+    c = new TinyLfuBufferCacheShard(cct);
   else
     ceph_abort_msg("unrecognized cache type");
   c->logger = logger;
@@ -1549,6 +2056,25 @@ void BlueStore::BufferSpace::read(
   cache->logger->inc(l_bluestore_buffer_miss_bytes, miss_bytes);
 }
 
+bool BlueStore::BufferSpace::is_cached(
+  BufferCacheShard* cache,
+  uint32_t offset,
+  uint32_t length)
+{
+  uint32_t end = offset + length;
+  std::lock_guard l(cache->lock);
+  for (auto i = _data_lower_bound(offset);
+       i != buffer_map.end() && offset < end;
+       ++i) {
+    Buffer *b = i->second.get();
+    if (b->offset > offset || !(b->is_writing() || b->is_clean())) {
+      return false;
+    }
+    offset = b->end();
+  }
+  return offset >= end;
+}
+
 void BlueStore::BufferSpace::_finish_write(BufferCacheShard* cache, uint64_t seq)
 {
   auto i = writing.begin();
@@ -3549,6 +4075,7 @@ BlueStore::Collection::Collection(BlueStore *store_, OnodeCacheShard *oc, Buffer
   : CollectionImpl(store_->cct, cid),
     store(store_),
     cache(bc),
+    pool_io(store_->_get_pool_io(cid)),
     exists(true),
     onode_map(oc),
     commit_queue(nullptr)
@@ -3826,6 +4353,7 @@ void *BlueStore::MempoolThread::entry()
   utime_t next_balance = ceph_clock_now();
   utime_t next_resize = ceph_clock_now();
   utime_t next_deferred_force_submit = ceph_clock_now();
+  utime_t next_list_cursor_expire = ceph_clock_now();
 
   bool interval_stats_trim = false;
   while (!stop) {
@@ -3872,6 +4400,14 @@ void *BlueStore::MempoolThread::entry()
       next_deferred_force_submit += max_defer_interval/3;
     }
 
+    double list_cursor_age = store->cct->_conf.get_val<double>(
+      "bluestore_collection_list_cursor_age");
+    if (list_cursor_age > 0 && next_list_cursor_expire < ceph_clock_now()) {
+      store->_expire_list_cursors(list_cursor_age);
+      next_list_cursor_expire = ceph_clock_now();
+      next_list_cursor_expire += list_cursor_age / 2;
+    }
+
     // Now Resize the shards 
     _resize_shards(interval_stats_trim);
     interval_stats_trim = false;
@@ -3936,6 +4472,9 @@ void BlueStore::MempoolThread::_resize_shards(bool interval_stats)
                    << " data_used: " << data_used << dendl;
   }
 
+  store->readahead_budget = static_cast<uint64_t>(
+    data_alloc * cct->_conf.get_val<double>("bluestore_readahead_cache_ratio"));
+
   uint64_t max_shard_onodes = static_cast<uint64_t>(
       (meta_alloc / (double) onode_shards) / meta_cache->get_bytes_per_onode());
   uint64_t max_shard_buffer = static_cast<uint64_t>(data_alloc / buffer_shards);
@@ -4127,6 +4666,29 @@ bufferlist BlueStore::OmapIteratorImpl::value()
   return it->value();
 }
 
+size_t BlueStore::OmapIteratorImpl::next_batch(
+  size_t max_entries,
+  size_t max_bytes,
+  KeyValueDB::IteratorBatch *batch)
+{
+  std::shared_lock l(c->lock);
+  auto start1 = mono_clock::now();
+  size_t n = 0;
+  if (o->onode.has_omap() && it) {
+    // head is the db key of the empty user key, so every db key of
+    // this onode is head followed by the user key
+    size_t first = batch->size();
+    n = it->next_batch_until(tail, max_entries, max_bytes, batch);
+    batch->trim_keys(first, head.size());
+  }
+  c->store->log_latency(
+    __func__,
+    l_bluestore_omap_next_batch_lat,
+    mono_clock::now() - start1,
+    c->store->cct->_conf->bluestore_log_omap_iterator_age);
+  return n;
+}
+
 
 // =====================================
 
@@ -4138,7 +4700,9 @@ static void aio_cb(void *priv, void *priv2)
 {
   BlueStore *store = static_cast<BlueStore*>(priv);
   BlueStore::AioContext *c = static_cast<BlueStore::AioContext*>(priv2);
-  c->aio_finish(store);
+  if (c->num_iocs.fetch_sub(1) == 1) {
+    c->aio_finish(store);
+  }
 }
 
 static void discard_cb(void *priv, void *priv2)
@@ -4527,6 +5091,10 @@ void BlueStore::_init_logger()
   b.add_time_avg(l_bluestore_kv_final_lat, "kv_final_lat",
 		 "Average kv_finalize thread latency",
 		 "kf_l", PerfCountersBuilder::PRIO_INTERESTING);
+  b.add_u64(l_bluestore_kv_queued, "kv_queued",
+	    "Transactions waiting for kv_sync thread");
+  b.add_u64_avg(l_bluestore_kv_batch, "kv_batch",
+		"Average transactions per kv_sync thread commit");
   b.add_time_avg(l_bluestore_state_prepare_lat, "state_prepare_lat",
     "Average prepare state latency");
   b.add_time_avg(l_bluestore_state_aio_wait_lat, "state_aio_wait_lat",
@@ -4568,7 +5136,45 @@ void BlueStore::_init_logger()
     "Average read latency");
   b.add_time_avg(l_bluestore_compress_lat, "compress_lat",
     "Average compress latency");
-  b.add_time_avg(l_bluestore_decompress_lat, "decompress_lat",
+  {
+    // compress time axis, values are in nanoseconds
+    PerfHistogramCommon::axis_config_d compress_hist_x_axis_config{
+      "Compress time (usec)",
+      PerfHistogramCommon::SCALE_LOG2, ///< Time in logarithmic scale
+      0,                               ///< Start at 0
+      1000,                            ///< Quantization unit is 1usec
+      24,                              ///< Enough to cover seconds
+    };
+    // blob size axis, values are in bytes
+    PerfHistogramCommon::axis_config_d compress_hist_y_axis_config{
+      "Blob size (bytes)",
+      PerfHistogramCommon::SCALE_LOG2, ///< Size in logarithmic scale
+      0,                               ///< Start at 0
+      4096,                            ///< Quantization unit is 4KB
+      12,                              ///< Enough to cover 4MB blobs
+    };
+    b.add_u64_counter_histogram(
+      l_bluestore_compress_snappy_lat, "compress_snappy_lat",
+      compress_hist_x_axis_config, compress_hist_y_axis_config,
+      "Histogram of snappy compress time (nanoseconds) vs. blob size");
+    b.add_u64_counter_histogram(
+      l_bluestore_compress_zlib_lat, "compress_zlib_lat",
+      compress_hist_x_axis_config, compress_hist_y_axis_config,
+      "Histogram of zlib compress time (nanoseconds) vs. blob size");
+    b.add_u64_counter_histogram(
+      l_bluestore_compress_zstd_lat, "compress_zstd_lat",
+      compress_hist_x_axis_config, compress_hist_y_axis_config,
+      "Histogram of zstd compress time (nanoseconds) vs. blob size");
+    b.add_u64_counter_histogram(
+      l_bluestore_compress_lz4_lat, "compress_lz4_lat",
+      compress_hist_x_axis_config, compress_hist_y_axis_config,
+      "Histogram of lz4 compress time (nanoseconds) vs. blob size");
+    b.add_u64_counter_histogram(
+      l_bluestore_compress_brotli_lat, "compress_brotli_lat",
+      compress_hist_x_axis_config, compress_hist_y_axis_config,
+      "Histogram of brotli compress time (nanoseconds) vs. blob size");
+  }
+  b.add_time_avg(l_bluestore_decompress_lat, "decompress_lat",
     "Average decompress latency");
   b.add_time_avg(l_bluestore_csum_lat, "csum_lat",
     "Average checksum latency");
@@ -4582,6 +5188,10 @@ void BlueStore::_init_logger()
 		    "Sum for deferred write op");
   b.add_u64_counter(l_bluestore_deferred_write_bytes, "deferred_write_bytes",
 		    "Sum for deferred write bytes", "def", 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_deferred_write_unaligned_bytes,
+		    "deferred_write_unaligned_bytes",
+		    "Sum for deferred write bytes in buffers the device has to "
+		    "realign", NULL, 0, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluestore_write_penalty_read_ops, "write_penalty_read_ops",
 		    "Sum for write penalty read ops");
   b.add_u64(l_bluestore_allocated, "bluestore_allocated",
@@ -4605,6 +5215,8 @@ void BlueStore::_init_logger()
 		    "Sum for onode-lookups hit in the cache");
   b.add_u64_counter(l_bluestore_onode_misses, "bluestore_onode_misses",
 		    "Sum for onode-lookups missed in the cache");
+  b.add_u64_counter(l_bluestore_onode_ghost_hits, "bluestore_onode_ghost_hits",
+		    "Sum for onodes loaded again after recent eviction (tinylfu)");
   b.add_u64_counter(l_bluestore_onode_shard_hits, "bluestore_onode_shard_hits",
 		    "Sum for onode-shard lookups hit in the cache");
   b.add_u64_counter(l_bluestore_onode_shard_misses,
@@ -4622,6 +5234,8 @@ void BlueStore::_init_logger()
 	    "Sum for bytes of read hit in the cache", NULL, 0, unit_t(UNIT_BYTES));
   b.add_u64_counter(l_bluestore_buffer_miss_bytes, "bluestore_buffer_miss_bytes",
 	    "Sum for bytes of read missed in the cache", NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_buffer_ghost_hits, "bluestore_buffer_ghost_hits",
+	    "Sum for buffers read again after recent eviction (tinylfu)");
 
   b.add_u64_counter(l_bluestore_write_big, "bluestore_write_big",
 		    "Large aligned writes into fresh blobs");
@@ -4660,6 +5274,16 @@ void BlueStore::_init_logger()
                     "Read EIO errors propagated to high level callers");
   b.add_u64_counter(l_bluestore_reads_with_retries, "bluestore_reads_with_retries",
                     "Read operations that required at least one retry due to failed checksum validation");
+  b.add_u64_counter(l_bluestore_readahead_ios, "readahead_ios",
+                    "Readahead prefetches issued for sequential readers");
+  b.add_u64_counter(l_bluestore_readahead_bytes, "readahead_bytes",
+                    "Bytes prefetched by readahead",
+                    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_readahead_hit_bytes, "readahead_hit_bytes",
+                    "Bytes read from a previously prefetched range",
+                    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_readahead_dropped, "readahead_dropped",
+                    "Prefetches skipped over budget or discarded as stale");
   b.add_u64(l_bluestore_fragmentation, "bluestore_fragmentation_micros",
             "How fragmented bluestore free space is (free extents / max possible number of free extents) * 1000");
   b.add_time_avg(l_bluestore_omap_seek_to_first_lat, "omap_seek_to_first_lat",
@@ -4670,8 +5294,48 @@ void BlueStore::_init_logger()
     "Average omap iterator lower_bound call latency");
   b.add_time_avg(l_bluestore_omap_next_lat, "omap_next_lat",
     "Average omap iterator next call latency");
+  b.add_time_avg(l_bluestore_omap_next_batch_lat, "omap_next_batch_lat",
+    "Average omap iterator next_batch call latency");
   b.add_time_avg(l_bluestore_clist_lat, "clist_lat",
     "Average collection listing latency");
+  b.add_u64_counter(l_bluestore_clist_cursor_hit, "clist_cursor_hit",
+    "Collection listings resumed from where the previous page stopped");
+  b.add_u64(l_bluestore_tier_used_bytes, "tier_used_bytes",
+    "Bytes allocated on the data tier device",
+    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_tier_write_bytes, "tier_write_bytes",
+    "Bytes of new blob data placed on the data tier",
+    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_tier_read_bytes, "tier_read_bytes",
+    "Bytes read from the data tier",
+    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_tier_full, "tier_full",
+    "Writes placed on the main device because the data tier was full");
+  b.add_u64_counter(l_bluestore_tier_demoted_objects, "tier_demoted_objects",
+    "Objects moved off the data tier");
+  b.add_u64_counter(l_bluestore_tier_demoted_bytes, "tier_demoted_bytes",
+    "Bytes moved off the data tier",
+    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_tier_promoted_objects, "tier_promoted_objects",
+    "Objects moved onto the data tier after getting hot");
+  b.add_u64_counter(l_bluestore_tier_promoted_bytes, "tier_promoted_bytes",
+    "Bytes moved onto the data tier",
+    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_logical_write_bytes, "logical_write_bytes",
+    "Bytes of object data and omap written by users",
+    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_data_write_bytes, "data_write_bytes",
+    "Bytes written to the data device directly (not deferred)",
+    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_kv_write_bytes, "kv_write_bytes",
+    "Bytes of kv transactions submitted",
+    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_logical_read_bytes, "logical_read_bytes",
+    "Bytes of object data read by users",
+    NULL, 0, unit_t(UNIT_BYTES));
+  b.add_u64_counter(l_bluestore_data_read_bytes, "data_read_bytes",
+    "Bytes read from the data device",
+    NULL, 0, unit_t(UNIT_BYTES));
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -4936,6 +5600,134 @@ void BlueStore::_close_bdev()
   bdev = NULL;
 }
 
+// The data tier is an optional fast device ($path/block.tier) that new
+// blob data of up to bluestore_tier_max_write_size is allocated from
+// while it has room.  Its extents are told apart from those on the main
+// device by bluestore_pextent_t::TIER_FLAG in their offset, they have a
+// freelist of their own under PREFIX_TIER_ALLOC and every onode with
+// data on the tier is indexed under PREFIX_TIER.  _tier_thread_entry()
+// moves the coldest of those back to the main device once the tier is
+// above bluestore_tier_high_ratio, and promotes objects whose reads get
+// hot (see _tier_touch()) while it is below bluestore_tier_low_ratio.
+// The tier is created on the first mount that finds block.tier; after
+// that it can not be taken away again.
+int BlueStore::_open_tier(bool read_only)
+{
+  ceph_assert(bdev_tier == nullptr);
+  string p = path + "/block.tier";
+  bufferlist bl;
+  bool created = db->get(PREFIX_SUPER, "tier_size", &bl) >= 0;
+  struct stat st;
+  if (::fstatat(path_fd, "block.tier", &st, 0) < 0) {
+    if (created) {
+      derr << __func__ << " " << p << " is missing but the store has a data"
+	   << " tier" << dendl;
+      return -ENOENT;
+    }
+    return 0;
+  }
+  if (!created && read_only) {
+    dout(1) << __func__ << " not creating the data tier read-only" << dendl;
+    return 0;
+  }
+
+  bdev_tier = BlockDevice::create(cct, p, aio_cb, static_cast<void*>(this),
+				  nullptr, nullptr);
+  int r = bdev_tier->open(p);
+  if (r < 0)
+    goto fail;
+  if (bdev_tier->get_block_size() != block_size) {
+    derr << __func__ << " " << p << " block size "
+	 << bdev_tier->get_block_size() << " does not match the main device's "
+	 << block_size << dendl;
+    r = -EINVAL;
+    goto fail_close;
+  }
+  if (bdev_tier->supported_bdev_label()) {
+    r = _check_or_set_bdev_label(p, bdev_tier->get_size(), "tier", !created);
+    if (r < 0)
+      goto fail_close;
+  }
+
+  tier_fm = FreelistManager::create(cct, freelist_type, PREFIX_TIER_ALLOC);
+  ceph_assert(tier_fm);
+  if (!created) {
+    uint64_t size = p2align(bdev_tier->get_size(), min_alloc_size);
+    dout(1) << __func__ << " creating the data tier on " << p << " size 0x"
+	    << std::hex << size << std::dec << dendl;
+    KeyValueDB::Transaction t = db->get_transaction();
+    tier_fm->create(size, min_alloc_size, t);
+    tier_fm->allocate(0, p2roundup((uint64_t)BDEV_LABEL_BLOCK_SIZE,
+				   min_alloc_size), t);
+    bufferlist sbl;
+    encode(size, sbl);
+    t->set(PREFIX_SUPER, "tier_size", sbl);
+    db->submit_transaction_sync(t);
+  }
+  r = tier_fm->init(db);
+  if (r < 0) {
+    derr << __func__ << " tier freelist init failed: " << cpp_strerror(r)
+	 << dendl;
+    goto fail_fm;
+  }
+
+  tier_alloc = Allocator::create(cct, cct->_conf->bluestore_allocator,
+				 tier_fm->get_size(), min_alloc_size, "tier");
+  if (!tier_alloc) {
+    r = -EINVAL;
+    goto fail_fm;
+  }
+  {
+    uint64_t offset, length, bytes = 0;
+    tier_fm->enumerate_reset();
+    while (tier_fm->enumerate_next(db, &offset, &length)) {
+      tier_alloc->init_add_free(offset, length);
+      bytes += length;
+    }
+    tier_fm->enumerate_reset();
+    dout(1) << __func__ << " " << p << " size 0x" << std::hex
+	    << tier_fm->get_size() << " free 0x" << bytes << std::dec << dendl;
+  }
+
+  tier_max_write_size = cct->_conf.get_val<Option::size_t>(
+    "bluestore_tier_max_write_size");
+  tier_high = tier_fm->get_size() *
+    cct->_conf.get_val<double>("bluestore_tier_high_ratio");
+  tier_low = tier_fm->get_size() *
+    cct->_conf.get_val<double>("bluestore_tier_low_ratio");
+  tier_half_life = std::max<uint64_t>(
+    1, cct->_conf.get_val<uint64_t>("bluestore_tier_heat_half_life"));
+  tier_epoch = mono_clock::now();
+  return 0;
+
+ fail_fm:
+  tier_fm->shutdown();
+  delete tier_fm;
+  tier_fm = nullptr;
+ fail_close:
+  bdev_tier->close();
+ fail:
+  delete bdev_tier;
+  bdev_tier = nullptr;
+  return r;
+}
+
+void BlueStore::_close_tier()
+{
+  if (!bdev_tier) {
+    return;
+  }
+  tier_alloc->shutdown();
+  delete tier_alloc;
+  tier_alloc = nullptr;
+  tier_fm->shutdown();
+  delete tier_fm;
+  tier_fm = nullptr;
+  bdev_tier->close();
+  delete bdev_tier;
+  bdev_tier = nullptr;
+}
+
 int BlueStore::_open_fm(KeyValueDB::Transaction t)
 {
   ceph_assert(fm == NULL);
@@ -5076,17 +5868,30 @@ int BlueStore::_open_alloc()
   uint64_t num = 0, bytes = 0;
 
   dout(1) << __func__ << " opening allocation metadata" << dendl;
-  // initialize from freelist
-  fm->enumerate_reset();
-  uint64_t offset, length;
-  while (fm->enumerate_next(db, &offset, &length)) {
-    alloc->init_add_free(offset, length);
-    ++num;
-    bytes += length;
-  }
-  fm->enumerate_reset();
+  int r = -ENOENT;
+  if (bluefs &&
+      cct->_conf.get_val<bool>("bluestore_allocator_snapshot")) {
+    r = _load_alloc_snapshot(&num, &bytes);
+    if (r < 0 && r != -ENOENT) {
+      // nothing was added to the allocator
+      dout(1) << __func__ << " not using allocator snapshot: "
+	      << cpp_strerror(r) << dendl;
+    }
+  }
+  if (r < 0) {
+    // initialize from freelist
+    fm->enumerate_reset();
+    uint64_t offset, length;
+    while (fm->enumerate_next(db, &offset, &length)) {
+      alloc->init_add_free(offset, length);
+      ++num;
+      bytes += length;
+    }
+    fm->enumerate_reset();
+  }
   dout(1) << __func__ << " loaded " << byte_u_t(bytes)
 	  << " in " << num << " extents"
+	  << (r == 0 ? " from snapshot" : "")
 	  << dendl;
 
   // also mark bluefs space as allocated
@@ -5109,6 +5914,180 @@ void BlueStore::_close_alloc()
   bluefs_extents.clear();
 }
 
+// The allocator snapshot is a copy of the freelist taken on clean umount:
+// the allocator's free extents plus the space owned by bluefs (which the
+// freelist considers free).  It is trusted only while the sequence number
+// stored under PREFIX_SUPER matches the one in the file; every read/write
+// open of the db drops that key before anything can touch the freelist,
+// and a kv-only mount that leaves the db to the tool drops the file.
+int BlueStore::_load_alloc_snapshot(uint64_t *num, uint64_t *bytes)
+{
+  bufferlist bl;
+  int r = db->get(PREFIX_SUPER, ALLOC_SNAPSHOT_SEQ_KEY, &bl);
+  if (r < 0) {
+    return -ENOENT;
+  }
+  uint64_t seq;
+  try {
+    auto p = bl.cbegin();
+    decode(seq, p);
+  } catch (buffer::error& e) {
+    derr << __func__ << " unable to decode " << ALLOC_SNAPSHOT_SEQ_KEY
+	 << dendl;
+    return -EIO;
+  }
+  alloc_snapshot_seq = seq;
+
+  uint64_t size;
+  utime_t mtime;
+  r = bluefs->stat(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE, &size, &mtime);
+  if (r < 0) {
+    return r;
+  }
+  BlueFS::FileReader *h;
+  r = bluefs->open_for_read(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE, &h);
+  if (r < 0) {
+    return r;
+  }
+  bl.clear();
+  uint64_t pos = 0;
+  while (pos < size) {
+    r = bluefs->read(h, &h->buf, pos, size - pos, &bl, nullptr);
+    if (r <= 0) {
+      break;
+    }
+    pos += r;
+  }
+  delete h;
+  if (pos < size || size < sizeof(uint32_t)) {
+    derr << __func__ << " short read of allocator snapshot" << dendl;
+    return r < 0 ? r : -EIO;
+  }
+
+  uint64_t snap_seq, dev_size, alloc_unit;
+  interval_set<uint64_t> free;
+  try {
+    bufferlist payload;
+    payload.substr_of(bl, 0, size - sizeof(uint32_t));
+    uint32_t crc;
+    auto p = bl.cbegin(size - sizeof(uint32_t));
+    decode(crc, p);
+    if (payload.crc32c(-1) != crc) {
+      derr << __func__ << " allocator snapshot crc mismatch" << dendl;
+      return -EIO;
+    }
+    p = payload.cbegin();
+    DECODE_START(1, p);
+    decode(snap_seq, p);
+    decode(dev_size, p);
+    decode(alloc_unit, p);
+    decode(free, p);
+    DECODE_FINISH(p);
+  } catch (buffer::error& e) {
+    derr << __func__ << " unable to decode allocator snapshot" << dendl;
+    return -EIO;
+  }
+  if (snap_seq != seq ||
+      dev_size != bdev->get_size() ||
+      alloc_unit != min_alloc_size) {
+    dout(1) << __func__ << " allocator snapshot is stale: seq " << snap_seq
+	    << " (expected " << seq << ") size 0x" << std::hex << dev_size
+	    << " alloc unit 0x" << alloc_unit << std::dec << dendl;
+    return -ESTALE;
+  }
+  for (auto e = free.begin(); e != free.end(); ++e) {
+    alloc->init_add_free(e.get_start(), e.get_len());
+    ++*num;
+    *bytes += e.get_len();
+  }
+  return 0;
+}
+
+void BlueStore::_write_alloc_snapshot()
+{
+  if (!bluefs || !alloc ||
+      !cct->_conf.get_val<bool>("bluestore_allocator_snapshot")) {
+    return;
+  }
+  auto start = mono_clock::now();
+  interval_set<uint64_t> free;
+  alloc->dump([&](uint64_t offset, uint64_t length) {
+    free.union_insert(offset, length);
+  });
+  for (auto e = bluefs_extents.begin(); e != bluefs_extents.end(); ++e) {
+    free.union_insert(e.get_start(), e.get_len());
+  }
+
+  uint64_t seq = ++alloc_snapshot_seq;
+  bufferlist bl;
+  ENCODE_START(1, 1, bl);
+  encode(seq, bl);
+  encode(bdev->get_size(), bl);
+  encode((uint64_t)min_alloc_size, bl);
+  encode(free, bl);
+  ENCODE_FINISH(bl);
+  uint32_t crc = bl.crc32c(-1);
+  encode(crc, bl);
+
+  int r = 0;
+  if (!bluefs->dir_exists(ALLOC_SNAPSHOT_DIR)) {
+    r = bluefs->mkdir(ALLOC_SNAPSHOT_DIR);
+  }
+  BlueFS::FileWriter *h = nullptr;
+  if (r == 0) {
+    r = bluefs->open_for_write(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE, &h,
+			       false);
+  }
+  if (r == 0) {
+    h->append(bl);
+    r = bluefs->fsync(h);
+    bluefs->close_writer(h);
+  }
+  if (r < 0) {
+    derr << __func__ << " failed to write allocator snapshot: "
+	 << cpp_strerror(r) << dendl;
+    return;
+  }
+
+  bufferlist seq_bl;
+  encode(seq, seq_bl);
+  KeyValueDB::Transaction t = db->get_transaction();
+  t->set(PREFIX_SUPER, ALLOC_SNAPSHOT_SEQ_KEY, seq_bl);
+  db->submit_transaction_sync(t);
+  dout(1) << __func__ << " seq " << seq << " " << free.num_intervals()
+	  << " extents, " << byte_u_t(free.size()) << " free, in "
+	  << ceph::to_seconds<double>(mono_clock::now() - start) << "s"
+	  << dendl;
+}
+
+void BlueStore::_invalidate_alloc_snapshot(bool db_open)
+{
+  if (!db_open) {
+    // the seq key can't be dropped before the db is opened; drop the
+    // file instead, the snapshot is not loaded without it
+    uint64_t size;
+    utime_t mtime;
+    if (!bluefs ||
+	bluefs->stat(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE,
+		     &size, &mtime) < 0) {
+      return;
+    }
+    dout(10) << __func__ << " removing " << ALLOC_SNAPSHOT_DIR << "/"
+	     << ALLOC_SNAPSHOT_FILE << dendl;
+    bluefs->unlink(ALLOC_SNAPSHOT_DIR, ALLOC_SNAPSHOT_FILE);
+    bluefs->sync_metadata();
+    return;
+  }
+  bufferlist bl;
+  if (db->get(PREFIX_SUPER, ALLOC_SNAPSHOT_SEQ_KEY, &bl) < 0) {
+    return;
+  }
+  dout(10) << __func__ << dendl;
+  KeyValueDB::Transaction t = db->get_transaction();
+  t->rmkey(PREFIX_SUPER, ALLOC_SNAPSHOT_SEQ_KEY);
+  db->submit_transaction_sync(t);
+}
+
 int BlueStore::_open_fsid(bool create)
 {
   ceph_assert(fsid_fd < 0);
@@ -5521,6 +6500,7 @@ int BlueStore::_open_db_and_around(bool read_only)
 	_close_fm();
 	return r;
       }
+      _invalidate_alloc_snapshot();
     }
   } else {
     r = _open_db(false, false);
@@ -5540,6 +6520,11 @@ int BlueStore::_open_db_and_around(bool read_only)
     if (r < 0)
       goto out_fm;
   }
+  r = _open_tier(read_only);
+  if (r < 0) {
+    _close_alloc();
+    goto out_fm;
+  }
   return 0;
 
  out_fm:
@@ -5551,6 +6536,7 @@ int BlueStore::_open_db_and_around(bool read_only)
 
 void BlueStore::_close_db_and_around()
 {
+  _close_tier();
   if (bluefs) {
     if (out_of_sync_fm.fetch_and(0)) {
       _sync_bluefs_and_fm();
@@ -6349,6 +7335,13 @@ int BlueStore::mkfs()
     if (r < 0)
       goto out_close_fsid;
   }
+  // the data tier itself is set up by the first mount, see _open_tier()
+  r = _setup_block_symlink_or_file("block.tier",
+    cct->_conf.get_val<std::string>("bluestore_tier_path"),
+    cct->_conf.get_val<Option::size_t>("bluestore_tier_size"),
+    cct->_conf.get_val<bool>("bluestore_tier_create"));
+  if (r < 0)
+    goto out_close_fsid;
 
   r = _open_bdev(true);
   if (r < 0)
@@ -6946,9 +7939,15 @@ int BlueStore::_mount(bool kv_only, bool open_db)
   if (open_db) {
     r = _open_db_and_around(false);
   } else {
-    // we can bypass db open exclusively in case of kv_only mode
+    // we can bypass db open exclusively in case of kv_only mode.
+    // The tool opens the db itself (rocksdb repair, reshard).  Repair
+    // may drop or roll back any key, the freelist ones included, so the
+    // allocator snapshot can't be trusted after it.
     ceph_assert(kv_only);
     r = _open_db(false, true);
+    if (r == 0) {
+      _invalidate_alloc_snapshot(false);
+    }
   }
   if (r < 0) {
     goto out_bdev;
@@ -6977,6 +7976,7 @@ int BlueStore::_mount(bool kv_only, bool open_db)
     goto out_stop;
 
   mempool_thread.init();
+  _compress_start();
 
   if ((!per_pool_stat_collection || !per_pool_omap) &&
     cct->_conf->bluestore_fsck_quick_fix_on_mount == true) {
@@ -6997,6 +7997,7 @@ int BlueStore::_mount(bool kv_only, bool open_db)
     }
   }
 
+  _tier_start();
   mounted = true;
   return 0;
 
@@ -7020,14 +8021,20 @@ int BlueStore::umount()
   ceph_assert(_kv_only || mounted);
   dout(1) << __func__ << dendl;
 
+  if (!_kv_only) {
+    _tier_stop();
+  }
   _osr_drain_all();
 
   mounted = false;
   if (!_kv_only) {
+    _readahead_drain();
+    _compress_stop();
     mempool_thread.shutdown();
     dout(20) << __func__ << " stopping kv thread" << dendl;
     _kv_stop();
     _flush_cache();
+    _write_alloc_snapshot();
     dout(20) << __func__ << " closing" << dendl;
 
   }
@@ -7139,6 +8146,10 @@ int BlueStore::_fsck_check_extents(
     if (compressed) {
       expected_statfs.data_compressed_allocated += e.length;
     }
+    if (e.is_on_tier()) {
+      // used_blocks only covers the main device
+      continue;
+    }
     if (depth != FSCK_SHALLOW) {
       bool already = false;
       apply_for_bitset_range(
@@ -7160,7 +8171,7 @@ int BlueStore::_fsck_check_extents(
 	    bs.set(pos);
         });
         if (repairer) {
-	  repairer->get_space_usage_tracker().set_used( e.offset, e.length, cid, oid);
+	  repairer->set_space_used(e.offset, e.length, cid, oid);
         }
 
       if (e.end() > bdev->get_size()) {
@@ -7795,46 +8806,27 @@ void BlueStore::_fsck_check_object_omap(FSCKDepth depth,
   }
 }
 
-void BlueStore::_fsck_check_objects(FSCKDepth depth,
-  BlueStore::FSCK_ObjectCtx& ctx)
+size_t BlueStore::_fsck_check_objects_range(FSCKDepth depth,
+  BlueStore::FSCK_ObjectCtx& ctx,
+  const string& start,
+  const string& end,
+  uint64_t_btree_t& used_nids,
+  const fsck_offload_fn& offload)
 {
   auto& errors = ctx.errors;
-  auto sb_info_lock = ctx.sb_info_lock;
-  auto& sb_info = ctx.sb_info;
-  auto repairer = ctx.repairer;
-
-  uint64_t_btree_t used_nids;
 
   size_t processed_myself = 0;
 
   auto it = db->get_iterator(PREFIX_OBJ);
   mempool::bluestore_fsck::list<string> expecting_shards;
   if (it) {
-    const size_t thread_count = cct->_conf->bluestore_fsck_quick_fix_threads;
-    typedef ShallowFSCKThreadPool::FSCKWorkQueue<256> WQ;
-    std::unique_ptr<WQ> wq(
-      new WQ(
-        "FSCKWorkQueue",
-        (thread_count ? : 1) * 32,
-        this,
-        sb_info_lock,
-        sb_info,
-        repairer));
-
-    ShallowFSCKThreadPool thread_pool(cct, "ShallowFSCKThreadPool", "ShallowFSCK", thread_count);
-
-    thread_pool.add_work_queue(wq.get());
-    if (depth == FSCK_SHALLOW && thread_count > 0) {
-      //not the best place but let's check anyway
-      ceph_assert(sb_info_lock);
-      thread_pool.start();
-    }
-
     //fill global if not overriden below
     CollectionRef c;
     int64_t pool_id = -1;
     spg_t pgid;
-    for (it->lower_bound(string()); it->valid(); it->next()) {
+    for (it->lower_bound(start);
+	 it->valid() && (end.empty() || it->key() < end);
+	 it->next()) {
       dout(30) << __func__ << " key "
         << pretty_binary_string(it->key()) << dendl;
       if (is_extent_shard_key(it->key())) {
@@ -7922,8 +8914,8 @@ void BlueStore::_fsck_check_objects(FSCKDepth depth,
       }
 
       bool queued = false;
-      if (depth == FSCK_SHALLOW && thread_count > 0) {
-        queued = wq->queue(
+      if (offload) {
+        queued = offload(
           pool_id,
           c,
           oid,
@@ -8036,8 +9028,65 @@ void BlueStore::_fsck_check_objects(FSCKDepth depth,
           } while (offset < o->onode.size);
         } // deep
       } //if (depth != FSCK_SHALLOW)
-    } // for (it->lower_bound(string()); it->valid(); it->next())
-    if (depth == FSCK_SHALLOW && thread_count > 0) {
+    } // for (it->lower_bound(start); ...; it->next())
+  } // if (it)
+  return processed_myself;
+}
+
+void BlueStore::_fsck_check_objects(FSCKDepth depth,
+  BlueStore::FSCK_ObjectCtx& ctx)
+{
+  auto sb_info_lock = ctx.sb_info_lock;
+  auto& sb_info = ctx.sb_info;
+  auto repairer = ctx.repairer;
+
+  if (depth != FSCK_SHALLOW) {
+    const size_t thread_count =
+      cct->_conf.get_val<int64_t>("bluestore_fsck_threads");
+    if (thread_count > 1) {
+      _fsck_check_objects_parallel(depth, ctx, thread_count);
+      return;
+    }
+    uint64_t_btree_t used_nids;
+    _fsck_check_objects_range(depth, ctx, string(), string(), used_nids,
+      nullptr);
+    return;
+  }
+
+  auto it = db->get_iterator(PREFIX_OBJ);
+  if (it) {
+    const size_t thread_count = cct->_conf->bluestore_fsck_quick_fix_threads;
+    typedef ShallowFSCKThreadPool::FSCKWorkQueue<256> WQ;
+    std::unique_ptr<WQ> wq(
+      new WQ(
+        "FSCKWorkQueue",
+        (thread_count ? : 1) * 32,
+        this,
+        sb_info_lock,
+        sb_info,
+        repairer));
+
+    ShallowFSCKThreadPool thread_pool(cct, "ShallowFSCKThreadPool", "ShallowFSCK", thread_count);
+
+    thread_pool.add_work_queue(wq.get());
+    if (thread_count > 0) {
+      //not the best place but let's check anyway
+      ceph_assert(sb_info_lock);
+      thread_pool.start();
+    }
+
+    uint64_t_btree_t used_nids;
+    size_t processed_myself = _fsck_check_objects_range(depth, ctx,
+      string(), string(), used_nids,
+      [&](int64_t pool_id,
+	  CollectionRef c,
+	  const ghobject_t& oid,
+	  const string& key,
+	  const bufferlist& value) {
+	return thread_count > 0 &&
+	  wq->queue(pool_id, c, oid, key, value);
+      });
+    if (thread_count > 0) {
       wq->finalize(thread_pool, ctx);
       if (processed_myself) {
         // may be needs more threads?
@@ -8050,6 +9099,174 @@ void BlueStore::_fsck_check_objects(FSCKDepth depth,
     }
   } // if (it)
 }
+void BlueStore::_fsck_check_objects_parallel(FSCKDepth depth,
+  BlueStore::FSCK_ObjectCtx& ctx,
+  size_t thread_count)
+{
+  // Object keys start with shard, pool and hash, so splitting the keyspace
+  // at collection starts never separates an onode from its extent shards.
+  std::set<string> bounds;
+  for (auto& p : coll_map) {
+    string temp_start, temp_end, start, end;
+    get_coll_key_range(p.first, p.second->cnode.bits,
+      &temp_start, &temp_end, &start, &end);
+    bounds.insert(temp_start);
+    bounds.insert(start);
+  }
+  bounds.erase(string());
+  vector<pair<string, string>> ranges;
+  string prev;
+  for (auto& b : bounds) {
+    ranges.emplace_back(prev, b);
+    prev = b;
+  }
+  ranges.emplace_back(prev, string());
+  thread_count = std::min(thread_count, ranges.size());
+
+  struct worker_t {
+    int64_t errors = 0;
+    int64_t warnings = 0;
+    uint64_t num_objects = 0;
+    uint64_t num_extents = 0;
+    uint64_t num_blobs = 0;
+    uint64_t num_sharded_objects = 0;
+    uint64_t num_spanning_blobs = 0;
+    mempool_dynamic_bitset used_blocks;
+    uint64_t_btree_t used_nids;
+    uint64_t_btree_t used_omap_head;
+    sb_info_map_t sb_info;
+    store_statfs_t expected_store_statfs;
+    per_pool_statfs expected_pool_statfs;
+  };
+  vector<worker_t> workers(thread_count);
+  std::atomic<size_t> next_range = {0};
+  std::atomic<uint64_t> objects_done = {0};
+  ceph::mutex lock = ceph::make_mutex("BlueStore::fsck::workers_lock");
+  ceph::condition_variable cond;
+  size_t running = thread_count;
+
+  dout(1) << __func__ << " " << ranges.size() << " key ranges, "
+	  << thread_count << " threads" << dendl;
+  vector<std::thread> threads;
+  for (size_t i = 0; i < thread_count; ++i) {
+    threads.emplace_back(make_named_thread("bstore_fsck", [&, i] {
+      auto& w = workers[i];
+      w.used_blocks.resize(ctx.used_blocks->size());
+      FSCK_ObjectCtx wctx(
+	w.errors,
+	w.warnings,
+	w.num_objects,
+	w.num_extents,
+	w.num_blobs,
+	w.num_sharded_objects,
+	w.num_spanning_blobs,
+	&w.used_blocks,
+	&w.used_omap_head,
+	nullptr, // sb_info is per worker
+	w.sb_info,
+	w.expected_store_statfs,
+	w.expected_pool_statfs,
+	ctx.repairer);
+      size_t n;
+      while ((n = next_range++) < ranges.size()) {
+	uint64_t before = w.num_objects;
+	_fsck_check_objects_range(depth, wctx,
+	  ranges[n].first, ranges[n].second, w.used_nids, nullptr);
+	objects_done += w.num_objects - before;
+      }
+      std::lock_guard l(lock);
+      --running;
+      cond.notify_all();
+    }));
+  }
+  {
+    std::unique_lock l(lock);
+    while (running) {
+      if (cond.wait_for(l, std::chrono::seconds(10)) ==
+	  std::cv_status::timeout) {
+	dout(1) << __func__ << " progress "
+		<< std::min(next_range.load(), ranges.size())
+		<< "/" << ranges.size() << " key ranges, "
+		<< objects_done << " objects" << dendl;
+      }
+    }
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  // merge
+  auto& errors = ctx.errors;
+  uint64_t granularity = fm->get_alloc_size();
+  uint64_t_btree_t used_nids;
+  for (auto& w : workers) {
+    errors += w.errors;
+    ctx.warnings += w.warnings;
+    ctx.num_objects += w.num_objects;
+    ctx.num_extents += w.num_extents;
+    ctx.num_blobs += w.num_blobs;
+    ctx.num_sharded_objects += w.num_sharded_objects;
+    ctx.num_spanning_blobs += w.num_spanning_blobs;
+    ctx.expected_store_statfs.add(w.expected_store_statfs);
+    for (auto& p : w.expected_pool_statfs) {
+      ctx.expected_pool_statfs[p.first].add(p.second);
+    }
+
+    // blocks claimed by more than one worker (or by bluefs/super) are
+    // misreferenced, just like a collision within a single walk
+    mempool_dynamic_bitset dup = w.used_blocks & *ctx.used_blocks;
+    for (auto pos = dup.find_first(); pos != dup.npos;) {
+      auto run_end = pos;
+      while (run_end + 1 < dup.size() && dup.test(run_end + 1)) {
+	++run_end;
+      }
+      derr << "fsck error: extent 0x" << std::hex << pos * granularity
+	   << "~" << (run_end - pos + 1) * granularity << std::dec
+	   << " or a subset is already allocated (misreferenced)" << dendl;
+      ++errors;
+      if (ctx.repairer) {
+	for (auto p = pos; p <= run_end; ++p) {
+	  ctx.repairer->note_misreference(
+	    p * min_alloc_size, min_alloc_size, p == pos);
+	}
+      }
+      pos = dup.find_next(run_end);
+    }
+    *ctx.used_blocks |= w.used_blocks;
+    w.used_blocks.clear();
+
+    for (auto nid : w.used_nids) {
+      if (!used_nids.insert(nid).second) {
+	derr << "fsck error: nid " << nid << " already in use" << dendl;
+	++errors;
+      }
+    }
+    ceph_assert(ctx.used_omap_head);
+    for (auto nid : w.used_omap_head) {
+      if (!ctx.used_omap_head->insert(nid).second) {
+	derr << "fsck error: omap_head " << nid << " already in use" << dendl;
+	++errors;
+      }
+    }
+    for (auto& p : w.sb_info) {
+      auto& src = p.second;
+      sb_info_t& sbi = ctx.sb_info[p.first];
+      ceph_assert(sbi.cid == coll_t() || sbi.cid == src.cid);
+      ceph_assert(sbi.pool_id == INT64_MIN || sbi.pool_id == src.pool_id);
+      sbi.cid = src.cid;
+      sbi.pool_id = src.pool_id;
+      sbi.sb = src.sb;
+      sbi.oids.splice(sbi.oids.end(), src.oids);
+      sbi.compressed = src.compressed;
+      for (auto& r : src.ref_map.ref_map) {
+	for (unsigned i = 0; i < r.second.refs; ++i) {
+	  sbi.ref_map.get(r.first, r.second.length);
+	}
+      }
+    }
+    w.sb_info.clear();
+  }
+}
 /**
 An overview for currently implemented repair logics 
 performed in fsck in two stages: detection(+preparation) and commit.
@@ -9205,6 +10422,10 @@ int BlueStore::pool_statfs(uint64_t pool_id, struct store_statfs_t *buf,
   {
     std::lock_guard l(vstatfs_lock);
     osd_pools[pool_id].publish(buf);
+    auto p = osd_pools_io.find(pool_id);
+    if (p != osd_pools_io.end()) {
+      p->second.publish(buf);
+    }
   }
 
   string key_prefix;
@@ -9256,8 +10477,9 @@ BlueStore::CollectionRef BlueStore::_get_collection(const coll_t& cid)
 void BlueStore::_queue_reap_collection(CollectionRef& c)
 {
   dout(10) << __func__ << " " << c << " " << c->cid << dendl;
-  // _reap_collections and this in the same thread,
-  // so no need a lock.
+  // kv commit lanes finalize txcs too, so this may race with
+  // _reap_collections in another thread.
+  std::lock_guard l(reap_lock);
   removed_collections.push_back(c);
 }
 
@@ -9266,8 +10488,7 @@ void BlueStore::_reap_collections()
 
   list<CollectionRef> removed_colls;
   {
-    // _queue_reap_collection and this in the same thread.
-    // So no need a lock.
+    std::lock_guard l(reap_lock);
     if (!removed_collections.empty())
       removed_colls.swap(removed_collections);
     else
@@ -9297,6 +10518,7 @@ void BlueStore::_reap_collections()
   if (removed_colls.empty()) {
     dout(10) << __func__ << " all reaped" << dendl;
   } else {
+    std::lock_guard l(reap_lock);
     removed_collections.splice(removed_collections.begin(), removed_colls);
   }
 }
@@ -9324,6 +10546,15 @@ void BlueStore::_update_cache_logger()
   logger->set(l_bluestore_buffer_bytes, num_buffer_bytes);
 }
 
+void BlueStore::_expire_list_cursors(double age)
+{
+  auto before = mono_clock::now() - ceph::make_timespan(age);
+  std::shared_lock l(coll_lock);
+  for (auto& p : coll_map) {
+    p.second->expire_list_cursors(before);
+  }
+}
+
 // ---------------
 // read operations
 
@@ -9460,6 +10691,13 @@ int BlueStore::read(
     r = _do_read(c, o, offset, length, bl, op_flags);
     if (r == -EIO) {
       logger->inc(l_bluestore_read_eio);
+    } else if (r > 0) {
+      logger->inc(l_bluestore_logical_read_bytes, r);
+      c->pool_io->values[pool_io_t::IO_READ] += r;
+      _maybe_readahead(c, o, offset, r, op_flags);
+      if (bdev_tier) {
+	_tier_note_read(c, o);
+      }
     }
   }
 
@@ -9484,22 +10722,78 @@ int BlueStore::read(
   return r;
 }
 
-void BlueStore::_read_cache(
-  OnodeRef o,
+bool BlueStore::is_cached(
+  CollectionHandle &c_,
+  const ghobject_t& oid,
   uint64_t offset,
-  size_t length,
-  int read_cache_policy,
-  ready_regions_t& ready_regions,
-  blobs2read_t& blobs2read)
+  size_t length)
 {
-  // build blob-wise list to of stuff read (that isn't cached)
-  unsigned left = length;
-  uint64_t pos = offset;
-  auto lp = o->extent_map.seek_lextent(offset);
-  while (left > 0 && lp != o->extent_map.extent_map.end()) {
-    if (pos < lp->logical_offset) {
-      unsigned hole = lp->logical_offset - pos;
-      if (hole >= left) {
+  Collection *c = static_cast<Collection *>(c_.get());
+  if (!c->exists) {
+    return false;
+  }
+  // never wait: a writer holding the collection lock may be doing io
+  std::shared_lock l(c->lock, std::try_to_lock);
+  if (!l.owns_lock()) {
+    return false;
+  }
+  OnodeRef o = c->onode_map.lookup(oid);
+  if (!o || !o->exists) {
+    return false;
+  }
+  if (offset >= o->onode.size) {
+    return true;
+  }
+  if (length == 0) {
+    length = o->onode.size - offset;
+  }
+  length = std::min<uint64_t>(length, o->onode.size - offset);
+
+  // the extent map shards covering the range must not need a db read
+  if (!o->extent_map.shards.empty()) {
+    int s = o->extent_map.seek_shard(offset);
+    int last = o->extent_map.seek_shard(offset + length - 1);
+    if (s < 0 || last < s) {
+      return false;
+    }
+    for (; s <= last; ++s) {
+      if (!o->extent_map.shards[s].loaded) {
+	return false;
+      }
+    }
+  }
+
+  uint64_t end = offset + length;
+  for (auto lp = o->extent_map.seek_lextent(offset);
+       lp != o->extent_map.extent_map.end() && lp->logical_offset < end;
+       ++lp) {
+    uint64_t pos = std::max<uint64_t>(offset, lp->logical_offset);
+    uint32_t b_off = pos - lp->logical_offset + lp->blob_offset;
+    uint32_t b_len = std::min<uint64_t>(end, lp->logical_end()) - pos;
+    auto& sb = lp->blob->shared_blob;
+    if (!sb->bc.is_cached(sb->get_cache(), b_off, b_len)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void BlueStore::_read_cache(
+  OnodeRef o,
+  uint64_t offset,
+  size_t length,
+  int read_cache_policy,
+  ready_regions_t& ready_regions,
+  blobs2read_t& blobs2read)
+{
+  // build blob-wise list to of stuff read (that isn't cached)
+  unsigned left = length;
+  uint64_t pos = offset;
+  auto lp = o->extent_map.seek_lextent(offset);
+  while (left > 0 && lp != o->extent_map.extent_map.end()) {
+    if (pos < lp->logical_offset) {
+      unsigned hole = lp->logical_offset - pos;
+      if (hole >= left) {
         break;
       }
       dout(30) << __func__ << "  hole 0x" << std::hex << pos << "~" << hole
@@ -9582,10 +10876,13 @@ void BlueStore::_read_cache(
 }
 
 int BlueStore::_prepare_read_ioc(
+  Collection* c,
   blobs2read_t& blobs2read,
   vector<bufferlist>* compressed_blob_bls,
-  IOContext* ioc)
+  IOContext* ioc,
+  IOContext* tier_ioc)
 {
+  uint64_t read_bytes = 0;
   for (auto& p : blobs2read) {
     const BlobRef& bptr = p.first;
     regions2read_t& r2r = p.second;
@@ -9602,7 +10899,13 @@ int BlueStore::_prepare_read_ioc(
       auto r = bptr->get_blob().map(
         0, bptr->get_blob().get_ondisk_length(),
         [&](uint64_t offset, uint64_t length) {
-          int r = bdev->aio_read(offset, length, &bl, ioc);
+          BlockDevice *dev = _data_bdev(&offset);
+          if (dev != bdev) {
+            logger->inc(l_bluestore_tier_read_bytes, length);
+          }
+          read_bytes += length;
+          int r = dev->aio_read(offset, length, &bl,
+                                _data_ioc(dev, ioc, tier_ioc));
           if (r < 0)
             return r;
           return 0;
@@ -9629,7 +10932,13 @@ int BlueStore::_prepare_read_ioc(
         auto r = bptr->get_blob().map(
           req.r_off, req.r_len,
           [&](uint64_t offset, uint64_t length) {
-            int r = bdev->aio_read(offset, length, &req.bl, ioc);
+            BlockDevice *dev = _data_bdev(&offset);
+            if (dev != bdev) {
+              logger->inc(l_bluestore_tier_read_bytes, length);
+            }
+            read_bytes += length;
+            int r = dev->aio_read(offset, length, &req.bl,
+                                  _data_ioc(dev, ioc, tier_ioc));
             if (r < 0)
               return r;
             return 0;
@@ -9647,6 +10956,10 @@ int BlueStore::_prepare_read_ioc(
       }
     }
   }
+  if (read_bytes) {
+    logger->inc(l_bluestore_data_read_bytes, read_bytes);
+    c->pool_io->values[pool_io_t::IO_DATA_READ] += read_bytes;
+  }
   return 0;
 }
 
@@ -9778,83 +11091,660 @@ int BlueStore::_do_read(
     buffered = true;
   }
 
-  if (offset + length > o->onode.size) {
-    length = o->onode.size - offset;
+  if (offset + length > o->onode.size) {
+    length = o->onode.size - offset;
+  }
+
+  auto start = mono_clock::now();
+  o->extent_map.fault_range(db, offset, length);
+  log_latency(__func__,
+    l_bluestore_read_onode_meta_lat,
+    mono_clock::now() - start,
+    cct->_conf->bluestore_log_op_age);
+  _dump_onode<30>(cct, *o);
+
+  // for deep-scrub, we only read dirty cache and bypass clean cache in
+  // order to read underlying block device in case there are silent disk errors.
+  if (op_flags & CEPH_OSD_OP_FLAG_BYPASS_CLEAN_CACHE) {
+    dout(20) << __func__ << " will bypass cache and do direct read" << dendl;
+    read_cache_policy = BufferSpace::BYPASS_CLEAN_CACHE;
+  }
+
+  // build blob-wise list to of stuff read (that isn't cached)
+  ready_regions_t ready_regions;
+  blobs2read_t blobs2read;
+  _read_cache(o, offset, length, read_cache_policy, ready_regions, blobs2read);
+
+
+  // read raw blob data.
+  start = mono_clock::now(); // for the sake of simplicity
+                             // measure the whole block below.
+                             // The error isn't that much...
+  vector<bufferlist> compressed_blob_bls;
+  IOContext ioc(cct, NULL, true); // allow EIO
+  IOContext tier_ioc(cct, NULL, true);
+  r = _prepare_read_ioc(c, blobs2read, &compressed_blob_bls, &ioc, &tier_ioc);
+  // we always issue aio for reading, so errors other than EIO are not allowed
+  if (r < 0)
+    return r;
+
+  int64_t num_ios = length;
+  if (ioc.has_pending_aios() || tier_ioc.has_pending_aios()) {
+    num_ios = -(ioc.get_num_ios() + tier_ioc.get_num_ios());
+    dout(20) << __func__ << " waiting for aio" << dendl;
+    r = _aio_read_wait(&ioc, &tier_ioc);
+    if (r < 0) {
+      ceph_assert(r == -EIO); // no other errors allowed
+      return -EIO;
+    }
+  }
+  log_latency_fn(__func__,
+    l_bluestore_read_wait_aio_lat,
+    mono_clock::now() - start,
+    cct->_conf->bluestore_log_op_age,
+    [&](auto lat) { return ", num_ios = " + stringify(num_ios); }
+  );
+
+  bool csum_error = false;
+  r = _generate_read_result_bl(o, offset, length, ready_regions,
+                              compressed_blob_bls, blobs2read,
+                              buffered, &csum_error, bl);
+  if (csum_error) {
+    // Handles spurious read errors caused by a kernel bug.
+    // We sometimes get all-zero pages as a result of the read under
+    // high memory pressure. Retrying the failing read succeeds in most 
+    // cases.
+    // See also: http://tracker.ceph.com/issues/22464
+    if (retry_count >= cct->_conf->bluestore_retry_disk_reads) {
+      return -EIO;
+    }
+    return _do_read(c, o, offset, length, bl, op_flags, retry_count + 1);
+  }
+  r = bl.length();
+  if (retry_count) {
+    logger->inc(l_bluestore_reads_with_retries);
+    dout(5) << __func__ << " read at 0x" << std::hex << offset << "~" << length
+            << " failed " << std::dec << retry_count << " times before succeeding" << dendl;
+  }
+  return r;
+}
+
+void BlueStore::_maybe_readahead(
+  Collection *c,
+  OnodeRef o,
+  uint64_t offset,
+  size_t length,
+  uint32_t op_flags)
+{
+  uint64_t end = offset + length;
+  uint64_t prev = o->readahead_next.exchange(end);
+  uint64_t min_seq =
+    cct->_conf.get_val<uint64_t>("bluestore_readahead_min_sequential");
+  uint64_t max_window =
+    cct->_conf.get_val<Option::size_t>("bluestore_readahead_max_bytes");
+  if (min_seq == 0 || max_window == 0) {
+    return;
+  }
+  // honor the same hints _do_read uses to decide whether to cache
+  if (op_flags & (CEPH_OSD_OP_FLAG_FADVISE_RANDOM |
+		  CEPH_OSD_OP_FLAG_FADVISE_DONTNEED |
+		  CEPH_OSD_OP_FLAG_FADVISE_NOCACHE |
+		  CEPH_OSD_OP_FLAG_BYPASS_CLEAN_CACHE)) {
+    return;
+  }
+  if ((op_flags & CEPH_OSD_OP_FLAG_FADVISE_WILLNEED) == 0 &&
+      !cct->_conf->bluestore_default_buffered_read) {
+    return;
+  }
+  if (offset != prev) {
+    // not a continuation of the previous read; start over
+    o->readahead_seq = 0;
+    o->readahead_window = 0;
+    o->readahead_end = 0;
+    return;
+  }
+
+  uint64_t ra_end = o->readahead_end;
+  if (ra_end > offset) {
+    logger->inc(l_bluestore_readahead_hit_bytes,
+		std::min(ra_end, end) - offset);
+  }
+  if (++o->readahead_seq < min_seq &&
+      (op_flags & CEPH_OSD_OP_FLAG_FADVISE_SEQUENTIAL) == 0) {
+    return;
+  }
+
+  // Keep half a window ahead of the reader, doubling the window each
+  // time we have to refill it, so that the device stays busy while the
+  // client consumes what we already have.
+  uint64_t window = o->readahead_window;
+  if (ra_end > end && ra_end - end > window / 2) {
+    return;
+  }
+  window = std::min(max_window, std::max(window * 2, (uint64_t)length * 2));
+  uint64_t ra_off = std::max(ra_end, end);
+  uint64_t size = o->onode.size;
+  if (ra_off >= size || ra_off >= end + window) {
+    return;
+  }
+  uint64_t ra_len = std::min(end + window, size) - ra_off;
+
+  // bytes in flight are accounted to the data cache (see DataCache), and
+  // may only use a slice of what the priority cache gave it
+  if (readahead_inflight.fetch_add(ra_len) + ra_len > readahead_budget) {
+    readahead_inflight -= ra_len;
+    logger->inc(l_bluestore_readahead_dropped);
+    dout(20) << __func__ << " " << o->oid << " 0x" << std::hex << ra_off
+	     << "~" << ra_len << std::dec << " over budget" << dendl;
+    return;
+  }
+  o->readahead_window = window;
+  o->readahead_end = ra_off + ra_len;
+
+  o->extent_map.fault_range(db, ra_off, ra_len);
+  auto ctx = new ReadaheadContext(cct, c, o, ra_off, ra_len);
+  ready_regions_t ready_regions;
+  _read_cache(o, ra_off, ra_len, 0, ready_regions, ctx->blobs2read);
+  int r = _prepare_read_ioc(c, ctx->blobs2read, &ctx->compressed_blob_bls,
+			    &ctx->ioc, &ctx->tier_ioc);
+  if (r < 0 ||
+      (!ctx->ioc.has_pending_aios() && !ctx->tier_ioc.has_pending_aios())) {
+    // all cached already, or a device error the reader will hit itself
+    readahead_inflight -= ra_len;
+    delete ctx;
+    return;
+  }
+  dout(20) << __func__ << " " << o->oid << " 0x" << std::hex << ra_off
+	   << "~" << ra_len << std::dec << " ios "
+	   << ctx->ioc.get_num_ios() + ctx->tier_ioc.get_num_ios() << dendl;
+  {
+    std::lock_guard l(readahead_lock);
+    ++readahead_num_ios;
+  }
+  logger->inc(l_bluestore_readahead_ios);
+  logger->inc(l_bluestore_readahead_bytes, ra_len);
+  _aio_submit(ctx, &ctx->ioc, &ctx->tier_ioc);
+}
+
+void BlueStore::_readahead_finish(ReadaheadContext *ctx)
+{
+  Collection *c = ctx->c.get();
+  OnodeRef& o = ctx->o;
+  bool used = false;
+  // We are on the aio completion thread: never block on the collection
+  // lock (a writer holding it may be waiting for one of our aios).  The
+  // data is only good if nothing modified the object since it was read.
+  if (ctx->ioc.get_return_value() == 0 &&
+      ctx->tier_ioc.get_return_value() == 0 &&
+      c->lock.try_lock_shared()) {
+    if (o->exists && o->readahead_gen == ctx->gen) {
+      used = true;
+      auto p = ctx->compressed_blob_bls.begin();
+      for (auto& [bptr, r2r] : ctx->blobs2read) {
+	BufferCacheShard *cache = bptr->shared_blob->get_cache();
+	if (bptr->get_blob().is_compressed()) {
+	  bufferlist& compressed_bl = *p++;
+	  bufferlist raw_bl;
+	  if (_verify_csum(o, &bptr->get_blob(), 0, compressed_bl,
+			   r2r.front().regs.front().logical_offset) < 0 ||
+	      _decompress(compressed_bl, &raw_bl) < 0) {
+	    continue;
+	  }
+	  bptr->shared_blob->bc.did_read(cache, 0, raw_bl);
+	} else {
+	  for (auto& req : r2r) {
+	    if (_verify_csum(o, &bptr->get_blob(), req.r_off, req.bl,
+			     req.regs.front().logical_offset) < 0) {
+	      continue;
+	    }
+	    bptr->shared_blob->bc.did_read(cache, req.r_off, req.bl);
+	  }
+	}
+      }
+    }
+    c->lock.unlock_shared();
+  }
+  if (!used) {
+    dout(20) << __func__ << " " << o->oid << " 0x" << std::hex << ctx->offset
+	     << "~" << ctx->length << std::dec << " discarded" << dendl;
+    o->readahead_end = 0;
+    logger->inc(l_bluestore_readahead_dropped);
+  }
+  readahead_inflight -= ctx->length;
+  delete ctx;
+
+  std::lock_guard l(readahead_lock);
+  if (--readahead_num_ios == 0) {
+    readahead_cond.notify_all();
+  }
+}
+
+void BlueStore::_readahead_drain()
+{
+  std::unique_lock l(readahead_lock);
+  readahead_cond.wait(l, [this] { return readahead_num_ios == 0; });
+}
+
+// =======================================================
+// compression threads
+
+static int _compress_hist_idx(int alg)
+{
+  switch (alg) {
+  case Compressor::COMP_ALG_SNAPPY:
+    return l_bluestore_compress_snappy_lat;
+  case Compressor::COMP_ALG_ZLIB:
+    return l_bluestore_compress_zlib_lat;
+  case Compressor::COMP_ALG_ZSTD:
+    return l_bluestore_compress_zstd_lat;
+#ifdef HAVE_LZ4
+  case Compressor::COMP_ALG_LZ4:
+    return l_bluestore_compress_lz4_lat;
+#endif
+#ifdef HAVE_BROTLI
+  case Compressor::COMP_ALG_BROTLI:
+    return l_bluestore_compress_brotli_lat;
+#endif
+  default:
+    return -1;
+  }
+}
+
+void BlueStore::_compress_start()
+{
+  auto n = cct->_conf.get_val<uint64_t>("bluestore_compression_threads");
+  dout(10) << __func__ << " " << n << " threads" << dendl;
+  compress_stop = false;
+  for (uint64_t i = 0; i < n; ++i) {
+    compress_threads.emplace_back(make_named_thread("bstore_compress", [this] {
+      _compress_thread();
+    }));
+  }
+}
+
+void BlueStore::_compress_stop()
+{
+  dout(10) << __func__ << dendl;
+  {
+    std::lock_guard l(compress_lock);
+    compress_stop = true;
+    compress_cond.notify_all();
+  }
+  for (auto& t : compress_threads) {
+    t.join();
+  }
+  compress_threads.clear();
+  ceph_assert(compress_queue.empty());
+}
+
+void BlueStore::_compress_thread()
+{
+  std::unique_lock l(compress_lock);
+  while (true) {
+    if (compress_queue.empty()) {
+      if (compress_stop) {
+	break;
+      }
+      compress_cond.wait(l);
+      continue;
+    }
+    auto batch = compress_queue.front();
+    size_t i = batch->next++;
+    if (i >= batch->jobs->size()) {
+      // all claimed; the submitter may still be waiting for the last ones
+      compress_queue.pop_front();
+      continue;
+    }
+    l.unlock();
+    (*batch->jobs)[i]();
+    l.lock();
+    if (++batch->done == batch->jobs->size()) {
+      compress_done_cond.notify_all();
+    }
+  }
+}
+
+void BlueStore::_compress_run(vector<std::function<void()>>& jobs)
+{
+  if (compress_threads.empty() || jobs.size() < 2) {
+    for (auto& j : jobs) {
+      j();
+    }
+    return;
+  }
+  compress_batch_t batch;
+  batch.jobs = &jobs;
+  {
+    std::lock_guard l(compress_lock);
+    compress_queue.push_back(&batch);
+    compress_cond.notify_all();
+  }
+  // work through the batch alongside the compress threads
+  size_t mine = 0;
+  for (size_t i = batch.next++; i < jobs.size(); i = batch.next++) {
+    jobs[i]();
+    ++mine;
+  }
+  std::unique_lock l(compress_lock);
+  batch.done += mine;
+  compress_done_cond.wait(l, [&] { return batch.done == jobs.size(); });
+  auto p = std::find(compress_queue.begin(), compress_queue.end(), &batch);
+  if (p != compress_queue.end()) {
+    compress_queue.erase(p);
+  }
+}
+
+// data tier
+
+uint32_t BlueStore::_tier_period() const
+{
+  auto age = std::chrono::duration_cast<std::chrono::seconds>(
+    mono_clock::now() - tier_epoch);
+  return age.count() / tier_half_life;
+}
+
+uint32_t BlueStore::_tier_touch(Onode *o)
+{
+  // rather than aging every onode, the heat of one is halved for each
+  // half life period that passed since it was last touched.  racing
+  // touches may lose a count, which is fine for a heuristic.
+  uint32_t period = _tier_period();
+  uint32_t heat = o->get_tier_heat(period);
+  if (heat < std::numeric_limits<uint32_t>::max()) {
+    ++heat;
+  }
+  o->tier_heat_period = period;
+  o->tier_heat = heat;
+  return heat;
+}
+
+void BlueStore::_tier_note_read(Collection *c, OnodeRef& o)
+{
+  uint32_t heat = _tier_touch(o.get());
+  auto promote_heat = cct->_conf.get_val<uint64_t>(
+    "bluestore_tier_promote_heat");
+  // queue an object once, as it gets to promote_heat
+  if (!promote_heat || heat != promote_heat ||
+      o->onode.has_flag(bluestore_onode_t::FLAG_TIER)) {
+    return;
+  }
+  dout(20) << __func__ << " " << c->cid << " " << o->oid << " heat " << heat
+	   << dendl;
+  std::lock_guard l(tier_lock);
+  if (tier_promote_queue.size() >= 1024) {
+    tier_promote_queue.pop_front();
+  }
+  tier_promote_queue.emplace_back(c, o->oid);
+}
+
+bool BlueStore::_tier_move_source(const TransContext *txc,
+				  const bluestore_blob_t& b)
+{
+  if (txc->tier_move == TransContext::TIER_MOVE_NONE) {
+    return false;
+  }
+  bool promote = txc->tier_move == TransContext::TIER_MOVE_PROMOTE;
+  for (auto& e : b.get_extents()) {
+    if (e.is_valid() && e.is_on_tier() != promote) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool BlueStore::_tier_has_room(uint64_t need, bool promote)
+{
+  // promotions fill the tier up to the low watermark only, so they can
+  // not chase out what was just written.  writes stop halfway between
+  // the high watermark and full, which leaves the migration some time
+  // to catch up before the tier runs out.
+  uint64_t size = tier_fm->get_size();
+  uint64_t used = size - tier_alloc->get_free();
+  uint64_t limit = promote ? tier_low : (tier_high + size) / 2;
+  return used + need <= limit;
+}
+
+void BlueStore::_tier_index(TransContext *txc, OnodeRef& o, bool on)
+{
+  if (o->onode.has_flag(bluestore_onode_t::FLAG_TIER) == on) {
+    return;
+  }
+  if (on) {
+    o->onode.set_flag(bluestore_onode_t::FLAG_TIER);
+    txc->t->set(PREFIX_TIER, o->key.c_str(), o->key.size(), bufferlist());
+  } else {
+    o->onode.clear_flag(bluestore_onode_t::FLAG_TIER);
+    txc->t->rmkey(PREFIX_TIER, o->key.c_str(), o->key.size());
+  }
+}
+
+void BlueStore::_tier_start()
+{
+  if (!bdev_tier) {
+    return;
+  }
+  dout(10) << __func__ << dendl;
+  tier_stop = false;
+  tier_thread = make_named_thread("bstore_tier", [this] {
+    _tier_thread_entry();
+  });
+}
+
+void BlueStore::_tier_stop()
+{
+  if (!tier_thread.joinable()) {
+    return;
+  }
+  dout(10) << __func__ << dendl;
+  {
+    std::lock_guard l(tier_lock);
+    tier_stop = true;
+    tier_cond.notify_all();
+  }
+  tier_thread.join();
+  tier_promote_queue.clear();
+  tier_scan_pos.clear();
+}
+
+void BlueStore::_tier_thread_entry()
+{
+  std::unique_lock l(tier_lock);
+  while (!tier_stop) {
+    l.unlock();
+    _tier_migrate_pass();
+    l.lock();
+    if (tier_stop) {
+      break;
+    }
+    tier_cond.wait_for(l, ceph::make_timespan(
+      cct->_conf.get_val<double>("bluestore_tier_migrate_interval")));
+  }
+}
+
+void BlueStore::_tier_migrate_pass()
+{
+  auto stopping = [this] {
+    std::lock_guard l(tier_lock);
+    return tier_stop;
+  };
+  uint64_t used = tier_fm->get_size() - tier_alloc->get_free();
+  logger->set(l_bluestore_tier_used_bytes, used);
+
+  if (used > tier_high) {
+    // demote the coldest of the next bluestore_tier_migrate_scan indexed
+    // objects, going on from where the previous pass left off
+    uint32_t period = _tier_period();
+    auto scan = cct->_conf.get_val<uint64_t>("bluestore_tier_migrate_scan");
+    vector<std::tuple<uint32_t, CollectionRef, ghobject_t>> candidates;
+    CollectionRef last;
+    KeyValueDB::Iterator it = db->get_iterator(PREFIX_TIER);
+    for (it->lower_bound(tier_scan_pos);
+	 it->valid() && candidates.size() < scan;
+	 it->next()) {
+      ghobject_t oid;
+      if (get_key_object(it->key(), &oid) < 0) {
+	derr << __func__ << " bad key " << pretty_binary_string(it->key())
+	     << dendl;
+	continue;
+      }
+      // keys are sorted by pool and hash; most share the previous pg
+      CollectionRef c = last && last->contains(oid) ?
+	last : _tier_find_collection(oid);
+      if (!c) {
+	dout(10) << __func__ << " no collection for " << oid << dendl;
+	continue;
+      }
+      last = c;
+      OnodeRef o = c->onode_map.lookup(oid);
+      candidates.emplace_back(o ? o->get_tier_heat(period) : 0, c, oid);
+    }
+    tier_scan_pos = it->valid() ? it->key() : string();
+    std::stable_sort(candidates.begin(), candidates.end(),
+		     [](const auto& a, const auto& b) {
+		       return std::get<0>(a) < std::get<0>(b);
+		     });
+    uint64_t want = used - tier_low, moved = 0;
+    dout(10) << __func__ << " used 0x" << std::hex << used << " want 0x"
+	     << want << std::dec << " of " << candidates.size()
+	     << " candidates" << dendl;
+    for (auto& [heat, c, oid] : candidates) {
+      if (moved >= want || stopping()) {
+	break;
+      }
+      dout(20) << __func__ << " demoting " << oid << " heat " << heat
+	       << dendl;
+      moved += _tier_move(c, oid, false);
+    }
+  }
+
+  while (_tier_has_room(0, true)) {
+    std::pair<CollectionRef, ghobject_t> obj;
+    {
+      std::lock_guard l(tier_lock);
+      if (tier_stop || tier_promote_queue.empty()) {
+	break;
+      }
+      obj = std::move(tier_promote_queue.back());
+      tier_promote_queue.pop_back();
+    }
+    dout(20) << __func__ << " promoting " << obj.second << dendl;
+    _tier_move(obj.first, obj.second, true);
+  }
+}
+
+BlueStore::CollectionRef BlueStore::_tier_find_collection(
+  const ghobject_t& oid)
+{
+  std::shared_lock l(coll_lock);
+  for (auto& p : coll_map) {
+    if (p.second->contains(oid)) {
+      return p.second;
+    }
   }
+  return CollectionRef();
+}
 
-  auto start = mono_clock::now();
-  o->extent_map.fault_range(db, offset, length);
-  log_latency(__func__,
-    l_bluestore_read_onode_meta_lat,
-    mono_clock::now() - start,
-    cct->_conf->bluestore_log_op_age);
-  _dump_onode<30>(cct, *o);
-
-  // for deep-scrub, we only read dirty cache and bypass clean cache in
-  // order to read underlying block device in case there are silent disk errors.
-  if (op_flags & CEPH_OSD_OP_FLAG_BYPASS_CLEAN_CACHE) {
-    dout(20) << __func__ << " will bypass cache and do direct read" << dendl;
-    read_cache_policy = BufferSpace::BYPASS_CLEAN_CACHE;
+uint64_t BlueStore::_tier_move(CollectionRef c, const ghobject_t& oid,
+			       bool promote)
+{
+  OpSequencer *osr = c->osr.get();
+  std::unique_lock pl(osr->prepare_lock);
+  TransContext *txc = _txc_create(c.get(), osr, nullptr);
+  txc->tier_move = promote ? TransContext::TIER_MOVE_PROMOTE :
+    TransContext::TIER_MOVE_DEMOTE;
+  spg_t pgid;
+  if (c->cid.is_pg(&pgid)) {
+    txc->osd_pool_id = pgid.pool();
   }
+  uint64_t moved = 0;
+  {
+    std::unique_lock l(c->lock);
+    OnodeRef o;
+    if (c->exists && c->contains(oid)) {
+      o = c->get_onode(oid, false);
+    }
+    if (o && o->exists) {
+      moved = _tier_rewrite(txc, c, o);
+    }
+  }
+  txc->bytes = moved;
+  _txc_calc_cost(txc);
+  _txc_write_nodes(txc, txc->t);
+  if (txc->deferred_txn) {
+    txc->deferred_txn->seq = ++deferred_seq;
+    bufferlist bl;
+    encode(*txc->deferred_txn, bl);
+    string key;
+    get_deferred_key(txc->deferred_txn->seq, &key);
+    txc->t->set(PREFIX_DEFERRED, key, bl);
+  }
+  _txc_finalize_kv(txc, txc->t);
+  pl.unlock();
 
-  // build blob-wise list to of stuff read (that isn't cached)
-  ready_regions_t ready_regions;
-  blobs2read_t blobs2read;
-  _read_cache(o, offset, length, read_cache_policy, ready_regions, blobs2read);
-
+  auto tstart = mono_clock::now();
+  if (!throttle.try_start_transaction(*db, *txc, tstart)) {
+    ++deferred_aggressive;
+    deferred_try_submit();
+    throttle.finish_start_transaction(*db, *txc, tstart);
+    --deferred_aggressive;
+  }
+  logger->inc(l_bluestore_txc);
+  _txc_state_proc(txc);
 
-  // read raw blob data.
-  start = mono_clock::now(); // for the sake of simplicity
-                             // measure the whole block below.
-                             // The error isn't that much...
-  vector<bufferlist> compressed_blob_bls;
-  IOContext ioc(cct, NULL, true); // allow EIO
-  r = _prepare_read_ioc(blobs2read, &compressed_blob_bls, &ioc);
-  // we always issue aio for reading, so errors other than EIO are not allowed
-  if (r < 0)
-    return r;
+  if (moved) {
+    logger->inc(promote ? l_bluestore_tier_promoted_objects :
+		l_bluestore_tier_demoted_objects);
+    logger->inc(promote ? l_bluestore_tier_promoted_bytes :
+		l_bluestore_tier_demoted_bytes, moved);
+  }
+  return moved;
+}
 
-  int64_t num_ios = length;
-  if (ioc.has_pending_aios()) {
-    num_ios = -ioc.get_num_ios();
-    bdev->aio_submit(&ioc);
-    dout(20) << __func__ << " waiting for aio" << dendl;
-    ioc.aio_wait();
-    r = ioc.get_return_value();
-    if (r < 0) {
-      ceph_assert(r == -EIO); // no other errors allowed
-      return -EIO;
+uint64_t BlueStore::_tier_rewrite(TransContext *txc, CollectionRef& c,
+				  OnodeRef& o)
+{
+  bool promote = txc->tier_move == TransContext::TIER_MOVE_PROMOTE;
+  o->extent_map.fault_range(db, 0, o->onode.size);
+  interval_set<uint64_t> ranges;
+  for (auto& e : o->extent_map.extent_map) {
+    if (_tier_move_source(txc, e.blob->get_blob())) {
+      ranges.union_insert(e.logical_offset, e.length);
     }
   }
-  log_latency_fn(__func__,
-    l_bluestore_read_wait_aio_lat,
-    mono_clock::now() - start,
-    cct->_conf->bluestore_log_op_age,
-    [&](auto lat) { return ", num_ios = " + stringify(num_ios); }
-  );
+  if (!promote && ranges.size() > alloc->get_free()) {
+    dout(1) << __func__ << " not enough space to demote " << o->oid
+	    << dendl;
+    return 0;
+  }
+  dout(15) << __func__ << " " << c->cid << " " << o->oid
+	   << (promote ? " promote" : " demote") << " 0x" << std::hex
+	   << ranges << std::dec << dendl;
 
-  bool csum_error = false;
-  r = _generate_read_result_bl(o, offset, length, ready_regions,
-                              compressed_blob_bls, blobs2read,
-                              buffered, &csum_error, bl);
-  if (csum_error) {
-    // Handles spurious read errors caused by a kernel bug.
-    // We sometimes get all-zero pages as a result of the read under
-    // high memory pressure. Retrying the failing read succeeds in most 
-    // cases.
-    // See also: http://tracker.ceph.com/issues/22464
-    if (retry_count >= cct->_conf->bluestore_retry_disk_reads) {
-      return -EIO;
+  uint64_t moved = 0;
+  for (auto p = ranges.begin(); p != ranges.end(); ++p) {
+    bufferlist bl;
+    int r = _do_read(c.get(), o, p.get_start(), p.get_len(), bl, 0);
+    if (r < 0) {
+      derr << __func__ << " " << o->oid << " read 0x" << std::hex
+	   << p.get_start() << "~" << p.get_len() << std::dec
+	   << " failed: " << cpp_strerror(r) << dendl;
+      return moved;
     }
-    return _do_read(c, o, offset, length, bl, op_flags, retry_count + 1);
+    r = _do_write(txc, c, o, p.get_start(), bl.length(), bl, 0);
+    if (r < 0) {
+      // _do_write leaves the onode half updated, as it would for a
+      // transaction (see _txc_add_transaction)
+      derr << __func__ << " " << o->oid << " write failed: "
+	   << cpp_strerror(r) << dendl;
+      ceph_abort_msg("unexpected error during tier migration");
+    }
+    moved += bl.length();
   }
-  r = bl.length();
-  if (retry_count) {
-    logger->inc(l_bluestore_reads_with_retries);
-    dout(5) << __func__ << " read at 0x" << std::hex << offset << "~" << length
-            << " failed " << std::dec << retry_count << " times before succeeding" << dendl;
+  if (!promote) {
+    _tier_index(txc, o, false);
   }
-  return r;
+  txc->write_onode(o);
+  return moved;
 }
 
 int BlueStore::_verify_csum(OnodeRef& o,
@@ -10084,6 +11974,12 @@ int BlueStore::readv(
     r = _do_readv(c, o, m, bl, op_flags);
     if (r == -EIO) {
       logger->inc(l_bluestore_read_eio);
+    } else if (r > 0) {
+      logger->inc(l_bluestore_logical_read_bytes, r);
+      c->pool_io->values[pool_io_t::IO_READ] += r;
+      if (bdev_tier) {
+	_tier_note_read(c, o);
+      }
     }
   }
 
@@ -10152,6 +12048,7 @@ int BlueStore::_do_readv(
   _dump_onode<30>(cct, *o);
 
   IOContext ioc(cct, NULL, true); // allow EIO
+  IOContext tier_ioc(cct, NULL, true);
   vector<std::tuple<ready_regions_t, vector<bufferlist>, blobs2read_t>> raw_results;
   raw_results.reserve(m.num_intervals());
   int i = 0;
@@ -10159,19 +12056,17 @@ int BlueStore::_do_readv(
     raw_results.push_back({});
     _read_cache(o, p.get_start(), p.get_len(), read_cache_policy,
                 std::get<0>(raw_results[i]), std::get<2>(raw_results[i]));
-    r = _prepare_read_ioc(std::get<2>(raw_results[i]), &std::get<1>(raw_results[i]), &ioc);
+    r = _prepare_read_ioc(c, std::get<2>(raw_results[i]), &std::get<1>(raw_results[i]), &ioc, &tier_ioc);
     // we always issue aio for reading, so errors other than EIO are not allowed
     if (r < 0)
       return r;
   }
 
   auto num_ios = m.size();
-  if (ioc.has_pending_aios()) {
-    num_ios = ioc.get_num_ios();
-    bdev->aio_submit(&ioc);
+  if (ioc.has_pending_aios() || tier_ioc.has_pending_aios()) {
+    num_ios = ioc.get_num_ios() + tier_ioc.get_num_ios();
     dout(20) << __func__ << " waiting for aio" << dendl;
-    ioc.aio_wait();
-    r = ioc.get_return_value();
+    r = _aio_read_wait(&ioc, &tier_ioc);
     if (r < 0) {
       ceph_assert(r == -EIO); // no other errors allowed
       return -EIO;
@@ -10374,13 +12269,16 @@ int BlueStore::collection_list(
   vector<ghobject_t> *ls, ghobject_t *pnext)
 {
   Collection *c = static_cast<Collection *>(c_.get());
+  // before the flush, so that a cursor is only ever reused when nothing
+  // was created or removed since the iterator it holds was
+  uint64_t list_gen = c->list_gen;
   c->flush();
   dout(15) << __func__ << " " << c->cid
            << " start " << start << " end " << end << " max " << max << dendl;
   int r;
   {
     std::shared_lock l(c->lock);
-    r = _collection_list(c, start, end, max, ls, pnext);
+    r = _collection_list(c, start, end, max, ls, pnext, &list_gen);
   }
 
   dout(10) << __func__ << " " << c->cid
@@ -10392,7 +12290,7 @@ int BlueStore::collection_list(
 
 int BlueStore::_collection_list(
   Collection *c, const ghobject_t& start, const ghobject_t& end, int max,
-  vector<ghobject_t> *ls, ghobject_t *pnext)
+  vector<ghobject_t> *ls, ghobject_t *pnext, const uint64_t *list_gen)
 {
 
   if (!c->exists)
@@ -10407,6 +12305,10 @@ int BlueStore::_collection_list(
   bool set_next = false;
   string pend;
   bool temp;
+  uint64_t max_cursors = list_gen ?
+    cct->_conf.get_val<uint64_t>("bluestore_collection_list_cursors") : 0;
+  auto cursor_age = ceph::make_timespan(
+    cct->_conf.get_val<double>("bluestore_collection_list_cursor_age"));
 
   if (!pnext)
     pnext = &static_next;
@@ -10422,10 +12324,32 @@ int BlueStore::_collection_list(
     << " and " << pretty_binary_string(start_key)
     << " to " << pretty_binary_string(end_key)
     << " start " << start << dendl;
-  it = db->get_iterator(PREFIX_OBJ);
-  if (start == ghobject_t() ||
+  if (max_cursors) {
+    std::lock_guard l(c->list_cursor_lock);
+    auto& cursors = c->list_cursors;
+    for (auto p = cursors.begin(); p != cursors.end(); ) {
+      if (p->gen < *list_gen ||
+	  (cursor_age > ceph::timespan::zero() && p->stamp + cursor_age < start_time)) {
+	p = cursors.erase(p);
+      } else if (!it && p->gen == *list_gen && p->next == start &&
+		 p->end == end) {
+	it = std::move(p->it);
+	temp = p->temp;
+	p = cursors.erase(p);
+      } else {
+	++p;
+      }
+    }
+  }
+  if (it) {
+    dout(20) << __func__ << " resume from cursor at "
+	     << pretty_binary_string(it->key()) << " temp=" << (int)temp
+	     << dendl;
+    logger->inc(l_bluestore_clist_cursor_hit);
+  } else if (start == ghobject_t() ||
     start.hobj == hobject_t() ||
     start == c->cid.get_min_hobj()) {
+    it = db->get_iterator(PREFIX_OBJ, {temp_start_key, temp_end_key});
     it->upper_bound(temp_start_key);
     temp = true;
   } else {
@@ -10434,9 +12358,11 @@ int BlueStore::_collection_list(
     if (start.hobj.is_temp()) {
       temp = true;
       ceph_assert(k >= temp_start_key && k < temp_end_key);
+      it = db->get_iterator(PREFIX_OBJ, {temp_start_key, temp_end_key});
     } else {
       temp = false;
       ceph_assert(k >= start_key && k < end_key);
+      it = db->get_iterator(PREFIX_OBJ, {start_key, end_key});
     }
     dout(20) << __func__ << " start from " << pretty_binary_string(k)
       << " temp=" << (int)temp << dendl;
@@ -10469,6 +12395,7 @@ int BlueStore::_collection_list(
 	}
 	dout(30) << __func__ << " switch to non-temp namespace" << dendl;
 	temp = false;
+	it = db->get_iterator(PREFIX_OBJ, {start_key, end_key});
 	it->upper_bound(start_key);
 	pend = end_key;
 	dout(30) << __func__ << " pend " << pretty_binary_string(pend) << dendl;
@@ -10494,6 +12421,16 @@ int BlueStore::_collection_list(
     ls->push_back(oid);
     it->next();
   }
+  if (set_next && max_cursors) {
+    // it is still at *pnext, for the next page to pick up from
+    std::lock_guard l(c->list_cursor_lock);
+    c->list_cursors.push_front(
+      Collection::list_cursor_t{std::move(it), *pnext, end, temp, *list_gen,
+				mono_clock::now()});
+    while (c->list_cursors.size() > max_cursors) {
+      c->list_cursors.pop_back();
+    }
+  }
 out:
   if (!set_next) {
     *pnext = ghobject_t::get_max();
@@ -11005,6 +12942,7 @@ void BlueStore::_assign_nid(TransContext *txc, OnodeRef o)
   o->onode.nid = nid;
   txc->last_nid = nid;
   o->exists = true;
+  ++o->c->list_gen;
 }
 
 uint64_t BlueStore::_assign_blobid(TransContext *txc)
@@ -11035,7 +12973,7 @@ BlueStore::TransContext *BlueStore::_txc_create(
 void BlueStore::_txc_calc_cost(TransContext *txc)
 {
   // one "io" for the kv commit
-  auto ios = 1 + txc->ioc.get_num_ios();
+  auto ios = 1 + txc->ioc.get_num_ios() + txc->tier_ioc.get_num_ios();
   auto cost = throttle_cost_per_io.load();
   txc->cost = ios * cost + txc->bytes;
   txc->ios = ios;
@@ -11085,7 +13023,7 @@ void BlueStore::_txc_state_proc(TransContext *txc)
     switch (txc->state) {
     case TransContext::STATE_PREPARE:
       throttle.log_state_latency(*txc, logger, l_bluestore_state_prepare_lat);
-      if (txc->ioc.has_pending_aios()) {
+      if (txc->ioc.has_pending_aios() || txc->tier_ioc.has_pending_aios()) {
 	txc->state = TransContext::STATE_AIO_WAIT;
 	txc->had_ios = true;
 	_txc_aio_submit(txc);
@@ -11139,7 +13077,22 @@ void BlueStore::_txc_state_proc(TransContext *txc)
 	  _txc_apply_kv(txc, true);
 	}
       }
-      {
+      if (KVSyncLane *lane = _get_kv_lane(txc->osr.get()); lane) {
+	std::lock_guard l(lane->lock);
+	lane->queue.push_back(txc);
+	if (!lane->in_progress) {
+	  lane->in_progress = true;
+	  lane->cond.notify_one();
+	}
+	if (txc->state != TransContext::STATE_KV_SUBMITTED) {
+	  lane->queue_unsubmitted.push_back(txc);
+	  ++txc->osr->kv_committing_serially;
+	}
+	if (txc->had_ios)
+	  lane->ios++;
+	lane->throttle_costs += txc->cost;
+	lane->logger->set(l_bluestore_kv_lane_queued, lane->queue.size());
+      } else {
 	std::lock_guard l(kv_lock);
 	kv_queue.push_back(txc);
 	if (!kv_sync_in_progress) {
@@ -11153,6 +13106,7 @@ void BlueStore::_txc_state_proc(TransContext *txc)
 	if (txc->had_ios)
 	  kv_ios++;
 	kv_throttle_costs += txc->cost;
+	logger->set(l_bluestore_kv_queued, kv_queue.size());
       }
       return;
     case TransContext::STATE_KV_SUBMITTED:
@@ -11201,6 +13155,7 @@ void BlueStore::_txc_finish_io(TransContext *txc)
   std::lock_guard l(osr->qlock);
   txc->state = TransContext::STATE_IO_DONE;
   txc->ioc.release_running_aios();
+  txc->tier_ioc.release_running_aios();
   OpSequencer::q_list_t::iterator p = osr->q.iterator_to(*txc);
   while (p != osr->q.begin()) {
     --p;
@@ -11281,6 +13236,37 @@ void BlueStore::BSPerfTracker::update_from_perfcounters(
       l_bluestore_commit_lat));
 }
 
+BlueStore::pool_io_t *BlueStore::_get_pool_io(const coll_t& cid)
+{
+  spg_t pgid;
+  uint64_t pool_id = cid.is_pg(&pgid) ? pgid.pool() : META_POOL_ID;
+  std::lock_guard l(vstatfs_lock);
+  return &osd_pools_io[pool_id];
+}
+
+void BlueStore::_txc_account_io(TransContext *txc)
+{
+  if (txc->deferred_txn) {
+    for (auto& op : txc->deferred_txn->ops) {
+      txc->io[pool_io_t::IO_DEFERRED_WRITTEN] += op.data.length();
+    }
+  }
+  txc->io[pool_io_t::IO_KV_WRITTEN] = txc->t->get_size_bytes();
+
+  logger->inc(l_bluestore_logical_write_bytes,
+	      txc->io[pool_io_t::IO_WRITTEN]);
+  logger->inc(l_bluestore_data_write_bytes,
+	      txc->io[pool_io_t::IO_DATA_WRITTEN]);
+  logger->inc(l_bluestore_kv_write_bytes, txc->io[pool_io_t::IO_KV_WRITTEN]);
+
+  auto& pool_io = *txc->ch->pool_io;
+  for (size_t i = 0; i < pool_io_t::IO_LAST; ++i) {
+    if (txc->io[i]) {
+      pool_io.values[i] += txc->io[i];
+    }
+  }
+}
+
 void BlueStore::_txc_finalize_kv(TransContext *txc, KeyValueDB::Transaction t)
 {
   dout(20) << __func__ << " txc " << txc << std::hex
@@ -11326,7 +13312,28 @@ void BlueStore::_txc_finalize_kv(TransContext *txc, KeyValueDB::Transaction t)
     fm->release(p.get_start(), p.get_len(), t);
   }
 
+  // and the same for the data tier's freelist
+  if (!txc->tier_allocated.empty() || !txc->tier_released.empty()) {
+    interval_set<uint64_t> allocated = txc->tier_allocated;
+    interval_set<uint64_t> released = txc->tier_released;
+    if (!allocated.empty() && !released.empty()) {
+      interval_set<uint64_t> overlap;
+      overlap.intersection_of(allocated, released);
+      allocated.subtract(overlap);
+      released.subtract(overlap);
+    }
+    dout(20) << __func__ << " tier allocated 0x" << std::hex << allocated
+	     << " released 0x" << released << std::dec << dendl;
+    for (auto p = allocated.begin(); p != allocated.end(); ++p) {
+      tier_fm->allocate(p.get_start(), p.get_len(), t);
+    }
+    for (auto p = released.begin(); p != released.end(); ++p) {
+      tier_fm->release(p.get_start(), p.get_len(), t);
+    }
+  }
+
   _txc_update_store_statfs(txc);
+  _txc_account_io(txc);
 }
 
 void BlueStore::_txc_apply_kv(TransContext *txc, bool sync_submit_transaction)
@@ -11503,8 +13510,14 @@ void BlueStore::_txc_release_alloc(TransContext *txc)
   }
 
 out:
+  if (!txc->tier_released.empty() &&
+      likely(!cct->_conf->bluestore_debug_no_reuse_blocks)) {
+    tier_alloc->release(txc->tier_released);
+  }
   txc->allocated.clear();
   txc->released.clear();
+  txc->tier_allocated.clear();
+  txc->tier_released.clear();
 }
 
 void BlueStore::_osr_attach(Collection *c)
@@ -11662,14 +13675,56 @@ void BlueStore::_kv_start()
 {
   dout(10) << __func__ << dendl;
 
+  ceph_assert(kv_sync_lanes.empty());
+  auto lanes = cct->_conf.get_val<uint64_t>("bluestore_kv_sync_lanes");
+  for (unsigned i = 1; i < lanes; ++i) {
+    KVSyncLane *lane = new KVSyncLane(this, i);
+    PerfCountersBuilder b(cct, "bluestore-kv-lane-" + stringify(i),
+			  l_bluestore_kv_lane_first, l_bluestore_kv_lane_last);
+    b.add_u64(l_bluestore_kv_lane_queued, "kv_queued",
+	      "Transactions waiting for this kv commit lane");
+    b.add_u64_avg(l_bluestore_kv_lane_batch, "kv_batch",
+		  "Average transactions per lane commit");
+    b.add_time_avg(l_bluestore_kv_lane_flush_lat, "kv_flush_lat",
+		   "Average lane flush latency");
+    b.add_time_avg(l_bluestore_kv_lane_commit_lat, "kv_commit_lat",
+		   "Average lane commit latency");
+    b.add_time_avg(l_bluestore_kv_lane_sync_lat, "kv_sync_lat",
+		   "Average lane sync latency");
+    lane->logger = b.create_perf_counters();
+    cct->get_perfcounters_collection()->add(lane->logger);
+    kv_sync_lanes.push_back(lane);
+  }
+  dout(10) << __func__ << " " << kv_sync_lanes.size() + 1 << " kv sync lanes"
+	   << dendl;
+
   finisher.start();
   kv_sync_thread.create("bstore_kv_sync");
   kv_finalize_thread.create("bstore_kv_final");
+  for (auto lane : kv_sync_lanes) {
+    lane->create(lane->lane_name.c_str());
+  }
 }
 
 void BlueStore::_kv_stop()
 {
   dout(10) << __func__ << dendl;
+  for (auto lane : kv_sync_lanes) {
+    {
+      std::unique_lock l{lane->lock};
+      while (!lane->started) {
+	lane->cond.wait(l);
+      }
+      lane->stop = true;
+      lane->cond.notify_all();
+    }
+    lane->join();
+    ceph_assert(lane->queue.empty());
+    cct->get_perfcounters_collection()->remove(lane->logger);
+    delete lane->logger;
+    delete lane;
+  }
+  kv_sync_lanes.clear();
   {
     std::unique_lock l{kv_lock};
     while (!kv_sync_started) {
@@ -11713,9 +13768,11 @@ void BlueStore::_kv_sync_thread()
   kv_cond.notify_all();
   while (true) {
     ceph_assert(kv_committing.empty());
+    // with multiple lanes most txcs bypass this thread, so deferred
+    // cleanup can't wait for the next commit to piggyback on.
     if (kv_queue.empty() &&
 	((deferred_done_queue.empty() && deferred_stable_queue.empty()) ||
-	 !deferred_aggressive)) {
+	 (!deferred_aggressive && kv_sync_lanes.empty()))) {
       if (kv_stop)
 	break;
       dout(20) << __func__ << " sleep" << dendl;
@@ -11740,6 +13797,7 @@ void BlueStore::_kv_sync_thread()
       costs = kv_throttle_costs;
       kv_ios = 0;
       kv_throttle_costs = 0;
+      logger->set(l_bluestore_kv_queued, 0);
       l.unlock();
 
       dout(30) << __func__ << " committing " << kv_committing << dendl;
@@ -11775,7 +13833,7 @@ void BlueStore::_kv_sync_thread()
 		 << " force_flush=" << (int)force_flush
 		 << ", flushing, deferred done->stable" << dendl;
 	// flush/barrier on block device
-	bdev->flush();
+	_flush_data_bdevs();
 
 	// if we flush then deferred done are now deferred stable
 	deferred_stable.insert(deferred_stable.end(), deferred_done.begin(),
@@ -11787,29 +13845,8 @@ void BlueStore::_kv_sync_thread()
       // we will use one final transaction to force a sync
       KeyValueDB::Transaction synct = db->get_transaction();
 
-      // increase {nid,blobid}_max?  note that this covers both the
-      // case where we are approaching the max and the case we passed
-      // it.  in either case, we increase the max in the earlier txn
-      // we submit.
       uint64_t new_nid_max = 0, new_blobid_max = 0;
-      if (nid_last + cct->_conf->bluestore_nid_prealloc/2 > nid_max) {
-	KeyValueDB::Transaction t =
-	  kv_submitting.empty() ? synct : kv_submitting.front()->t;
-	new_nid_max = nid_last + cct->_conf->bluestore_nid_prealloc;
-	bufferlist bl;
-	encode(new_nid_max, bl);
-	t->set(PREFIX_SUPER, "nid_max", bl);
-	dout(10) << __func__ << " new_nid_max " << new_nid_max << dendl;
-      }
-      if (blobid_last + cct->_conf->bluestore_blobid_prealloc/2 > blobid_max) {
-	KeyValueDB::Transaction t =
-	  kv_submitting.empty() ? synct : kv_submitting.front()->t;
-	new_blobid_max = blobid_last + cct->_conf->bluestore_blobid_prealloc;
-	bufferlist bl;
-	encode(new_blobid_max, bl);
-	t->set(PREFIX_SUPER, "blobid_max", bl);
-	dout(10) << __func__ << " new_blobid_max " << new_blobid_max << dendl;
-      }
+      _kv_reserve_max(kv_submitting, synct, &new_nid_max, &new_blobid_max);
 
       for (auto txc : kv_committing) {
 	throttle.log_state_latency(*txc, logger, l_bluestore_state_kv_queued_lat);
@@ -11904,14 +13941,8 @@ void BlueStore::_kv_sync_thread()
 	}
       }
 
-      if (new_nid_max) {
-	nid_max = new_nid_max;
-	dout(10) << __func__ << " nid_max now " << nid_max << dendl;
-      }
-      if (new_blobid_max) {
-	blobid_max = new_blobid_max;
-	dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
-      }
+      _kv_publish_max(new_nid_max, new_blobid_max);
+      logger->inc(l_bluestore_kv_batch, committing_size);
 
       {
 	auto finish = mono_clock::now();
@@ -11969,6 +14000,164 @@ clear:
   kv_sync_started = false;
 }
 
+void BlueStore::_kv_reserve_max(
+  const deque<TransContext*>& kv_submitting,
+  KeyValueDB::Transaction synct,
+  uint64_t *new_nid_max,
+  uint64_t *new_blobid_max)
+{
+  std::unique_lock l{kv_max_lock};
+  // a txc using ids past the committed max must not become durable
+  // before the increase covering it.  if another lane has one in flight,
+  // wait for it to land rather than racing it with a second update.
+  while (kv_max_updating &&
+	 std::any_of(kv_submitting.begin(), kv_submitting.end(),
+		     [this](TransContext *txc) {
+		       return txc->last_nid >= nid_max ||
+			 txc->last_blobid >= blobid_max;
+		     })) {
+    dout(20) << __func__ << " waiting for {nid,blobid}_max update" << dendl;
+    kv_max_cond.wait(l);
+  }
+  if (kv_max_updating) {
+    return;
+  }
+
+  // increase {nid,blobid}_max?  note that this covers both the
+  // case where we are approaching the max and the case we passed
+  // it.  in either case, we increase the max in the earlier txn
+  // we submit.
+  if (nid_last + cct->_conf->bluestore_nid_prealloc/2 > nid_max) {
+    KeyValueDB::Transaction t =
+      kv_submitting.empty() ? synct : kv_submitting.front()->t;
+    *new_nid_max = nid_last + cct->_conf->bluestore_nid_prealloc;
+    bufferlist bl;
+    encode(*new_nid_max, bl);
+    t->set(PREFIX_SUPER, "nid_max", bl);
+    dout(10) << __func__ << " new_nid_max " << *new_nid_max << dendl;
+  }
+  if (blobid_last + cct->_conf->bluestore_blobid_prealloc/2 > blobid_max) {
+    KeyValueDB::Transaction t =
+      kv_submitting.empty() ? synct : kv_submitting.front()->t;
+    *new_blobid_max = blobid_last + cct->_conf->bluestore_blobid_prealloc;
+    bufferlist bl;
+    encode(*new_blobid_max, bl);
+    t->set(PREFIX_SUPER, "blobid_max", bl);
+    dout(10) << __func__ << " new_blobid_max " << *new_blobid_max << dendl;
+  }
+  kv_max_updating = *new_nid_max || *new_blobid_max;
+}
+
+void BlueStore::_kv_publish_max(uint64_t new_nid_max, uint64_t new_blobid_max)
+{
+  if (!new_nid_max && !new_blobid_max) {
+    return;
+  }
+  std::lock_guard l{kv_max_lock};
+  if (new_nid_max) {
+    nid_max = new_nid_max;
+    dout(10) << __func__ << " nid_max now " << nid_max << dendl;
+  }
+  if (new_blobid_max) {
+    blobid_max = new_blobid_max;
+    dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
+  }
+  kv_max_updating = false;
+  kv_max_cond.notify_all();
+}
+
+void BlueStore::_kv_sync_lane_thread(KVSyncLane *lane)
+{
+  dout(10) << __func__ << " " << lane->id << " start" << dendl;
+  std::unique_lock l{lane->lock};
+  ceph_assert(!lane->started);
+  lane->started = true;
+  lane->cond.notify_all();
+  while (true) {
+    if (lane->queue.empty()) {
+      if (lane->stop)
+	break;
+      dout(20) << __func__ << " " << lane->id << " sleep" << dendl;
+      lane->in_progress = false;
+      lane->cond.wait(l);
+      dout(20) << __func__ << " " << lane->id << " wake" << dendl;
+    } else {
+      deque<TransContext*> kv_committing, kv_submitting;
+      kv_committing.swap(lane->queue);
+      kv_submitting.swap(lane->queue_unsubmitted);
+      uint64_t aios = lane->ios;
+      uint64_t costs = lane->throttle_costs;
+      lane->ios = 0;
+      lane->throttle_costs = 0;
+      lane->logger->set(l_bluestore_kv_lane_queued, 0);
+      l.unlock();
+
+      dout(20) << __func__ << " " << lane->id
+	       << " committing " << kv_committing.size()
+	       << " submitting " << kv_submitting.size() << dendl;
+
+      auto start = mono_clock::now();
+
+      // data must be stable before the metadata that references it
+      if (aios) {
+	_flush_data_bdevs();
+      }
+      auto after_flush = mono_clock::now();
+
+      KeyValueDB::Transaction synct = db->get_transaction();
+      uint64_t new_nid_max = 0, new_blobid_max = 0;
+      _kv_reserve_max(kv_submitting, synct, &new_nid_max, &new_blobid_max);
+
+      for (auto txc : kv_committing) {
+	throttle.log_state_latency(*txc, logger, l_bluestore_state_kv_queued_lat);
+	if (txc->state == TransContext::STATE_KV_QUEUED) {
+	  _txc_apply_kv(txc, false);
+	  --txc->osr->kv_committing_serially;
+	} else {
+	  ceph_assert(txc->state == TransContext::STATE_KV_SUBMITTED);
+	}
+	if (txc->had_ios) {
+	  --txc->osr->txc_with_unstable_io;
+	}
+      }
+      throttle.release_kv_throttle(costs);
+
+      // the wal is shared, so rocksdb groups concurrent syncs from
+      // all lanes into as few fsyncs as it can
+      int r = cct->_conf->bluestore_debug_omit_kv_commit ? 0 : db->submit_transaction_sync(synct);
+      ceph_assert(r == 0);
+      _kv_publish_max(new_nid_max, new_blobid_max);
+
+      auto finish = mono_clock::now();
+      lane->logger->inc(l_bluestore_kv_lane_batch, kv_committing.size());
+      lane->logger->tinc(l_bluestore_kv_lane_flush_lat, after_flush - start);
+      lane->logger->tinc(l_bluestore_kv_lane_commit_lat, finish - after_flush);
+      lane->logger->tinc(l_bluestore_kv_lane_sync_lat, finish - start);
+      log_latency("kv_sync",
+	l_bluestore_kv_sync_lat,
+	finish - start,
+	cct->_conf->bluestore_log_op_age);
+
+      // finalize here; the lane owns its sequencers end to end
+      for (auto txc : kv_committing) {
+	ceph_assert(txc->state == TransContext::STATE_KV_SUBMITTED);
+	_txc_state_proc(txc);
+      }
+      if (!deferred_aggressive) {
+	if (deferred_queue_size >= deferred_batch_ops.load() ||
+	    throttle.should_submit_deferred()) {
+	  deferred_try_submit();
+	}
+      }
+      _reap_collections();
+
+      l.lock();
+    }
+  }
+  dout(10) << __func__ << " " << lane->id << " finish" << dendl;
+  lane->started = false;
+}
+
 void BlueStore::_kv_finalize_thread()
 {
   deque<TransContext*> kv_committed;
@@ -12129,19 +14318,34 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
   for (auto& txc : b->txcs) {
     throttle.log_state_latency(txc, logger, l_bluestore_state_deferred_queued_lat);
   }
+  // Adjacent extents go out as a single vectored write referencing the
+  // queued buffers as they are.  A run is cut short of IOV_MAX segments;
+  // past that the device would rebuild (copy) the whole run into fewer,
+  // larger buffers.
   uint64_t start = 0, pos = 0;
   bufferlist bl;
   auto i = b->iomap.begin();
   while (true) {
-    if (i == b->iomap.end() || i->first != pos) {
+    if (i == b->iomap.end() || i->first != pos ||
+	bl.get_num_buffers() + i->second.bl.get_num_buffers() > IOV_MAX) {
       if (bl.length()) {
 	dout(20) << __func__ << " write 0x" << std::hex
 		 << start << "~" << bl.length()
 		 << " crc " << bl.crc32c(-1) << std::dec << dendl;
 	if (!g_conf()->bluestore_debug_omit_block_device_write) {
+	  uint64_t unaligned = 0;
+	  for (auto& p : bl.buffers()) {
+	    if (!p.is_aligned(block_size) || !p.is_n_align_sized(block_size)) {
+	      unaligned += p.length();
+	    }
+	  }
 	  logger->inc(l_bluestore_deferred_write_ops);
 	  logger->inc(l_bluestore_deferred_write_bytes, bl.length());
-	  int r = bdev->aio_write(start, bl, &b->ioc, false);
+	  logger->inc(l_bluestore_deferred_write_unaligned_bytes, unaligned);
+	  uint64_t offset = start;
+	  BlockDevice *dev = _data_bdev(&offset);
+	  int r = dev->aio_write(offset, bl,
+				 _data_ioc(dev, &b->ioc, &b->tier_ioc), false);
 	  ceph_assert(r == 0);
 	}
       }
@@ -12163,7 +14367,7 @@ void BlueStore::_deferred_submit_unlock(OpSequencer *osr)
     ++i;
   }
 
-  bdev->aio_submit(&b->ioc);
+  _aio_submit(b, &b->ioc, &b->tier_ioc);
 }
 
 struct C_DeferredTrySubmit : public Context {
@@ -12218,8 +14422,10 @@ void BlueStore::_deferred_aio_finish(OpSequencer *osr)
     deferred_done_queue.emplace_back(b);
 
     // in the normal case, do not bother waking up the kv thread; it will
-    // catch us on the next commit anyway.
-    if (deferred_aggressive && !kv_sync_in_progress) {
+    // catch us on the next commit anyway.  that doesn't hold with
+    // multiple kv sync lanes, where our txcs may never pass through it.
+    if ((deferred_aggressive || !kv_sync_lanes.empty()) &&
+	!kv_sync_in_progress) {
 	kv_sync_in_progress = true;
 	kv_cond.notify_one();
     }
@@ -12293,6 +14499,7 @@ int BlueStore::queue_transactions(
   dout(10) << __func__ << " ch " << c << " " << c->cid << dendl;
 
   // prepare
+  std::unique_lock pl(osr->prepare_lock);
   TransContext *txc = _txc_create(static_cast<Collection*>(ch.get()), osr,
 				  &on_commit);
 
@@ -12315,6 +14522,7 @@ int BlueStore::queue_transactions(
   }
 
   _txc_finalize_kv(txc, txc->t);
+  pl.unlock();
   if (handle)
     handle->suspend_tp_timeout();
 
@@ -12376,7 +14584,34 @@ int BlueStore::queue_transactions(
 void BlueStore::_txc_aio_submit(TransContext *txc)
 {
   dout(10) << __func__ << " txc " << txc << dendl;
-  bdev->aio_submit(&txc->ioc);
+  _aio_submit(txc, &txc->ioc, &txc->tier_ioc);
+}
+
+void BlueStore::_aio_submit(AioContext *c, IOContext *ioc, IOContext *tier_ioc)
+{
+  if (!tier_ioc->has_pending_aios()) {
+    c->num_iocs = 1;
+    bdev->aio_submit(ioc);
+    return;
+  }
+  bool main = ioc->has_pending_aios();
+  c->num_iocs = main ? 2 : 1;
+  if (main) {
+    bdev->aio_submit(ioc);
+  }
+  bdev_tier->aio_submit(tier_ioc);
+}
+
+int BlueStore::_aio_read_wait(IOContext *ioc, IOContext *tier_ioc)
+{
+  bdev->aio_submit(ioc);
+  if (tier_ioc->has_pending_aios()) {
+    bdev_tier->aio_submit(tier_ioc);
+  }
+  ioc->aio_wait();
+  tier_ioc->aio_wait();
+  int r = ioc->get_return_value();
+  return r < 0 ? r : tier_ioc->get_return_value();
 }
 
 void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
@@ -12807,7 +15042,7 @@ void BlueStore::_pad_zeros(
     ceph_assert(back_pad == 0);
     back_pad = chunk_size - back_copy;
     ceph_assert(back_copy <= length);
-    bufferptr tail(chunk_size);
+    bufferptr tail = buffer::create_small_page_aligned(chunk_size);
     bl->begin(length - back_copy).copy(back_copy, tail.c_str());
     tail.zero(back_copy, back_pad, false);
     bufferlist old;
@@ -12907,6 +15142,8 @@ void BlueStore::_do_write_small(
 	dout(20) << __func__ << " ignoring distant " << *b << dendl;
       } else if (!b->get_blob().is_mutable()) {
 	dout(20) << __func__ << " ignoring immutable " << *b << dendl;
+      } else if (_tier_move_source(txc, b->get_blob())) {
+	dout(20) << __func__ << " ignoring tier migrated " << *b << dendl;
       } else if (ep->logical_offset % min_alloc_size !=
 		  ep->blob_offset % min_alloc_size) {
 	dout(20) << __func__ << " ignoring offset-skewed " << *b << dendl;
@@ -12962,8 +15199,11 @@ void BlueStore::_do_write_small(
 	      b->get_blob().map_bl(
 		b_off, bl,
 		[&](uint64_t offset, bufferlist& t) {
-		  bdev->aio_write(offset, t,
-				  &txc->ioc, wctx->buffered);
+		  txc->io[pool_io_t::IO_DATA_WRITTEN] += t.length();
+		  BlockDevice *dev = _data_bdev(&offset);
+		  dev->aio_write(offset, t,
+				 _data_ioc(dev, &txc->ioc, &txc->tier_ioc),
+				 wctx->buffered);
 		});
 	    }
 	  }
@@ -13114,7 +15354,8 @@ void BlueStore::_do_write_small(
       auto bstart = prev_ep->blob_start();
       dout(20) << __func__ << " considering " << *b
 	       << " bstart 0x" << std::hex << bstart << std::dec << dendl;
-      if (b->can_reuse_blob(min_alloc_size,
+      if (!_tier_move_source(txc, b->get_blob()) &&
+	  b->can_reuse_blob(min_alloc_size,
 			    max_bsize,
                             offset0 - bstart,
                             &alloc_len)) {
@@ -13229,6 +15470,7 @@ void BlueStore::_do_write_big(
 	any_change = false;
 	if (ep != end && ep->logical_offset < offset + max_bsize) {
 	  if (offset >= ep->blob_start() &&
+	      !_tier_move_source(txc, ep->blob->get_blob()) &&
               ep->blob->can_reuse_blob(min_alloc_size, max_bsize,
 	                               offset - ep->blob_start(),
 	                               &l)) {
@@ -13244,7 +15486,8 @@ void BlueStore::_do_write_big(
 	}
 
 	if (prev_ep != end && prev_ep->logical_offset >= min_off) {
-	  if (prev_ep->blob->can_reuse_blob(min_alloc_size, max_bsize,
+	  if (!_tier_move_source(txc, prev_ep->blob->get_blob()) &&
+	      prev_ep->blob->can_reuse_blob(min_alloc_size, max_bsize,
                                     	    offset - prev_ep->blob_start(),
                                     	    &l)) {
 	    b = prev_ep->blob;
@@ -13340,20 +15583,38 @@ int BlueStore::_do_alloc_write(
     }
   );
 
-  // compress (as needed) and calc needed space
+  // compress (as needed), all blobs at once
+  size_t nwrites = wctx->writes.size();
+  vector<bufferlist> compressed_bls(c ? nwrites : 0);
+  vector<int> compress_rs(c ? nwrites : 0);
+  vector<mono_clock::duration> compress_lats(c ? nwrites : 0);
+  if (c) {
+    vector<std::function<void()>> jobs;
+    for (size_t i = 0; i < nwrites; ++i) {
+      auto& wi = wctx->writes[i];
+      if (wi.blob_length > min_alloc_size) {
+	ceph_assert(wi.b_off == 0);
+	ceph_assert(wi.blob_length == wi.bl.length());
+	jobs.emplace_back([&, i] {
+	  auto start = mono_clock::now();
+	  // FIXME: memory alignment here is bad
+	  compress_rs[i] = c->compress(wctx->writes[i].bl, compressed_bls[i]);
+	  compress_lats[i] = mono_clock::now() - start;
+	});
+      }
+    }
+    _compress_run(jobs);
+  }
+
+  // calc needed space
   uint64_t need = 0;
   auto max_bsize = std::max(wctx->target_blob_size, min_alloc_size);
-  for (auto& wi : wctx->writes) {
+  for (size_t i = 0; i < nwrites; ++i) {
+    auto& wi = wctx->writes[i];
     if (c && wi.blob_length > min_alloc_size) {
       auto start = mono_clock::now();
-
-      // compress
-      ceph_assert(wi.b_off == 0);
-      ceph_assert(wi.blob_length == wi.bl.length());
-
-      // FIXME: memory alignment here is bad
-      bufferlist t;
-      int r = c->compress(wi.bl, t);
+      bufferlist& t = compressed_bls[i];
+      int r = compress_rs[i];
       uint64_t want_len_raw = wi.blob_length * crr;
       uint64_t want_len = p2roundup(want_len_raw, min_alloc_size);
       bool rejected = false;
@@ -13413,10 +15674,17 @@ int BlueStore::_do_alloc_write(
 	logger->inc(l_bluestore_compress_rejected_count);
 	need += wi.blob_length;
       }
+      auto lat = compress_lats[i] + (mono_clock::now() - start);
       log_latency("compress@_do_alloc_write",
 	l_bluestore_compress_lat,
-        mono_clock::now() - start,
+	lat,
 	cct->_conf->bluestore_log_op_age );
+      int hist = _compress_hist_idx(c->get_type());
+      if (hist >= 0) {
+	logger->hinc(hist,
+		     std::chrono::duration_cast<std::chrono::nanoseconds>(lat).count(),
+		     wi.blob_length);
+      }
     } else {
       need += wi.blob_length;
     }
@@ -13424,9 +15692,45 @@ int BlueStore::_do_alloc_write(
   PExtentVector prealloc;
   prealloc.reserve(2 * wctx->writes.size());;
   int64_t prealloc_left = 0;
-  prealloc_left = alloc->allocate(
-    need, min_alloc_size, need,
-    0, &prealloc);
+  bool on_tier = false;
+  if (bdev_tier &&
+      txc->tier_move != TransContext::TIER_MOVE_DEMOTE &&
+      (txc->tier_move == TransContext::TIER_MOVE_PROMOTE ||
+       need <= tier_max_write_size)) {
+    if (_tier_has_room(need,
+		       txc->tier_move == TransContext::TIER_MOVE_PROMOTE)) {
+      prealloc_left = tier_alloc->allocate(
+	need, min_alloc_size, need,
+	0, &prealloc);
+      if (prealloc_left >= (int64_t)need) {
+	on_tier = true;
+	for (auto& e : prealloc) {
+	  txc->tier_allocated.insert(e.offset, e.length);
+	  e.offset |= bluestore_pextent_t::TIER_FLAG;
+	}
+	_tier_index(txc, o, true);
+	if (txc->tier_move == TransContext::TIER_MOVE_NONE) {
+	  logger->inc(l_bluestore_tier_write_bytes, need);
+	}
+      } else {
+	dout(10) << __func__ << " tier allocation of 0x" << std::hex << need
+		 << " came up short, 0x" << (prealloc_left < 0 ? 0 : prealloc_left)
+		 << std::dec << dendl;
+	if (prealloc.size()) {
+	  tier_alloc->release(prealloc);
+	  prealloc.clear();
+	}
+	logger->inc(l_bluestore_tier_full);
+      }
+    } else {
+      logger->inc(l_bluestore_tier_full);
+    }
+  }
+  if (!on_tier) {
+    prealloc_left = alloc->allocate(
+      need, min_alloc_size, need,
+      0, &prealloc);
+  }
   if (prealloc_left < 0 || prealloc_left < (int64_t)need) {
     derr << __func__ << " failed to allocate 0x" << std::hex << need
          << " allocated 0x " << (prealloc_left < 0 ? 0 : prealloc_left)
@@ -13509,8 +15813,10 @@ int BlueStore::_do_alloc_write(
 	break;
       }
     }
-    for (auto& p : extents) {
-      txc->allocated.insert(p.offset, p.length);
+    if (!on_tier) {
+      for (auto& p : extents) {
+	txc->allocated.insert(p.offset, p.length);
+      }
     }
     dblob.allocated(p2align(b_off, min_alloc_size), final_length, extents);
 
@@ -13542,7 +15848,7 @@ int BlueStore::_do_alloc_write(
 
     // queue io
     if (!g_conf()->bluestore_debug_omit_block_device_write) {
-      if (l->length() <= prefer_deferred_size.load()) {
+      if (!on_tier && l->length() <= prefer_deferred_size.load()) {
 	dout(20) << __func__ << " deferring small 0x" << std::hex
 		 << l->length() << std::dec << " write via deferred" << dendl;
 	bluestore_deferred_op_t *op = _get_deferred_op(txc);
@@ -13560,7 +15866,10 @@ int BlueStore::_do_alloc_write(
 	b->get_blob().map_bl(
 	  b_off, *l,
 	  [&](uint64_t offset, bufferlist& t) {
-	    bdev->aio_write(offset, t, &txc->ioc, false);
+	    txc->io[pool_io_t::IO_DATA_WRITTEN] += t.length();
+	    BlockDevice *dev = _data_bdev(&offset);
+	    dev->aio_write(offset, t,
+			   _data_ioc(dev, &txc->ioc, &txc->tier_ioc), false);
 	  });
 	logger->inc(l_bluestore_write_small_new);
       }
@@ -13626,7 +15935,12 @@ void BlueStore::_wctx_finish(
     b->discard_unallocated(c.get());
     for (auto e : r) {
       dout(20) << __func__ << "  release " << e << dendl;
-      txc->released.insert(e.offset, e.length);
+      if (e.is_on_tier()) {
+	txc->tier_released.insert(e.offset & ~bluestore_pextent_t::TIER_FLAG,
+				  e.length);
+      } else {
+	txc->released.insert(e.offset, e.length);
+      }
       txc->statfs_delta.allocated() -= e.length;
       if (blob.is_compressed()) {
         txc->statfs_delta.compressed_allocated() -= e.length;
@@ -13952,8 +16266,12 @@ int BlueStore::_write(TransContext *txc,
     r = -E2BIG;
   } else {
     _assign_nid(txc, o);
+    if (bdev_tier) {
+      _tier_touch(o.get());
+    }
     r = _do_write(txc, c, o, offset, length, bl, fadvise_flags);
     txc->write_onode(o);
+    txc->io[pool_io_t::IO_WRITTEN] += length;
   }
   dout(10) << __func__ << " " << c->cid << " " << o->oid
 	   << " 0x" << std::hex << offset << "~" << length << std::dec
@@ -14083,6 +16401,7 @@ int BlueStore::_do_remove(
     _do_omap_clear(txc, o);
   }
   o->exists = false;
+  ++c->list_gen;
   string key;
   for (auto &s : o->extent_map.shards) {
     dout(20) << __func__ << "  removing shard 0x" << std::hex
@@ -14094,6 +16413,7 @@ int BlueStore::_do_remove(
     );
   }
   txc->t->rmkey(PREFIX_OBJ, o->key.c_str(), o->key.size());
+  _tier_index(txc, o, false);
   txc->note_removed_object(o);
   o->extent_map.clear();
   o->onode = bluestore_onode_t();
@@ -14344,6 +16664,7 @@ int BlueStore::_omap_setkeys(TransContext *txc,
     dout(20) << __func__ << "  " << pretty_binary_string(final_key)
 	     << " <- " << key << dendl;
     txc->t->set(prefix, final_key, value);
+    txc->io[pool_io_t::IO_WRITTEN] += key.length() + value.length();
   }
   r = 0;
   dout(10) << __func__ << " " << c->cid << " " << o->oid << " = " << r << dendl;
@@ -14377,6 +16698,7 @@ int BlueStore::_omap_setheader(TransContext *txc,
   const string& prefix = o->get_omap_prefix();
   o->get_omap_header(&key);
   txc->t->set(prefix, key, bl);
+  txc->io[pool_io_t::IO_WRITTEN] += bl.length();
   r = 0;
   dout(10) << __func__ << " " << c->cid << " " << o->oid << " = " << r << dendl;
   return r;
@@ -14573,6 +16895,10 @@ int BlueStore::_do_clone_range(
   _dump_onode<30>(cct, *newo);
 
   oldo->extent_map.dup(this, txc, c, oldo, newo, srcoff, length, dstoff);
+  if (oldo->onode.has_flag(bluestore_onode_t::FLAG_TIER)) {
+    // the shared blobs may be on the data tier
+    _tier_index(txc, newo, true);
+  }
   _dump_onode<30>(cct, *oldo);
   _dump_onode<30>(cct, *newo);
   return 0;
@@ -14648,11 +16974,17 @@ int BlueStore::_rename(TransContext *txc,
   }
 
   txc->t->rmkey(PREFIX_OBJ, oldo->key.c_str(), oldo->key.size());
+  ++c->list_gen;
 
   // rewrite shards
   {
     oldo->extent_map.fault_range(db, 0, oldo->onode.size);
     get_object_key(cct, new_oid, &new_okey);
+    if (oldo->onode.has_flag(bluestore_onode_t::FLAG_TIER)) {
+      txc->t->rmkey(PREFIX_TIER, oldo->key.c_str(), oldo->key.size());
+      txc->t->set(PREFIX_TIER, new_okey.c_str(), new_okey.size(),
+		  bufferlist());
+    }
     string key;
     for (auto &s : oldo->extent_map.shards) {
       generate_extent_shard_key_and_apply(oldo->key, s.shard_info->offset, &key,
@@ -14789,6 +17121,7 @@ void BlueStore::_do_remove_collection(TransContext *txc,
   coll_map.erase((*c)->cid);
   txc->removed_collections.push_back(*c);
   (*c)->exists = false;
+  (*c)->clear_list_cursors();
   _osr_register_zombie((*c)->osr.get());
   txc->t->rmkey(PREFIX_COLL, stringify((*c)->cid));
   c->reset();
@@ -14835,6 +17168,8 @@ int BlueStore::_split_collection(TransContext *txc,
   // split call for this parent (first child).
   c->cnode.bits = bits;
   ceph_assert(d->cnode.bits == bits);
+  ++c->list_gen;
+  ++d->list_gen;
   r = 0;
 
   bufferlist bl;
@@ -14881,6 +17216,7 @@ int BlueStore::_merge_collection(
   // adjust bits.  note that this will be redundant for all but the first
   // merge call for the parent/target.
   d->cnode.bits = bits;
+  ++d->list_gen;
 
   // behavior depends on target (d) bits, so this after that is updated.
   (*c)->split_cache(d.get());
@@ -15286,6 +17622,8 @@ void BlueStore::_flush_cache()
     ceph_assert(i->empty());
   }
   for (auto& p : coll_map) {
+    // the cursors' iterators must not outlive the db
+    p.second->clear_list_cursors();
     if (!p.second->onode_map.empty()) {
       derr << __func__ << " stray onodes on " << p.first << dendl;
       p.second->onode_map.dump<0>(cct);
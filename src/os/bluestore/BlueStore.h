@@ -71,6 +71,8 @@ enum {
   l_bluestore_kv_commit_lat,
   l_bluestore_kv_sync_lat,
   l_bluestore_kv_final_lat,
+  l_bluestore_kv_queued,
+  l_bluestore_kv_batch,
   l_bluestore_state_prepare_lat,
   l_bluestore_state_aio_wait_lat,
   l_bluestore_state_io_done_lat,
@@ -89,6 +91,11 @@ enum {
   l_bluestore_read_onode_meta_lat,
   l_bluestore_read_wait_aio_lat,
   l_bluestore_compress_lat,
+  l_bluestore_compress_snappy_lat,
+  l_bluestore_compress_zlib_lat,
+  l_bluestore_compress_zstd_lat,
+  l_bluestore_compress_lz4_lat,
+  l_bluestore_compress_brotli_lat,
   l_bluestore_decompress_lat,
   l_bluestore_csum_lat,
   l_bluestore_compress_success_count,
@@ -96,6 +103,7 @@ enum {
   l_bluestore_write_pad_bytes,
   l_bluestore_deferred_write_ops,
   l_bluestore_deferred_write_bytes,
+  l_bluestore_deferred_write_unaligned_bytes,
   l_bluestore_write_penalty_read_ops,
   l_bluestore_allocated,
   l_bluestore_stored,
@@ -106,6 +114,7 @@ enum {
   l_bluestore_pinned_onodes,
   l_bluestore_onode_hits,
   l_bluestore_onode_misses,
+  l_bluestore_onode_ghost_hits,
   l_bluestore_onode_shard_hits,
   l_bluestore_onode_shard_misses,
   l_bluestore_extents,
@@ -114,6 +123,7 @@ enum {
   l_bluestore_buffer_bytes,
   l_bluestore_buffer_hit_bytes,
   l_bluestore_buffer_miss_bytes,
+  l_bluestore_buffer_ghost_hits,
   l_bluestore_write_big,
   l_bluestore_write_big_bytes,
   l_bluestore_write_big_blobs,
@@ -130,15 +140,46 @@ enum {
   l_bluestore_gc_merged,
   l_bluestore_read_eio,
   l_bluestore_reads_with_retries,
+  l_bluestore_readahead_ios,
+  l_bluestore_readahead_bytes,
+  l_bluestore_readahead_hit_bytes,
+  l_bluestore_readahead_dropped,
   l_bluestore_fragmentation,
   l_bluestore_omap_seek_to_first_lat,
   l_bluestore_omap_upper_bound_lat,
   l_bluestore_omap_lower_bound_lat,
   l_bluestore_omap_next_lat,
+  l_bluestore_omap_next_batch_lat,
   l_bluestore_clist_lat,
+  l_bluestore_clist_cursor_hit,
+  l_bluestore_tier_used_bytes,
+  l_bluestore_tier_write_bytes,
+  l_bluestore_tier_read_bytes,
+  l_bluestore_tier_full,
+  l_bluestore_tier_demoted_objects,
+  l_bluestore_tier_demoted_bytes,
+  l_bluestore_tier_promoted_objects,
+  l_bluestore_tier_promoted_bytes,
+  l_bluestore_logical_write_bytes,
+  l_bluestore_data_write_bytes,
+  l_bluestore_kv_write_bytes,
+  l_bluestore_logical_read_bytes,
+  l_bluestore_data_read_bytes,
   l_bluestore_last
 };
 
+// per-lane counters for the additional kv commit lanes; lane 0 is the
+// kv_sync_thread and reports through the main bluestore counters.
+enum {
+  l_bluestore_kv_lane_first = 732700,
+  l_bluestore_kv_lane_queued,
+  l_bluestore_kv_lane_batch,
+  l_bluestore_kv_lane_flush_lat,
+  l_bluestore_kv_lane_commit_lat,
+  l_bluestore_kv_lane_sync_lat,
+  l_bluestore_kv_lane_last
+};
+
 #define META_POOL_ID ((uint64_t)-1ull)
 
 class BlueStore : public ObjectStore,
@@ -174,6 +215,8 @@ public:
   typedef boost::intrusive_ptr<Collection> CollectionRef;
 
   struct AioContext {
+    /// IOContexts of ours still running, see _aio_submit()
+    std::atomic<int> num_iocs = {0};
     virtual void aio_finish(BlueStore *store) = 0;
     virtual ~AioContext() {}
   };
@@ -379,6 +422,9 @@ public:
 	      interval_set<uint32_t>& res_intervals,
 	      int flags = 0);
 
+    /// true if offset~length is all in clean or writing buffers
+    bool is_cached(BufferCacheShard* cache, uint32_t offset, uint32_t length);
+
     void truncate(BufferCacheShard* cache, uint32_t offset) {
       discard(cache, offset, (uint32_t)-1 - offset);
     }
@@ -1057,6 +1103,7 @@ public:
     // Not persisted and updated on cache insertion/removal
     OnodeCacheShard *s;
     bool pinned = false; // Only to be used by the onode cache shard
+    uint16_t cache_private = 0; ///< opaque (to us) value used by Cache impl
 
     std::atomic_int nref;  ///< reference count
     Collection *c;
@@ -1080,6 +1127,24 @@ public:
     ceph::mutex flush_lock = ceph::make_mutex("BlueStore::Onode::flush_lock");
     ceph::condition_variable flush_cond;   ///< wait here for uncommitted txns
 
+    // sequential read stream detection, see BlueStore::_maybe_readahead()
+    std::atomic<uint64_t> readahead_next = {0};  ///< end of the last read
+    std::atomic<uint64_t> readahead_end = {0};   ///< end of prefetched range
+    std::atomic<uint32_t> readahead_window = {0};
+    std::atomic<uint32_t> readahead_seq = {0};   ///< back-to-back seq reads
+    std::atomic<uint32_t> readahead_gen = {0};   ///< bumped on every update
+
+    // access heat for data tier placement, see BlueStore::_tier_touch()
+    std::atomic<uint32_t> tier_heat = {0};        ///< decayed access count
+    std::atomic<uint32_t> tier_heat_period = {0}; ///< of the last access
+
+    /// tier_heat as of half life period
+    uint32_t get_tier_heat(uint32_t period) const {
+      uint32_t last = tier_heat_period;
+      uint32_t shift = period > last ? period - last : 0;
+      return shift >= 32 ? 0 : tier_heat >> shift;
+    }
+
     Onode(Collection *c, const ghobject_t& o,
 	  const mempool::bluestore_cache_other::string& k)
       : s(nullptr),
@@ -1306,10 +1371,13 @@ public:
   class OpSequencer;
   using OpSequencerRef = ceph::ref_t<OpSequencer>;
 
+  struct pool_io_t;
+
   struct Collection : public CollectionImpl {
     BlueStore *store;
     OpSequencerRef osr;
     BufferCacheShard *cache;       ///< our cache shard
+    pool_io_t *pool_io;            ///< I/O accounting of our pool
     bluestore_cnode_t cnode;
     ceph::shared_mutex lock =
       ceph::make_shared_mutex("BlueStore::Collection::lock", true, false);
@@ -1326,6 +1394,34 @@ public:
     pool_opts_t pool_opts;
     ContextQueue *commit_queue;
 
+    /// where a collection_list() page stopped, for the next to resume from
+    struct list_cursor_t {
+      KeyValueDB::Iterator it;  ///< positioned at next
+      ghobject_t next, end;
+      bool temp;                ///< it is in the temp namespace
+      uint64_t gen;             ///< list_gen it was created under
+      mono_clock::time_point stamp;  ///< when it was left there
+    };
+    ceph::mutex list_cursor_lock =
+      ceph::make_mutex("BlueStore::Collection::list_cursor_lock");
+    std::list<list_cursor_t> list_cursors;  ///< most recent first
+    /// bumped whenever objects are created or removed, or the collection
+    /// is split or merged, which outdates the list_cursors
+    std::atomic<uint64_t> list_gen = {0};
+
+    void clear_list_cursors() {
+      std::lock_guard l(list_cursor_lock);
+      list_cursors.clear();
+    }
+    /// drop the cursors left before @p before: their iterators pin the
+    /// db's memtables and sst files for as long as they live
+    void expire_list_cursors(mono_clock::time_point before) {
+      std::lock_guard l(list_cursor_lock);
+      list_cursors.remove_if([before](const list_cursor_t& p) {
+	return p.stamp < before;
+      });
+    }
+
     OnodeRef get_onode(const ghobject_t& oid, bool create, bool is_createop=false);
 
     // the terminology is confusing here, sorry!
@@ -1391,6 +1487,8 @@ public:
     int next() override;
     string key() override;
     bufferlist value() override;
+    size_t next_batch(size_t max_entries, size_t max_bytes,
+		      KeyValueDB::IteratorBatch *batch) override;
     std::string tail_key() {
       return tail;
     }
@@ -1490,6 +1588,29 @@ public:
     }
   };
 
+  /// I/O done on behalf of a pool, since the store was instantiated
+  struct pool_io_t {
+    enum {
+      IO_WRITTEN = 0,       ///< logical data and omap bytes
+      IO_DATA_WRITTEN,      ///< written to the data device directly
+      IO_DEFERRED_WRITTEN,  ///< written to the data device via the kv WAL
+      IO_KV_WRITTEN,        ///< kv transaction bytes
+      IO_READ,              ///< logical data bytes
+      IO_DATA_READ,         ///< read from the data device
+      IO_LAST
+    };
+    std::atomic<uint64_t> values[IO_LAST] = {};
+
+    void publish(store_statfs_t* buf) const {
+      buf->io_written = values[IO_WRITTEN];
+      buf->io_data_written = values[IO_DATA_WRITTEN];
+      buf->io_deferred_written = values[IO_DEFERRED_WRITTEN];
+      buf->io_kv_written = values[IO_KV_WRITTEN];
+      buf->io_read = values[IO_READ];
+      buf->io_data_read = values[IO_DATA_READ];
+    }
+  };
+
   struct TransContext final : public AioContext {
     MEMPOOL_CLASS_HELPERS();
 
@@ -1563,10 +1684,19 @@ public:
     bluestore_deferred_transaction_t *deferred_txn = nullptr; ///< if any
 
     interval_set<uint64_t> allocated, released;
+    interval_set<uint64_t> tier_allocated, tier_released; ///< on bdev_tier
+    /// a tier migration: where the data it rewrites has to go
+    enum {
+      TIER_MOVE_NONE,
+      TIER_MOVE_DEMOTE,   ///< off the data tier
+      TIER_MOVE_PROMOTE,  ///< onto the data tier
+    } tier_move = TIER_MOVE_NONE;
     volatile_statfs statfs_delta;	   ///< overall store statistics delta
+    uint64_t io[pool_io_t::IO_LAST] = {};  ///< I/O to account to ch->pool_io
     uint64_t osd_pool_id = META_POOL_ID;    ///< osd pool id we're operating on
     
     IOContext ioc;
+    IOContext tier_ioc;    ///< aios for bdev_tier
     bool had_ios = false;  ///< true if we submitted IOs before our kv txn
 
     uint64_t seq = 0;
@@ -1585,6 +1715,7 @@ public:
       : ch(c),
 	osr(o),
 	ioc(cct, this),
+	tier_ioc(cct, this),
 	start(mono_clock::now()) {
       last_stamp = start;
       if (on_commits) {
@@ -1596,6 +1727,7 @@ public:
     }
 
     void write_onode(OnodeRef &o) {
+      ++o->readahead_gen;
       onodes.insert(o);
     }
     void write_shared_blob(SharedBlobRef &sb) {
@@ -1608,9 +1740,11 @@ public:
     /// note we logically modified object (when onode itself is unmodified)
     void note_modified_object(OnodeRef &o) {
       // onode itself isn't written, though
+      ++o->readahead_gen;
       modified_objects.insert(o);
     }
     void note_removed_object(OnodeRef& o) {
+      ++o->readahead_gen;
       onodes.erase(o);
       modified_objects.insert(o);
     }
@@ -1744,6 +1878,7 @@ public:
     map<uint64_t,deferred_io> iomap; ///< map of ios in this batch
     deferred_queue_t txcs;           ///< txcs in this batch
     IOContext ioc;                   ///< our aios
+    IOContext tier_ioc;              ///< our aios for bdev_tier
     /// bytes of pending io for each deferred seq (may be 0)
     map<uint64_t,int> seq_bytes;
 
@@ -1751,7 +1886,7 @@ public:
     void _audit(CephContext *cct);
 
     DeferredBatch(CephContext *cct, OpSequencer *osr)
-      : osr(osr), ioc(cct, this) {}
+      : osr(osr), ioc(cct, this), tier_ioc(cct, this) {}
 
     /// prepare a write
     void prepare_write(CephContext *cct,
@@ -1766,6 +1901,10 @@ public:
   class OpSequencer : public RefCountedObject {
   public:
     ceph::mutex qlock = ceph::make_mutex("BlueStore::OpSequencer::qlock");
+    /// serializes preparing txcs, which the OSD does from one thread at a
+    /// time anyway, with the tier migration doing it too
+    ceph::mutex prepare_lock =
+      ceph::make_mutex("BlueStore::OpSequencer::prepare_lock");
     ceph::condition_variable qcond;
     typedef boost::intrusive::list<
       TransContext,
@@ -1914,6 +2053,32 @@ public:
     }
   };
 
+  /// additional kv commit lane (see bluestore_kv_sync_lanes).  a lane
+  /// batches, submits and syncs the txcs of the sequencers mapped to it
+  /// and finalizes them itself; deferred io is left to kv_sync_thread.
+  struct KVSyncLane : public Thread {
+    BlueStore *store;
+    const unsigned id;
+    const std::string lane_name;            ///< thread name, must outlive it
+    ceph::mutex lock = ceph::make_mutex("BlueStore::KVSyncLane::lock");
+    ceph::condition_variable cond;
+    bool started = false;
+    bool stop = false;
+    bool in_progress = false;
+    deque<TransContext*> queue;             ///< ready, already submitted
+    deque<TransContext*> queue_unsubmitted; ///< ready, need submit by lane
+    uint64_t ios = 0;
+    uint64_t throttle_costs = 0;
+    PerfCounters *logger = nullptr;
+
+    KVSyncLane(BlueStore *s, unsigned id)
+      : store(s), id(id), lane_name("bstore_kv_ln" + std::to_string(id)) {}
+    void *entry() override {
+      store->_kv_sync_lane_thread(this);
+      return NULL;
+    }
+  };
+
   struct DBHistogram {
     struct value_dist {
       uint64_t count;
@@ -1950,6 +2115,22 @@ private:
   std::string freelist_type;
   FreelistManager *fm = nullptr;
   Allocator *alloc = nullptr;
+
+  // data tier, see _open_tier()
+  BlockDevice *bdev_tier = nullptr;
+  FreelistManager *tier_fm = nullptr;
+  Allocator *tier_alloc = nullptr;
+  uint64_t tier_max_write_size = 0;
+  uint64_t tier_high = 0, tier_low = 0;  ///< used bytes watermarks
+  mono_time tier_epoch;                  ///< heat periods count from here
+  uint32_t tier_half_life = 0;           ///< of heat, in seconds
+  ceph::mutex tier_lock = ceph::make_mutex("BlueStore::tier_lock");
+  ceph::condition_variable tier_cond;
+  std::thread tier_thread;
+  bool tier_stop = false;
+  /// objects to promote, most recent last
+  std::deque<std::pair<CollectionRef, ghobject_t>> tier_promote_queue;
+  std::string tier_scan_pos;  ///< PREFIX_TIER key to look on from
   uuid_d fsid;
   int path_fd = -1;  ///< open handle to $path
   int fsid_fd = -1;  ///< open handle (locked) to $path/fsid
@@ -1975,6 +2156,7 @@ private:
 
   interval_set<uint64_t> bluefs_extents;  ///< block extents owned by bluefs
   interval_set<uint64_t> bluefs_extents_reclaiming; ///< currently reclaiming
+  uint64_t alloc_snapshot_seq = 0;  ///< last allocator snapshot seen/written
 
   ceph::mutex deferred_lock = ceph::make_mutex("BlueStore::deferred_lock");
   std::atomic<uint64_t> deferred_seq = {0};
@@ -2005,8 +2187,17 @@ private:
   deque<DeferredBatch*> deferred_stable_to_finalize; ///< pending finalization
   bool kv_finalize_in_progress = false;
 
+  vector<KVSyncLane*> kv_sync_lanes; ///< lanes 1..n-1; fixed while mounted
+
+  /// serializes {nid,blobid}_max increases across kv commit lanes
+  ceph::mutex kv_max_lock = ceph::make_mutex("BlueStore::kv_max_lock");
+  ceph::condition_variable kv_max_cond;
+  bool kv_max_updating = false;  ///< an increase is waiting for its commit
+
   PerfCounters *logger = nullptr;
 
+  /// protect removed_collections; kv commit lanes finalize txcs, too
+  ceph::mutex reap_lock = ceph::make_mutex("BlueStore::reap_lock");
   list<CollectionRef> removed_collections;
 
   ceph::shared_mutex debug_read_error_lock =
@@ -2052,6 +2243,26 @@ private:
   uint64_t kv_ios = 0;
   uint64_t kv_throttle_costs = 0;
 
+  // readahead, see _maybe_readahead()
+  std::atomic<uint64_t> readahead_budget = {0};   ///< set by MempoolThread
+  std::atomic<uint64_t> readahead_inflight = {0}; ///< bytes being prefetched
+  ceph::mutex readahead_lock = ceph::make_mutex("BlueStore::readahead_lock");
+  ceph::condition_variable readahead_cond;
+  unsigned readahead_num_ios = 0;  ///< prefetches not yet completed
+
+  // compression threads, see _compress_run()
+  struct compress_batch_t {
+    std::vector<std::function<void()>> *jobs = nullptr;
+    std::atomic<size_t> next = {0};  ///< next job to claim
+    size_t done = 0;                 ///< protected by compress_lock
+  };
+  ceph::mutex compress_lock = ceph::make_mutex("BlueStore::compress_lock");
+  ceph::condition_variable compress_cond;       ///< work queued, or stop
+  ceph::condition_variable compress_done_cond;  ///< a batch finished
+  deque<compress_batch_t*> compress_queue;
+  vector<std::thread> compress_threads;
+  bool compress_stop = false;
+
   // cache trim control
   uint64_t cache_size = 0;       ///< total cache size
   double cache_meta_ratio = 0;   ///< cache ratio dedicated to metadata
@@ -2072,6 +2283,9 @@ private:
   ceph::mutex vstatfs_lock = ceph::make_mutex("BlueStore::vstatfs_lock");
   volatile_statfs vstatfs;
   osd_pools_map osd_pools; // protected by vstatfs_lock as well
+  /// protected by vstatfs_lock as well; entries are never removed, so
+  /// Collections can keep pointers to them
+  map<uint64_t, pool_io_t> osd_pools_io;
 
   bool per_pool_stat_collection = true;
 
@@ -2179,6 +2393,8 @@ private:
         for (auto i : store->buffer_cache_shards) {
           bytes += i->_get_bytes();
         }
+        // prefetched data is about to land in the buffer cache
+        bytes += store->readahead_inflight;
         return bytes; 
       }
       virtual string get_cache_name() const {
@@ -2239,6 +2455,33 @@ private:
   // its initialization (and outside of _open_bdev)
   void _validate_bdev();
   void _close_bdev();
+  int _open_tier(bool read_only);
+  void _close_tier();
+
+  /// the device an extent offset of a blob is on; strips the tier flag
+  BlockDevice *_data_bdev(uint64_t *offset) {
+    if (*offset & bluestore_pextent_t::TIER_FLAG) {
+      ceph_assert(bdev_tier);
+      *offset &= ~bluestore_pextent_t::TIER_FLAG;
+      return bdev_tier;
+    }
+    return bdev;
+  }
+  /// the IOContext for aios to dev: each device runs only its own aios
+  IOContext *_data_ioc(BlockDevice *dev, IOContext *ioc, IOContext *tier_ioc) {
+    return dev == bdev ? ioc : tier_ioc;
+  }
+  /// submit the aios of c to their devices; c->aio_finish() runs once
+  /// all are done
+  void _aio_submit(AioContext *c, IOContext *ioc, IOContext *tier_ioc);
+  /// submit the aios of a synchronous read and wait for them
+  int _aio_read_wait(IOContext *ioc, IOContext *tier_ioc);
+  void _flush_data_bdevs() {
+    bdev->flush();
+    if (bdev_tier) {
+      bdev_tier->flush();
+    }
+  }
 
   int _minimal_open_bluefs(bool create);
   void _minimal_close_bluefs();
@@ -2274,6 +2517,9 @@ private:
   void _close_fm();
   int _open_alloc();
   void _close_alloc();
+  int _load_alloc_snapshot(uint64_t *num, uint64_t *bytes);
+  void _write_alloc_snapshot();
+  void _invalidate_alloc_snapshot(bool db_open = true);
   int _open_collections();
   void _fsck_collections(int64_t* errors);
   void _close_collections();
@@ -2309,6 +2555,8 @@ private:
   void _queue_reap_collection(CollectionRef& c);
   void _reap_collections();
   void _update_cache_logger();
+  /// drop the collection list cursors older than @p age seconds
+  void _expire_list_cursors(double age);
 
   void _assign_nid(TransContext *txc, OnodeRef o);
   uint64_t _assign_blobid(TransContext *txc);
@@ -2323,6 +2571,8 @@ private:
   TransContext *_txc_create(Collection *c, OpSequencer *osr,
 			    list<Context*> *on_commits);
   void _txc_update_store_statfs(TransContext *txc);
+  pool_io_t *_get_pool_io(const coll_t& cid);
+  void _txc_account_io(TransContext *txc);
   void _txc_add_transaction(TransContext *txc, Transaction *t);
   void _txc_calc_cost(TransContext *txc);
   void _txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t);
@@ -2350,6 +2600,21 @@ private:
   void _kv_stop();
   void _kv_sync_thread();
   void _kv_finalize_thread();
+  void _kv_sync_lane_thread(KVSyncLane *lane);
+
+  /// lane for the given sequencer, or nullptr for kv_sync_thread
+  KVSyncLane *_get_kv_lane(const OpSequencer *osr) const {
+    if (kv_sync_lanes.empty()) {
+      return nullptr;
+    }
+    unsigned n = osr->get_sequencer_id() % (kv_sync_lanes.size() + 1);
+    return n ? kv_sync_lanes[n - 1] : nullptr;
+  }
+  void _kv_reserve_max(const deque<TransContext*>& kv_submitting,
+		       KeyValueDB::Transaction synct,
+		       uint64_t *new_nid_max,
+		       uint64_t *new_blobid_max);
+  void _kv_publish_max(uint64_t new_nid_max, uint64_t new_blobid_max);
 
   bluestore_deferred_op_t *_get_deferred_op(TransContext *txc);
   void _deferred_queue(TransContext *txc);
@@ -2408,9 +2673,12 @@ private:
     txc->shared_blobs_written.insert(b->shared_blob);
   }
 
+  /// list_gen, if given, is Collection::list_gen as of before the
+  /// collection was flushed, and lets the listing use list_cursors
   int _collection_list(
     Collection *c, const ghobject_t& start, const ghobject_t& end,
-    int max, vector<ghobject_t> *ls, ghobject_t *next);
+    int max, vector<ghobject_t> *ls, ghobject_t *next,
+    const uint64_t *list_gen = nullptr);
 
   template <typename T, typename F>
   T select_option(const std::string& opt_name, T val1, F f) {
@@ -2597,6 +2865,12 @@ public:
     bufferlist& bl,
     uint32_t op_flags = 0) override;
 
+  bool is_cached(
+    CollectionHandle &c,
+    const ghobject_t& oid,
+    uint64_t offset,
+    size_t len) override;
+
 private:
 
   // --------------------------------------------------------
@@ -2656,9 +2930,11 @@ private:
 
 
   int _prepare_read_ioc(
+    Collection* c,
     blobs2read_t& blobs2read,
     vector<bufferlist>* compressed_blob_bls,
-    IOContext* ioc);
+    IOContext* ioc,
+    IOContext* tier_ioc);
 
   int _generate_read_result_bl(
     OnodeRef o,
@@ -2688,6 +2964,57 @@ private:
     uint32_t op_flags = 0,
     uint64_t retry_count = 0);
 
+  /// asynchronous prefetch of the extents following a sequential read
+  struct ReadaheadContext final : public AioContext {
+    CollectionRef c;
+    OnodeRef o;
+    uint32_t gen;                 ///< o->readahead_gen when issued
+    uint64_t offset, length;      ///< logical range, charged to the budget
+    blobs2read_t blobs2read;
+    vector<bufferlist> compressed_blob_bls;
+    IOContext ioc;
+    IOContext tier_ioc;
+
+    ReadaheadContext(CephContext *cct, Collection *c, OnodeRef o,
+		     uint64_t offset, uint64_t length)
+      : c(c), o(o), gen(o->readahead_gen), offset(offset), length(length),
+	ioc(cct, this, true), tier_ioc(cct, this, true) {}
+
+    void aio_finish(BlueStore *store) override {
+      store->_readahead_finish(this);
+    }
+  };
+
+  void _maybe_readahead(
+    Collection *c,
+    OnodeRef o,
+    uint64_t offset,
+    size_t length,
+    uint32_t op_flags);
+  void _readahead_finish(ReadaheadContext *ctx);
+  void _readahead_drain();
+
+  void _compress_start();
+  void _compress_stop();
+  void _compress_thread();
+  void _compress_run(vector<std::function<void()>>& jobs);
+
+  uint32_t _tier_period() const;
+  uint32_t _tier_touch(Onode *o);
+  void _tier_note_read(Collection *c, OnodeRef& o);
+  /// whether b has data on the device the tier migration in txc moves off
+  static bool _tier_move_source(const TransContext *txc,
+				const bluestore_blob_t& b);
+  bool _tier_has_room(uint64_t need, bool promote);
+  void _tier_index(TransContext *txc, OnodeRef& o, bool on);
+  void _tier_start();
+  void _tier_stop();
+  void _tier_thread_entry();
+  void _tier_migrate_pass();
+  CollectionRef _tier_find_collection(const ghobject_t& oid);
+  uint64_t _tier_move(CollectionRef c, const ghobject_t& oid, bool promote);
+  uint64_t _tier_rewrite(TransContext *txc, CollectionRef& c, OnodeRef& o);
+
   int _fiemap(CollectionHandle &c_, const ghobject_t& oid,
  	     uint64_t offset, size_t len, interval_set<uint64_t>& destset);
 public:
@@ -3306,6 +3633,22 @@ private:
     OnodeRef& o,
     const BlueStore::FSCK_ObjectCtx& ctx);
 
+  typedef std::function<bool(int64_t pool_id,
+			     CollectionRef c,
+			     const ghobject_t& oid,
+			     const string& key,
+			     const bufferlist& value)> fsck_offload_fn;
+  /// walk onodes in [start, end) (empty end means unbounded); returns
+  /// the number of objects not handed over to offload
+  size_t _fsck_check_objects_range(FSCKDepth depth,
+    FSCK_ObjectCtx& ctx,
+    const string& start,
+    const string& end,
+    uint64_t_btree_t& used_nids,
+    const fsck_offload_fn& offload);
+  void _fsck_check_objects_parallel(FSCKDepth depth,
+    FSCK_ObjectCtx& ctx,
+    size_t thread_count);
   void _fsck_check_objects(FSCKDepth depth,
     FSCK_ObjectCtx& ctx);
 };
@@ -3489,13 +3832,20 @@ public:
 
   unsigned apply(KeyValueDB* db);
 
+  // note_misreference, set_space_used and inc_repaired are thread-safe,
+  // parallel fsck calls them from its workers.
   void note_misreference(uint64_t offs, uint64_t len, bool inc_error) {
+    std::lock_guard l(lock);
     misreferenced_extents.union_insert(offs, len);
     if (inc_error) {
       ++to_repair_cnt;
     }
   }
-  // In fact this is the only repairer's method which is thread-safe!!
+  void set_space_used(uint64_t offset, uint64_t len,
+		      const coll_t& cid, const ghobject_t& oid) {
+    std::lock_guard l(lock);
+    space_usage_tracker.set_used(offset, len, cid, oid);
+  }
   void inc_repaired() {
     ++to_repair_cnt;
   }
@@ -3511,6 +3861,7 @@ public:
   }
 
 private:
+  ceph::mutex lock = ceph::make_mutex("BlueStoreRepairer::lock");
   std::atomic<unsigned> to_repair_cnt = { 0 };
   KeyValueDB::Transaction fix_per_pool_omap_txn;
   KeyValueDB::Transaction fix_fm_leaked_txn;
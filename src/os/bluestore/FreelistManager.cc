@@ -13,13 +13,16 @@ FreelistManager *FreelistManager::create(
   // put the freelistmanagers in different prefixes because the merge
   // op is per prefix, has to done pre-db-open, and we don't know the
   // freelist type until after we open the db.
-  ceph_assert(prefix == "B");
+  ceph_assert(prefix == "B" || prefix == "U");
   if (type == "bitmap")
-    return new BitmapFreelistManager(cct, "B", "b");
+    return new BitmapFreelistManager(cct, prefix,
+				     prefix == "B" ? "b" : "u");
   return NULL;
 }
 
 void FreelistManager::setup_merge_operators(KeyValueDB *db)
 {
   BitmapFreelistManager::setup_merge_operator(db, "b");
+  // the data tier's, see BlueStore::_open_tier()
+  BitmapFreelistManager::setup_merge_operator(db, "u");
 }
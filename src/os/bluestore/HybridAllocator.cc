@@ -0,0 +1,385 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "HybridAllocator.h"
+
+#include <limits>
+
+#include "common/config_proxy.h"
+#include "common/debug.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef  dout_prefix
+#define dout_prefix *_dout << "HybridAllocator "
+
+MEMPOOL_DEFINE_OBJECT_FACTORY(hybrid_seg_t, hybrid_seg_t, bluestore_alloc);
+
+namespace {
+  // a light-weight "hybrid_seg_t", which only used as the key when
+  // searching in range_tree
+  struct range_t {
+    uint64_t start;
+    uint64_t end;
+  };
+
+  struct dispose_rs {
+    void operator()(hybrid_seg_t* p)
+    {
+      delete p;
+    }
+  };
+}
+
+void HybridAllocator::_bucket_insert(hybrid_seg_t& rs)
+{
+  unsigned b = _bucket(rs.length());
+  buckets[b].insert(rs);
+  bucket_mask |= 1ull << b;
+}
+
+void HybridAllocator::_bucket_erase(hybrid_seg_t& rs)
+{
+  unsigned b = _bucket(rs.length());
+  buckets[b].erase(buckets[b].iterator_to(rs));
+  if (buckets[b].empty()) {
+    bucket_mask &= ~(1ull << b);
+  }
+}
+
+void HybridAllocator::_add_to_tree(uint64_t start, uint64_t size)
+{
+  assert(size != 0);
+
+  uint64_t end = start + size;
+
+  auto rs_after = range_tree.upper_bound(range_t{start, end},
+					 range_tree.key_comp());
+
+  /* Make sure we don't overlap with either of our neighbors */
+  auto rs_before = range_tree.end();
+  if (rs_after != range_tree.begin()) {
+    rs_before = std::prev(rs_after);
+  }
+
+  bool merge_before = (rs_before != range_tree.end() && rs_before->end == start);
+  bool merge_after = (rs_after != range_tree.end() && rs_after->start == end);
+
+  if (merge_before && merge_after) {
+    _bucket_erase(*rs_before);
+    _bucket_erase(*rs_after);
+    rs_after->start = rs_before->start;
+    range_tree.erase_and_dispose(rs_before, dispose_rs{});
+    _bucket_insert(*rs_after);
+  } else if (merge_before) {
+    _bucket_erase(*rs_before);
+    rs_before->end = end;
+    _bucket_insert(*rs_before);
+  } else if (merge_after) {
+    _bucket_erase(*rs_after);
+    rs_after->start = start;
+    _bucket_insert(*rs_after);
+  } else {
+    auto new_rs = new hybrid_seg_t{start, end};
+    range_tree.insert_before(rs_after, *new_rs);
+    _bucket_insert(*new_rs);
+  }
+  num_free += size;
+}
+
+void HybridAllocator::_remove_from_tree(uint64_t start, uint64_t size)
+{
+  uint64_t end = start + size;
+
+  assert(size != 0);
+  assert(size <= num_free);
+
+  auto rs = range_tree.find(range_t{start, end}, range_tree.key_comp());
+  /* Make sure we completely overlap with someone */
+  assert(rs != range_tree.end());
+  assert(rs->start <= start);
+  assert(rs->end >= end);
+
+  bool left_over = (rs->start != start);
+  bool right_over = (rs->end != end);
+
+  _bucket_erase(*rs);
+
+  if (left_over && right_over) {
+    auto new_seg = new hybrid_seg_t{end, rs->end};
+    rs->end = start;
+    range_tree.insert(rs, *new_seg);
+    _bucket_insert(*new_seg);
+    _bucket_insert(*rs);
+  } else if (left_over) {
+    rs->end = start;
+    _bucket_insert(*rs);
+  } else if (right_over) {
+    rs->start = end;
+    _bucket_insert(*rs);
+  } else {
+    range_tree.erase_and_dispose(rs, dispose_rs{});
+  }
+  assert(num_free >= size);
+  num_free -= size;
+}
+
+/*
+ * First-fit by offset starting at *cursor, wrapping around once; the
+ * same walk AvlAllocator does over its range tree.
+ */
+uint64_t HybridAllocator::_first_fit(uint64_t *cursor,
+				     uint64_t size,
+				     uint64_t align)
+{
+  const auto compare = range_tree.key_comp();
+  for (auto rs = range_tree.lower_bound(range_t{*cursor, size}, compare);
+       rs != range_tree.end(); ++rs) {
+    uint64_t offset = p2roundup(rs->start, align);
+    if (offset + size <= rs->end) {
+      *cursor = offset + size;
+      return offset;
+    }
+  }
+  if (*cursor == 0) {
+    return -1ULL;
+  }
+  *cursor = 0;
+  return _first_fit(cursor, size, align);
+}
+
+/*
+ * Best-fit through the size classes.  Classes below _bucket(size) only
+ * hold segments shorter than size, so the search starts there and takes
+ * the first class with a segment that fits.
+ *
+ * Within a class, the shortest segments at least size long come first,
+ * but alignment may keep them from fitting, so only BEST_FIT_SCAN of
+ * them are tried.  Past that, the shortest segment of size + align - 1
+ * or more is taken, which fits wherever it starts.
+ */
+uint64_t HybridAllocator::_best_fit(uint64_t size, uint64_t align)
+{
+  const auto compare = hybrid_seg_t::shorter_t{};
+  for (uint64_t mask = bucket_mask & (~0ull << _bucket(size));
+       mask;
+       mask &= mask - 1) {
+    auto& bucket = buckets[ctz(mask)];
+    auto rs = bucket.lower_bound(size, compare);
+    for (unsigned scanned = 0;
+	 rs != bucket.end() && scanned < BEST_FIT_SCAN;
+	 ++rs, ++scanned) {
+      uint64_t offset = p2roundup(rs->start, align);
+      if (offset + size <= rs->end) {
+	return offset;
+      }
+    }
+    if (rs == bucket.end()) {
+      continue;
+    }
+    rs = bucket.lower_bound(size + align - 1, compare);
+    if (rs != bucket.end()) {
+      return p2roundup(rs->start, align);
+    }
+  }
+  return -1ULL;
+}
+
+/*
+ * Length of the longest free segment, or want if there is one at least
+ * that long: the last segment of the highest size class.
+ */
+uint64_t HybridAllocator::_max_size(uint64_t want)
+{
+  if (!bucket_mask) {
+    return 0;
+  }
+  unsigned top = NUM_BUCKETS - 1 - __builtin_clzll(bucket_mask);
+  return std::min(want, buckets[top].rbegin()->length());
+}
+
+double HybridAllocator::_get_fragmentation() const
+{
+  auto free_blocks = p2align(num_free, block_size) / block_size;
+  if (free_blocks <= 1) {
+    return .0;
+  }
+  return (static_cast<double>(range_tree.size() - 1) / (free_blocks - 1));
+}
+
+int HybridAllocator::_allocate(
+  uint64_t size,
+  uint64_t unit,
+  uint64_t *offset,
+  uint64_t *length)
+{
+  std::lock_guard l(lock);
+  uint64_t max_size = _max_size(size);
+
+  bool force_best_fit = false;
+  if (max_size < size) {
+    if (max_size < unit) {
+      return -ENOSPC;
+    }
+    size = p2align(max_size, unit);
+    assert(size > 0);
+    force_best_fit = true;
+  }
+
+  uint64_t start = 0;
+  if (force_best_fit ||
+      _get_fragmentation() > best_fit_frag_threshold) {
+    start = _best_fit(size, unit);
+  } else {
+    /*
+     * Allocations of the same power of 2 alignment share a cursor so
+     * they tend to come from the same area, see AvlAllocator::_allocate.
+     */
+    const uint64_t align = size & -size;
+    assert(align != 0);
+    start = _first_fit(&lbas[cbits(align) - 1], size, unit);
+  }
+  if (start == -1ULL) {
+    return -ENOSPC;
+  }
+
+  _remove_from_tree(start, size);
+
+  *offset = start;
+  *length = size;
+  return 0;
+}
+
+HybridAllocator::HybridAllocator(CephContext* cct,
+				 int64_t device_size,
+				 int64_t block_size,
+				 const std::string& name) :
+  Allocator(name),
+  num_total(device_size),
+  block_size(block_size),
+  best_fit_frag_threshold(
+    cct->_conf.get_val<double>("bluestore_hybrid_alloc_bf_frag_threshold")),
+  cct(cct)
+{}
+
+int64_t HybridAllocator::allocate(
+  uint64_t want,
+  uint64_t unit,
+  uint64_t max_alloc_size,
+  int64_t  hint, // unused, for now!
+  PExtentVector* extents)
+{
+  ldout(cct, 10) << __func__ << std::hex
+                 << " want 0x" << want
+                 << " unit 0x" << unit
+                 << " max_alloc_size 0x" << max_alloc_size
+                 << " hint 0x" << hint
+                 << std::dec << dendl;
+  assert(isp2(unit));
+  assert(want % unit == 0);
+
+  if (max_alloc_size == 0) {
+    max_alloc_size = want;
+  }
+  if (constexpr auto cap = std::numeric_limits<decltype(bluestore_pextent_t::length)>::max();
+      max_alloc_size >= cap) {
+    max_alloc_size = cap;
+  }
+
+  uint64_t allocated = 0;
+  while (allocated < want) {
+    uint64_t offset, length;
+    int r = _allocate(std::min(max_alloc_size, want - allocated),
+                      unit, &offset, &length);
+    if (r < 0) {
+      // Allocation failed.
+      break;
+    }
+    extents->emplace_back(offset, length);
+    allocated += length;
+  }
+  return allocated ? allocated : -ENOSPC;
+}
+
+void HybridAllocator::release(const interval_set<uint64_t>& release_set)
+{
+  std::lock_guard l(lock);
+  for (auto p = release_set.begin(); p != release_set.end(); ++p) {
+    const auto offset = p.get_start();
+    const auto length = p.get_len();
+    ldout(cct, 10) << __func__ << std::hex
+                   << " offset 0x" << offset
+                   << " length 0x" << length
+                   << std::dec << dendl;
+    _add_to_tree(offset, length);
+  }
+}
+
+uint64_t HybridAllocator::get_free()
+{
+  std::lock_guard l(lock);
+  return num_free;
+}
+
+double HybridAllocator::get_fragmentation()
+{
+  std::lock_guard l(lock);
+  return _get_fragmentation();
+}
+
+void HybridAllocator::dump()
+{
+  std::lock_guard l(lock);
+  ldout(cct, 0) << __func__ << " range_tree: " << dendl;
+  for (auto& rs : range_tree) {
+    ldout(cct, 0) << std::hex
+                  << "0x" << rs.start << "~" << rs.end
+                  << std::dec
+                  << dendl;
+  }
+
+  ldout(cct, 0) << __func__ << " size classes: " << dendl;
+  for (unsigned i = 0; i < NUM_BUCKETS; ++i) {
+    if (!buckets[i].empty()) {
+      ldout(cct, 0) << "  0x" << std::hex << (1ull << i) << std::dec
+		    << ": " << buckets[i].size() << dendl;
+    }
+  }
+}
+
+void HybridAllocator::dump(std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+  for (auto& rs : range_tree) {
+    notify(rs.start, rs.end - rs.start);
+  }
+}
+
+void HybridAllocator::init_add_free(uint64_t offset, uint64_t length)
+{
+  std::lock_guard l(lock);
+  ldout(cct, 10) << __func__ << std::hex
+                 << " offset 0x" << offset
+                 << " length 0x" << length
+                 << std::dec << dendl;
+  _add_to_tree(offset, length);
+}
+
+void HybridAllocator::init_rm_free(uint64_t offset, uint64_t length)
+{
+  std::lock_guard l(lock);
+  ldout(cct, 10) << __func__ << std::hex
+                 << " offset 0x" << offset
+                 << " length 0x" << length
+                 << std::dec << dendl;
+  _remove_from_tree(offset, length);
+}
+
+void HybridAllocator::shutdown()
+{
+  std::lock_guard l(lock);
+  for (auto& b : buckets) {
+    b.clear();
+  }
+  bucket_mask = 0;
+  range_tree.clear_and_dispose(dispose_rs{});
+}
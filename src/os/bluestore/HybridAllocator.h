@@ -0,0 +1,155 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#pragma once
+
+#include <mutex>
+#include <boost/intrusive/avl_set.hpp>
+
+#include "Allocator.h"
+#include "os/bluestore/bluestore_types.h"
+#include "include/mempool.h"
+
+struct hybrid_seg_t {
+  MEMPOOL_CLASS_HELPERS();  ///< memory monitoring
+  uint64_t start;   ///< starting offset of this segment
+  uint64_t end;	    ///< ending offset (non-inclusive)
+
+  hybrid_seg_t(uint64_t start, uint64_t end)
+    : start{start},
+      end{end}
+  {}
+  uint64_t length() const {
+    return end - start;
+  }
+  // Tree is sorted by offset, greater offsets at the end of the tree.
+  struct before_t {
+    template<typename KeyLeft, typename KeyRight>
+    bool operator()(const KeyLeft& lhs, const KeyRight& rhs) const {
+      return lhs.end <= rhs.start;
+    }
+  };
+  boost::intrusive::avl_set_member_hook<> offset_hook;
+  // Size classes are sorted by length, then offset.  A bare length
+  // looks up the shortest segment at least that long.
+  struct shorter_t {
+    bool operator()(const hybrid_seg_t& lhs, const hybrid_seg_t& rhs) const {
+      return lhs.length() < rhs.length() ||
+	(lhs.length() == rhs.length() && lhs.start < rhs.start);
+    }
+    bool operator()(const hybrid_seg_t& lhs, uint64_t length) const {
+      return lhs.length() < length;
+    }
+    bool operator()(uint64_t length, const hybrid_seg_t& rhs) const {
+      return length <= rhs.length();
+    }
+  };
+  // Membership in the size class tree, see HybridAllocator::buckets.
+  boost::intrusive::avl_set_member_hook<> bucket_hook;
+};
+
+/*
+ * An AVL range tree (as in AvlAllocator) with a power-of-2 size class
+ * index over the free segments instead of a second, size-sorted tree.
+ *
+ * While free space is contiguous, allocations are first-fit by offset,
+ * which keeps related data close together.  Once get_fragmentation()
+ * climbs past bluestore_hybrid_alloc_bf_frag_threshold, allocations go
+ * best-fit through the size classes: the smallest non-empty class that
+ * can hold the request is found in O(1) from a bitmask, and the class
+ * being sorted by length leads straight to the shortest segment that
+ * fits.  That keeps large free
+ * extents intact for large writes rather than chopping them up for small
+ * ones.
+ */
+class HybridAllocator final : public Allocator {
+public:
+  HybridAllocator(CephContext* cct, int64_t device_size, int64_t block_size,
+		  const std::string& name);
+  int64_t allocate(
+    uint64_t want,
+    uint64_t unit,
+    uint64_t max_alloc_size,
+    int64_t  hint,
+    PExtentVector *extents) final;
+  void release(const interval_set<uint64_t>& release_set) final;
+  uint64_t get_free() final;
+  double get_fragmentation() final;
+
+  void dump() final;
+  void dump(std::function<void(uint64_t offset, uint64_t length)> notify) final;
+  void init_add_free(uint64_t offset, uint64_t length) final;
+  void init_rm_free(uint64_t offset, uint64_t length) final;
+  void shutdown() final;
+
+private:
+  static unsigned _bucket(uint64_t length) {
+    return cbits(length) - 1;
+  }
+  void _bucket_insert(hybrid_seg_t& rs);
+  void _bucket_erase(hybrid_seg_t& rs);
+  void _add_to_tree(uint64_t start, uint64_t size);
+  void _remove_from_tree(uint64_t start, uint64_t size);
+  uint64_t _first_fit(uint64_t *cursor, uint64_t size, uint64_t align);
+  uint64_t _best_fit(uint64_t size, uint64_t align);
+  uint64_t _max_size(uint64_t want);
+  double _get_fragmentation() const;
+  int _allocate(
+    uint64_t size,
+    uint64_t unit,
+    uint64_t *offset,
+    uint64_t *length);
+
+  using range_tree_t =
+    boost::intrusive::avl_set<
+      hybrid_seg_t,
+      boost::intrusive::compare<hybrid_seg_t::before_t>,
+      boost::intrusive::member_hook<
+	hybrid_seg_t,
+	boost::intrusive::avl_set_member_hook<>,
+	&hybrid_seg_t::offset_hook>>;
+  range_tree_t range_tree;    ///< main range tree
+
+  using bucket_t =
+    boost::intrusive::avl_set<
+      hybrid_seg_t,
+      boost::intrusive::compare<hybrid_seg_t::shorter_t>,
+      boost::intrusive::member_hook<
+	hybrid_seg_t,
+	boost::intrusive::avl_set_member_hook<>,
+	&hybrid_seg_t::bucket_hook>>;
+  /*
+   * Every segment in range_tree is also linked into buckets[i] where
+   * 2^i <= length < 2^(i+1), sorted by length.  Bit i of bucket_mask is
+   * set when that bucket is not empty.
+   */
+  static constexpr unsigned NUM_BUCKETS = 64;
+  bucket_t buckets[NUM_BUCKETS];
+  uint64_t bucket_mask = 0;
+
+  /*
+   * How many of the shortest segments long enough for a request best-fit
+   * tries before it settles for one long enough to fit at any alignment.
+   */
+  static constexpr unsigned BEST_FIT_SCAN = 32;
+
+  const int64_t num_total;   ///< device size
+  const uint64_t block_size; ///< block size
+  uint64_t num_free = 0;     ///< total bytes in freelist
+
+  /*
+   * First-fit cursors, one per power of 2 alignment, see
+   * AvlAllocator::lbas.
+   */
+  static constexpr unsigned MAX_LBAS = 64;
+  uint64_t lbas[MAX_LBAS] = {0};
+
+  /*
+   * Fragmentation (as reported by get_fragmentation()) above which
+   * allocations switch from first-fit to best-fit.
+   */
+  const double best_fit_frag_threshold;
+
+  CephContext* cct;
+  std::mutex lock;
+};
@@ -59,7 +59,13 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv, ai
   unsigned int iodepth = cct->_conf->bdev_aio_max_queue_depth;
 
   if (use_ioring && ioring_queue_t::supported()) {
-    io_queue = std::make_unique<ioring_queue_t>(iodepth);
+    io_queue = std::make_unique<ioring_queue_t>(
+      iodepth,
+      cct->_conf.get_val<bool>("bdev_ioring_hipri"),
+      cct->_conf.get_val<bool>("bdev_ioring_sqthread_poll"),
+      cct->_conf.get_val<uint64_t>("bdev_ioring_sqthread_idle_ms"),
+      cct->_conf.get_val<uint64_t>("bdev_ioring_fixed_buffers"),
+      cct->_conf.get_val<Option::size_t>("bdev_ioring_fixed_buffer_size"));
   } else {
     static bool once;
     if (use_ioring && !once) {
@@ -1028,7 +1034,7 @@ int KernelDevice::aio_read(
     ioc->pending_aios.push_back(aio_t(ioc, fd_directs[WRITE_LIFE_NOT_SET]));
     ++ioc->num_pending;
     aio_t& aio = ioc->pending_aios.back();
-    bufferptr p = buffer::create_small_page_aligned(len);
+    bufferptr p = io_queue->create_io_buffer(len);
     aio.bl.append(std::move(p));
     aio.bl.prepare_iov(&aio.iov);
     aio.preadv(off, len);
@@ -18,6 +18,7 @@
 
 #include "os/bluestore/BlueFS.h"
 #include "os/bluestore/BlueStore.h"
+#include "kv/RocksDBStore.h"
 #include "common/admin_socket.h"
 
 namespace po = boost::program_options;
@@ -226,6 +227,7 @@ int main(int argc, char **argv)
   string log_file;
   string key, value;
   vector<string> allocs_name;
+  string new_sharding;
   int log_level = 30;
   bool fsck_deep = false;
   po::options_description po_options("Options");
@@ -242,6 +244,7 @@ int main(int argc, char **argv)
     ("key,k", po::value<string>(&key), "label metadata key name")
     ("value,v", po::value<string>(&value), "label metadata value")
     ("allocator", po::value<vector<string>>(&allocs_name), "allocator to inspect: 'block'/'bluefs-wal'/'bluefs-db'/'bluefs-slow'")
+    ("sharding", po::value<string>(&new_sharding), "new column family layout for reshard, same syntax as bluestore_rocksdb_cfs")
     ;
   po::options_description po_positional("Positional options");
   po_positional.add_options()
@@ -261,7 +264,8 @@ int main(int argc, char **argv)
         "prime-osd-dir, "
         "bluefs-log-dump, "
         "free-dump, "
-        "free-score")
+        "free-score, "
+        "reshard")
     ;
   po::options_description po_all("All options");
   po_all.add(po_options).add(po_positional);
@@ -344,6 +348,16 @@ int main(int argc, char **argv)
     }
     inferring_bluefs_devices(devs, path);
   }
+  if (action == "reshard") {
+    if (path.empty()) {
+      cerr << "must specify bluestore path" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    if (new_sharding.empty()) {
+      cerr << "must specify the new layout with --sharding" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
   if (action == "bluefs-bdev-sizes" || action == "bluefs-bdev-expand") {
     if (path.empty()) {
       cerr << "must specify bluestore path" << std::endl;
@@ -858,6 +872,31 @@ int main(int argc, char **argv)
     }
 
     bluestore.cold_close();
+  } else if (action == "reshard") {
+    validate_path(cct.get(), path, false);
+    BlueStore bluestore(cct.get(), path);
+    KeyValueDB *db_ptr;
+    // the db is opened by reshard() itself, it may be half resharded
+    int r = bluestore.start_kv_only(&db_ptr, false);
+    if (r < 0) {
+      cerr << "error preparing db environment: " << cpp_strerror(r)
+	   << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    RocksDBStore *rocks_db = dynamic_cast<RocksDBStore*>(db_ptr);
+    if (!rocks_db) {
+      cerr << "reshard is only supported for rocksdb" << std::endl;
+      bluestore.umount();
+      exit(EXIT_FAILURE);
+    }
+    r = rocks_db->reshard(new_sharding, cout);
+    bluestore.umount();
+    if (r < 0) {
+      cerr << "error resharding: " << cpp_strerror(r) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    cout << "column family options come from bluestore_rocksdb_cfs; "
+	 << "update it to match" << std::endl;
   } else {
     cerr << "unrecognized action " << action << std::endl;
     return 1;
@@ -93,6 +93,10 @@ struct bluestore_interval_t
 /// pextent: physical extent
 struct bluestore_pextent_t : public bluestore_interval_t<uint64_t, uint32_t> 
 {
+  /// set in the offset of an extent on the data tier device rather than
+  /// on the main device (see BlueStore::_open_tier())
+  static constexpr uint64_t TIER_FLAG = 1ull << 62;
+
   bluestore_pextent_t() {}
   bluestore_pextent_t(uint64_t o, uint64_t l) : bluestore_interval_t(o, l) {}
   bluestore_pextent_t(const bluestore_interval_t &ext) :
@@ -103,6 +107,10 @@ struct bluestore_pextent_t : public bluestore_interval_t<uint64_t, uint32_t>
     denc_varint_lowz(v.length, p);
   }
 
+  bool is_on_tier() const {
+    return is_valid() && (offset & TIER_FLAG);
+  }
+
   void dump(Formatter *f) const;
   static void generate_test_instances(list<bluestore_pextent_t*>& ls);
 };
@@ -916,6 +924,7 @@ struct bluestore_onode_t {
     FLAG_OMAP = 1,       ///< object may have omap data
     FLAG_PGMETA_OMAP = 2,  ///< omap data is in meta omap prefix
     FLAG_PERPOOL_OMAP = 4, ///< omap data is in per-pool prefix; per-pool keys
+    FLAG_TIER = 8,       ///< object may have data on the data tier
   };
 
   string get_flags_string() const {
@@ -929,6 +938,9 @@ struct bluestore_onode_t {
     if (flags & FLAG_PERPOOL_OMAP) {
       s += "+perpool_omap";
     }
+    if (flags & FLAG_TIER) {
+      s += "+tier";
+    }
     return s;
   }
 
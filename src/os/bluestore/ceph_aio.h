@@ -103,6 +103,12 @@ struct io_queue_t {
   virtual int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
 			   void *priv, int *retries) = 0;
   virtual int get_next_completed(int timeout_ms, aio_t **paio, int max) = 0;
+
+  /// buffer for the data of an io of len bytes.  queues that register
+  /// memory with the kernel hand that out when they have some to spare.
+  virtual bufferptr create_io_buffer(size_t len) {
+    return buffer::create_small_page_aligned(len);
+  }
 };
 
 struct aio_queue_t final : public io_queue_t {
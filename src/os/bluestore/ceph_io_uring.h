@@ -13,13 +13,20 @@ struct ioring_data;
 struct ioring_queue_t final : public io_queue_t {
   std::unique_ptr<ioring_data> d;
   unsigned iodepth = 0;
+  bool hipri = false;      ///< use IO polling (IORING_SETUP_IOPOLL)
+  bool sq_thread = false;  ///< use kernel submission/poller thread
+  unsigned sq_thread_idle_ms = 0;
+  unsigned fixed_buffers = 0;     ///< registered buffers, 0 to disable
+  size_t fixed_buffer_size = 0;   ///< size of each registered buffer
 
   typedef std::list<aio_t>::iterator aio_iter;
 
   // Returns true if arch is x86-64 and kernel supports io_uring
   static bool supported();
 
-  ioring_queue_t(unsigned iodepth_);
+  ioring_queue_t(unsigned iodepth_, bool hipri_, bool sq_thread_,
+		 unsigned sq_thread_idle_ms_,
+		 unsigned fixed_buffers_, size_t fixed_buffer_size_);
   ~ioring_queue_t() final;
 
   int init(std::vector<int> &fds) final;
@@ -28,4 +35,5 @@ struct ioring_queue_t final : public io_queue_t {
   int submit_batch(aio_iter begin, aio_iter end, uint16_t aios_size,
                    void *priv, int *retries) final;
   int get_next_completed(int timeout_ms, aio_t **paio, int max) final;
+  bufferptr create_io_buffer(size_t len) final;
 };
@@ -6,19 +6,86 @@
 #if defined(HAVE_LIBURING) && defined(__x86_64__)
 
 #include "liburing.h"
+#include <atomic>
 #include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "common/deleter.h"
+#include "include/intarith.h"
+
+/*
+ * A slab registered with the ring (IORING_REGISTER_BUFFERS) and carved
+ * into equal buffers, so that ios landing in it skip the per-io page
+ * pinning.  Buffers handed out keep the pool alive: the slab is unmapped
+ * only when the last of them is released, which may be well after the
+ * ring is gone since the caller is free to cache what it reads.
+ */
+struct ioring_buffer_pool {
+  char *base = nullptr;
+  size_t length = 0;
+  size_t buf_size = 0;
+  std::mutex lock;
+  std::vector<unsigned> free_bufs;
+
+  ~ioring_buffer_pool() {
+    if (base)
+      munmap(base, length);
+  }
 
-/* Options */
+  int init(unsigned nbufs, size_t size) {
+    buf_size = p2roundup<size_t>(size, CEPH_PAGE_SIZE);
+    length = nbufs * buf_size;
+    // the whole slab is pinned once at registration; prefer huge pages
+    // so that it costs few tlb entries, too.
+    void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p == MAP_FAILED)
+      p = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+	       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      return -errno;
+    base = static_cast<char*>(p);
+    free_bufs.reserve(nbufs);
+    for (unsigned i = nbufs; i > 0; --i)
+      free_bufs.push_back(i - 1);
+    return 0;
+  }
+
+  bool contains(const void *p, size_t len) const {
+    const char *c = static_cast<const char*>(p);
+    return c >= base && c + len <= base + length;
+  }
 
-static bool hipri = false;      /* use IO polling */
-static bool sq_thread = false;  /* use kernel submission/poller thread */
+  int get() {
+    std::lock_guard l(lock);
+    if (free_bufs.empty())
+      return -1;
+    unsigned i = free_bufs.back();
+    free_bufs.pop_back();
+    return i;
+  }
+
+  void put(unsigned i) {
+    std::lock_guard l(lock);
+    free_bufs.push_back(i);
+  }
+};
 
 struct ioring_data {
   struct io_uring io_uring;
   pthread_mutex_t cq_mutex;
   pthread_mutex_t sq_mutex;
   int epoll_fd = -1;
+  bool hipri = false;
+  // polled completions are reaped by ioring_poll_cqe(), which waits on
+  // inflight_cond under sq_mutex while nothing is in flight
+  bool poll_reap = false;
+  std::atomic<unsigned> inflight = {0};
+  pthread_cond_t inflight_cond;
   std::map<int, int> fixed_fds_map;
+  std::shared_ptr<ioring_buffer_pool> buffers; ///< registered as index 0
 };
 
 static int ioring_get_cqe(struct ioring_data *d, unsigned int max,
@@ -29,7 +96,14 @@ static int ioring_get_cqe(struct ioring_data *d, unsigned int max,
 
   unsigned nr = 0;
   unsigned head;
+  unsigned seen = 0;
   io_uring_for_each_cqe(ring, head, cqe) {
+    ++seen;
+#ifdef LIBURING_UDATA_TIMEOUT
+    // liburing's own timeouts; we don't queue any, but be safe
+    if (cqe->user_data == LIBURING_UDATA_TIMEOUT)
+      continue;
+#endif
     struct aio_t *io = (struct aio_t *)(uintptr_t) io_uring_cqe_get_data(cqe);
     io->rval = cqe->res;
 
@@ -38,11 +112,77 @@ static int ioring_get_cqe(struct ioring_data *d, unsigned int max,
     if (nr == max)
       break;
   }
-  io_uring_cq_advance(ring, nr);
+  io_uring_cq_advance(ring, seen);
+  if (d->poll_reap)
+    d->inflight -= nr;
 
   return nr;
 }
 
+/*
+ * Reap polled (IORING_SETUP_IOPOLL) completions: they never raise an
+ * event on the ring fd, so enter the kernel to poll for them.  This
+ * must not add an sqe, which io_uring_wait_cqe_timeout() does for its
+ * timeout on kernels without IORING_FEAT_EXT_ARG, as submit_batch() may
+ * be filling the sq ring meanwhile.
+ *
+ * Polling is only worth it while ios are in flight: with none, sleep
+ * until submit_batch() queues some.  The kernel may also return before
+ * anything completes, so back off, doubling up to POLL_BACKOFF_MAX_US,
+ * between attempts.
+ */
+static constexpr unsigned POLL_BACKOFF_MAX_US = 128;
+
+static int ioring_poll_cqe(struct ioring_data *d, int timeout_ms,
+			   unsigned int max, struct aio_t **paio)
+{
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (timeout_ms % 1000) * 1000000l;
+  if (deadline.tv_nsec >= 1000000000l) {
+    ++deadline.tv_sec;
+    deadline.tv_nsec -= 1000000000l;
+  }
+  auto expired = [&deadline] {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline.tv_sec ||
+      (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec);
+  };
+
+  unsigned backoff_us = 1;
+  do {
+    if (d->inflight == 0) {
+      pthread_mutex_lock(&d->sq_mutex);
+      int r = 0;
+      while (d->inflight == 0 && r != ETIMEDOUT)
+	r = pthread_cond_timedwait(&d->inflight_cond, &d->sq_mutex,
+				   &deadline);
+      pthread_mutex_unlock(&d->sq_mutex);
+      if (r == ETIMEDOUT)
+	return 0;
+      backoff_us = 1;
+    }
+
+    int ret = syscall(__NR_io_uring_enter, d->io_uring.ring_fd, 0, 1,
+		      IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      return -errno;
+
+    pthread_mutex_lock(&d->cq_mutex);
+    int events = ioring_get_cqe(d, max, paio);
+    pthread_mutex_unlock(&d->cq_mutex);
+    if (events)
+      return events;
+
+    usleep(backoff_us);
+    backoff_us = std::min(backoff_us * 2, POLL_BACKOFF_MAX_US);
+  } while (!expired());
+
+  return 0;
+}
+
 static int find_fixed_fd(struct ioring_data *d, int real_fd)
 {
   auto it = d->fixed_fds_map.find(real_fd);
@@ -59,14 +199,26 @@ static void init_sqe(struct ioring_data *d, struct io_uring_sqe *sqe,
 
   ceph_assert(fixed_fd != -1);
 
-  if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV)
-    io_uring_prep_writev(sqe, fixed_fd, &io->iov[0],
-			 io->iov.size(), io->offset);
-  else if (io->iocb.aio_lio_opcode == IO_CMD_PREADV)
-    io_uring_prep_readv(sqe, fixed_fd, &io->iov[0],
-			io->iov.size(), io->offset);
-  else
+  bool fixed_buf = d->buffers && io->iov.size() == 1 &&
+    d->buffers->contains(io->iov[0].iov_base, io->iov[0].iov_len);
+
+  if (io->iocb.aio_lio_opcode == IO_CMD_PWRITEV) {
+    if (fixed_buf)
+      io_uring_prep_write_fixed(sqe, fixed_fd, io->iov[0].iov_base,
+				io->iov[0].iov_len, io->offset, 0);
+    else
+      io_uring_prep_writev(sqe, fixed_fd, &io->iov[0],
+			   io->iov.size(), io->offset);
+  } else if (io->iocb.aio_lio_opcode == IO_CMD_PREADV) {
+    if (fixed_buf)
+      io_uring_prep_read_fixed(sqe, fixed_fd, io->iov[0].iov_base,
+			       io->iov[0].iov_len, io->offset, 0);
+    else
+      io_uring_prep_readv(sqe, fixed_fd, &io->iov[0],
+			  io->iov.size(), io->offset);
+  } else {
     ceph_assert(0);
+  }
 
   io_uring_sqe_set_data(sqe, io);
   io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
@@ -96,7 +248,13 @@ static int ioring_queue(struct ioring_data *d, void *priv,
     /* Queue is full, go and reap something first */
     return 0;
 
-  return io_uring_submit(ring);
+  int r = io_uring_submit(ring);
+  if (r > 0 && d->poll_reap) {
+    // under sq_mutex, so a reaper about to wait sees this or is woken
+    d->inflight += r;
+    pthread_cond_signal(&d->inflight_cond);
+  }
+  return r;
 }
 
 static void build_fixed_fds_map(struct ioring_data *d,
@@ -108,9 +266,36 @@ static void build_fixed_fds_map(struct ioring_data *d,
   }
 }
 
-ioring_queue_t::ioring_queue_t(unsigned iodepth_) :
+static void register_fixed_buffers(struct ioring_data *d,
+				   unsigned nbufs, size_t buf_size)
+{
+  // the kernel refuses to register a buffer larger than 1G
+  nbufs = std::min<size_t>(
+    nbufs, (1ull << 30) / p2roundup<size_t>(buf_size, CEPH_PAGE_SIZE));
+
+  auto pool = std::make_shared<ioring_buffer_pool>();
+  if (pool->init(nbufs, buf_size) < 0)
+    return;
+
+  struct iovec iov = { pool->base, pool->length };
+  // this may fail for lack of RLIMIT_MEMLOCK; we simply do without
+  if (io_uring_register_buffers(&d->io_uring, &iov, 1) < 0)
+    return;
+
+  d->buffers = std::move(pool);
+}
+
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_,
+			       bool sq_thread_, unsigned sq_thread_idle_ms_,
+			       unsigned fixed_buffers_,
+			       size_t fixed_buffer_size_) :
   d(make_unique<ioring_data>()),
-  iodepth(iodepth_)
+  iodepth(iodepth_),
+  hipri(hipri_),
+  sq_thread(sq_thread_),
+  sq_thread_idle_ms(sq_thread_idle_ms_),
+  fixed_buffers(fixed_buffers_),
+  fixed_buffer_size(fixed_buffer_size_)
 {
 }
 
@@ -120,17 +305,28 @@ ioring_queue_t::~ioring_queue_t()
 
 int ioring_queue_t::init(std::vector<int> &fds)
 {
-  unsigned flags = 0;
+  struct io_uring_params params;
 
+  memset(&params, 0, sizeof(params));
   pthread_mutex_init(&d->cq_mutex, NULL);
   pthread_mutex_init(&d->sq_mutex, NULL);
 
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&d->inflight_cond, &cond_attr);
+  pthread_condattr_destroy(&cond_attr);
+
+  d->hipri = hipri;
+  d->poll_reap = hipri && !sq_thread;
   if (hipri)
-    flags |= IORING_SETUP_IOPOLL;
-  if (sq_thread)
-    flags |= IORING_SETUP_SQPOLL;
+    params.flags |= IORING_SETUP_IOPOLL;
+  if (sq_thread) {
+    params.flags |= IORING_SETUP_SQPOLL;
+    params.sq_thread_idle = sq_thread_idle_ms;
+  }
 
-  int ret = io_uring_queue_init(iodepth, &d->io_uring, flags);
+  int ret = io_uring_queue_init_params(iodepth, &d->io_uring, &params);
   if (ret < 0)
     return ret;
 
@@ -143,6 +339,9 @@ int ioring_queue_t::init(std::vector<int> &fds)
 
   build_fixed_fds_map(d.get(), fds);
 
+  if (fixed_buffers && fixed_buffer_size)
+    register_fixed_buffers(d.get(), fixed_buffers, fixed_buffer_size);
+
   d->epoll_fd = epoll_create1(0);
   if (d->epoll_fd < 0) {
     ret = -errno;
@@ -170,6 +369,8 @@ close_ring_fd:
 void ioring_queue_t::shutdown()
 {
   d->fixed_fds_map.clear();
+  // outstanding buffers keep the slab mapped; drop only our reference
+  d->buffers.reset();
   close(d->epoll_fd);
   d->epoll_fd = -1;
   io_uring_queue_exit(&d->io_uring);
@@ -196,7 +397,11 @@ get_cqe:
   int events = ioring_get_cqe(d.get(), max, paio);
   pthread_mutex_unlock(&d->cq_mutex);
 
-  if (events == 0) {
+  if (events == 0 && d->poll_reap) {
+    events = ioring_poll_cqe(d.get(), timeout_ms, max, paio);
+  } else if (events == 0) {
+    // with SQPOLL the sq thread also reaps polled completions, and
+    // posting them wakes the ring fd
     struct epoll_event ev;
     int ret = epoll_wait(d->epoll_fd, &ev, 1, timeout_ms);
     if (ret < 0)
@@ -209,6 +414,20 @@ get_cqe:
   return events;
 }
 
+bufferptr ioring_queue_t::create_io_buffer(size_t len)
+{
+  auto pool = d->buffers;
+  if (pool && len <= pool->buf_size) {
+    int i = pool->get();
+    if (i >= 0) {
+      char *buf = pool->base + (size_t)i * pool->buf_size;
+      return bufferptr(buffer::claim_buffer(
+	len, buf, make_deleter([pool, i] { pool->put(i); })));
+    }
+  }
+  return buffer::create_small_page_aligned(len);
+}
+
 bool ioring_queue_t::supported()
 {
   struct io_uring_params p;
@@ -227,7 +446,10 @@ bool ioring_queue_t::supported()
 
 struct ioring_data {};
 
-ioring_queue_t::ioring_queue_t(unsigned iodepth_)
+ioring_queue_t::ioring_queue_t(unsigned iodepth_, bool hipri_,
+			       bool sq_thread_, unsigned sq_thread_idle_ms_,
+			       unsigned fixed_buffers_,
+			       size_t fixed_buffer_size_)
 {
   ceph_assert(0);
 }
@@ -259,6 +481,11 @@ int ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
   ceph_assert(0);
 }
 
+bufferptr ioring_queue_t::create_io_buffer(size_t len)
+{
+  ceph_assert(0);
+}
+
 bool ioring_queue_t::supported()
 {
   return false;
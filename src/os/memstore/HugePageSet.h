@@ -0,0 +1,473 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.	See file COPYING.
+ *
+ */
+
+#ifndef CEPH_HUGEPAGESET_H
+#define CEPH_HUGEPAGESET_H
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <boost/intrusive_ptr.hpp>
+
+#include "include/ceph_assert.h"
+#include "include/encoding.h"
+
+// A page of a HugePageSet; the data lives in a slab of HugePageAllocator
+struct HugePage {
+  char *data = nullptr;
+  uint64_t offset = 0;
+  void *slab = nullptr;   ///< owning HugePageAllocator::Slab
+
+  std::atomic<uint32_t> nrefs = {0};
+  void get() { ++nrefs; }
+  inline void put();
+
+  typedef boost::intrusive_ptr<HugePage> Ref;
+  friend void intrusive_ptr_add_ref(HugePage *p) { p->get(); }
+  friend void intrusive_ptr_release(HugePage *p) { p->put(); }
+
+  void encode(bufferlist &bl, size_t page_size) const {
+    using ceph::encode;
+    bl.append(buffer::copy(data, page_size));
+    encode(offset, bl);
+  }
+  void decode(bufferlist::const_iterator &p, size_t page_size) {
+    using ceph::decode;
+    p.copy(page_size, data);
+    decode(offset, p);
+  }
+};
+
+// Hands out pages carved from 2MB slabs, backed by huge pages where the
+// system has them.  There is one allocator per page size, shared by every
+// HugePageSet and split into shards by thread so that allocations from
+// different threads don't contend.  A shard keeps one fully free slab
+// around and returns any other to the system.
+class HugePageAllocator {
+ public:
+  static constexpr size_t HUGE_PAGE_SIZE = 2 << 20;
+  static constexpr size_t MAX_SLAB_PAGES = 512;
+  static constexpr unsigned NUM_SHARDS = 16;
+
+  static HugePageAllocator& get(size_t page_size) {
+    static std::mutex lock;
+    // never freed: pages may be released after every HugePageSet is gone
+    static std::map<size_t, HugePageAllocator*> allocators;
+    std::lock_guard<std::mutex> l(lock);
+    auto& a = allocators[page_size];
+    if (!a) {
+      a = new HugePageAllocator(page_size);
+    }
+    return *a;
+  }
+
+  HugePage *allocate() {
+    auto& s = shards[shard_of_thread()];
+    std::lock_guard<std::mutex> l(s.lock);
+    if (s.available.empty()) {
+      Slab *slab = s.empty;
+      s.empty = nullptr;
+      if (!slab) {
+	slab = new_slab(&s);
+      }
+      slab->pos = s.available.insert(s.available.end(), slab);
+    }
+    Slab *slab = s.available.front();
+    HugePage *page = slab->free.back();
+    slab->free.pop_back();
+    if (slab->free.empty()) {
+      s.available.erase(slab->pos);
+    }
+    page->nrefs = 1;
+    return page;
+  }
+
+  static void release(HugePage *page) {
+    Slab *slab = static_cast<Slab*>(page->slab);
+    Shard& s = *slab->owner;
+    std::lock_guard<std::mutex> l(s.lock);
+    slab->free.push_back(page);
+    if (slab->free.size() == 1) {
+      slab->pos = s.available.insert(s.available.end(), slab);
+    }
+    if (slab->free.size() == slab->npages) {
+      s.available.erase(slab->pos);
+      if (!s.empty) {
+	s.empty = slab;
+      } else {
+	delete_slab(slab);
+      }
+    }
+  }
+
+ private:
+  struct Shard;
+  struct Slab {
+    Shard *owner = nullptr;
+    char *base = nullptr;
+    size_t size = 0;
+    bool hugetlb = false;    ///< mmap()ed from the hugetlb pool
+    size_t npages = 0;
+    std::unique_ptr<HugePage[]> pages;
+    std::vector<HugePage*> free;
+    std::list<Slab*>::iterator pos;  ///< in owner->available
+  };
+  struct Shard {
+    std::mutex lock;
+    std::list<Slab*> available;  ///< slabs with free pages
+    Slab *empty = nullptr;       ///< a fully free slab, kept for reuse
+  };
+
+  const size_t page_size;
+  const size_t slab_pages;
+  std::atomic<bool> try_hugetlb = {true};
+  Shard shards[NUM_SHARDS];
+
+  explicit HugePageAllocator(size_t page_size)
+    : page_size(page_size),
+      slab_pages(std::clamp<size_t>(HUGE_PAGE_SIZE / page_size,
+				    1, MAX_SLAB_PAGES)) {}
+
+  static unsigned shard_of_thread() {
+    static thread_local unsigned shard =
+      std::hash<std::thread::id>()(std::this_thread::get_id()) % NUM_SHARDS;
+    return shard;
+  }
+
+  Slab *new_slab(Shard *owner) {
+    auto slab = new Slab;
+    slab->owner = owner;
+    slab->npages = slab_pages;
+    slab->size = slab_pages * page_size;
+    const bool huge = slab->size % HUGE_PAGE_SIZE == 0;
+    void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (huge && try_hugetlb) {
+      p = ::mmap(nullptr, slab->size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p == MAP_FAILED) {
+	// no huge pages reserved; don't ask again
+	try_hugetlb = false;
+      } else {
+	slab->hugetlb = true;
+      }
+    }
+#endif
+    if (p == MAP_FAILED) {
+      if (::posix_memalign(&p, huge ? HUGE_PAGE_SIZE : 64, slab->size)) {
+	delete slab;
+	throw std::bad_alloc();
+      }
+#ifdef MADV_HUGEPAGE
+      if (huge) {
+	::madvise(p, slab->size, MADV_HUGEPAGE);
+      }
+#endif
+    }
+    slab->base = static_cast<char*>(p);
+    slab->pages.reset(new HugePage[slab_pages]);
+    slab->free.reserve(slab_pages);
+    for (size_t i = slab_pages; i-- > 0; ) {
+      auto& page = slab->pages[i];
+      page.data = slab->base + i * page_size;
+      page.slab = slab;
+      slab->free.push_back(&page);
+    }
+    return slab;
+  }
+
+  static void delete_slab(Slab *slab) {
+    if (slab->hugetlb) {
+      ::munmap(slab->base, slab->size);
+    } else {
+      ::free(slab->base);
+    }
+    delete slab;
+  }
+};
+
+void HugePage::put()
+{
+  if (--nrefs == 0) {
+    HugePageAllocator::release(this);
+  }
+}
+
+// A PageSet with the same interface, built for many threads working on one
+// large object: pages come from HugePageAllocator, they are indexed by a
+// radix tree keyed on offset / page_size that readers walk without locking,
+// and pages are added or removed under one of NUM_LOCKS locks picked by the
+// 2MB range they fall in, so operations on different ranges run in
+// parallel.  Interior nodes of the tree are only freed with the set.
+class HugePageSet {
+ public:
+  typedef std::vector<HugePage::Ref> page_vector;
+
+ private:
+  static constexpr unsigned RADIX_BITS = 9;
+  static constexpr unsigned RADIX = 1 << RADIX_BITS;
+  static constexpr unsigned NUM_LOCKS = 64;
+
+  struct Node {
+    const unsigned shift;	   ///< index bits below this level
+    std::atomic<void*> slots[RADIX]; ///< HugePage* at shift 0, else Node*
+    explicit Node(unsigned shift) : shift(shift) {
+      for (auto& s : slots) {
+	s = nullptr;
+      }
+    }
+  };
+
+  uint64_t page_size;
+  HugePageAllocator *allocator;
+  uint64_t lock_span;		///< pages covered by each range lock
+  std::mutex locks[NUM_LOCKS];
+  std::mutex grow_lock;
+  std::atomic<Node*> root;
+  std::atomic<size_t> count = {0};
+
+  // holds the lock of the range the last index passed in falls in
+  class range_guard {
+    HugePageSet *ps;
+    std::mutex *held = nullptr;
+   public:
+    explicit range_guard(HugePageSet *ps) : ps(ps) {}
+    ~range_guard() {
+      if (held) {
+	held->unlock();
+      }
+    }
+    void lock(uint64_t index) {
+      auto m = &ps->locks[(index / ps->lock_span) % NUM_LOCKS];
+      if (m != held) {
+	if (held) {
+	  held->unlock();
+	}
+	m->lock();
+	held = m;
+      }
+    }
+  };
+
+  static uint64_t max_index(const Node *n) {
+    return n->shift + RADIX_BITS >= 64 ?
+      std::numeric_limits<uint64_t>::max() :
+      (1ull << (n->shift + RADIX_BITS)) - 1;
+  }
+
+  void init(uint64_t size) {
+    page_size = size;
+    allocator = &HugePageAllocator::get(page_size);
+    lock_span = std::max<uint64_t>(1,
+      HugePageAllocator::HUGE_PAGE_SIZE / page_size);
+  }
+
+  Node *grow(uint64_t index) {
+    std::lock_guard<std::mutex> l(grow_lock);
+    Node *n = root;
+    while (index > max_index(n)) {
+      auto r = new Node(n->shift + RADIX_BITS);
+      r->slots[0] = n;
+      root = n = r;
+    }
+    return n;
+  }
+
+  std::atomic<void*> *find_slot(uint64_t index, bool create) {
+    Node *n = root;
+    if (index > max_index(n)) {
+      if (!create) {
+	return nullptr;
+      }
+      n = grow(index);
+    }
+    while (n->shift) {
+      auto& slot = n->slots[(index >> n->shift) & (RADIX - 1)];
+      void *child = slot;
+      if (!child) {
+	if (!create) {
+	  return nullptr;
+	}
+	auto c = new Node(n->shift - RADIX_BITS);
+	if (slot.compare_exchange_strong(child, c)) {
+	  child = c;
+	} else {
+	  delete c;
+	}
+      }
+      n = static_cast<Node*>(child);
+    }
+    return &n->slots[index & (RADIX - 1)];
+  }
+
+  // call f(slot, index) for every allocated page in [first, last], in order
+  template <typename F>
+  static void walk(Node *n, uint64_t base, uint64_t first, uint64_t last,
+		   F&& f) {
+    unsigned lo = (first - base) >> n->shift;
+    unsigned hi = (last - base) >> n->shift;
+    for (unsigned i = lo; i <= hi; ++i) {
+      void *p = n->slots[i];
+      if (!p) {
+	continue;
+      }
+      uint64_t child_base = base + ((uint64_t)i << n->shift);
+      if (n->shift == 0) {
+	f(n->slots[i], child_base);
+      } else {
+	uint64_t child_last = child_base + ((1ull << n->shift) - 1);
+	walk(static_cast<Node*>(p), child_base, std::max(first, child_base),
+	     std::min(last, child_last), f);
+      }
+    }
+  }
+  template <typename F>
+  void walk(uint64_t first, uint64_t last, F&& f) const {
+    Node *n = root;
+    last = std::min(last, max_index(n));
+    if (first <= last) {
+      walk(n, 0, first, last, f);
+    }
+  }
+
+  static void free_nodes(Node *n) {
+    if (n->shift) {
+      for (auto& s : n->slots) {
+	if (void *p = s) {
+	  free_nodes(static_cast<Node*>(p));
+	}
+      }
+    }
+    delete n;
+  }
+
+  void free_pages(uint64_t first, uint64_t last) {
+    range_guard g(this);
+    walk(first, last, [&](std::atomic<void*>& slot, uint64_t index) {
+	g.lock(index);
+	if (auto page = static_cast<HugePage*>(slot.exchange(nullptr))) {
+	  --count;
+	  page->put();
+	}
+      });
+  }
+
+ public:
+  explicit HugePageSet(size_t page_size) : root(new Node(0)) {
+    init(page_size);
+  }
+  ~HugePageSet() {
+    free_pages(0, std::numeric_limits<uint64_t>::max());
+    free_nodes(root);
+  }
+
+  // disable copy
+  HugePageSet(const HugePageSet&) = delete;
+  const HugePageSet& operator=(const HugePageSet&) = delete;
+
+  bool empty() const { return count == 0; }
+  size_t size() const { return count; }
+  size_t get_page_size() const { return page_size; }
+
+  // allocate all pages that intersect the range [offset,length)
+  void alloc_range(uint64_t offset, uint64_t length, page_vector &range) {
+    if (!length) {
+      return;
+    }
+    const uint64_t first = offset / page_size;
+    const uint64_t last = (offset + length - 1) / page_size;
+    range.reserve(range.size() + last - first + 1);
+    range_guard g(this);
+    for (uint64_t index = first; index <= last; ++index) {
+      auto slot = find_slot(index, true);
+      g.lock(index);
+      auto page = static_cast<HugePage*>(slot->load());
+      if (!page) {
+	page = allocator->allocate();
+	page->offset = index * page_size;
+
+	// assume that the caller will write to the range [offset,length),
+	//  so we only need to zero memory outside of this range
+	if (offset + length < page->offset + page_size)
+	  std::fill(page->data + offset + length - page->offset,
+		    page->data + page_size, 0);
+	if (offset > page->offset)
+	  std::fill(page->data, page->data + offset - page->offset, 0);
+	*slot = page;
+	++count;
+      }
+      range.emplace_back(page);
+    }
+  }
+
+  // return all allocated pages that intersect the range [offset,length)
+  void get_range(uint64_t offset, uint64_t length, page_vector &range) {
+    if (!length) {
+      return;
+    }
+    range_guard g(this);
+    walk(offset / page_size, (offset + length - 1) / page_size,
+	 [&](std::atomic<void*>& slot, uint64_t index) {
+	   g.lock(index);
+	   if (auto page = static_cast<HugePage*>(slot.load())) {
+	     range.emplace_back(page);
+	   }
+	 });
+  }
+
+  void free_pages_after(uint64_t offset) {
+    free_pages((offset + page_size - 1) / page_size,
+	       std::numeric_limits<uint64_t>::max());
+  }
+
+  // same encoding as PageSet
+  void encode(bufferlist &bl) const {
+    using ceph::encode;
+    std::vector<HugePage*> pages;
+    pages.reserve(count);
+    walk(0, std::numeric_limits<uint64_t>::max(),
+	 [&](std::atomic<void*>& slot, uint64_t index) {
+	   pages.push_back(static_cast<HugePage*>(slot.load()));
+	 });
+    encode(page_size, bl);
+    unsigned n = pages.size();
+    encode(n, bl);
+    for (auto p = pages.rbegin(); p != pages.rend(); ++p)
+      (*p)->encode(bl, page_size);
+  }
+  void decode(bufferlist::const_iterator &p) {
+    using ceph::decode;
+    ceph_assert(empty());
+    uint64_t size;
+    decode(size, p);
+    init(size);
+    unsigned n;
+    decode(n, p);
+    for (unsigned i = 0; i < n; i++) {
+      auto page = allocator->allocate();
+      page->decode(p, page_size);
+      *find_slot(page->offset / page_size, true) = page;
+      ++count;
+    }
+  }
+};
+
+#endif // CEPH_HUGEPAGESET_H
@@ -1564,13 +1564,17 @@ int BufferlistObject::truncate(uint64_t size)
 
 // PageSetObject
 
+template <class PageSetT>
 struct MemStore::PageSetObject : public Object {
-  PageSet data;
+  PageSetT data;
   uint64_t data_len;
 #if defined(__GLIBCXX__)
   // use a thread-local vector for the pages returned by PageSet, so we
   // can avoid allocations in read/write()
-  static thread_local PageSet::page_vector tls_pages;
+  static typename PageSetT::page_vector& tls_page_vector() {
+    static thread_local typename PageSetT::page_vector pages;
+    return pages;
+  }
 #endif
 
   size_t get_size() const override { return data_len; }
@@ -1602,15 +1606,13 @@ private:
 };
 
 #if defined(__GLIBCXX__)
-// use a thread-local vector for the pages returned by PageSet, so we
-// can avoid allocations in read/write()
-thread_local PageSet::page_vector MemStore::PageSetObject::tls_pages;
-#define DEFINE_PAGE_VECTOR(name)
+#define DEFINE_PAGE_VECTOR(name) auto& name = tls_page_vector();
 #else
-#define DEFINE_PAGE_VECTOR(name) PageSet::page_vector name;
+#define DEFINE_PAGE_VECTOR(name) typename PageSetT::page_vector name;
 #endif
 
-int MemStore::PageSetObject::read(uint64_t offset, uint64_t len, bufferlist& bl)
+template <class PageSetT>
+int MemStore::PageSetObject<PageSetT>::read(uint64_t offset, uint64_t len, bufferlist& bl)
 {
   const auto start = offset;
   const auto end = offset + len;
@@ -1659,7 +1661,8 @@ int MemStore::PageSetObject::read(uint64_t offset, uint64_t len, bufferlist& bl)
   return len;
 }
 
-int MemStore::PageSetObject::write(uint64_t offset, const bufferlist &src)
+template <class PageSetT>
+int MemStore::PageSetObject<PageSetT>::write(uint64_t offset, const bufferlist &src)
 {
   unsigned len = src.length();
 
@@ -1686,19 +1689,29 @@ int MemStore::PageSetObject::write(uint64_t offset, const bufferlist &src)
   return 0;
 }
 
-int MemStore::PageSetObject::clone(Object *src, uint64_t srcoff,
-                                   uint64_t len, uint64_t dstoff)
+template <class PageSetT>
+int MemStore::PageSetObject<PageSetT>::clone(Object *src, uint64_t srcoff,
+                                             uint64_t len, uint64_t dstoff)
 {
+  auto src_obj = dynamic_cast<PageSetObject*>(src);
+  if (src_obj == nullptr) {
+    // a page set of the other kind: no pages to share, copy the data
+    bufferlist bl;
+    int r = src->read(srcoff, len, bl);
+    if (r < 0)
+      return r;
+    return write(dstoff, bl);
+  }
   const int64_t delta = dstoff - srcoff;
 
-  auto &src_data = static_cast<PageSetObject*>(src)->data;
+  auto &src_data = src_obj->data;
   const uint64_t src_page_size = src_data.get_page_size();
 
   auto &dst_data = data;
   const auto dst_page_size = dst_data.get_page_size();
 
   DEFINE_PAGE_VECTOR(tls_pages);
-  PageSet::page_vector dst_pages;
+  typename PageSetT::page_vector dst_pages;
 
   while (len) {
     // limit to 16 pages at a time so tls_pages doesn't balloon in size
@@ -1776,7 +1789,8 @@ int MemStore::PageSetObject::clone(Object *src, uint64_t srcoff,
   return 0;
 }
 
-int MemStore::PageSetObject::truncate(uint64_t size)
+template <class PageSetT>
+int MemStore::PageSetObject<PageSetT>::truncate(uint64_t size)
 {
   data.free_pages_after(size);
   data_len = size;
@@ -1801,7 +1815,11 @@ int MemStore::PageSetObject::truncate(uint64_t size)
 
 
 MemStore::ObjectRef MemStore::Collection::create_object() const {
-  if (use_page_set)
-    return ceph::make_ref<PageSetObject>(cct->_conf->memstore_page_size);
+  if (use_page_set) {
+    if (use_huge_pages)
+      return ceph::make_ref<PageSetObject<HugePageSet>>(
+	cct->_conf->memstore_page_size);
+    return ceph::make_ref<PageSetObject<PageSet>>(cct->_conf->memstore_page_size);
+  }
   return new BufferlistObject();
 }
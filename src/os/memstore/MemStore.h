@@ -25,6 +25,7 @@
 #include "common/RWLock.h"
 #include "os/ObjectStore.h"
 #include "PageSet.h"
+#include "HugePageSet.h"
 #include "include/ceph_assert.h"
 
 class MemStore : public ObjectStore {
@@ -92,11 +93,12 @@ public:
   };
   using ObjectRef = Object::Ref;
 
-  struct PageSetObject;
+  template <class PageSetT> struct PageSetObject;
   struct Collection : public CollectionImpl {
     int bits = 0;
     CephContext *cct;
     bool use_page_set;
+    bool use_huge_pages;  ///< page sets are HugePageSets
     ceph::unordered_map<ghobject_t, ObjectRef> object_hash;  ///< for lookup
     map<ghobject_t, ObjectRef> object_map;        ///< for iteration
     map<string,bufferptr> xattr;
@@ -134,7 +136,7 @@ public:
     }
 
     void encode(bufferlist& bl) const {
-      ENCODE_START(1, 1, bl);
+      ENCODE_START(2, 1, bl);
       encode(xattr, bl);
       encode(use_page_set, bl);
       uint32_t s = object_map.size();
@@ -145,12 +147,20 @@ public:
 	encode(p->first, bl);
 	p->second->encode(bl);
       }
+      encode(use_huge_pages, bl);
       ENCODE_FINISH(bl);
     }
     void decode(bufferlist::const_iterator& p) {
-      DECODE_START(1, p);
+      DECODE_START(2, p);
       decode(xattr, p);
       decode(use_page_set, p);
+      use_huge_pages = false;
+      if (struct_v >= 2) {
+	// appended last for compat, but needed to create the objects
+	auto q = p;
+	q += struct_end - 1 - p.get_off();
+	decode(use_huge_pages, q);
+      }
       uint32_t s;
       decode(s, p);
       while (s--) {
@@ -161,6 +171,9 @@ public:
 	object_map.insert(make_pair(k, o));
 	object_hash.insert(make_pair(k, o));
       }
+      if (struct_v >= 2) {
+	decode(use_huge_pages, p);
+      }
       DECODE_FINISH(p);
     }
 
@@ -186,7 +199,9 @@ public:
     explicit Collection(CephContext *cct, coll_t c)
       : CollectionImpl(cct, c),
 	cct(cct),
-	use_page_set(cct->_conf->memstore_page_set) {}
+	use_page_set(cct->_conf->memstore_page_set),
+	use_huge_pages(
+	  cct->_conf.get_val<bool>("memstore_page_set_huge_pages")) {}
   };
   typedef Collection::Ref CollectionRef;
 
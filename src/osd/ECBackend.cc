@@ -1427,6 +1427,7 @@ void ECBackend::on_change()
   completed_to = eversion_t();
   committed_to = eversion_t();
   pipeline_state.clear();
+  parity_delta_objects.clear();
   waiting_reads.clear();
   waiting_state.clear();
   waiting_commit.clear();
@@ -1854,7 +1855,11 @@ void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
       }
       return ref;
     },
-    get_parent()->get_dpp());
+    get_parent()->get_dpp(),
+    get_parent()->get_pool().allows_ecoverwrites() &&
+    (ec_impl->get_supported_optimizations() &
+     ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION) &&
+    cct->_conf.get_val<bool>("osd_ec_parity_delta_writes"));
 
   dout(10) << __func__ << ": " << *op << dendl;
 
@@ -1876,6 +1881,32 @@ bool ECBackend::try_state_to_reads()
 	     << dendl;
     return false;
   }
+  for (auto &&i : op->plan.to_read) {
+    if (parity_delta_objects.count(i.first)) {
+      dout(20) << __func__ << ": blocking " << *op
+	       << " because it reads " << i.first
+	       << " under a parity delta write" << dendl;
+      return false;
+    }
+  }
+
+  if (op->plan.parity_delta) {
+    if (!is_write_in_flight(op->plan.parity_delta->oid) &&
+	can_parity_delta(op->plan.parity_delta->oid)) {
+      op->using_cache = false;
+      op->parity_delta_oid = op->plan.parity_delta->oid;
+      parity_delta_objects.insert(*op->parity_delta_oid);
+      waiting_state.pop_front();
+      waiting_reads.push_back(*op);
+      op->remote_read = op->plan.to_read;
+      dout(10) << __func__ << ": parity delta " << *op << dendl;
+      start_parity_delta_read(op);
+      return true;
+    }
+    dout(20) << __func__ << ": not using parity delta for " << *op << dendl;
+    get_parent()->get_logger()->inc(l_osd_ec_parity_delta_fallback);
+    op->plan.parity_delta.reset();
+  }
 
   if (!pipeline_state.caching_enabled()) {
     op->using_cache = false;
@@ -1936,6 +1967,140 @@ bool ECBackend::try_state_to_reads()
   return true;
 }
 
+bool ECBackend::is_write_in_flight(const hobject_t &hoid) const
+{
+  for (auto &&l : {&waiting_reads, &waiting_commit}) {
+    for (auto &&op : *l) {
+      if (op.plan.will_write.count(hoid))
+	return true;
+    }
+  }
+  return false;
+}
+
+bool ECBackend::can_parity_delta(const hobject_t &hoid) const
+{
+  // every shard is needed: the coding chunks to update and any data
+  // chunk to read, and a shard being recovered would miss the update
+  if (get_parent()->get_acting_shards().size() != ec_impl->get_chunk_count())
+    return false;
+  for (auto &&i : get_parent()->get_acting_recovery_backfill_shards()) {
+    if (get_parent()->get_shard_missing(i).is_missing(hoid))
+      return false;
+  }
+  return true;
+}
+
+struct OnParityDeltaReadComplete :
+  public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
+  ECBackend *ec;
+  ECBackend::Op *op;
+  OnParityDeltaReadComplete(ECBackend *ec, ECBackend::Op *op)
+    : ec(ec), op(op) {}
+  void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override {
+    ec->finish_parity_delta_read(op, in.second);
+  }
+};
+
+void ECBackend::start_parity_delta_read(Op *op)
+{
+  const ECTransaction::ParityDelta &pd = *op->plan.parity_delta;
+  const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+  auto shard_of = [&](int chunk) {
+    return (int)chunk_mapping.size() > chunk ? chunk_mapping[chunk] : chunk;
+  };
+  set<int> want;
+  for (auto c : pd.data_chunks) {
+    want.insert(shard_of(c));
+  }
+  for (int c = ec_impl->get_data_chunk_count();
+       c < (int)ec_impl->get_chunk_count();
+       ++c) {
+    want.insert(shard_of(c));
+  }
+
+  vector<pair<int, int>> subchunks;
+  subchunks.push_back(make_pair(0, ec_impl->get_sub_chunk_count()));
+  map<pg_shard_t, vector<pair<int, int>>> need;
+  for (auto &&i : get_parent()->get_acting_shards()) {
+    if (want.count(i.shard)) {
+      need[i] = subchunks;
+    }
+  }
+  ceph_assert(need.size() == want.size());
+
+  list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+  to_read.push_back(boost::make_tuple(pd.stripe_off, sinfo.get_stripe_width(), 0));
+  map<hobject_t, read_request_t> for_read_op;
+  for_read_op.insert(
+    make_pair(
+      pd.oid,
+      read_request_t(
+	to_read,
+	need,
+	false,
+	new OnParityDeltaReadComplete(this, op))));
+  map<hobject_t, set<int>> want_to_read;
+  want_to_read.insert(make_pair(pd.oid, std::move(want)));
+
+  start_read_op(
+    CEPH_MSG_PRIO_DEFAULT,
+    want_to_read,
+    for_read_op,
+    op->client_op,
+    false,
+    false);
+}
+
+void ECBackend::finish_parity_delta_read(Op *op, read_result_t &res)
+{
+  ECTransaction::ParityDelta &pd = *op->plan.parity_delta;
+  ceph_assert(pd.old_chunks.empty());
+  if (res.r == 0 && res.errors.empty() && res.returned.size() == 1) {
+    // a read retried elsewhere may have come back with other shards
+    auto &returned = res.returned.front().get<2>();
+    bool complete = true;
+    for (auto &&i : get_parent()->get_acting_shards()) {
+      auto r = returned.find(i);
+      if (r != returned.end()) {
+	pd.old_chunks[i.shard].claim(r->second);
+      }
+    }
+    const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+    for (int c = 0; c < (int)ec_impl->get_chunk_count(); ++c) {
+      if (c < (int)ec_impl->get_data_chunk_count() && !pd.data_chunks.count(c))
+	continue;
+      int shard = (int)chunk_mapping.size() > c ? chunk_mapping[c] : c;
+      auto o = pd.old_chunks.find(shard);
+      if (o == pd.old_chunks.end() ||
+	  o->second.length() != sinfo.get_chunk_size()) {
+	complete = false;
+	break;
+      }
+    }
+    if (complete) {
+      dout(20) << __func__ << ": " << *op << dendl;
+      op->remote_read_result.emplace(pd.oid, extent_map());
+      check_ops();
+      return;
+    }
+  }
+
+  // read the stripe and re-encode it after all
+  dout(10) << __func__ << ": r=" << res.r << " errors=" << res.errors
+	   << ", falling back to rmw for " << *op << dendl;
+  get_parent()->get_logger()->inc(l_osd_ec_parity_delta_fallback);
+  op->plan.parity_delta.reset();
+  objects_read_async_no_cache(
+    op->remote_read,
+    [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
+      for (auto &&i: results) {
+	op->remote_read_result.emplace(i.first, i.second.second);
+      }
+      check_ops();
+    });
+}
+
 bool ECBackend::try_reads_to_commit()
 {
   if (waiting_reads.empty())
@@ -2012,7 +2177,15 @@ bool ECBackend::try_reads_to_commit()
     written_set[i.first] = i.second.get_interval_set();
   }
   dout(20) << __func__ << ": written_set: " << written_set << dendl;
-  ceph_assert(written_set == op->plan.will_write);
+  if (op->plan.parity_delta) {
+    get_parent()->get_logger()->inc(l_osd_ec_parity_delta);
+    // written in place, not as whole stripes
+    auto will_write = op->plan.will_write;
+    will_write.erase(op->plan.parity_delta->oid);
+    ceph_assert(written_set == will_write);
+  } else {
+    ceph_assert(written_set == op->plan.will_write);
+  }
 
   if (op->using_cache) {
     for (auto &&hpair: written) {
@@ -2136,6 +2309,9 @@ bool ECBackend::try_finish_rmw()
   if (op->using_cache) {
     cache.release_write_pin(op->pin);
   }
+  if (op->parity_delta_oid) {
+    parity_delta_objects.erase(*op->parity_delta_oid);
+  }
   tid_to_op_map.erase(op->tid);
 
   if (waiting_reads.empty() &&
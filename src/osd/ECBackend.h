@@ -505,6 +505,9 @@ public:
     /// pin for cache
     ExtentCache::write_pin pin;
 
+    /// set if this op started as a parity delta, see parity_delta_objects
+    std::optional<hobject_t> parity_delta_oid;
+
     /// Callbacks
     Context *on_all_commit = nullptr;
     ~Op() {
@@ -570,6 +573,27 @@ public:
   bool try_finish_rmw();
   void check_ops();
 
+  /**
+   * Parity delta writes
+   *
+   * A write within a single stripe of an object whose shards are all
+   * present reads back only the data chunks it changes and the coding
+   * chunks, and updates the coding chunks with the encoded difference
+   * (see ECUtil::encode_parity_delta) rather than re-encoding the stripe.
+   *
+   * The chunks it reads must not be changed by an earlier write still in
+   * flight, so it falls back to a full stripe rmw while one to the same
+   * object is.  What it writes does not go through the cache, so until
+   * it commits, later ops that read the same object have to wait for it.
+   * Ops on other objects go on using the cache.
+   */
+  set<hobject_t> parity_delta_objects;
+  bool can_parity_delta(const hobject_t &hoid) const;
+  bool is_write_in_flight(const hobject_t &hoid) const;
+  void start_parity_delta_read(Op *op);
+  void finish_parity_delta_read(Op *op, read_result_t &res);
+  friend struct OnParityDeltaReadComplete;
+
   ErasureCodeInterfaceRef ec_impl;
 
 
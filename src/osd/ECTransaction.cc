@@ -81,6 +81,95 @@ void encode_and_write(
   }
 }
 
+void ECTransaction::write_parity_delta(
+  pg_t pgid,
+  const ECUtil::stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ecimpl,
+  const ECTransaction::ParityDelta &pd,
+  const PGTransaction::ObjectOperation::buffer_update_type &buffer_updates,
+  map<shard_id_t, ObjectStore::Transaction> *transactions,
+  DoutPrefixProvider *dpp) {
+  using BufferUpdate = PGTransaction::ObjectOperation::BufferUpdate;
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const vector<int> &chunk_mapping = ecimpl->get_chunk_mapping();
+  auto shard_of = [&](int chunk) {
+    return (int)chunk_mapping.size() > chunk ? chunk_mapping[chunk] : chunk;
+  };
+
+  // lay the updates over the old data chunks
+  map<int, bufferlist> new_data;
+  uint32_t fadvise_flags = 0;
+  for (auto c : pd.data_chunks) {
+    int shard = shard_of(c);
+    auto old = pd.old_chunks.find(shard);
+    ceph_assert(old != pd.old_chunks.end());
+    uint64_t chunk_start = pd.stripe_off + c * chunk_size;
+    uint64_t chunk_end = chunk_start + chunk_size;
+    uint64_t pos = 0;
+    bufferlist &bl = new_data[shard];
+    for (auto &&extent : buffer_updates) {
+      uint64_t start = std::max(extent.get_off(), chunk_start);
+      uint64_t end = std::min(extent.get_off() + extent.get_len(), chunk_end);
+      if (start >= end) {
+	continue;
+      }
+      if (start - chunk_start > pos) {
+	bufferlist keep;
+	keep.substr_of(old->second, pos, start - chunk_start - pos);
+	bl.claim_append(keep);
+      }
+      match(
+	extent.get_val(),
+	[&](const BufferUpdate::Write &op) {
+	  bufferlist part;
+	  part.substr_of(op.buffer, start - extent.get_off(), end - start);
+	  bl.claim_append(part);
+	  fadvise_flags |= op.fadvise_flags;
+	},
+	[&](const BufferUpdate::Zero &) {
+	  bl.append_zero(end - start);
+	},
+	[&](const BufferUpdate::CloneRange &) {
+	  ceph_assert(
+	    0 ==
+	    "CloneRange is not allowed, do_op should have returned ENOTSUPP");
+	});
+      pos = end - chunk_start;
+    }
+    if (pos < chunk_size) {
+      bufferlist keep;
+      keep.substr_of(old->second, pos, chunk_size - pos);
+      bl.claim_append(keep);
+    }
+    ceph_assert(bl.length() == chunk_size);
+  }
+
+  map<int, bufferlist> new_parity;
+  int r = ECUtil::encode_parity_delta(
+    sinfo, ecimpl, pd.old_chunks, new_data, &new_parity);
+  ceph_assert(r == 0);
+  new_data.merge(new_parity);
+
+  uint64_t chunk_off = sinfo.logical_to_prev_chunk_offset(pd.stripe_off);
+  ldpp_dout(dpp, 20) << __func__ << ": " << pd.oid
+		     << " writing shards " << new_data.size()
+		     << " of " << transactions->size()
+		     << " at chunk offset " << chunk_off << dendl;
+  for (auto &&i : new_data) {
+    auto st = transactions->find(shard_id_t(i.first));
+    if (st == transactions->end()) {
+      continue;
+    }
+    st->second.write(
+      coll_t(spg_t(pgid, st->first)),
+      ghobject_t(pd.oid, ghobject_t::NO_GEN, st->first),
+      chunk_off,
+      i.second.length(),
+      i.second,
+      fadvise_flags);
+  }
+}
+
 bool ECTransaction::requires_overwrite(
   uint64_t prev_size,
   const PGTransaction::ObjectOperation &op) {
@@ -403,6 +492,37 @@ void ECTransaction::generate_transactions(
       uint64_t new_size = orig_size;
       uint64_t append_after = new_size;
       ldpp_dout(dpp, 20) << __func__ << ": new_size start " << new_size << dendl;
+      if (plan.parity_delta && plan.parity_delta->oid == oid) {
+	ceph_assert(op.is_none() && !op.truncate);
+	if (entry) {
+	  // every shard keeps the stripe for rollback, written or not
+	  uint64_t restore_from = sinfo.logical_to_prev_chunk_offset(
+	    plan.parity_delta->stripe_off);
+	  uint64_t restore_len = sinfo.get_chunk_size();
+	  rollback_extents.emplace_back(make_pair(restore_from, restore_len));
+	  for (auto &&st : *transactions) {
+	    st.second.touch(
+	      coll_t(spg_t(pgid, st.first)),
+	      ghobject_t(oid, entry->version.version, st.first));
+	    st.second.clone_range(
+	      coll_t(spg_t(pgid, st.first)),
+	      ghobject_t(oid, ghobject_t::NO_GEN, st.first),
+	      ghobject_t(oid, entry->version.version, st.first),
+	      restore_from,
+	      restore_len,
+	      restore_from);
+	  }
+	}
+	write_parity_delta(
+	  pgid,
+	  sinfo,
+	  ecimpl,
+	  *plan.parity_delta,
+	  op.buffer_updates,
+	  transactions,
+	  dpp);
+	op.buffer_updates.clear();
+      }
       if (op.truncate && op.truncate->first < new_size) {
 	ceph_assert(!op.is_fresh_object());
 	new_size = sinfo.logical_to_next_stripe_offset(
@@ -23,6 +23,22 @@
 #include "ExtentCache.h"
 
 namespace ECTransaction {
+  /**
+   * An overwrite of part of one stripe of an existing object, which
+   * the code may let us do by parity delta (see
+   * FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION): read and rewrite just
+   * the data chunks written and the coding chunks, rather than read
+   * the stripe and rewrite every chunk of it.
+   */
+  struct ParityDelta {
+    hobject_t oid;
+    uint64_t stripe_off = 0;  ///< logical offset of the stripe
+    set<int> data_chunks;     ///< data chunks written, as 0..k-1
+
+    /// old data_chunks and coding chunks, by shard, once read
+    map<int, bufferlist> old_chunks;
+  };
+
   struct WritePlan {
     PGTransactionUPtr t;
     bool invalidates_cache = false; // Yes, both are possible
@@ -30,6 +46,9 @@ namespace ECTransaction {
     map<hobject_t,extent_set> will_write; // superset of to_read
 
     map<hobject_t,ECUtil::HashInfoRef> hash_infos;
+
+    /// set if the only read can be done by parity delta instead
+    std::optional<ParityDelta> parity_delta;
   };
 
   bool requires_overwrite(
@@ -41,7 +60,8 @@ namespace ECTransaction {
     const ECUtil::stripe_info_t &sinfo,
     PGTransactionUPtr &&t,
     F &&get_hinfo,
-    DoutPrefixProvider *dpp) {
+    DoutPrefixProvider *dpp,
+    bool allow_parity_delta = false) {
     WritePlan plan;
     t->safe_create_traverse(
       [&](pair<const hobject_t, PGTransaction::ObjectOperation> &i) {
@@ -97,6 +117,35 @@ namespace ECTransaction {
 	}
 
 	auto orig_size = projected_size;
+	if (allow_parity_delta &&
+	    i.second.is_none() &&
+	    !i.second.truncate &&
+	    !raw_write_set.empty() &&
+	    raw_write_set.range_end() <= orig_size) {
+	  uint64_t stripe_off =
+	    sinfo.logical_to_prev_stripe_offset(raw_write_set.range_start());
+	  uint64_t stripe_end = stripe_off + sinfo.get_stripe_width();
+	  if (raw_write_set.range_end() <= stripe_end &&
+	      (raw_write_set.range_start() != stripe_off ||
+	       raw_write_set.range_end() != stripe_end)) {
+	    ParityDelta pd;
+	    pd.oid = i.first;
+	    pd.stripe_off = stripe_off;
+	    for (auto &&extent : raw_write_set) {
+	      uint64_t first = extent.first - stripe_off;
+	      uint64_t last = first + extent.second - 1;
+	      for (uint64_t c = first / sinfo.get_chunk_size();
+		   c <= last / sinfo.get_chunk_size();
+		   ++c) {
+		pd.data_chunks.insert(c);
+	      }
+	    }
+	    ldpp_dout(dpp, 20) << __func__ << ": parity delta possible for "
+			       << pd.oid << " stripe " << pd.stripe_off
+			       << " data chunks " << pd.data_chunks << dendl;
+	    plan.parity_delta = std::move(pd);
+	  }
+	}
 	for (auto extent = raw_write_set.begin();
 	     extent != raw_write_set.end();
 	     ++extent) {
@@ -178,10 +227,29 @@ namespace ECTransaction {
 	       (!plan.to_read.at(i.first).empty() &&
 		!i.second.has_source()));
       });
+    // only worth it, and only handled, if that's all there is to read
+    if (plan.parity_delta &&
+	(plan.to_read.size() != 1 ||
+	 !plan.to_read.count(plan.parity_delta->oid))) {
+      plan.parity_delta.reset();
+    }
     plan.t = std::move(t);
     return plan;
   }
 
+  /**
+   * Lay buffer_updates over pd.old_chunks, and add to transactions the
+   * writes of the data chunks changed and of the new coding chunks.
+   */
+  void write_parity_delta(
+    pg_t pgid,
+    const ECUtil::stripe_info_t &sinfo,
+    ErasureCodeInterfaceRef &ecimpl,
+    const ParityDelta &pd,
+    const PGTransaction::ObjectOperation::buffer_update_type &buffer_updates,
+    map<shard_id_t, ObjectStore::Transaction> *transactions,
+    DoutPrefixProvider *dpp);
+
   void generate_transactions(
     WritePlan &plan,
     ErasureCodeInterfaceRef &ecimpl,
@@ -158,6 +158,78 @@ int ECUtil::encode(
   return 0;
 }
 
+static void xor_into(char *dst, const bufferlist &src)
+{
+  for (auto &p : src.buffers()) {
+    const char *s = p.c_str();
+    for (unsigned i = 0; i < p.length(); ++i) {
+      dst[i] ^= s[i];
+    }
+    dst += p.length();
+  }
+}
+
+int ECUtil::encode_parity_delta(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  const map<int, bufferlist> &old_chunks,
+  const map<int, bufferlist> &new_data,
+  map<int, bufferlist> *out) {
+
+  ceph_assert(ec_impl->get_supported_optimizations() &
+	      ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION);
+  ceph_assert(out);
+  ceph_assert(out->empty());
+
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+  auto shard_of = [&](int chunk) {
+    return (int)chunk_mapping.size() > chunk ? chunk_mapping[chunk] : chunk;
+  };
+
+  // old ^ new for the data chunks changing, zeroes for the others
+  bufferptr delta = buffer::create_page_aligned(sinfo.get_stripe_width());
+  delta.zero();
+  const int k = ec_impl->get_data_chunk_count();
+  for (int i = 0; i < k; ++i) {
+    auto n = new_data.find(shard_of(i));
+    if (n == new_data.end()) {
+      continue;
+    }
+    auto o = old_chunks.find(n->first);
+    ceph_assert(o != old_chunks.end());
+    ceph_assert(n->second.length() == chunk_size);
+    ceph_assert(o->second.length() == chunk_size);
+    char *p = delta.c_str() + i * chunk_size;
+    xor_into(p, n->second);
+    xor_into(p, o->second);
+  }
+
+  set<int> want;
+  for (int i = k; i < (int)ec_impl->get_chunk_count(); ++i) {
+    want.insert(shard_of(i));
+  }
+  bufferlist in;
+  in.push_back(std::move(delta));
+  map<int, bufferlist> encoded;
+  int r = ec_impl->encode(want, in, &encoded);
+  if (r < 0) {
+    return r;
+  }
+
+  for (auto shard : want) {
+    auto o = old_chunks.find(shard);
+    ceph_assert(o != old_chunks.end());
+    ceph_assert(o->second.length() == chunk_size);
+    ceph_assert(encoded[shard].length() == chunk_size);
+    bufferptr parity = buffer::create_page_aligned(chunk_size);
+    o->second.begin().copy(chunk_size, parity.c_str());
+    xor_into(parity.c_str(), encoded[shard]);
+    (*out)[shard].push_back(std::move(parity));
+  }
+  return 0;
+}
+
 void ECUtil::HashInfo::append(uint64_t old_size,
 			      map<int, bufferlist> &to_append) {
   ceph_assert(old_size == total_chunk_size);
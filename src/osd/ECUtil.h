@@ -98,6 +98,23 @@ int encode(
   const std::set<int> &want,
   std::map<int, bufferlist> *out);
 
+/**
+ * Compute the new coding chunks of a stripe when some of its data
+ * chunks change, from the old and new contents of those alone.  Needs
+ * FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION.
+ *
+ * @param old_chunks old contents of the changed data chunks and of all
+ *                   the coding chunks, by shard
+ * @param new_data new contents of the changed data chunks, by shard
+ * @param out new coding chunks, by shard
+ */
+int encode_parity_delta(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  const std::map<int, bufferlist> &old_chunks,
+  const std::map<int, bufferlist> &new_data,
+  std::map<int, bufferlist> *out);
+
 class HashInfo {
   uint64_t total_chunk_size = 0;
   std::vector<uint32_t> cumulative_shard_hashes;
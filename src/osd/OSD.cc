@@ -2225,10 +2225,17 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
       this);
     shards.push_back(one_shard);
   }
+
+  fast_read_max_bytes = cct->_conf.get_val<Option::size_t>(
+    "osd_fast_read_max_bytes");
+  fast_read = cct->_conf.get_val<bool>("osd_fast_read");
 }
 
 OSD::~OSD()
 {
+  for (auto& [thread, hb] : fast_read_hbs) {
+    cct->get_heartbeat_map()->remove_worker(hb);
+  }
   while (!shards.empty()) {
     delete shards.back();
     shards.pop_back();
@@ -7080,6 +7087,13 @@ void OSD::ms_fast_dispatch(Message *m)
 
   service.maybe_inject_dispatch_delay();
 
+  if (fast_read &&
+      m->get_type() == CEPH_MSG_OSD_OP &&
+      m->get_connection()->has_features(CEPH_FEATUREMASK_RESEND_ON_SPLIT) &&
+      try_fast_read(op)) {
+    return;
+  }
+
   if (m->get_connection()->has_features(CEPH_FEATUREMASK_RESEND_ON_SPLIT) ||
       m->get_type() != CEPH_MSG_OSD_OP) {
     // queue it directly
@@ -9444,6 +9458,24 @@ unsigned OSDService::get_target_pg_log_entries() const
   }
 }
 
+unsigned OSDService::get_pg_log_trim_budget() const
+{
+  auto per_op = cct->_conf.get_val<uint64_t>("osd_pg_log_trim_max_per_op");
+  if (per_op == 0) {
+    return 0;
+  }
+  // halve the budget for every op queued per shard, so that trimming
+  // gets out of the way of client io when there is any to speak of
+  unsigned queued = 0;
+  for (auto shard : osd->shards) {
+    queued += shard->num_queued;
+  }
+  queued /= std::max(osd->num_shards, 1u);
+  uint64_t budget = cct->_conf->osd_pg_log_trim_max;
+  budget >>= std::min(queued, 63u);
+  return std::max(budget, per_op);
+}
+
 void OSD::do_recovery(
   PG *pg, epoch_t queued, uint64_t reserved_pushes,
   ThreadPool::TPHandle &handle)
@@ -9614,6 +9646,71 @@ void OSD::enqueue_op(spg_t pg, OpRequestRef&& op, epoch_t epoch)
       cost, priority, stamp, owner, epoch));
 }
 
+bool OSD::try_fast_read(OpRequestRef& op)
+{
+  const MOSDOp *m = op->get_req<MOSDOp>();
+  if ((m->get_flags() & (CEPH_OSD_FLAG_READ | CEPH_OSD_FLAG_WRITE)) !=
+      CEPH_OSD_FLAG_READ) {
+    return false;
+  }
+  const spg_t pgid = m->get_spg();
+  OSDShard *sdata = shards[pgid.hash_to_shard(num_shards)];
+  PGRef pg;
+  {
+    // the op may only overtake the queue if nothing is queued ahead of
+    // it for this pg, and the pg must be ours without waiting for it
+    std::lock_guard l{sdata->shard_lock};
+    if (sdata->num_queued) {
+      return false;
+    }
+    auto p = sdata->pg_slots.find(pgid);
+    if (p == sdata->pg_slots.end() ||
+	!p->second->pg ||
+	p->second->num_running ||
+	!p->second->to_process.empty() ||
+	!p->second->waiting.empty()) {
+      return false;
+    }
+    pg = p->second->pg;
+    if (!pg->try_lock()) {
+      return false;
+    }
+  }
+  if (m->get_map_epoch() > pg->get_osdmap_epoch() ||
+      !pg->can_fast_read(op, fast_read_max_bytes)) {
+    pg->unlock();
+    logger->inc(l_osd_op_r_fast_miss);
+    return false;
+  }
+
+  dout(15) << __func__ << " " << op << " " << *m << dendl;
+  op->fast_dispatched = true;
+  ceph::heartbeat_handle_d *hb = get_fast_read_hb();
+  ThreadPool::TPHandle handle(cct, hb,
+			      cct->_conf->osd_op_thread_timeout,
+			      cct->_conf->osd_op_thread_suicide_timeout);
+  handle.reset_tp_timeout();
+  dequeue_op(pg, op, handle);
+  pg->unlock();
+  handle.suspend_tp_timeout();
+  return true;
+}
+
+ceph::heartbeat_handle_d *OSD::get_fast_read_hb()
+{
+  // the messenger threads are fixed, so this grows to one handle per
+  // worker and then stays put
+  pthread_t self = pthread_self();
+  std::lock_guard l{fast_read_hb_lock};
+  auto p = fast_read_hbs.find(self);
+  if (p == fast_read_hbs.end()) {
+    p = fast_read_hbs.emplace(
+      self,
+      cct->get_heartbeat_map()->add_worker("OSD::fast_read", self)).first;
+  }
+  return p->second;
+}
+
 void OSD::enqueue_peering_evt(spg_t pgid, PGPeeringEventRef evt)
 {
   dout(15) << __func__ << " " << pgid << " " << evt->get_desc() << dendl;
@@ -10153,12 +10250,14 @@ void OSDShard::_wake_pg_slot(
        ++i) {
     scheduler->enqueue_front(std::move(*i));
   }
+  num_queued += slot->to_process.size();
   slot->to_process.clear();
   for (auto i = slot->waiting.rbegin();
        i != slot->waiting.rend();
        ++i) {
     scheduler->enqueue_front(std::move(*i));
   }
+  num_queued += slot->waiting.size();
   slot->waiting.clear();
   for (auto i = slot->waiting_peering.rbegin();
        i != slot->waiting_peering.rend();
@@ -10169,6 +10268,7 @@ void OSDShard::_wake_pg_slot(
     for (auto j = i->second.rbegin(); j != i->second.rend(); ++j) {
       scheduler->enqueue_front(std::move(*j));
     }
+    num_queued += i->second.size();
   }
   slot->waiting_peering.clear();
   ++slot->requeue_seq;
@@ -10421,6 +10521,14 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
   // callback.
   bool is_smallest_thread_index = thread_index < osd->num_shards;
 
+  // nothing to do here; help out a shard that is falling behind
+  if (steal_scan &&
+      sdata->num_queued == 0 &&
+      !(is_smallest_thread_index && !sdata->context_queue.empty()) &&
+      _steal(thread_index, hb)) {
+    return;
+  }
+
   // peek at spg_t
   sdata->shard_lock.lock();
   if (sdata->scheduler->empty() &&
@@ -10471,6 +10579,7 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
   }
 
   OpSchedulerItem item = sdata->scheduler->dequeue();
+  --sdata->num_queued;
   if (osd->is_stopping()) {
     sdata->shard_lock.unlock();
     for (auto c : oncommits) {
@@ -10480,6 +10589,79 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb)
     return;    // OSD shutdown, discard.
   }
 
+  _process_item(sdata, std::move(item), oncommits, hb);
+}
+
+bool OSD::ShardedOpWQ::_steal(uint32_t thread_index, heartbeat_handle_d *hb)
+{
+  uint32_t shard_index = thread_index % osd->num_shards;
+
+  // go for the longest queue.  skipped items are put back with
+  // enqueue_front, so leave alone a scheduler (mclock) that would give
+  // them a different place, and with it a different qos treatment
+  OSDShard *victim = nullptr;
+  unsigned victim_queued = 0;
+  for (uint32_t i = 1; i < osd->num_shards; ++i) {
+    auto sdata = osd->shards[(shard_index + i) % osd->num_shards];
+    unsigned queued = sdata->num_queued;
+    if (queued > victim_queued &&
+	sdata->scheduler->requeue_front_preserves_order()) {
+      victim = sdata;
+      victim_queued = queued;
+    }
+  }
+  if (!victim) {
+    return false;
+  }
+
+  // only take an item whose pg no other thread is about to lock: we
+  // would just queue up behind it on the pg lock.  anything we look at
+  // and skip goes back to the front of the queue, in order.
+  victim->shard_lock.lock();
+  if (osd->is_stopping()) {
+    victim->shard_lock.unlock();
+    return false;
+  }
+  std::optional<OpSchedulerItem> item;
+  vector<OpSchedulerItem> skipped;
+  while (!victim->scheduler->empty() && skipped.size() < steal_scan) {
+    auto qi = victim->scheduler->dequeue();
+    --victim->num_queued;
+    auto p = victim->pg_slots.find(qi.get_ordering_token());
+    if (p != victim->pg_slots.end() &&
+	p->second->pg &&
+	p->second->num_running == 0 &&
+	p->second->to_process.empty()) {
+      item = std::move(qi);
+      break;
+    }
+    skipped.push_back(std::move(qi));
+  }
+  for (auto i = skipped.rbegin(); i != skipped.rend(); ++i) {
+    victim->scheduler->enqueue_front(std::move(*i));
+    ++victim->num_queued;
+  }
+  if (!item) {
+    victim->shard_lock.unlock();
+    return false;
+  }
+  dout(20) << __func__ << " from shard " << victim->shard_id
+	   << ": " << *item << dendl;
+  ++victim->num_stolen;
+  osd->logger->inc(l_osd_op_wq_stolen);
+
+  list<Context *> oncommits;
+  _process_item(victim, std::move(*item), oncommits, hb);
+  return true;
+}
+
+void OSD::ShardedOpWQ::_process_item(
+  OSDShard *sdata,
+  OpSchedulerItem&& item,
+  list<Context *>& oncommits,
+  heartbeat_handle_d *hb)
+{
+  uint32_t shard_index = sdata->shard_id;
   const auto token = item.get_ordering_token();
   auto r = sdata->pg_slots.emplace(token, nullptr);
   if (r.second) {
@@ -10717,11 +10899,23 @@ void OSD::ShardedOpWQ::_enqueue(OpSchedulerItem&& item) {
     std::lock_guard l{sdata->shard_lock};
     empty = sdata->scheduler->empty();
     sdata->scheduler->enqueue(std::move(item));
+    ++sdata->num_queued;
   }
 
   if (empty) {
     std::lock_guard l{sdata->sdata_wait_lock};
     sdata->sdata_cond.notify_one();
+  } else if (steal_scan &&
+	     sdata->scheduler->requeue_front_preserves_order()) {
+    // this shard is backed up; wake a thread of an idle one to help
+    for (uint32_t i = 1; i < osd->num_shards; ++i) {
+      auto idle = osd->shards[(shard_index + i) % osd->num_shards];
+      if (idle->num_queued == 0) {
+	std::lock_guard l{idle->sdata_wait_lock};
+	idle->sdata_cond.notify_one();
+	break;
+      }
+    }
   }
 }
 
@@ -10748,6 +10942,7 @@ void OSD::ShardedOpWQ::_enqueue_front(OpSchedulerItem&& item)
     dout(20) << __func__ << " " << item << dendl;
   }
   sdata->scheduler->enqueue_front(std::move(item));
+  ++sdata->num_queued;
   sdata->shard_lock.unlock();
   std::lock_guard l{sdata->sdata_wait_lock};
   sdata->sdata_cond.notify_one();
@@ -664,6 +664,7 @@ public:
   }
 
   unsigned get_target_pg_log_entries() const;
+  unsigned get_pg_log_trim_budget() const;
   
   // delayed pg activation
   void queue_for_recovery(PG *pg) {
@@ -1038,6 +1039,10 @@ struct OSDShard {
 
   /// priority queue
   ceph::osd::scheduler::OpSchedulerRef scheduler;
+  /// items in scheduler; updated under shard_lock, read without it
+  std::atomic<unsigned> num_queued = {0};
+  /// items processed by threads of other shards
+  std::atomic<uint64_t> num_stolen = {0};
 
   bool stop_waiting = false;
 
@@ -1589,6 +1594,19 @@ protected:
     : public ShardedThreadPool::ShardedWQ<OpSchedulerItem>
   {
     OSD *osd;
+    /// how many queued items an idle thread looks through on another
+    /// shard for one it can take; 0 if it does not steal
+    const uint64_t steal_scan;
+
+    /// take an item from the busiest other shard and process it
+    bool _steal(uint32_t thread_index, heartbeat_handle_d *hb);
+
+    /// process an item just dequeued from sdata (shard_lock held)
+    void _process_item(
+      OSDShard *sdata,
+      OpSchedulerItem&& item,
+      list<Context *>& oncommits,
+      heartbeat_handle_d *hb);
 
   public:
     ShardedOpWQ(OSD *o,
@@ -1596,7 +1614,8 @@ protected:
 		time_t si,
 		ShardedThreadPool* tp)
       : ShardedThreadPool::ShardedWQ<OpSchedulerItem>(ti, si, tp),
-        osd(o) {
+        osd(o),
+	steal_scan(o->cct->_conf.get_val<uint64_t>("osd_op_steal_scan")) {
     }
 
     void _add_slot_waiter(
@@ -1642,6 +1661,8 @@ protected:
 
 	std::scoped_lock l{sdata->shard_lock};
 	f->open_object_section(queue_name);
+	f->dump_unsigned("num_queued", sdata->num_queued);
+	f->dump_unsigned("num_stolen", sdata->num_stolen);
 	sdata->scheduler->dump(*f);
 	f->close_section();
       }
@@ -1668,6 +1689,8 @@ protected:
 
 
   void enqueue_op(spg_t pg, OpRequestRef&& op, epoch_t epoch);
+  /// run a small read of a pg with nothing queued right here, if we can
+  bool try_fast_read(OpRequestRef& op);
   void dequeue_op(
     PGRef pg, OpRequestRef op,
     ThreadPool::TPHandle &handle);
@@ -1755,6 +1778,13 @@ public:
   vector<OSDShard*> shards;
   uint32_t num_shards = 0;
 
+  bool fast_read = false;
+  uint64_t fast_read_max_bytes = 0;
+  /// heartbeat handles of the messenger threads that ran fast reads
+  ceph::mutex fast_read_hb_lock = ceph::make_mutex("OSD::fast_read_hb_lock");
+  std::map<pthread_t, ceph::heartbeat_handle_d*> fast_read_hbs;
+  ceph::heartbeat_handle_d *get_fast_read_hb();
+
   void inc_num_pgs() {
     ++num_pgs;
   }
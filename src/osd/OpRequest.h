@@ -86,6 +86,7 @@ public:
   bool check_send_map = true; ///< true until we check if sender needs a map
   epoch_t sent_epoch = 0;     ///< client's map epoch
   epoch_t min_epoch = 0;      ///< min epoch needed to handle this msg
+  bool fast_dispatched = false; ///< run by the messenger thread, not queued
 
   bool hitset_inserted;
 
@@ -241,6 +241,21 @@ void PG::lock(bool no_lockdep) const
   dout(30) << "lock" << dendl;
 }
 
+bool PG::try_lock() const
+{
+  if (!_lock.try_lock()) {
+    return false;
+  }
+#ifndef CEPH_DEBUG_MUTEX
+  locked_by = std::this_thread::get_id();
+#endif
+  // if we have unrecorded dirty state with the lock dropped, there is a bug
+  ceph_assert(!recovery_state.debug_has_dirty_state());
+
+  dout(30) << "try_lock" << dendl;
+  return true;
+}
+
 bool PG::is_locked() const
 {
   return ceph_mutex_is_locked(_lock);
@@ -856,6 +871,11 @@ unsigned PG::get_target_pg_log_entries() const
   return osd->get_target_pg_log_entries();
 }
 
+unsigned PG::get_pg_log_trim_budget() const
+{
+  return osd->get_pg_log_trim_budget();
+}
+
 void PG::clear_publish_stats()
 {
   dout(15) << "clear_stats" << dendl;
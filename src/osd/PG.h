@@ -217,6 +217,7 @@ public:
     handle.reset_tp_timeout();
   }
   void lock(bool no_lockdep = false) const;
+  bool try_lock() const;
   void unlock() const;
   bool is_locked() const;
 
@@ -401,6 +402,7 @@ public:
     return snap_trimq.size();
   }
   unsigned get_target_pg_log_entries() const override;
+  unsigned get_pg_log_trim_budget() const override;
 
   void clear_publish_stats() override;
   void clear_primary_state() override;
@@ -531,6 +533,9 @@ public:
     OpRequestRef& op,
     ThreadPool::TPHandle &handle
   ) = 0;
+  /// true if op is a small read we can serve from cached state right
+  /// away; pg lock held
+  virtual bool can_fast_read(OpRequestRef& op, uint64_t max_bytes) = 0;
   virtual void clear_cache() = 0;
   virtual int get_cache_obj_count() = 0;
 
@@ -43,12 +43,13 @@ void PGLog::IndexedLog::split_out_child(
   reset_rollback_info_trimmed_to_riter();
 }
 
-void PGLog::IndexedLog::trim(
+size_t PGLog::IndexedLog::trim(
   CephContext* cct,
   eversion_t s,
   set<eversion_t> *trimmed,
   set<string>* trimmed_dups,
-  eversion_t *write_from_dups)
+  eversion_t *write_from_dups,
+  size_t max_trim)
 {
   ceph_assert(s <= can_rollback_to);
   if (complete_to != log.end())
@@ -60,10 +61,18 @@ void PGLog::IndexedLog::trim(
     : log.rbegin()->version.version - cct->_conf->osd_pg_log_dups_tracked + 1;
 
   lgeneric_subdout(cct, osd, 20) << "earliest_dup_version = " << earliest_dup_version << dendl;
+  size_t num_trimmed = 0;
+  size_t backlog = 0;
   while (!log.empty()) {
     const pg_log_entry_t &e = *log.begin();
     if (e.version > s)
       break;
+    if (max_trim && num_trimmed >= max_trim) {
+      // leave the rest for later; the tail is what we got to
+      backlog = s.version - e.version.version + 1;
+      s = tail;
+      break;
+    }
     lgeneric_subdout(cct, osd, 20) << "trim " << e << dendl;
     if (trimmed)
       trimmed->emplace(e.version);
@@ -101,6 +110,8 @@ void PGLog::IndexedLog::trim(
     // we are trimming past complete_to, so reset complete_to
     if (complete_to != log.end() && e.version >= complete_to->version)
       reset_complete_to = true;
+    tail = e.version;
+    ++num_trimmed;
     if (rollback_info_trimmed_to_riter == log.rend() ||
 	e.version == rollback_info_trimmed_to_riter->version) {
       log.pop_front();
@@ -125,16 +136,22 @@ void PGLog::IndexedLog::trim(
     const auto& e = *dups.begin();
     if (e.version.version >= earliest_dup_version)
       break;
+    if (max_trim && num_trimmed >= max_trim) {
+      backlog += earliest_dup_version - e.version.version;
+      break;
+    }
     lgeneric_subdout(cct, osd, 20) << "trim dup " << e << dendl;
     if (trimmed_dups)
       trimmed_dups->insert(e.get_key_name());
     unindex(e);
     dups.pop_front();
+    ++num_trimmed;
   }
 
   // raise tail?
   if (tail < s)
     tail = s;
+  return backlog;
 }
 
 ostream& PGLog::IndexedLog::print(ostream& out) const
@@ -168,6 +185,7 @@ void PGLog::reset_backfill()
 void PGLog::clear() {
   missing.clear();
   log.clear();
+  trim_backlog = 0;
   log_keys_debug.clear();
   undirty();
 }
@@ -183,7 +201,8 @@ void PGLog::trim(
   eversion_t trim_to,
   pg_info_t &info,
   bool transaction_applied,
-  bool async)
+  bool async,
+  size_t max_trim)
 {
   dout(10) << __func__ << " proposed trim_to = " << trim_to << dendl;
   // trim?
@@ -195,11 +214,18 @@ void PGLog::trim(
       ceph_assert(trim_to <= info.last_complete);
 
     dout(10) << "trim " << log << " to " << trim_to << dendl;
-    log.trim(cct, trim_to, &trimmed, &trimmed_dups, &write_from_dups);
+    trim_backlog = log.trim(cct, trim_to, &trimmed, &trimmed_dups,
+			    &write_from_dups, max_trim);
     info.log_tail = log.tail;
     if (log.complete_to != log.log.end())
       dout(10) << " after trim complete_to " << log.complete_to->version << dendl;
+  } else if (trim_backlog) {
+    // dups an earlier trim ran out of budget for
+    trim_backlog = log.trim(cct, eversion_t(), &trimmed, &trimmed_dups,
+			    &write_from_dups, max_trim);
   }
+  if (trim_backlog)
+    dout(10) << __func__ << " backlog " << trim_backlog << dendl;
 }
 
 void PGLog::proc_replica_log(
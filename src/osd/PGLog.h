@@ -19,6 +19,7 @@
 // re-include our assert to clobber boost's
 #include "include/ceph_assert.h"
 #include "osd_types.h"
+#include "PGLogIndex.h"
 #include "os/ObjectStore.h"
 #include <list>
 
@@ -72,11 +73,26 @@ public:
    * IndexLog - adds in-memory index of the log, by oid.
    * plus some methods to manipulate it all.
    */
+  struct entry_soid_t {
+    const hobject_t& operator()(const pg_log_entry_t& e) const {
+      return e.soid;
+    }
+  };
+  template <typename T>
+  struct reqid_of_t {
+    const osd_reqid_t& operator()(const T& e) const {
+      return e.reqid;
+    }
+  };
+
   struct IndexedLog : public pg_log_t {
-    mutable ceph::unordered_map<hobject_t,pg_log_entry_t*> objects;  // ptrs into log.  be careful!
-    mutable ceph::unordered_map<osd_reqid_t,pg_log_entry_t*> caller_ops;
+    // ptrs into log.  be careful!
+    mutable PGLogIndex<hobject_t, pg_log_entry_t, entry_soid_t> objects;
+    mutable PGLogIndex<osd_reqid_t, pg_log_entry_t,
+		       reqid_of_t<pg_log_entry_t>> caller_ops;
     mutable ceph::unordered_multimap<osd_reqid_t,pg_log_entry_t*> extra_caller_ops;
-    mutable ceph::unordered_map<osd_reqid_t,pg_log_dup_t*> dup_index;
+    mutable PGLogIndex<osd_reqid_t, pg_log_dup_t,
+		       reqid_of_t<pg_log_dup_t>> dup_index;
 
     // recovery pointers
     list<pg_log_entry_t>::iterator complete_to; // not inclusive of referenced item
@@ -273,16 +289,14 @@ public:
       ceph_assert(version);
       ceph_assert(user_version);
       ceph_assert(return_code);
-      ceph::unordered_map<osd_reqid_t,pg_log_entry_t*>::const_iterator p;
       if (!(indexed_data & PGLOG_INDEXED_CALLER_OPS)) {
         index_caller_ops();
       }
-      p = caller_ops.find(r);
-      if (p != caller_ops.end()) {
-	*version = p->second->version;
-	*user_version = p->second->user_version;
-	*return_code = p->second->return_code;
-	*op_returns = p->second->op_returns;
+      if (const pg_log_entry_t *e = caller_ops[r]; e) {
+	*version = e->version;
+	*user_version = e->user_version;
+	*return_code = e->return_code;
+	*op_returns = e->op_returns;
 	return true;
       }
 
@@ -291,7 +305,7 @@ public:
       if (!(indexed_data & PGLOG_INDEXED_EXTRA_CALLER_OPS)) {
         index_extra_caller_ops();
       }
-      p = extra_caller_ops.find(r);
+      auto p = extra_caller_ops.find(r);
       if (p != extra_caller_ops.end()) {
 	uint32_t idx = 0;
 	for (auto i = p->second->extra_reqids.begin();
@@ -388,8 +402,9 @@ public:
 	extra_caller_ops.clear();
       if (to_index & PGLOG_INDEXED_DUPS) {
 	dup_index.clear();
+	dup_index.reserve(dups.size());
 	for (auto& i : dups) {
-	  dup_index[i.reqid] = const_cast<pg_log_dup_t*>(&i);
+	  dup_index.insert(const_cast<pg_log_dup_t*>(&i));
 	}
       }
 
@@ -399,18 +414,22 @@ public:
 	PGLOG_INDEXED_EXTRA_CALLER_OPS;
 
       if (to_index & any_log_entry_index) {
+	if (to_index & PGLOG_INDEXED_OBJECTS)
+	  objects.reserve(log.size());
+	if (to_index & PGLOG_INDEXED_CALLER_OPS)
+	  caller_ops.reserve(log.size());
 	for (list<pg_log_entry_t>::const_iterator i = log.begin();
 	     i != log.end();
 	     ++i) {
 	  if (to_index & PGLOG_INDEXED_OBJECTS) {
 	    if (i->object_is_indexed()) {
-	      objects[i->soid] = const_cast<pg_log_entry_t*>(&(*i));
+	      objects.insert(const_cast<pg_log_entry_t*>(&(*i)));
 	    }
 	  }
 
 	  if (to_index & PGLOG_INDEXED_CALLER_OPS) {
 	    if (i->reqid_is_indexed()) {
-	      caller_ops[i->reqid] = const_cast<pg_log_entry_t*>(&(*i));
+	      caller_ops.insert(const_cast<pg_log_entry_t*>(&(*i)));
 	    }
 	  }
 
@@ -446,14 +465,15 @@ public:
 
     void index(pg_log_entry_t& e) {
       if ((indexed_data & PGLOG_INDEXED_OBJECTS) && e.object_is_indexed()) {
-        if (objects.count(e.soid) == 0 ||
-            objects[e.soid]->version < e.version)
-          objects[e.soid] = &e;
+	auto it = objects.find(e.soid);
+        if (it == objects.end() ||
+            it->second->version < e.version)
+          objects.insert(&e);
       }
       if (indexed_data & PGLOG_INDEXED_CALLER_OPS) {
 	// divergent merge_log indexes new before unindexing old
         if (e.reqid_is_indexed()) {
-	  caller_ops[e.reqid] = &e;
+	  caller_ops.insert(&e);
         }
       }
       if (indexed_data & PGLOG_INDEXED_EXTRA_CALLER_OPS) {
@@ -507,7 +527,7 @@ public:
 
     void index(pg_log_dup_t& e) {
       if (indexed_data & PGLOG_INDEXED_DUPS) {
-	dup_index[e.reqid] = &e;
+	dup_index.insert(&e);
       }
     }
 
@@ -542,11 +562,11 @@ public:
 
       // to our index
       if ((indexed_data & PGLOG_INDEXED_OBJECTS) && e.object_is_indexed()) {
-        objects[e.soid] = &(log.back());
+        objects.insert(&(log.back()));
       }
       if (indexed_data & PGLOG_INDEXED_CALLER_OPS) {
         if (e.reqid_is_indexed()) {
-	  caller_ops[e.reqid] = &(log.back());
+	  caller_ops.insert(&(log.back()));
         }
       }
 
@@ -563,12 +583,20 @@ public:
       }
     } // add
 
-    void trim(
+    /**
+     * trim entries <= s, and dups past osd_pg_log_dups_tracked
+     *
+     * @param max_trim stop after removing this many entries and dups,
+     *                 0 for no limit
+     * @return approximate number of entries and dups left to trim
+     */
+    size_t trim(
       CephContext* cct,
       eversion_t s,
       set<eversion_t> *trimmed,
       set<string>* trimmed_dups,
-      eversion_t *write_from_dups);
+      eversion_t *write_from_dups,
+      size_t max_trim = 0);
 
     ostream& print(ostream& out) const;
   }; // IndexedLog
@@ -588,6 +616,7 @@ protected:
   eversion_t dirty_from_dups;  ///< must clear/writeout all dups >= dirty_from_dups
   eversion_t write_from_dups;  ///< must write keys >= write_from_dups
   set<string> trimmed_dups;    ///< must clear keys in trimmed_dups
+  size_t trim_backlog = 0;     ///< approx entries and dups left to trim
   CephContext *cct;
   bool pg_log_debug;
   /// Log is clean on [dirty_to, dirty_from)
@@ -745,7 +774,13 @@ public:
     eversion_t trim_to,
     pg_info_t &info,
     bool transaction_applied = true,
-    bool async = false);
+    bool async = false,
+    size_t max_trim = 0);
+
+  /// entries and dups a budgeted trim() has left for later
+  size_t get_trim_backlog() const {
+    return trim_backlog;
+  }
 
   void roll_forward_to(
     eversion_t roll_forward_to,
@@ -984,8 +1019,7 @@ protected:
 		       << " last_divergent_update: " << last_divergent_update
 		       << dendl;
 
-    ceph::unordered_map<hobject_t, pg_log_entry_t*>::const_iterator objiter =
-      log.objects.find(hoid);
+    auto objiter = log.objects.find(hoid);
     if (objiter != log.objects.end() &&
 	objiter->second->version >= first_divergent_update) {
       /// Case 1)
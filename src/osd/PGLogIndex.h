@@ -0,0 +1,196 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+
+#include "include/ceph_assert.h"
+#include "include/mempool.h"
+
+/**
+ * PGLogIndex - index of pg log entries (or dups) by a key they contain
+ *
+ * An open addressing hash table of pointers to the entries, which hold
+ * their own keys: a slot is a pointer and a hash, rather than a node
+ * with a copy of the key (a whole hobject_t for the objects index) as
+ * with an unordered_map.  That cuts the cost of indexing an entry to
+ * a few dozen bytes, and keeps it in the osd_pglog mempool.
+ *
+ * Inserting an entry replaces any entry with the same key.  Indexed
+ * entries must stay put and keep their keys until they are erased.
+ *
+ * @tparam K key type, with a std::hash
+ * @tparam T entry type
+ * @tparam KeyOf functor returning a const K& to the key of a const T&
+ */
+template <typename K, typename T, typename KeyOf>
+class PGLogIndex {
+  struct slot_t {
+    T *entry = nullptr;  ///< nullptr if the slot is free
+    uint32_t hash = 0;
+  };
+  mempool::osd_pglog::vector<slot_t> slots;  ///< power of 2 sized
+  size_t num = 0;
+
+  static constexpr size_t npos = std::numeric_limits<size_t>::max();
+  static constexpr size_t min_slots = 16;
+
+  static uint32_t hash_of(const K& k) {
+    // std::hash of most keys is not meant to be masked
+    uint64_t h = std::hash<K>()(k) * 0x9e3779b97f4a7c15ull;
+    return h >> 32;
+  }
+  size_t mask() const {
+    return slots.size() - 1;
+  }
+  size_t find_slot(const K& k) const {
+    if (!num) {
+      return npos;
+    }
+    uint32_t h = hash_of(k);
+    for (size_t i = h & mask(); slots[i].entry; i = (i + 1) & mask()) {
+      if (slots[i].hash == h && KeyOf()(*slots[i].entry) == k) {
+	return i;
+      }
+    }
+    return npos;
+  }
+  void rehash(size_t n) {
+    mempool::osd_pglog::vector<slot_t> old(n);
+    old.swap(slots);
+    for (auto& s : old) {
+      if (s.entry) {
+	size_t i = s.hash & mask();
+	while (slots[i].entry) {
+	  i = (i + 1) & mask();
+	}
+	slots[i] = s;
+      }
+    }
+  }
+  void erase_slot(size_t i) {
+    // shift back the entries after i that would no longer be found
+    // past the hole, rather than leaving a tombstone
+    for (size_t j = (i + 1) & mask(); slots[j].entry; j = (j + 1) & mask()) {
+      size_t home = slots[j].hash & mask();
+      if (((j - home) & mask()) >= ((j - i) & mask())) {
+	slots[i] = slots[j];
+	i = j;
+      }
+    }
+    slots[i] = slot_t();
+    --num;
+  }
+
+public:
+  /// what an iterator points to, like the value of an unordered_map
+  struct value_ref {
+    const K& first;
+    T *second;
+    const value_ref *operator->() const {
+      return this;
+    }
+  };
+
+  class iterator {
+    friend class PGLogIndex;
+    const PGLogIndex *index = nullptr;
+    size_t pos = npos;
+    iterator(const PGLogIndex *index, size_t pos) : index(index), pos(pos) {}
+  public:
+    iterator() = default;
+    value_ref operator*() const {
+      T *e = index->slots[pos].entry;
+      return value_ref{KeyOf()(*e), e};
+    }
+    value_ref operator->() const {
+      return **this;
+    }
+    bool operator==(const iterator& o) const {
+      return pos == o.pos;
+    }
+    bool operator!=(const iterator& o) const {
+      return pos != o.pos;
+    }
+  };
+  using const_iterator = iterator;
+
+  PGLogIndex() = default;
+  PGLogIndex(const PGLogIndex&) = delete;
+  PGLogIndex& operator=(const PGLogIndex&) = delete;
+
+  size_t size() const {
+    return num;
+  }
+  bool empty() const {
+    return num == 0;
+  }
+  /// bytes of memory used
+  size_t get_bytes() const {
+    return slots.capacity() * sizeof(slot_t);
+  }
+
+  iterator end() const {
+    return iterator(this, npos);
+  }
+  iterator find(const K& k) const {
+    return iterator(this, find_slot(k));
+  }
+  size_t count(const K& k) const {
+    return find_slot(k) == npos ? 0 : 1;
+  }
+  /// the entry with key k, or nullptr
+  T *operator[](const K& k) const {
+    size_t i = find_slot(k);
+    return i == npos ? nullptr : slots[i].entry;
+  }
+
+  /// make room for n entries
+  void reserve(size_t n) {
+    size_t want = min_slots;
+    while (want * 3 < n * 4) {
+      want *= 2;
+    }
+    if (want > slots.size()) {
+      rehash(want);
+    }
+  }
+  /// index e, in place of any entry with the same key
+  void insert(T *e) {
+    if ((num + 1) * 4 > slots.size() * 3) {
+      rehash(std::max(slots.size() * 2, min_slots));
+    }
+    const K& k = KeyOf()(*e);
+    uint32_t h = hash_of(k);
+    size_t i = h & mask();
+    for (; slots[i].entry; i = (i + 1) & mask()) {
+      if (slots[i].hash == h && KeyOf()(*slots[i].entry) == k) {
+	slots[i].entry = e;
+	return;
+      }
+    }
+    slots[i].entry = e;
+    slots[i].hash = h;
+    ++num;
+  }
+  void erase(iterator p) {
+    ceph_assert(p.index == this && p.pos != npos);
+    erase_slot(p.pos);
+  }
+  void clear() {
+    mempool::osd_pglog::vector<slot_t>().swap(slots);
+    num = 0;
+  }
+};
@@ -3006,6 +3006,7 @@ void PeeringState::merge_from(
   info.last_complete = info.last_update;  // to fake out trim()
   pg_log.reset_recovery_pointers();
   pg_log.trim(info.last_update, info);
+  publish_pg_log_trim_backlog(pg_log.get_trim_backlog());
 
   vector<PGLog*> log_from;
   for (auto& i : sources) {
@@ -3044,6 +3045,7 @@ void PeeringState::merge_from(
     source->info.last_complete = source->info.last_update;  // to fake out trim()
     source->pg_log.reset_recovery_pointers();
     source->pg_log.trim(source->info.last_update, source->info);
+    source->publish_pg_log_trim_backlog(0);
     log_from.push_back(&source->pg_log);
 
     // combine stats
@@ -3716,7 +3718,7 @@ bool PeeringState::append_log_entries_update_missing(
   psdout(20) << __func__ << " trim_to bool = " << bool(trim_to)
 	     << " trim_to = " << (trim_to ? *trim_to : eversion_t()) << dendl;
   if (trim_to)
-    pg_log.trim(*trim_to, info);
+    trim_log(*trim_to);
   dirty_info = true;
   write_if_dirty(t);
   return invalidate_stats;
@@ -3856,7 +3858,7 @@ void PeeringState::append_log(
   if (!transaction_applied || async)
     psdout(10) << __func__ << " " << pg_whoami
 	       << " is async_recovery or backfill target" << dendl;
-  pg_log.trim(trim_to, info, transaction_applied, async);
+  trim_log(trim_to, transaction_applied, async);
 
   // update the local pg, pg log
   dirty_info = true;
@@ -4089,6 +4091,30 @@ void PeeringState::calc_trim_to()
   }
 }
 
+void PeeringState::trim_log(
+  eversion_t trim_to,
+  bool transaction_applied,
+  bool async)
+{
+  // spread big trims (e.g. after recovery) over subsequent writes
+  // rather than deleting tens of thousands of keys in one commit
+  pg_log.trim(trim_to, info, transaction_applied, async,
+	      pl->get_pg_log_trim_budget());
+  publish_pg_log_trim_backlog(pg_log.get_trim_backlog());
+}
+
+void PeeringState::publish_pg_log_trim_backlog(size_t backlog)
+{
+  if (backlog > pg_log_trim_backlog) {
+    pl->get_perf_logger().inc(l_osd_pg_log_trim_backlog,
+			      backlog - pg_log_trim_backlog);
+  } else if (backlog < pg_log_trim_backlog) {
+    pl->get_perf_logger().dec(l_osd_pg_log_trim_backlog,
+			      pg_log_trim_backlog - backlog);
+  }
+  pg_log_trim_backlog = backlog;
+}
+
 void PeeringState::calc_trim_to_aggressive()
 {
   size_t target = pl->get_target_pg_log_entries();
@@ -6041,7 +6067,7 @@ boost::statechart::result PeeringState::ReplicaActive::react(const MTrim& trim)
 {
   DECLARE_LOCALS;
   // primary is instructing us to trim
-  ps->pg_log.trim(trim.trim_to, ps->info);
+  ps->trim_log(trim.trim_to);
   ps->dirty_info = true;
   return discard_event();
 }
@@ -6212,6 +6238,7 @@ PeeringState::ToDelete::ToDelete(my_context ctx)
   context< PeeringMachine >().log_enter(state_name);
   DECLARE_LOCALS;
   pl->get_perf_logger().inc(l_osd_pg_removing);
+  ps->publish_pg_log_trim_backlog(0);
 }
 
 void PeeringState::ToDelete::exit()
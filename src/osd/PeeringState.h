@@ -282,6 +282,8 @@ public:
     virtual void recheck_readable() = 0;
 
     virtual unsigned get_target_pg_log_entries() const = 0;
+    /// max log entries and dups to trim in one transaction, 0 for all
+    virtual unsigned get_pg_log_trim_budget() const = 0;
 
     // ============ Flush state ==================
     /**
@@ -1440,6 +1442,8 @@ public:
   eversion_t  min_last_complete_ondisk;
   /// point to which the log should be trimmed
   eversion_t  pg_trim_to;
+  /// our share of l_osd_pg_log_trim_backlog
+  size_t pg_log_trim_backlog = 0;
 
   set<int> blocked_by; ///< osds we are blocked by (for pg stats)
 
@@ -1618,6 +1622,12 @@ public:
   void calc_trim_to();
   void calc_trim_to_aggressive();
 
+  void trim_log(
+    eversion_t trim_to,
+    bool transaction_applied = true,
+    bool async = false);
+  void publish_pg_log_trim_backlog(size_t backlog);
+
 public:
   PeeringState(
     CephContext *cct,
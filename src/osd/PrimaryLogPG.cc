@@ -1624,6 +1624,61 @@ void PrimaryLogPG::handle_backoff(OpRequestRef& op)
   session->ack_backoff(cct, m->pgid, m->id, begin, end);
 }
 
+bool PrimaryLogPG::can_fast_read(OpRequestRef& op, uint64_t max_bytes)
+{
+  if (!is_primary() || !is_active() || !is_clean() ||
+      !pool.info.is_replicated() ||
+      pool.info.is_tier() || pool.info.has_tiers() ||
+      !waiting_for_map.empty()) {
+    return false;
+  }
+  MOSDOp *m = static_cast<MOSDOp*>(op->get_nonconst_req());
+  if (m->finish_decode()) {
+    op->reset_desc();   // for TrackedOp
+    m->clear_payload();
+  }
+  if (m->get_snapid() != CEPH_NOSNAP ||
+      m->has_flag(CEPH_OSD_FLAG_PARALLELEXEC)) {
+    return false;
+  }
+
+  // only an object we have a context for, that nobody is waiting on
+  ObjectContextRef obc = object_contexts.lookup(m->get_hobj());
+  if (!obc || !obc->obs.exists || !obc->empty()) {
+    return false;
+  }
+
+  // and only data the store can hand back without a device read, as
+  // the messenger thread must not block
+  uint64_t bytes = 0;
+  for (auto& osd_op : m->ops) {
+    switch (osd_op.op.op) {
+    case CEPH_OSD_OP_READ:
+    case CEPH_OSD_OP_SYNC_READ:
+      {
+	// a zero length reads to the end of the object
+	uint64_t offset = osd_op.op.extent.offset;
+	uint64_t length = osd_op.op.extent.length;
+	if (!length && offset < obc->obs.oi.size) {
+	  length = obc->obs.oi.size - offset;
+	}
+	bytes += length;
+	if (bytes > max_bytes ||
+	    !osd->store->is_cached(ch, ghobject_t(m->get_hobj()),
+				   offset, length)) {
+	  return false;
+	}
+      }
+      break;
+    case CEPH_OSD_OP_STAT:
+      break;
+    default:
+      return false;
+    }
+  }
+  return bytes <= max_bytes;
+}
+
 void PrimaryLogPG::do_request(
   OpRequestRef& op,
   ThreadPool::TPHandle &handle)
@@ -4098,6 +4153,14 @@ void PrimaryLogPG::log_op_stats(const OpRequest& op,
     osd->logger->tinc(l_osd_op_r_lat, latency);
     osd->logger->hinc(l_osd_op_r_lat_outb_hist, latency.to_nsec(), outb);
     osd->logger->tinc(l_osd_op_r_process_lat, process_latency);
+    if (op.fast_dispatched) {
+      osd->logger->inc(l_osd_op_r_fast);
+      osd->logger->tinc(l_osd_op_r_fast_lat, latency);
+      osd->logger->hinc(l_osd_op_r_fast_lat_outb_hist, latency.to_nsec(), outb);
+    } else {
+      osd->logger->hinc(l_osd_op_r_queued_lat_outb_hist, latency.to_nsec(),
+			outb);
+    }
   } else if (op.may_write() || op.may_cache()) {
     osd->logger->inc(l_osd_op_w);
     osd->logger->inc(l_osd_op_w_inb, inb);
@@ -7400,18 +7463,36 @@ int PrimaryLogPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
           }
 	  iter->upper_bound(start_after);
 	  if (filter_prefix > start_after) iter->lower_bound(filter_prefix);
-	  for (num = 0;
-	       iter->valid() &&
-		 iter->key().substr(0, filter_prefix.size()) == filter_prefix;
-	       ++num, iter->next()) {
-	    dout(20) << "Found key " << iter->key() << dendl;
-	    if (num >= max_return ||
-		bl.length() >= cct->_conf->osd_max_omap_bytes_per_request) {
-	      truncated = true;
+	  // pull the entries in batches rather than one key()/value()/next()
+	  // at a time; one entry past the limits tells us we are truncated
+	  const uint64_t max_bytes = cct->_conf->osd_max_omap_bytes_per_request;
+	  KeyValueDB::IteratorBatch batch;
+	  bool done = false;
+	  while (!done) {
+	    batch.clear();
+	    if (!iter->next_batch(
+		  std::min<uint64_t>(max_return - num + 1, 1024),
+		  bl.length() < max_bytes ? max_bytes - bl.length() : 1,
+		  &batch)) {
 	      break;
 	    }
-	    encode(iter->key(), bl);
-	    encode(iter->value(), bl);
+	    for (size_t i = 0; i < batch.size(); ++i) {
+	      auto key = batch.key(i);
+	      if (key.substr(0, filter_prefix.size()) != filter_prefix) {
+		done = true;
+		break;
+	      }
+	      dout(20) << "Found key " << key << dendl;
+	      if (num >= max_return || bl.length() >= max_bytes) {
+		truncated = true;
+		done = true;
+		break;
+	      }
+	      // a string and a bufferlist encode the same way
+	      encode(key, bl);
+	      encode(batch.value(i), bl);
+	      ++num;
+	    }
 	  }
 	} // else return empty out_set
 	encode(num, osd_op.outdata);
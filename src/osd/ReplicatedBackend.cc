@@ -290,6 +290,27 @@ public:
   }
 };
 
+// size t for what generate_transaction() is about to build from pgt
+static void reserve_transaction(
+  const PGTransaction &pgt,
+  ObjectStore::Transaction *t)
+{
+  uint32_t ops = 0, bytes = 0;
+  for (auto &&i : pgt.op_map) {
+    const auto &op = i.second;
+    // create/clone/remove, omap header, truncate and alloc hint
+    ops += 4 + op.attr_updates.size() + op.omap_updates.size() +
+      op.buffer_updates.ext_count();
+    // attr values, like write and omap payloads, are shared by reference
+    for (auto &&a : op.attr_updates) {
+      bytes += a.first.size();
+    }
+  }
+  // lengths and offsets encoded along with most ops
+  bytes += ops * sizeof(uint64_t) * 2;
+  t->reserve(ops, bytes);
+}
+
 void generate_transaction(
   PGTransactionUPtr &pgt,
   const coll_t &coll,
@@ -466,6 +487,7 @@ void ReplicatedBackend::submit_transaction(
   ObjectStore::Transaction op_t;
   PGTransactionUPtr t(std::move(_t));
   set<hobject_t> added, removed;
+  reserve_transaction(*t, &op_t);
   generate_transaction(
     t,
     coll,
@@ -927,6 +949,7 @@ Message * ReplicatedBackend::generate_subop(
   const bufferlist &log_entries,
   std::optional<pg_hit_set_history_t> &hset_hist,
   ObjectStore::Transaction &op_t,
+  const bufferlist &op_t_bl,
   pg_shard_t peer,
   const pg_info_t &pinfo)
 {
@@ -945,7 +968,7 @@ Message * ReplicatedBackend::generate_subop(
     ObjectStore::Transaction t;
     encode(t, wr->get_data());
   } else {
-    encode(op_t, wr->get_data());
+    wr->get_data().append(op_t_bl);
     wr->get_header().data_off = op_t.get_data_alignment();
   }
 
@@ -999,6 +1022,9 @@ void ReplicatedBackend::issue_op(
     // avoid doing the same work in generate_subop
     bufferlist logs;
     encode(log_entries, logs);
+    // every replica shares this encoding, and through it op_t's buffers
+    bufferlist op_t_bl;
+    encode(op_t, op_t_bl);
 
     for (const auto& shard : get_parent()->get_acting_recovery_backfill_shards()) {
       if (shard == parent->whoami_shard()) continue;
@@ -1017,6 +1043,7 @@ void ReplicatedBackend::issue_op(
 	  logs,
 	  hset_hist,
 	  op_t,
+	  op_t_bl,
 	  shard,
 	  pinfo);
       if (op->op && op->op->pg_trace)
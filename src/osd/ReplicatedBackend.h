@@ -387,6 +387,7 @@ private:
     const bufferlist &log_entries,
     std::optional<pg_hit_set_history_t> &hset_history,
     ObjectStore::Transaction &op_t,
+    const bufferlist &op_t_bl,
     pg_shard_t peer,
     const pg_info_t &pinfo);
   void issue_op(
@@ -71,6 +71,23 @@ PerfCounters *build_osd_logger(CephContext *cct) {
   osd_plb.add_time_avg(
     l_osd_op_r_prepare_lat, "op_r_prepare_latency",
     "Latency of read operations (excluding queue time and wait for finished)");
+  osd_plb.add_u64_counter(
+    l_osd_op_r_fast, "op_r_fast",
+    "Client reads run by the messenger thread (osd_fast_read)");
+  osd_plb.add_u64_counter(
+    l_osd_op_r_fast_miss, "op_r_fast_miss",
+    "Client reads of an idle pg queued because they could not run right away");
+  osd_plb.add_time_avg(
+    l_osd_op_r_fast_lat, "op_r_fast_latency",
+    "Latency of reads run by the messenger thread");
+  osd_plb.add_u64_counter_histogram(
+    l_osd_op_r_fast_lat_outb_hist, "op_r_fast_latency_out_bytes_histogram",
+    op_hist_x_axis_config, op_hist_y_axis_config,
+    "Histogram of latency + data read of reads run by the messenger thread");
+  osd_plb.add_u64_counter_histogram(
+    l_osd_op_r_queued_lat_outb_hist, "op_r_queued_latency_out_bytes_histogram",
+    op_hist_x_axis_config, op_hist_y_axis_config,
+    "Histogram of latency (including queue time) + data read of queued reads");
   osd_plb.add_u64_counter(
     l_osd_op_w, "op_w", "Client write operations");
   osd_plb.add_u64_counter(
@@ -276,6 +293,21 @@ PerfCounters *build_osd_logger(CephContext *cct) {
   osd_plb.add_u64_counter(
     l_osd_pg_biginfo, "osd_pg_biginfo", "PG updated its biginfo attr");
 
+  osd_plb.add_u64_counter(
+    l_osd_op_wq_stolen, "op_wq_stolen",
+    "Queued ops processed by a thread of another shard");
+
+  osd_plb.add_u64(
+    l_osd_pg_log_trim_backlog, "pg_log_trim_backlog",
+    "PG log entries and dups due for trimming but deferred to later writes");
+
+  osd_plb.add_u64_counter(
+    l_osd_ec_parity_delta, "ec_parity_delta",
+    "EC writes that updated the coding chunks with a parity delta");
+  osd_plb.add_u64_counter(
+    l_osd_ec_parity_delta_fallback, "ec_parity_delta_fallback",
+    "EC writes planned as a parity delta that re-encoded the stripe instead");
+
   return osd_plb.create_perf_counters();
 }
  
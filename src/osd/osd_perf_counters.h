@@ -20,6 +20,11 @@ enum {
   l_osd_op_r_lat_outb_hist,
   l_osd_op_r_process_lat,
   l_osd_op_r_prepare_lat,
+  l_osd_op_r_fast,
+  l_osd_op_r_fast_miss,
+  l_osd_op_r_fast_lat,
+  l_osd_op_r_fast_lat_outb_hist,
+  l_osd_op_r_queued_lat_outb_hist,
   l_osd_op_w,
   l_osd_op_w_inb,
   l_osd_op_w_lat,
@@ -117,6 +122,13 @@ enum {
   l_osd_pg_fastinfo,
   l_osd_pg_biginfo,
 
+  l_osd_op_wq_stolen,
+
+  l_osd_pg_log_trim_backlog,
+
+  l_osd_ec_parity_delta,
+  l_osd_ec_parity_delta_fallback,
+
   l_osd_last,
 };
 
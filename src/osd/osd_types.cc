@@ -3105,6 +3105,12 @@ void store_statfs_t::dump(Formatter *f) const
   f->dump_int("data_compressed_original", data_compressed_original);
   f->dump_int("omap_allocated", omap_allocated);
   f->dump_int("internal_metadata", internal_metadata);
+  f->dump_int("io_written", io_written);
+  f->dump_int("io_data_written", io_data_written);
+  f->dump_int("io_deferred_written", io_deferred_written);
+  f->dump_int("io_kv_written", io_kv_written);
+  f->dump_int("io_read", io_read);
+  f->dump_int("io_data_read", io_data_read);
 }
 
 ostream& operator<<(ostream& out, const store_statfs_t &s)
@@ -3119,8 +3125,16 @@ ostream& operator<<(ostream& out, const store_statfs_t &s)
       << "/0x"  << s.data_compressed_allocated
       << "/0x"  << s.data_compressed_original
       << ", omap 0x" << s.omap_allocated
-      << ", meta 0x" << s.internal_metadata
-      << std::dec
+      << ", meta 0x" << s.internal_metadata;
+  if (s.io_written || s.io_read) {
+    out << ", io w 0x" << s.io_written
+	<< "/0x" << s.io_data_written
+	<< "/0x" << s.io_deferred_written
+	<< "/0x" << s.io_kv_written
+	<< " r 0x" << s.io_read
+	<< "/0x" << s.io_data_read;
+  }
+  out << std::dec
       << ")";
   return out;
 }
@@ -3140,6 +3154,13 @@ void store_statfs_t::generate_test_instances(list<store_statfs_t*>& o)
   a.omap_allocated = 14;
   a.internal_metadata = 15;
   o.push_back(new store_statfs_t(a));
+  a.io_written = 16;
+  a.io_data_written = 17;
+  a.io_deferred_written = 18;
+  a.io_kv_written = 19;
+  a.io_read = 20;
+  a.io_data_read = 21;
+  o.push_back(new store_statfs_t(a));
 }
 
 // -- pool_stat_t --
@@ -2227,6 +2227,16 @@ struct store_statfs_t
   int64_t omap_allocated = 0;         ///< approx usage of omap data
   int64_t internal_metadata = 0;      ///< approx usage of internal metadata
 
+  // I/O done for the data, counted since the store was started; only
+  // reported per pool (see ObjectStore::pool_statfs()).  Being counters
+  // rather than usage, they are left out of operator==.
+  int64_t io_written = 0;          ///< Bytes of data and omap written by the user
+  int64_t io_data_written = 0;     ///< Bytes written to the data device directly
+  int64_t io_deferred_written = 0; ///< Bytes written to the data device via the kv WAL
+  int64_t io_kv_written = 0;       ///< Bytes of kv transactions (not BlueFS/WAL device bytes)
+  int64_t io_read = 0;             ///< Bytes of data read by the user
+  int64_t io_data_read = 0;        ///< Bytes read from the data device
+
   void reset() {
     *this = store_statfs_t();
   }
@@ -2243,6 +2253,13 @@ struct store_statfs_t
 
     FLOOR(omap_allocated);
     FLOOR(internal_metadata);
+
+    FLOOR(io_written);
+    FLOOR(io_data_written);
+    FLOOR(io_deferred_written);
+    FLOOR(io_kv_written);
+    FLOOR(io_read);
+    FLOOR(io_data_read);
 #undef FLOOR
   }
 
@@ -2251,6 +2268,25 @@ struct store_statfs_t
     return *this == store_statfs_t();
   }
 
+  /// true if the io_* counters started over since @p prev, an earlier
+  /// report of the same store
+  bool io_restarted_since(const store_statfs_t& prev) const {
+    return io_written < prev.io_written ||
+      io_data_written < prev.io_data_written ||
+      io_deferred_written < prev.io_deferred_written ||
+      io_kv_written < prev.io_kv_written ||
+      io_read < prev.io_read ||
+      io_data_read < prev.io_data_read;
+  }
+  void clear_io() {
+    io_written = 0;
+    io_data_written = 0;
+    io_deferred_written = 0;
+    io_kv_written = 0;
+    io_read = 0;
+    io_data_read = 0;
+  }
+
   uint64_t get_used() const {
     return total - available - internally_reserved;
   }
@@ -2304,6 +2340,12 @@ struct store_statfs_t
     data_compressed_original += o.data_compressed_original;
     omap_allocated += o.omap_allocated;
     internal_metadata += o.internal_metadata;
+    io_written += o.io_written;
+    io_data_written += o.io_data_written;
+    io_deferred_written += o.io_deferred_written;
+    io_kv_written += o.io_kv_written;
+    io_read += o.io_read;
+    io_data_read += o.io_data_read;
   }
   void sub(const store_statfs_t& o) {
     total -= o.total;
@@ -2316,10 +2358,16 @@ struct store_statfs_t
     data_compressed_original -= o.data_compressed_original;
     omap_allocated -= o.omap_allocated;
     internal_metadata -= o.internal_metadata;
+    io_written -= o.io_written;
+    io_data_written -= o.io_data_written;
+    io_deferred_written -= o.io_deferred_written;
+    io_kv_written -= o.io_kv_written;
+    io_read -= o.io_read;
+    io_data_read -= o.io_data_read;
   }
   void dump(ceph::Formatter *f) const;
   DENC(store_statfs_t, v, p) {
-    DENC_START(1, 1, p);
+    DENC_START(2, 1, p);
     denc(v.total, p);
     denc(v.available, p);
     denc(v.internally_reserved, p);
@@ -2330,6 +2378,14 @@ struct store_statfs_t
     denc(v.data_compressed_original, p);
     denc(v.omap_allocated, p);
     denc(v.internal_metadata, p);
+    if (struct_v >= 2) {
+      denc(v.io_written, p);
+      denc(v.io_data_written, p);
+      denc(v.io_deferred_written, p);
+      denc(v.io_kv_written, p);
+      denc(v.io_read, p);
+      denc(v.io_data_read, p);
+    }
     DENC_FINISH(p);
   }
   static void generate_test_instances(std::list<store_statfs_t*>& o);
@@ -36,6 +36,10 @@ public:
   // to other items already scheduled.
   virtual void enqueue_front(OpSchedulerItem &&item) = 0;
 
+  // Returns true iff enqueue_front puts a just dequeued item back where
+  // dequeue took it from, so peeking by dequeue then requeue is harmless
+  virtual bool requeue_front_preserves_order() const = 0;
+
   // Returns true iff there are no ops scheduled
   virtual bool empty() const = 0;
 
@@ -113,6 +117,10 @@ public:
 	priority, cost, std::move(item));
   }
 
+  bool requeue_front_preserves_order() const final {
+    return true;
+  }
+
   bool empty() const final {
     return queue.empty();
   }
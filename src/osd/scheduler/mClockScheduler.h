@@ -109,6 +109,11 @@ public:
   // Enqueue the op in the front of the regular queue
   void enqueue_front(OpSchedulerItem &&item) final;
 
+  // enqueue_front bypasses the dmclock queue (see above)
+  bool requeue_front_preserves_order() const final {
+    return false;
+  }
+
   // Return an op to be dispatch
   OpSchedulerItem dequeue() final;
 
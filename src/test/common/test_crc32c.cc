@@ -44,6 +44,23 @@ TEST(Crc32c, Big) {
   free(a);
 }
 
+TEST(Crc32c, Blocks) {
+  unsigned max_len = 4096 * 9;
+  unsigned char *a = (unsigned char *)malloc(max_len);
+  for (unsigned i = 0; i < max_len; i++)
+    a[i] = (i * 7) & 0xff;
+  uint32_t out[9];
+  for (unsigned block_len : {1, 7, 8, 13, 512, 4096}) {
+    for (unsigned count = 0; count <= 9; count++) {
+      ceph_crc32c_blocks(-1, a, block_len, count, out);
+      for (unsigned i = 0; i < count; i++) {
+	ASSERT_EQ(ceph_crc32c(-1, a + i * block_len, block_len), out[i]);
+      }
+    }
+  }
+  free(a);
+}
+
 TEST(Crc32c, Performance) {
   int len = 1000 * 1024 * 1024;
   char *a = (char *)malloc(len);
@@ -366,6 +366,41 @@ TEST_F(IsaErasureCodeTest, encode)
   }
 }
 
+TEST_F(IsaErasureCodeTest, parity_delta)
+{
+  ErasureCodeIsaDefault Isa(tcache);
+  ErasureCodeProfile profile;
+  profile["k"] = "2";
+  profile["m"] = "2";
+  Isa.init(profile, &cerr);
+  EXPECT_TRUE(Isa.get_supported_optimizations() &
+	      ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION);
+
+  //
+  // The coding chunks of a ^ b are those of a xor those of b.
+  //
+  unsigned stripe_width = Isa.get_chunk_size(4096) * 2;
+  bufferlist a, b, a_xor_b;
+  for (unsigned i = 0; i < stripe_width; ++i) {
+    char ca = i * 7, cb = (i % 3) ? 0 : i * 13;
+    a.append(ca);
+    b.append(cb);
+    a_xor_b.append(ca ^ cb);
+  }
+  set<int> want_to_encode = { 2, 3 };
+  map<int,bufferlist> ea, eb, eab;
+  EXPECT_EQ(0, Isa.encode(want_to_encode, a, &ea));
+  EXPECT_EQ(0, Isa.encode(want_to_encode, b, &eb));
+  EXPECT_EQ(0, Isa.encode(want_to_encode, a_xor_b, &eab));
+  for (int c : want_to_encode) {
+    const char *pa = ea[c].c_str(), *pb = eb[c].c_str(), *pab = eab[c].c_str();
+    ASSERT_EQ(ea[c].length(), eab[c].length());
+    for (unsigned i = 0; i < eab[c].length(); ++i) {
+      ASSERT_EQ((char)(pa[i] ^ pb[i]), pab[i]);
+    }
+  }
+}
+
 TEST_F(IsaErasureCodeTest, sanity_check_k)
 {
   ErasureCodeIsaDefault Isa(tcache);
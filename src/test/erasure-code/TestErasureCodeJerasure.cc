@@ -227,6 +227,44 @@ TYPED_TEST(ErasureCodeTest, minimum_to_decode)
   }
 }
 
+TYPED_TEST(ErasureCodeTest, parity_delta)
+{
+  TypeParam jerasure;
+  ErasureCodeProfile profile;
+  profile["k"] = "2";
+  profile["m"] = "2";
+  profile["packetsize"] = "8";
+  jerasure.init(profile, &cerr);
+  EXPECT_TRUE(jerasure.get_supported_optimizations() &
+	      ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION);
+
+  //
+  // The coding chunks of a ^ b are those of a xor those of b, so
+  // the coding chunks of an overwrite can be updated by encoding
+  // just the difference.
+  //
+  unsigned stripe_width = jerasure.get_chunk_size(4096) * 2;
+  bufferlist a, b, a_xor_b;
+  for (unsigned i = 0; i < stripe_width; ++i) {
+    char ca = i * 7, cb = (i % 3) ? 0 : i * 13;
+    a.append(ca);
+    b.append(cb);
+    a_xor_b.append(ca ^ cb);
+  }
+  set<int> want_to_encode = { 2, 3 };
+  map<int,bufferlist> ea, eb, eab;
+  EXPECT_EQ(0, jerasure.encode(want_to_encode, a, &ea));
+  EXPECT_EQ(0, jerasure.encode(want_to_encode, b, &eb));
+  EXPECT_EQ(0, jerasure.encode(want_to_encode, a_xor_b, &eab));
+  for (int c : want_to_encode) {
+    const char *pa = ea[c].c_str(), *pb = eb[c].c_str(), *pab = eab[c].c_str();
+    ASSERT_EQ(ea[c].length(), eab[c].length());
+    for (unsigned i = 0; i < eab[c].length(); ++i) {
+      ASSERT_EQ((char)(pa[i] ^ pb[i]), pab[i]);
+    }
+  }
+}
+
 TEST(ErasureCodeTest, encode)
 {
   ErasureCodeJerasureReedSolomonVandermonde jerasure;
@@ -33,6 +33,7 @@
 #include "include/utime.h"
 #include "erasure-code/ErasureCodePlugin.h"
 #include "erasure-code/ErasureCode.h"
+#include "osd/ECUtil.h"
 #include "ceph_erasure_code_benchmark.h"
 
 namespace po = boost::program_options;
@@ -50,7 +51,10 @@ int ErasureCodeBench::setup(int argc, char** argv) {
     ("plugin,p", po::value<string>()->default_value("jerasure"),
      "erasure code plugin name")
     ("workload,w", po::value<string>()->default_value("encode"),
-     "run either encode or decode")
+     "run either encode, decode or overwrite")
+    ("overwrite-size", po::value<int>()->default_value(4096),
+     "bytes overwritten at the start of a --size stripe by the overwrite "
+     "workload")
     ("erasures,e", po::value<int>()->default_value(1),
      "number of erasures when decoding")
     ("erased", po::value<vector<int> >(),
@@ -110,6 +114,7 @@ int ErasureCodeBench::setup(int argc, char** argv) {
   }
 
   in_size = vm["size"].as<int>();
+  overwrite_size = vm["overwrite-size"].as<int>();
   max_iterations = vm["iterations"].as<int>();
   plugin = vm["plugin"].as<string>();
   workload = vm["workload"].as<string>();
@@ -149,6 +154,8 @@ int ErasureCodeBench::run() {
 
   if (workload == "encode")
     return encode();
+  else if (workload == "overwrite")
+    return overwrite();
   else
     return decode();
 }
@@ -185,6 +192,113 @@ int ErasureCodeBench::encode()
   return 0;
 }
 
+/*
+ * Overwrite the first --overwrite-size bytes of a stripe, both by
+ * re-encoding the whole stripe (what an rmw does) and by encoding the
+ * difference and applying it to the old coding chunks (a parity
+ * delta), and compare the time taken and the bytes read and written
+ * per overwrite.
+ */
+int ErasureCodeBench::overwrite()
+{
+  ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
+  ErasureCodeInterfaceRef erasure_code;
+  stringstream messages;
+  int code = instance.factory(plugin,
+			      g_conf().get_val<std::string>("erasure_code_dir"),
+			      profile, &erasure_code, &messages);
+  if (code) {
+    cerr << messages.str() << endl;
+    return code;
+  }
+  if (!(erasure_code->get_supported_optimizations() &
+	ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA_OPTIMIZATION)) {
+    cerr << plugin << " cannot update coding chunks by parity delta" << endl;
+    return -EOPNOTSUPP;
+  }
+
+  unsigned chunk_size = erasure_code->get_chunk_size(in_size);
+  unsigned stripe_width = chunk_size * k;
+  if (overwrite_size <= 0 || (unsigned)overwrite_size > stripe_width) {
+    cerr << "--overwrite-size must be between 1 and the stripe width "
+	 << stripe_width << endl;
+    return -EINVAL;
+  }
+  unsigned data_chunks = (overwrite_size + chunk_size - 1) / chunk_size;
+
+  const vector<int> &chunk_mapping = erasure_code->get_chunk_mapping();
+  auto shard_of = [&](int chunk) {
+    return (int)chunk_mapping.size() > chunk ? chunk_mapping[chunk] : chunk;
+  };
+  set<int> want_to_encode, coding;
+  for (int i = 0; i < k + m; i++) {
+    want_to_encode.insert(i);
+    if (i >= k)
+      coding.insert(shard_of(i));
+  }
+
+  bufferlist old_in, new_in;
+  old_in.append(string(stripe_width, 'X'));
+  old_in.rebuild_aligned(ErasureCode::SIMD_ALIGN);
+  new_in.append(string(overwrite_size, 'Y'));
+  new_in.append(string(stripe_width - overwrite_size, 'X'));
+  new_in.rebuild_aligned(ErasureCode::SIMD_ALIGN);
+  map<int,bufferlist> old_chunks;
+  code = erasure_code->encode(want_to_encode, old_in, &old_chunks);
+  if (code)
+    return code;
+
+  map<int,bufferlist> full;
+  utime_t begin_time = ceph_clock_now();
+  for (int i = 0; i < max_iterations; i++) {
+    full.clear();
+    code = erasure_code->encode(want_to_encode, new_in, &full);
+    if (code)
+      return code;
+  }
+  utime_t full_time = ceph_clock_now() - begin_time;
+
+  // what a parity delta reads and writes
+  ECUtil::stripe_info_t sinfo(k, stripe_width);
+  map<int,bufferlist> delta_old, delta_new;
+  for (unsigned c = 0; c < data_chunks; c++) {
+    int shard = shard_of(c);
+    delta_old[shard] = old_chunks[shard];
+    delta_new[shard].substr_of(new_in, c * chunk_size, chunk_size);
+  }
+  for (auto shard : coding)
+    delta_old[shard] = old_chunks[shard];
+
+  map<int,bufferlist> delta_parity;
+  begin_time = ceph_clock_now();
+  for (int i = 0; i < max_iterations; i++) {
+    delta_parity.clear();
+    code = ECUtil::encode_parity_delta(sinfo, erasure_code,
+				       delta_old, delta_new, &delta_parity);
+    if (code)
+      return code;
+  }
+  utime_t delta_time = ceph_clock_now() - begin_time;
+
+  for (auto shard : coding) {
+    if (!delta_parity[shard].contents_equal(full[shard])) {
+      cerr << "chunk " << shard << " differs from the one encoded in full"
+	   << endl;
+      return -1;
+    }
+  }
+
+  // an rmw reads the stripe and writes every chunk, a parity delta
+  // reads and writes the data chunks overwritten and the coding chunks
+  cout << "rmw\t" << full_time
+       << "\t" << (uint64_t)k * chunk_size
+       << "\t" << (uint64_t)(k + m) * chunk_size << endl;
+  cout << "delta\t" << delta_time
+       << "\t" << (uint64_t)(data_chunks + m) * chunk_size
+       << "\t" << (uint64_t)(data_chunks + m) * chunk_size << endl;
+  return 0;
+}
+
 static void display_chunks(const map<int,bufferlist> &chunks,
 			   unsigned int chunk_count) {
   cout << "chunks ";
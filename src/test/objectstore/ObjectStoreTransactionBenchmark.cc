@@ -16,6 +16,8 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <atomic>
+#include <new>
 #include <string>
 #include <iostream>
 
@@ -27,6 +29,27 @@ using namespace std;
 #include "global/global_init.h"
 #include "os/ObjectStore.h"
 
+// count the heap allocations made while building and encoding
+static std::atomic<uint64_t> allocs = {0};
+
+void *operator new(size_t size)
+{
+  ++allocs;
+  if (void *p = malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
 class Transaction {
  private:
   ObjectStore::Transaction t;
@@ -42,7 +65,11 @@ class Transaction {
     }
   };
   static Tick write_ticks, setattr_ticks, omap_setkeys_ticks, omap_rmkey_ticks;
-  static Tick encode_ticks, decode_ticks, iterate_ticks;
+  static Tick encode_ticks, decode_ticks, iterate_ticks, replicate_ticks;
+
+  void reserve(uint32_t num_ops, uint32_t data_bytes) {
+    t.reserve(num_ops, data_bytes);
+  }
 
   void write(coll_t cid, const ghobject_t& oid, uint64_t off, uint64_t len,
              const bufferlist& data) {
@@ -83,6 +110,23 @@ class Transaction {
     decode_ticks.add(Cycles::rdtsc() - start_time);
   }
 
+  // build the messages of a repop to each replica, either encoding the
+  // transaction for each of them or encoding it once and sharing that
+  void apply_replicate(int replicas, bool encode_once) {
+    vector<bufferlist> msgs(replicas);
+    uint64_t start_time = Cycles::rdtsc();
+    if (encode_once) {
+      bufferlist bl;
+      t.encode(bl);
+      for (auto& m : msgs)
+        m.append(bl);
+    } else {
+      for (auto& m : msgs)
+        t.encode(m);
+    }
+    replicate_ticks.add(Cycles::rdtsc() - start_time);
+  }
+
   void apply_iterate() {
     uint64_t start_time = Cycles::rdtsc();
     ObjectStore::Transaction::iterator i = t.begin();
@@ -134,6 +178,11 @@ class Transaction {
     cerr << " encode op: " << Cycles::to_microseconds(Transaction::encode_ticks.ticks) << "us count: " << Transaction::encode_ticks.count << std::endl;
     cerr << " decode op: " << Cycles::to_microseconds(Transaction::decode_ticks.ticks) << "us count: " << Transaction::decode_ticks.count << std::endl;
     cerr << " iterate op: " << Cycles::to_microseconds(Transaction::iterate_ticks.ticks) << "us count: " << Transaction::iterate_ticks.count << std::endl;
+    cerr << " replicate op: " << Cycles::to_microseconds(Transaction::replicate_ticks.ticks) << "us count: " << Transaction::replicate_ticks.count << std::endl;
+  }
+  static void reset_stat() {
+    write_ticks = setattr_ticks = omap_setkeys_ticks = omap_rmkey_ticks = Tick();
+    encode_ticks = decode_ticks = iterate_ticks = replicate_ticks = Tick();
   }
 };
 
@@ -187,36 +236,50 @@ class PerfCase {
     data[info_info_attr] = generate_random(560, 1);
   }
 
-  uint64_t rados_write_4k(int times) {
+  // with reserve, each transaction is sized up front and encoded once for
+  // all replicas, as ReplicatedBackend does
+  uint64_t rados_write_4k(int times, int replicas, bool reserve,
+                          uint64_t *nallocs) {
     uint64_t ticks = 0;
+    *nallocs = 0;
     uint64_t len = Kib *4;
     for (int i = 0; i < times; i++) {
       uint64_t start_time = 0;
       {
-        Transaction t;
         ghobject_t oid = create_object();
+        uint64_t start_allocs = allocs;
         start_time = Cycles::rdtsc();
+        Transaction t;
+        if (reserve)
+          t.reserve(3, 64);
         t.write(cid, oid, 0, len, data["4k"]);
         t.setattr(cid, oid, attr, data[attr]);
         t.setattr(cid, oid, snapset_attr, data[snapset_attr]);
+        t.apply_replicate(replicas, reserve);
+        ticks += Cycles::rdtsc() - start_time;
+        *nallocs += allocs - start_allocs;
         t.apply_encode_decode();
         t.apply_iterate();
-        ticks += Cycles::rdtsc() - start_time;
       }
       {
-        Transaction t;
         map<string, bufferlist> pglog_attrset;
         map<string, bufferlist> info_attrset;
         pglog_attrset[pglog_attr] = data[pglog_attr];
         info_attrset[info_epoch_attr] = data[info_epoch_attr];
         info_attrset[info_info_attr] = data[info_info_attr];
+        uint64_t start_allocs = allocs;
         start_time = Cycles::rdtsc();
+        Transaction t;
+        if (reserve)
+          t.reserve(3, 128);
         t.omap_setkeys(meta_cid, pglog_oid, pglog_attrset);
         t.omap_setkeys(meta_cid, info_oid, info_attrset);
         t.omap_rmkey(meta_cid, pglog_oid, pglog_attr);
+        t.apply_replicate(replicas, reserve);
+        ticks += Cycles::rdtsc() - start_time;
+        *nallocs += allocs - start_allocs;
         t.apply_encode_decode();
         t.apply_iterate();
-        ticks += Cycles::rdtsc() - start_time;
       }
     }
     return ticks;
@@ -233,9 +296,10 @@ const ghobject_t PerfCase::pglog_oid(hobject_t(sobject_t(object_t("cid_pglog"),
 const ghobject_t PerfCase::info_oid(hobject_t(sobject_t(object_t("infos"), 0)));
 Transaction::Tick Transaction::write_ticks, Transaction::setattr_ticks, Transaction::omap_setkeys_ticks, Transaction::omap_rmkey_ticks;
 Transaction::Tick Transaction::encode_ticks, Transaction::decode_ticks, Transaction::iterate_ticks;
+Transaction::Tick Transaction::replicate_ticks;
 
 void usage(const string &name) {
-  cerr << "Usage: " << name << " [times] "
+  cerr << "Usage: " << name << " [times] [replicas]"
        << std::endl;
 }
 
@@ -258,10 +322,23 @@ int main(int argc, char **argv)
   }
 
   uint64_t times = atoi(args[0]);
+  int replicas = args.size() > 1 ? atoi(args[1]) : 2;
+  if (!times || replicas <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
   PerfCase c;
-  uint64_t ticks = c.rados_write_4k(times);
-  Transaction::dump_stat();
-  cerr << " Total rados op " << times << " run time " << Cycles::to_microseconds(ticks) << "us." << std::endl;
+  for (bool reserve : {false, true}) {
+    uint64_t nallocs;
+    Transaction::reset_stat();
+    uint64_t ticks = c.rados_write_4k(times, replicas, reserve, &nallocs);
+    cerr << (reserve ? "reserved, encoded once:" : "unreserved, encoded per replica:")
+         << std::endl;
+    Transaction::dump_stat();
+    cerr << " Total rados op " << times << " run time " << Cycles::to_microseconds(ticks) << "us, "
+         << Cycles::to_nanoseconds(ticks) / times << "ns/op, "
+         << (double)nallocs / times << " allocs/op." << std::endl;
+  }
 
   return 0;
 }
@@ -0,0 +1,324 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Age BlueStore allocators and report, round by round, how allocation
+ * latency and fragmentation evolve.  Each round frees random extents down
+ * to the low watermark and allocates up to the high watermark again (the
+ * pattern of Allocator_aging_fragmentation.cc), or replays a recorded
+ * trace instead:
+ *
+ *   ceph_test_alloc_aging_bench --capacity 64G --alloc-unit 4K \
+ *     --min-size 4K --max-size 256K --high 0.9 --low 0.7 --rounds 20 \
+ *     --allocators stupid,bitmap,avl,hybrid
+ *
+ *   ceph_test_alloc_aging_bench --trace ops.txt --capacity 64G
+ *
+ * A trace has one operation per line, "A <id> <length>" to allocate or
+ * "F <id>" to free what was allocated under <id>; the trace is replayed
+ * --rounds times with a report after each pass.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include "common/ceph_argparse.h"
+#include "common/debug.h"
+#include "common/strtol.h"
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "include/str_list.h"
+#include "include/stringify.h"
+#include "os/bluestore/Allocator.h"
+
+using namespace std;
+
+struct AgingConfig {
+  uint64_t capacity = 64ull << 30;
+  uint64_t alloc_unit = 4096;
+  uint64_t min_size = 4096;
+  uint64_t max_size = 256 << 10;
+  double high = 0.9;
+  double low = 0.7;
+  unsigned rounds = 20;
+  unsigned seed = 1;
+};
+
+struct TraceOp {
+  bool alloc;
+  uint64_t id;
+  uint64_t length;
+};
+
+class AgingRun {
+  const AgingConfig& cfg;
+  std::unique_ptr<Allocator> alloc;
+  std::mt19937_64 rng;
+  vector<PExtentVector> live;         ///< synthetic mode
+  map<uint64_t, PExtentVector> by_id; ///< trace mode
+  uint64_t level = 0;
+
+  // per round
+  vector<uint64_t> lat_ns;
+  uint64_t allocs = 0, fragmented = 0, fragments = 0, failed = 0;
+
+  bool do_alloc(uint64_t want, PExtentVector *out) {
+    auto start = mono_clock::now();
+    int64_t r = alloc->allocate(want, cfg.alloc_unit, 0, 0, out);
+    lat_ns.push_back(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+	mono_clock::now() - start).count());
+    if (r < (int64_t)want) {
+      ++failed;
+      release(*out);
+      out->clear();
+      return false;
+    }
+    level += r;
+    ++allocs;
+    if (out->size() > 1) {
+      ++fragmented;
+      fragments += out->size();
+    }
+    return true;
+  }
+  void release(const PExtentVector& extents) {
+    if (extents.empty()) {
+      return;
+    }
+    interval_set<uint64_t> release_set;
+    for (auto& e : extents) {
+      release_set.insert(e.offset, e.length);
+    }
+    alloc->release(release_set);
+  }
+  void free_random() {
+    size_t pos = rng() % live.size();
+    for (auto& e : live[pos]) {
+      level -= e.length;
+    }
+    release(live[pos]);
+    live[pos].swap(live.back());
+    live.pop_back();
+  }
+
+public:
+  AgingRun(const AgingConfig& cfg, const string& type)
+    : cfg(cfg),
+      alloc(Allocator::create(g_ceph_context, type, cfg.capacity,
+			      cfg.alloc_unit)),
+      rng(cfg.seed) {
+    ceph_assert(alloc);
+    alloc->init_add_free(0, cfg.capacity);
+  }
+  ~AgingRun() {
+    alloc->shutdown();
+  }
+
+  void round_synthetic(bool initial) {
+    std::uniform_int_distribution<uint64_t> size_dist(
+      cfg.min_size / cfg.alloc_unit, cfg.max_size / cfg.alloc_unit);
+    if (!initial) {
+      while (level > cfg.capacity * cfg.low && !live.empty()) {
+	free_random();
+      }
+    }
+    while (level < cfg.capacity * cfg.high) {
+      PExtentVector extents;
+      if (!do_alloc(size_dist(rng) * cfg.alloc_unit, &extents)) {
+	break;
+      }
+      live.emplace_back(std::move(extents));
+    }
+  }
+
+  void round_trace(const vector<TraceOp>& trace) {
+    for (auto& op : trace) {
+      auto p = by_id.find(op.id);
+      if (p != by_id.end()) {
+	// a previous pass (or a sloppy trace) left this one allocated
+	for (auto& e : p->second) {
+	  level -= e.length;
+	}
+	release(p->second);
+	by_id.erase(p);
+      }
+      if (op.alloc) {
+	PExtentVector extents;
+	if (do_alloc(p2roundup(op.length, cfg.alloc_unit), &extents)) {
+	  by_id[op.id].swap(extents);
+	}
+      }
+    }
+  }
+
+  void report(unsigned round) {
+    std::sort(lat_ns.begin(), lat_ns.end());
+    auto pct = [&](double p) {
+      return lat_ns.empty() ? 0 :
+	lat_ns[std::min<size_t>(lat_ns.size() - 1, lat_ns.size() * p)] / 1000.0;
+    };
+    uint64_t sum = 0;
+    for (auto l : lat_ns) {
+      sum += l;
+    }
+    cout << "  round " << round
+	 << " used " << (100.0 * level / cfg.capacity) << "%"
+	 << " allocs " << allocs
+	 << " failed " << failed
+	 << " fragmented " << (allocs ? 100.0 * fragmented / allocs : 0) << "%"
+	 << " (avg " << (fragmented ? double(fragments) / fragmented : 0)
+	 << " extents)"
+	 << " lat usec avg " << (lat_ns.empty() ? 0 : sum / lat_ns.size() / 1000.0)
+	 << " p99 " << pct(0.99)
+	 << " max " << (lat_ns.empty() ? 0 : lat_ns.back() / 1000.0)
+	 << " frag " << alloc->get_fragmentation()
+	 << " frag_score " << alloc->get_fragmentation_score()
+	 << std::endl;
+    lat_ns.clear();
+    allocs = fragmented = fragments = failed = 0;
+  }
+};
+
+static int load_trace(const string& path, vector<TraceOp> *trace)
+{
+  ifstream in(path);
+  if (!in) {
+    cerr << "unable to open " << path << std::endl;
+    return -ENOENT;
+  }
+  string line;
+  unsigned lineno = 0;
+  while (getline(in, line)) {
+    ++lineno;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    istringstream ss(line);
+    string op;
+    TraceOp t{false, 0, 0};
+    ss >> op >> t.id;
+    if (op == "A") {
+      t.alloc = true;
+      ss >> t.length;
+    }
+    if (!ss || (op != "A" && op != "F") || (t.alloc && !t.length)) {
+      cerr << path << ":" << lineno << ": bad line '" << line << "'"
+	   << std::endl;
+      return -EINVAL;
+    }
+    trace->push_back(t);
+  }
+  return 0;
+}
+
+static void usage(const char *name)
+{
+  cout << "usage: " << name << " [options]\n"
+       << "  --capacity <size>     device size (default 64G)\n"
+       << "  --alloc-unit <size>   allocation unit (default 4K)\n"
+       << "  --min-size <size>     smallest allocation (default 4K)\n"
+       << "  --max-size <size>     largest allocation (default 256K)\n"
+       << "  --high <f>            fill up to this ratio (default 0.9)\n"
+       << "  --low <f>             free down to this ratio (default 0.7)\n"
+       << "  --rounds <n>          free/fill rounds or trace passes (default 20)\n"
+       << "  --trace <file>        replay a trace instead of random aging\n"
+       << "  --allocators <list>   (default stupid,bitmap,avl,hybrid)\n"
+       << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  AgingConfig cfg;
+  string capacity = "64G", alloc_unit = "4K", min_size = "4K";
+  string max_size = "256K", high = "0.9", low = "0.7";
+  string trace_path, allocators = "stupid,bitmap,avl,hybrid";
+  int rounds = cfg.rounds;
+  std::ostringstream err;
+  for (auto i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return 0;
+    } else if (ceph_argparse_witharg(args, i, &capacity, "--capacity", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &alloc_unit, "--alloc-unit", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &min_size, "--min-size", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &max_size, "--max-size", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &high, "--high", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &low, "--low", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &trace_path, "--trace", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &allocators, "--allocators", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &rounds, err, "--rounds", (char*)NULL)) {
+    } else {
+      cerr << "unrecognized argument " << *i << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+    if (!err.str().empty()) {
+      cerr << err.str() << std::endl;
+      return 1;
+    }
+  }
+  string perr;
+  cfg.capacity = strict_iecstrtoll(capacity.c_str(), &perr);
+  if (perr.empty())
+    cfg.alloc_unit = strict_iecstrtoll(alloc_unit.c_str(), &perr);
+  if (perr.empty())
+    cfg.min_size = strict_iecstrtoll(min_size.c_str(), &perr);
+  if (perr.empty())
+    cfg.max_size = strict_iecstrtoll(max_size.c_str(), &perr);
+  if (perr.empty())
+    cfg.high = strict_strtod(high.c_str(), &perr);
+  if (perr.empty())
+    cfg.low = strict_strtod(low.c_str(), &perr);
+  if (!perr.empty() || rounds <= 0 || !isp2(cfg.alloc_unit) ||
+      cfg.capacity < cfg.alloc_unit ||
+      cfg.min_size < cfg.alloc_unit || cfg.max_size < cfg.min_size ||
+      cfg.low < 0 || cfg.high > 1 || cfg.low >= cfg.high) {
+    if (!perr.empty())
+      cerr << perr << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+  cfg.capacity = p2align(cfg.capacity, cfg.alloc_unit);
+  cfg.rounds = rounds;
+
+  vector<TraceOp> trace;
+  if (!trace_path.empty() && load_trace(trace_path, &trace) < 0) {
+    return 1;
+  }
+  g_ceph_context->_conf.set_val_or_die("bdev_block_size",
+				       stringify(cfg.alloc_unit));
+
+  list<string> allocator_list;
+  get_str_list(allocators, allocator_list);
+  for (auto& type : allocator_list) {
+    if (type != "stupid" && type != "bitmap" && type != "avl" &&
+	type != "hybrid") {
+      cerr << "unknown allocator " << type << std::endl;
+      return 1;
+    }
+    cout << type << ":" << std::endl;
+    AgingRun run(cfg, type);
+    for (unsigned round = 0; round < cfg.rounds; ++round) {
+      if (trace.empty()) {
+	run.round_synthetic(round == 0);
+      } else {
+	run.round_trace(trace);
+      }
+      run.report(round);
+    }
+  }
+  return 0;
+}
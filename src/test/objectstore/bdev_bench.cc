@@ -0,0 +1,233 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Compare the libaio and io_uring engines of KernelDevice, fio style:
+ * numjobs threads each keep one aligned random read or write in flight
+ * against the device for a fixed runtime, then IOPS and latency
+ * percentiles are reported per engine.
+ *
+ *   ceph_test_bdev_bench --path /dev/nvme0n1p3 --rw randread --bs 4096 \
+ *     --numjobs 16 --runtime 30 --engines libaio,io_uring --sqpoll \
+ *     --fixed-buffers 256
+ *
+ * Writes are destructive; point it at a scratch device or file.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "common/ceph_argparse.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "common/strtol.h"
+#include "global/global_init.h"
+#include "include/str_list.h"
+#include "include/stringify.h"
+#include "os/bluestore/BlockDevice.h"
+
+using namespace std;
+
+struct JobResult {
+  vector<uint64_t> lat_ns;
+  uint64_t bytes = 0;
+};
+
+static void run_job(BlockDevice *bdev, bool write, uint64_t bs,
+		    uint64_t span, unsigned seed,
+		    std::atomic<bool> *stop, JobResult *res)
+{
+  std::mt19937_64 rng(seed);
+  uint64_t blocks = span / bs;
+  bufferlist payload;
+  payload.append(buffer::create_small_page_aligned(bs));
+  memset(payload.c_str(), seed & 0xff, bs);
+
+  while (!*stop) {
+    uint64_t off = (rng() % blocks) * bs;
+    IOContext ioc(g_ceph_context, nullptr);
+    bufferlist bl;
+    auto start = mono_clock::now();
+    int r;
+    if (write) {
+      bl = payload;
+      r = bdev->aio_write(off, bl, &ioc, false);
+    } else {
+      r = bdev->aio_read(off, bs, &bl, &ioc);
+    }
+    ceph_assert(r == 0);
+    if (ioc.has_pending_aios()) {
+      bdev->aio_submit(&ioc);
+      ioc.aio_wait();
+    }
+    ceph_assert(ioc.get_return_value() == 0);
+    res->lat_ns.push_back(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+	mono_clock::now() - start).count());
+    res->bytes += bs;
+  }
+}
+
+static int run_engine(const string& engine, const string& path, bool write,
+		      uint64_t bs, uint64_t size, unsigned numjobs,
+		      unsigned runtime)
+{
+  g_ceph_context->_conf.set_val_or_die("bluestore_ioring",
+				       engine == "io_uring" ? "true" : "false");
+  g_ceph_context->_conf.apply_changes(nullptr);
+
+  std::unique_ptr<BlockDevice> bdev(
+    BlockDevice::create(g_ceph_context, path, nullptr, nullptr,
+			nullptr, nullptr));
+  int r = bdev->open(path);
+  if (r < 0) {
+    cerr << "failed to open " << path << ": " << cpp_strerror(r) << std::endl;
+    return r;
+  }
+  uint64_t span = size ? std::min(size, bdev->get_size()) : bdev->get_size();
+  span = p2align(span, bs);
+  if (span < bs) {
+    cerr << path << " is too small" << std::endl;
+    bdev->close();
+    return -EINVAL;
+  }
+
+  std::atomic<bool> stop = {false};
+  vector<JobResult> results(numjobs);
+  vector<std::thread> jobs;
+  auto start = mono_clock::now();
+  for (unsigned i = 0; i < numjobs; ++i) {
+    jobs.emplace_back(run_job, bdev.get(), write, bs, span, i + 1,
+		      &stop, &results[i]);
+  }
+  std::this_thread::sleep_for(std::chrono::seconds(runtime));
+  stop = true;
+  for (auto& t : jobs) {
+    t.join();
+  }
+  double elapsed = std::chrono::duration<double>(
+    mono_clock::now() - start).count();
+  bdev->close();
+
+  vector<uint64_t> lat;
+  uint64_t bytes = 0;
+  for (auto& res : results) {
+    lat.insert(lat.end(), res.lat_ns.begin(), res.lat_ns.end());
+    bytes += res.bytes;
+  }
+  if (lat.empty()) {
+    cerr << engine << ": no io completed" << std::endl;
+    return -EIO;
+  }
+  std::sort(lat.begin(), lat.end());
+  auto pct = [&](double p) {
+    return lat[std::min<size_t>(lat.size() - 1, lat.size() * p)] / 1000.0;
+  };
+  uint64_t sum = 0;
+  for (auto l : lat) {
+    sum += l;
+  }
+  cout << engine << ": " << (write ? "write" : "read")
+       << " bs=" << bs << " numjobs=" << numjobs << std::endl
+       << "  iops=" << (uint64_t)(lat.size() / elapsed)
+       << " bw=" << byte_u_t(bytes / elapsed) << "/s" << std::endl
+       << "  lat (usec): avg=" << (sum / lat.size()) / 1000.0
+       << " p50=" << pct(0.5)
+       << " p99=" << pct(0.99)
+       << " p99.9=" << pct(0.999)
+       << " max=" << lat.back() / 1000.0 << std::endl;
+  return 0;
+}
+
+static void usage(const char *name)
+{
+  cout << "usage: " << name << " --path <dev> [options]\n"
+       << "  --rw randread|randwrite   io pattern (default randread)\n"
+       << "  --bs <size>               io size (default 4K)\n"
+       << "  --size <size>             span of the device to use (default all)\n"
+       << "  --numjobs <n>             ios in flight (default 16)\n"
+       << "  --runtime <sec>           per engine (default 10)\n"
+       << "  --engines <list>          libaio,io_uring (default both)\n"
+       << "  --sqpoll                  io_uring: kernel submission thread\n"
+       << "  --hipri                   io_uring: polled completions\n"
+       << "  --fixed-buffers <n>       io_uring: registered read buffers\n"
+       << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  string path, rw = "randread", engines = "libaio,io_uring";
+  string bs_str = "4K", size_str = "0";
+  int numjobs = 16, runtime = 10, fixed_buffers = 0;
+  bool sqpoll = false, hipri = false;
+  std::ostringstream err;
+  for (auto i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return 0;
+    } else if (ceph_argparse_witharg(args, i, &path, "--path", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &rw, "--rw", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &bs_str, "--bs", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &size_str, "--size", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &engines, "--engines", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &numjobs, err, "--numjobs", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &runtime, err, "--runtime", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &fixed_buffers, err, "--fixed-buffers", (char*)NULL)) {
+    } else if (ceph_argparse_flag(args, i, "--sqpoll", (char*)NULL)) {
+      sqpoll = true;
+    } else if (ceph_argparse_flag(args, i, "--hipri", (char*)NULL)) {
+      hipri = true;
+    } else {
+      cerr << "unrecognized argument " << *i << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+    if (!err.str().empty()) {
+      cerr << err.str() << std::endl;
+      return 1;
+    }
+  }
+  string perr;
+  uint64_t bs = strict_iecstrtoll(bs_str.c_str(), &perr);
+  uint64_t size = perr.empty() ? strict_iecstrtoll(size_str.c_str(), &perr) : 0;
+  if (path.empty() || !perr.empty() || bs == 0 || numjobs <= 0 ||
+      (rw != "randread" && rw != "randwrite")) {
+    if (!perr.empty())
+      cerr << perr << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+
+  auto& conf = g_ceph_context->_conf;
+  conf.set_val_or_die("bdev_ioring_sqthread_poll", sqpoll ? "true" : "false");
+  conf.set_val_or_die("bdev_ioring_hipri", hipri ? "true" : "false");
+  conf.set_val_or_die("bdev_ioring_fixed_buffers", stringify(fixed_buffers));
+  conf.set_val_or_die("bdev_ioring_fixed_buffer_size", stringify(bs));
+
+  list<string> engine_list;
+  get_str_list(engines, engine_list);
+  for (auto& engine : engine_list) {
+    if (engine != "libaio" && engine != "io_uring") {
+      cerr << "unknown engine " << engine << std::endl;
+      return 1;
+    }
+    int r = run_engine(engine, path, rw == "randwrite", bs, size, numjobs,
+		       runtime);
+    if (r < 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
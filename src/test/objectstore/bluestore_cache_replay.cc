@@ -0,0 +1,266 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Replay a synthetic mix of zipfian point reads and periodic full
+ * object scans (deep-scrub, backfill) against the BlueStore onode and
+ * buffer cache shards, and report the hit rate of the zipfian traffic
+ * for each cache type.  No device is involved; only the cache policies
+ * are exercised.
+ *
+ *   ceph_test_bluestore_cache_replay --objects 100000 --ops 2000000 \
+ *     --onode-cache 10000 --buffer-cache 64M --scan-interval 100000 \
+ *     --scan-length 20000 --types lru,2q,tinylfu
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+#include "common/ceph_argparse.h"
+#include "common/strtol.h"
+#include "global/global_init.h"
+#include "include/str_list.h"
+#include "include/stringify.h"
+#include "os/bluestore/BlueStore.h"
+
+using namespace std;
+
+struct ReplayConfig {
+  uint64_t objects = 100000;
+  uint64_t blocks = 16;         ///< blocks per object
+  uint64_t block_size = 4096;
+  uint64_t ops = 2000000;
+  uint64_t onode_cache = 10000; ///< onodes
+  uint64_t buffer_cache = 64 << 20;
+  uint64_t scan_interval = 100000;
+  uint64_t scan_length = 20000; ///< objects per scan
+  double theta = 0.99;
+  unsigned seed = 1;
+};
+
+class Zipf {
+  vector<double> cdf;
+public:
+  Zipf(uint64_t n, double theta) : cdf(n) {
+    double sum = 0;
+    for (uint64_t i = 0; i < n; ++i) {
+      sum += 1.0 / pow(i + 1, theta);
+      cdf[i] = sum;
+    }
+    for (auto& c : cdf) {
+      c /= sum;
+    }
+  }
+  template <typename RNG>
+  uint64_t operator()(RNG& rng) {
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    return std::min<uint64_t>(
+      std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin(),
+      cdf.size() - 1);
+  }
+};
+
+struct Stats {
+  uint64_t onode_lookups = 0, onode_hits = 0;
+  uint64_t buffer_reads = 0, buffer_hits = 0;
+  uint64_t post_scan_reads = 0, post_scan_hits = 0;
+};
+
+static void replay(const string& type, const ReplayConfig& cfg)
+{
+  PerfCountersBuilder plb(g_ceph_context, "bluestore_cache_replay",
+			  l_bluestore_first, l_bluestore_last);
+  plb.add_u64_counter(l_bluestore_onode_hits, "onode_hits");
+  plb.add_u64_counter(l_bluestore_onode_misses, "onode_misses");
+  plb.add_u64_counter(l_bluestore_onode_ghost_hits, "onode_ghost_hits");
+  plb.add_u64_counter(l_bluestore_buffer_hit_bytes, "buffer_hit_bytes");
+  plb.add_u64_counter(l_bluestore_buffer_miss_bytes, "buffer_miss_bytes");
+  plb.add_u64_counter(l_bluestore_buffer_ghost_hits, "buffer_ghost_hits");
+  std::unique_ptr<PerfCounters> logger(plb.create_perf_counters());
+
+  BlueStore store(g_ceph_context, "", 4096);
+  BlueStore::OnodeCacheShard *oc =
+    BlueStore::OnodeCacheShard::create(g_ceph_context, type, logger.get());
+  BlueStore::BufferCacheShard *bc =
+    BlueStore::BufferCacheShard::create(g_ceph_context, type, logger.get());
+  oc->set_max(cfg.onode_cache);
+  bc->set_max(cfg.buffer_cache);
+  auto coll = ceph::make_ref<BlueStore::Collection>(&store, oc, bc, coll_t());
+
+  vector<BlueStore::SharedBlobRef> blobs(cfg.objects);
+  for (auto& sb : blobs) {
+    sb = new BlueStore::SharedBlob(coll.get());
+  }
+  bufferlist block;
+  block.append(buffer::create_small_page_aligned(cfg.block_size));
+  block.zero();
+
+  auto onode = [&](uint64_t obj) {
+    ghobject_t oid(hobject_t(sobject_t("obj" + stringify(obj), CEPH_NOSNAP)));
+    if (coll->onode_map.lookup(oid)) {
+      return true;
+    }
+    coll->onode_map.add(oid, BlueStore::OnodeRef(
+      new BlueStore::Onode(coll.get(), oid, "")));
+    return false;
+  };
+  auto read = [&](uint64_t obj, uint64_t blk) {
+    BlueStore::ready_regions_t res;
+    interval_set<uint32_t> res_intervals;
+    uint32_t off = blk * cfg.block_size;
+    auto& space = blobs[obj]->bc;
+    space.read(bc, off, cfg.block_size, res, res_intervals);
+    if (res_intervals.size() == cfg.block_size) {
+      return true;
+    }
+    bufferlist bl = block;
+    space.did_read(bc, off, bl);
+    return false;
+  };
+
+  // spread popular keys over the key space
+  std::mt19937_64 rng(cfg.seed);
+  vector<uint32_t> obj_perm(cfg.objects);
+  for (uint64_t i = 0; i < cfg.objects; ++i) {
+    obj_perm[i] = i;
+  }
+  std::shuffle(obj_perm.begin(), obj_perm.end(), rng);
+  Zipf obj_zipf(cfg.objects, cfg.theta);
+  Zipf blk_zipf(cfg.blocks, cfg.theta);
+
+  Stats st;
+  uint64_t scan_pos = 0;
+  uint64_t since_scan = ~0ull;
+  auto start = mono_clock::now();
+  for (uint64_t op = 0; op < cfg.ops; ++op) {
+    if (cfg.scan_interval && op && op % cfg.scan_interval == 0) {
+      for (uint64_t i = 0; i < cfg.scan_length; ++i) {
+	uint64_t obj = (scan_pos + i) % cfg.objects;
+	onode(obj);
+	for (uint64_t blk = 0; blk < cfg.blocks; ++blk) {
+	  read(obj, blk);
+	}
+      }
+      scan_pos += cfg.scan_length;
+      since_scan = 0;
+    }
+    uint64_t obj = obj_perm[obj_zipf(rng)];
+    st.onode_lookups++;
+    st.onode_hits += onode(obj);
+    bool hit = read(obj, blk_zipf(rng));
+    st.buffer_reads++;
+    st.buffer_hits += hit;
+    // the window right after a scan is where an LRU hurts
+    if (since_scan++ < cfg.scan_interval / 10) {
+      st.post_scan_reads++;
+      st.post_scan_hits += hit;
+    }
+  }
+  double elapsed = std::chrono::duration<double>(
+    mono_clock::now() - start).count();
+
+  auto pct = [](uint64_t a, uint64_t b) {
+    return b ? 100.0 * a / b : 0.0;
+  };
+  cout << type << ":" << std::endl
+       << "  onode hit rate " << pct(st.onode_hits, st.onode_lookups) << "%"
+       << " ghost hits " << logger->get(l_bluestore_onode_ghost_hits)
+       << std::endl
+       << "  buffer hit rate " << pct(st.buffer_hits, st.buffer_reads) << "%"
+       << " (" << pct(st.post_scan_hits, st.post_scan_reads)
+       << "% right after scans)"
+       << " ghost hits " << logger->get(l_bluestore_buffer_ghost_hits)
+       << std::endl
+       << "  " << (uint64_t)(cfg.ops / elapsed) << " ops/s" << std::endl;
+
+  blobs.clear();
+  coll->onode_map.clear();
+}
+
+static void usage(const char *name)
+{
+  cout << "usage: " << name << " [options]\n"
+       << "  --objects <n>          objects in the key space (default 100000)\n"
+       << "  --blocks <n>           blocks per object (default 16)\n"
+       << "  --ops <n>              zipfian point reads (default 2000000)\n"
+       << "  --theta <f>            zipf skew (default 0.99)\n"
+       << "  --onode-cache <n>      onode cache entries (default 10000)\n"
+       << "  --buffer-cache <size>  buffer cache bytes (default 64M)\n"
+       << "  --scan-interval <n>    ops between scans, 0 for none (default 100000)\n"
+       << "  --scan-length <n>      objects read per scan (default 20000)\n"
+       << "  --types <list>         cache types (default lru,2q,tinylfu)\n"
+       << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  ReplayConfig cfg;
+  string types = "lru,2q,tinylfu";
+  string buffer_cache = "64M", theta = "0.99";
+  int objects = cfg.objects, blocks = cfg.blocks, ops = cfg.ops;
+  int onode_cache = cfg.onode_cache, scan_interval = cfg.scan_interval;
+  int scan_length = cfg.scan_length;
+  std::ostringstream err;
+  for (auto i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return 0;
+    } else if (ceph_argparse_witharg(args, i, &types, "--types", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &buffer_cache, "--buffer-cache", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &theta, "--theta", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &objects, err, "--objects", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &blocks, err, "--blocks", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &ops, err, "--ops", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &onode_cache, err, "--onode-cache", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &scan_interval, err, "--scan-interval", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &scan_length, err, "--scan-length", (char*)NULL)) {
+    } else {
+      cerr << "unrecognized argument " << *i << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+    if (!err.str().empty()) {
+      cerr << err.str() << std::endl;
+      return 1;
+    }
+  }
+  string perr;
+  cfg.buffer_cache = strict_iecstrtoll(buffer_cache.c_str(), &perr);
+  if (perr.empty()) {
+    cfg.theta = strict_strtod(theta.c_str(), &perr);
+  }
+  if (!perr.empty() || objects <= 0 || blocks <= 0 || ops < 0 ||
+      onode_cache <= 0 || scan_interval < 0 || scan_length < 0) {
+    if (!perr.empty())
+      cerr << perr << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+  cfg.objects = objects;
+  cfg.blocks = blocks;
+  cfg.ops = ops;
+  cfg.onode_cache = onode_cache;
+  cfg.scan_interval = scan_interval;
+  cfg.scan_length = scan_length;
+
+  list<string> type_list;
+  get_str_list(types, type_list);
+  for (auto& type : type_list) {
+    if (type != "lru" && type != "2q" && type != "tinylfu") {
+      cerr << "unknown cache type " << type << std::endl;
+      return 1;
+    }
+    replay(type, cfg);
+  }
+  return 0;
+}
@@ -0,0 +1,191 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Compare the throughput of checksumming a buffer one csum block at a
+ * time (an Alg::calc() per block, as Checksummer used to) with the
+ * batched Checksummer::calculate(), for each csum type and block size:
+ *
+ *   ceph_test_checksummer_bench --size 4M --block-sizes 4K,64K \
+ *     --types crc32c,xxhash64 --iterations 256
+ *
+ * --fragment splits the buffer into pieces of that size first, to see
+ * what the straddling blocks of a fragmented read cost.
+ */
+
+#include <iostream>
+
+#include "include/types.h"
+#include "common/Checksummer.h"
+#include "common/ceph_argparse.h"
+#include "common/strtol.h"
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "include/str_list.h"
+
+using namespace std;
+
+struct BenchConfig {
+  uint64_t size = 4 << 20;
+  uint64_t fragment = 0;      ///< 0 for one buffer
+  unsigned iterations = 256;
+};
+
+template<class Alg>
+static void calc_per_block(size_t csum_block_size, const bufferlist& bl,
+			   bufferptr *csum_data)
+{
+  typename Alg::state_t state;
+  Alg::init(&state);
+  auto pv = reinterpret_cast<typename Alg::value_t*>(csum_data->c_str());
+  auto p = bl.begin();
+  for (size_t blocks = bl.length() / csum_block_size; blocks; --blocks) {
+    *pv++ = Alg::calc(state, -1, csum_block_size, p);
+  }
+  Alg::fini(&state);
+}
+
+template<class Alg>
+static void run(const string& type, const BenchConfig& cfg,
+		uint64_t block_size, const bufferlist& bl)
+{
+  size_t values = bl.length() / block_size;
+  bufferptr single(values * sizeof(typename Alg::value_t));
+  bufferptr batched(values * sizeof(typename Alg::value_t));
+
+  auto gbps = [&](auto&& fn) {
+    auto start = mono_clock::now();
+    for (unsigned i = 0; i < cfg.iterations; ++i) {
+      fn();
+    }
+    double elapsed = std::chrono::duration<double>(
+      mono_clock::now() - start).count();
+    return (double)bl.length() * cfg.iterations / elapsed / 1e9;
+  };
+  double single_rate = gbps([&] {
+      calc_per_block<Alg>(block_size, bl, &single);
+    });
+  double batched_rate = gbps([&] {
+      Checksummer::calculate<Alg>(block_size, 0, bl.length(), bl, &batched);
+    });
+  bool match = memcmp(single.c_str(), batched.c_str(), single.length()) == 0;
+
+  cout << type << " block " << block_size
+       << ": per block " << single_rate << " GB/s"
+       << ", batched " << batched_rate << " GB/s"
+       << " (x" << (single_rate ? batched_rate / single_rate : 0) << ")"
+       << (match ? "" : " MISMATCH") << std::endl;
+}
+
+static void usage(const char *name)
+{
+  cout << "usage: " << name << " [options]\n"
+       << "  --size <size>          bytes checksummed per iteration (default 4M)\n"
+       << "  --block-sizes <list>   csum block sizes (default 4K,64K)\n"
+       << "  --fragment <size>      split the buffer into pieces of this size\n"
+       << "  --iterations <n>       (default 256)\n"
+       << "  --types <list>         (default crc32c,crc32c_16,crc32c_8,xxhash32,xxhash64)\n"
+       << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  BenchConfig cfg;
+  string size = "4M", fragment = "0", block_sizes = "4K,64K";
+  string types = "crc32c,crc32c_16,crc32c_8,xxhash32,xxhash64";
+  int iterations = cfg.iterations;
+  std::ostringstream err;
+  for (auto i = args.begin(); i != args.end(); ) {
+    if (ceph_argparse_double_dash(args, i)) {
+      break;
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage(argv[0]);
+      return 0;
+    } else if (ceph_argparse_witharg(args, i, &size, "--size", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &block_sizes, "--block-sizes", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &fragment, "--fragment", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &types, "--types", (char*)NULL)) {
+    } else if (ceph_argparse_witharg(args, i, &iterations, err, "--iterations", (char*)NULL)) {
+    } else {
+      cerr << "unrecognized argument " << *i << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+    if (!err.str().empty()) {
+      cerr << err.str() << std::endl;
+      return 1;
+    }
+  }
+  string perr;
+  cfg.size = strict_iecstrtoll(size.c_str(), &perr);
+  if (perr.empty())
+    cfg.fragment = strict_iecstrtoll(fragment.c_str(), &perr);
+  vector<uint64_t> block_size_list;
+  list<string> bs_list;
+  get_str_list(block_sizes, bs_list);
+  for (auto& bs : bs_list) {
+    if (!perr.empty())
+      break;
+    block_size_list.push_back(strict_iecstrtoll(bs.c_str(), &perr));
+    if (perr.empty() && (!block_size_list.back() ||
+			 cfg.size % block_size_list.back())) {
+      perr = "block size " + bs + " does not divide --size";
+    }
+  }
+  if (!perr.empty() || iterations <= 0 || !cfg.size ||
+      block_size_list.empty()) {
+    if (!perr.empty())
+      cerr << perr << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+  cfg.iterations = iterations;
+
+  bufferptr bp = buffer::create_page_aligned(cfg.size);
+  for (uint64_t i = 0; i < cfg.size; ++i) {
+    bp.c_str()[i] = (i * 31) & 0xff;
+  }
+  bufferlist bl;
+  if (cfg.fragment) {
+    for (uint64_t off = 0; off < cfg.size; off += cfg.fragment) {
+      bl.append(bp, off, std::min(cfg.fragment, cfg.size - off));
+    }
+  } else {
+    bl.append(bp);
+  }
+
+  list<string> type_list;
+  get_str_list(types, type_list);
+  for (auto& type : type_list) {
+    for (auto block_size : block_size_list) {
+      switch (Checksummer::get_csum_string_type(type)) {
+      case Checksummer::CSUM_CRC32C:
+	run<Checksummer::crc32c>(type, cfg, block_size, bl);
+	break;
+      case Checksummer::CSUM_CRC32C_16:
+	run<Checksummer::crc32c_16>(type, cfg, block_size, bl);
+	break;
+      case Checksummer::CSUM_CRC32C_8:
+	run<Checksummer::crc32c_8>(type, cfg, block_size, bl);
+	break;
+      case Checksummer::CSUM_XXHASH32:
+	run<Checksummer::xxhash32>(type, cfg, block_size, bl);
+	break;
+      case Checksummer::CSUM_XXHASH64:
+	run<Checksummer::xxhash64>(type, cfg, block_size, bl);
+	break;
+      default:
+	cerr << "unknown csum type " << type << std::endl;
+	return 1;
+      }
+    }
+  }
+  return 0;
+}
@@ -29,6 +29,7 @@
 #if defined(WITH_BLUESTORE)
 #include "os/bluestore/BlueStore.h"
 #include "os/bluestore/BlueFS.h"
+#include "kv/RocksDBStore.h"
 #endif
 #include "include/Context.h"
 #include "common/ceph_argparse.h"
@@ -3628,6 +3629,76 @@ TEST_P(StoreTest, ManyObjectTest) {
 }
 
 
+TEST_P(StoreTest, CollectionListPagesSeeChanges) {
+  // listing page by page has to see objects created, and not see objects
+  // removed, past where the previous page stopped
+  int r = 0;
+  coll_t cid;
+  auto make_oid = [](unsigned hash) {
+    return ghobject_t(hobject_t(sobject_t("obj", CEPH_NOSNAP), string(),
+				hash, -1, ""));
+  };
+  set<ghobject_t> created;
+  auto ch = store->create_new_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    for (unsigned i = 0; i < 200; i += 2) {
+      t.touch(cid, make_oid(i));
+      created.insert(make_oid(i));
+    }
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+
+  set<ghobject_t> listed;
+  vector<ghobject_t> objects;
+  ghobject_t start, next;
+  for (int page = 0; ; ++page) {
+    objects.clear();
+    r = store->collection_list(ch, start, ghobject_t::get_max(), 20,
+			       &objects, &next);
+    ASSERT_EQ(r, 0);
+    ASSERT_TRUE(sorted(objects));
+    listed.insert(objects.begin(), objects.end());
+    if (next.is_max()) {
+      break;
+    }
+    if (page == 2) {
+      ghobject_t added, removed;
+      for (unsigned i = 1; i < 200 && added == ghobject_t(); i += 2) {
+	if (next < make_oid(i)) {
+	  added = make_oid(i);
+	}
+      }
+      auto p = created.upper_bound(next);
+      ASSERT_NE(added, ghobject_t());
+      ASSERT_TRUE(p != created.end());
+      removed = *p;
+      ObjectStore::Transaction t;
+      t.touch(cid, added);
+      t.remove(cid, removed);
+      created.insert(added);
+      created.erase(removed);
+      r = queue_transaction(store, ch, std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+    start = next;
+  }
+  ASSERT_EQ(listed, created);
+
+  {
+    ObjectStore::Transaction t;
+    for (auto& oid : created) {
+      t.remove(cid, oid);
+    }
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
+
 class ObjectGenerator {
 public:
   virtual ghobject_t create_object(gen_type *gen) = 0;
@@ -4792,6 +4863,448 @@ TEST_P(StoreTestSpecificAUSize, SyntheticMatrixPreferDeferred) {
   };
   do_matrix(m, std::bind(&StoreTest::doSyntheticTest, this, _1, _2, _3, _4));
 }
+
+TEST_P(StoreTestSpecificAUSize, KVSyncLanes) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  SetVal(g_conf(), "bluestore_kv_sync_lanes", "4");
+  g_conf().apply_changes(nullptr);
+  StartDeferred(0x10000);
+
+  // spread sequencers over all lanes and keep them all busy at once
+  const int num_colls = 8;
+  const int num_objs = 50;
+  vector<coll_t> cids;
+  vector<ObjectStore::CollectionHandle> chs;
+  for (int i = 0; i < num_colls; ++i) {
+    coll_t cid(spg_t(pg_t(i, 1), shard_id_t::NO_SHARD));
+    auto ch = store->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+    cids.push_back(cid);
+    chs.push_back(ch);
+  }
+  auto make_oid = [](int c, int o) {
+    return ghobject_t(hobject_t(sobject_t("obj_" + stringify(c) + "_" +
+					  stringify(o), CEPH_NOSNAP),
+				string(), 0, 1, string()));
+  };
+  for (int o = 0; o < num_objs; ++o) {
+    for (int c = 0; c < num_colls; ++c) {
+      ObjectStore::Transaction t;
+      bufferlist bl;
+      bl.append(string(4096, 'a' + (c + o) % 26));
+      t.write(cids[c], make_oid(c, o), 0, bl.length(), bl);
+      // a second, ordered overwrite through the same sequencer
+      ObjectStore::Transaction t2;
+      bufferlist bl2;
+      bl2.append(stringify(o));
+      t2.write(cids[c], make_oid(c, o), 0, bl2.length(), bl2);
+      store->queue_transaction(chs[c], std::move(t));
+      store->queue_transaction(chs[c], std::move(t2));
+    }
+  }
+  for (auto& ch : chs) {
+    ch->flush();
+  }
+  chs.clear();
+  EXPECT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  EXPECT_EQ(store->mount(), 0);
+
+  for (int c = 0; c < num_colls; ++c) {
+    auto ch = store->open_collection(cids[c]);
+    ASSERT_TRUE(ch);
+    for (int o = 0; o < num_objs; ++o) {
+      bufferlist in;
+      int r = store->read(ch, make_oid(c, o), 0, 4096, in);
+      ASSERT_EQ(4096, r);
+      bufferlist exp;
+      exp.append(stringify(o));
+      exp.append(string(4096 - exp.length(), 'a' + (c + o) % 26));
+      ASSERT_TRUE(bl_eq(exp, in));
+    }
+  }
+}
+
+TEST_P(StoreTestSpecificAUSize, Readahead) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  SetVal(g_conf(), "bluestore_readahead_min_sequential", "2");
+  SetVal(g_conf(), "bluestore_readahead_max_bytes", "1M");
+  SetVal(g_conf(), "bluestore_readahead_cache_ratio", "1");
+  g_conf().apply_changes(nullptr);
+  StartDeferred(0x10000);
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  const PerfCounters* logger = store->get_perf_counters();
+  const unsigned obj_size = 4 << 20;
+  const unsigned chunk = 64 << 10;
+  bufferlist data;
+  {
+    for (unsigned i = 0; i < obj_size / sizeof(uint32_t); ++i) {
+      uint32_t v = rand();
+      data.append((const char*)&v, sizeof(v));
+    }
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, data.length(), data);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // drop the buffers cached by the write
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+  EXPECT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+
+  for (unsigned off = 0; off < obj_size; off += chunk) {
+    if (off == obj_size / 2) {
+      // overwrite what was likely prefetched already
+      bufferlist bl;
+      bl.append(string(chunk * 2, 'x'));
+      bufferlist updated;
+      updated.substr_of(data, 0, off + chunk);
+      updated.append(bl);
+      bufferlist tail;
+      tail.substr_of(data, off + chunk * 3,
+		     obj_size - off - chunk * 3);
+      updated.append(tail);
+      data.swap(updated);
+      ObjectStore::Transaction t;
+      t.write(cid, hoid, off + chunk, bl.length(), bl);
+      int r = queue_transaction(store, ch, std::move(t));
+      ASSERT_EQ(r, 0);
+    }
+    bufferlist in, exp;
+    int r = store->read(ch, hoid, off, chunk, in);
+    ASSERT_EQ((int)chunk, r);
+    exp.substr_of(data, off, chunk);
+    ASSERT_TRUE(bl_eq(exp, in));
+  }
+  ASSERT_GT(logger->get(l_bluestore_readahead_bytes), 0u);
+  ASSERT_GT(logger->get(l_bluestore_readahead_hit_bytes), 0u);
+
+  // a random reader does not prefetch
+  uint64_t ios = logger->get(l_bluestore_readahead_ios);
+  for (unsigned i = 0; i < 16; ++i) {
+    bufferlist in;
+    uint64_t off = (i * 7 % 16) * (obj_size / 16);
+    int r = store->read(ch, hoid, off, 4096, in,
+			CEPH_OSD_OP_FLAG_FADVISE_RANDOM);
+    ASSERT_EQ(4096, r);
+  }
+  ASSERT_EQ(ios, logger->get(l_bluestore_readahead_ios));
+
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  EXPECT_EQ(store->mount(), 0);
+}
+
+TEST_P(StoreTestSpecificAUSize, DeferredWriteCoalescing) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  SetVal(g_conf(), "bluestore_prefer_deferred_size", "65536");
+  SetVal(g_conf(), "bluestore_deferred_batch_ops", "4096");
+  g_conf().apply_changes(nullptr);
+  StartDeferred(0x10000);
+
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  auto ch = store->create_new_collection(cid);
+  const PerfCounters* logger = store->get_perf_counters();
+  // more adjacent deferred extents than a single vectored write can take
+  const unsigned num_writes = IOV_MAX + IOV_MAX / 2;
+  const unsigned block = 4096;
+  bufferlist data;
+  {
+    data.append(buffer::create_small_page_aligned(num_writes * block));
+    data.zero();
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, data.length(), data);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  uint64_t ops = logger->get(l_bluestore_deferred_write_ops);
+  uint64_t bytes = logger->get(l_bluestore_deferred_write_bytes);
+  uint64_t unaligned = logger->get(l_bluestore_deferred_write_unaligned_bytes);
+  {
+    ObjectStore::Transaction t;
+    bufferlist updated;
+    for (unsigned i = 0; i < num_writes; ++i) {
+      bufferptr bp = buffer::create_small_page_aligned(block);
+      memset(bp.c_str(), 'a' + i % 26, block);
+      bufferlist bl;
+      bl.append(bp);
+      updated.append(bl);
+      t.write(cid, hoid, i * block, block, bl);
+    }
+    data.swap(updated);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+
+  // page aligned buffers went to the device as they were, in more than
+  // one vectored write
+  ASSERT_GE(logger->get(l_bluestore_deferred_write_bytes),
+	    bytes + data.length());
+  ASSERT_GE(logger->get(l_bluestore_deferred_write_ops), ops + 2);
+  ASSERT_EQ(unaligned,
+	    logger->get(l_bluestore_deferred_write_unaligned_bytes));
+
+  EXPECT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  bufferlist in;
+  int r = store->read(ch, hoid, 0, data.length(), in);
+  ASSERT_EQ((int)data.length(), r);
+  ASSERT_TRUE(bl_eq(data, in));
+}
+
+TEST_P(StoreTestSpecificAUSize, AllocatorSnapshot) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  SetVal(g_conf(), "bluestore_allocator_snapshot", "true");
+  SetVal(g_conf(), "bluestore_fsck_on_umount", "false");
+  g_conf().apply_changes(nullptr);
+  StartDeferred(0x10000);
+
+  coll_t cid;
+  auto ch = store->create_new_collection(cid);
+  auto write = [&](unsigned first, unsigned count) {
+    ObjectStore::Transaction t;
+    if (first == 0) {
+      t.create_collection(cid, 0);
+    }
+    bufferlist bl;
+    bl.append(string(0x30000, 'a'));
+    for (unsigned i = first; i < first + count; ++i) {
+      ghobject_t hoid(hobject_t(sobject_t("Object " + stringify(i),
+					  CEPH_NOSNAP)));
+      t.write(cid, hoid, 0, bl.length(), bl);
+    }
+    return queue_transaction(store, ch, std::move(t));
+  };
+  ASSERT_EQ(write(0, 16), 0);
+  store_statfs_t before;
+  ASSERT_EQ(store->statfs(&before), 0);
+
+  // clean umount writes the snapshot, mount loads it
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  EXPECT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  store_statfs_t after;
+  ASSERT_EQ(store->statfs(&after), 0);
+  ASSERT_EQ(before.available, after.available);
+
+  // space allocated after the snapshot was loaded must not be handed out
+  // twice, nor the snapshot trusted once the freelist has moved on
+  ASSERT_EQ(write(16, 16), 0);
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  SetVal(g_conf(), "bluestore_allocator_snapshot", "false");
+  g_conf().apply_changes(nullptr);
+  EXPECT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  ASSERT_EQ(write(32, 16), 0);
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+  SetVal(g_conf(), "bluestore_allocator_snapshot", "true");
+  g_conf().apply_changes(nullptr);
+  ASSERT_EQ(store->fsck(false), 0);
+  EXPECT_EQ(store->mount(), 0);
+  ASSERT_EQ(store->statfs(&after), 0);
+  ASSERT_LT(after.available, before.available);
+  ch = store->open_collection(cid);
+  ASSERT_EQ(write(48, 16), 0);
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  EXPECT_EQ(store->mount(), 0);
+}
+
+TEST_P(StoreTestSpecificAUSize, ReshardKVOnly) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  if (g_conf().get_val<string>("bluestore_kvbackend") != "rocksdb")
+    return;
+  SetVal(g_conf(), "bluestore_allocator_snapshot", "true");
+  SetVal(g_conf(), "bluestore_fsck_on_umount", "false");
+  g_conf().apply_changes(nullptr);
+  StartDeferred(0x10000);
+
+  coll_t cid;
+  auto ch = store->create_new_collection(cid);
+  auto hoid = [](unsigned i) {
+    return ghobject_t(hobject_t(sobject_t("Object " + stringify(i),
+					  CEPH_NOSNAP)));
+  };
+  bufferlist data;
+  data.append(string(0x30000, 'a'));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    for (unsigned i = 0; i < 16; ++i) {
+      map<string, bufferlist> km;
+      for (unsigned j = 0; j < 16; ++j) {
+	bufferlist v;
+	v.append(stringify(i * 100 + j));
+	km["key" + stringify(j)] = v;
+      }
+      t.write(cid, hoid(i), 0, data.length(), data);
+      t.omap_setkeys(cid, hoid(i), km);
+    }
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  store_statfs_t before;
+  ASSERT_EQ(store->statfs(&before), 0);
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+
+  // as ceph-bluestore-tool reshard does it: the db is prepared but not
+  // opened by the kv-only mount, reshard() opens it
+  {
+    BlueStore *bs = dynamic_cast<BlueStore*>(store.get());
+    ASSERT_TRUE(bs);
+    KeyValueDB *db = nullptr;
+    ASSERT_EQ(bs->start_kv_only(&db, false), 0);
+    RocksDBStore *rdb = dynamic_cast<RocksDBStore*>(db);
+    ASSERT_TRUE(rdb);
+    ASSERT_EQ(rdb->reshard("M(3) O(2) P L", cout), 0);
+    EXPECT_EQ(bs->umount(), 0);
+  }
+
+  ASSERT_EQ(store->fsck(false), 0);
+  EXPECT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  store_statfs_t after;
+  ASSERT_EQ(store->statfs(&after), 0);
+  ASSERT_EQ(before.available, after.available);
+  for (unsigned i = 0; i < 16; ++i) {
+    bufferlist bl;
+    ASSERT_EQ(store->read(ch, hoid(i), 0, data.length(), bl),
+	      (int)data.length());
+    ASSERT_TRUE(bl_eq(data, bl));
+    bufferlist hdr;
+    map<string, bufferlist> km;
+    ASSERT_EQ(store->omap_get(ch, hoid(i), &hdr, &km), 0);
+    ASSERT_EQ(km.size(), 16u);
+    ASSERT_EQ(km["key7"].to_str(), stringify(i * 100 + 7));
+  }
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(false), 0);
+  EXPECT_EQ(store->mount(), 0);
+}
+
+TEST_P(StoreTestSpecificAUSize, DataTier) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  SetVal(g_conf(), "bluestore_tier_create", "true");
+  SetVal(g_conf(), "bluestore_tier_size", "8M");
+  SetVal(g_conf(), "bluestore_tier_max_write_size", "64K");
+  SetVal(g_conf(), "bluestore_tier_high_ratio", ".5");
+  SetVal(g_conf(), "bluestore_tier_low_ratio", ".25");
+  SetVal(g_conf(), "bluestore_tier_migrate_interval", ".1");
+  SetVal(g_conf(), "bluestore_tier_promote_heat", "3");
+  g_conf().apply_changes(nullptr);
+  StartDeferred(0x10000);
+
+  int poolid = 4374;
+  coll_t cid(spg_t(pg_t(0, poolid), shard_id_t::NO_SHARD));
+  auto oid = [&](unsigned i) {
+    return ghobject_t(hobject_t(sobject_t("Object " + stringify(i),
+					  CEPH_NOSNAP),
+				string(), 0, poolid, string()));
+  };
+  auto data = [](unsigned i, unsigned len) {
+    bufferlist bl;
+    bl.append(string(len, 'a' + i % 26));
+    return bl;
+  };
+  auto wait_for = [](std::function<bool()> done) {
+    for (unsigned i = 0; i < 300 && !done(); ++i) {
+      usleep(100000);
+    }
+    return done();
+  };
+  auto ch = store->create_new_collection(cid);
+  const PerfCounters* logger = store->get_perf_counters();
+
+  // too big for the tier, goes to the main device...
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    bufferlist bl = data(0, 0x40000);
+    t.write(cid, oid(0), 0, bl.length(), bl);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ASSERT_EQ(0u, logger->get(l_bluestore_tier_write_bytes));
+  // ...until reads make it hot
+  for (unsigned i = 0; i < 2; ++i) {
+    bufferlist in;
+    ASSERT_EQ(0x40000, store->read(ch, oid(0), 0, 0x40000, in));
+  }
+  ASSERT_TRUE(wait_for([&] {
+    return logger->get(l_bluestore_tier_promoted_objects) == 1;
+  }));
+  ASSERT_EQ(0x40000u, logger->get(l_bluestore_tier_promoted_bytes));
+  {
+    bufferlist in;
+    ASSERT_EQ(0x40000, store->read(ch, oid(0), 0, 0x40000, in));
+    bufferlist exp = data(0, 0x40000);
+    ASSERT_TRUE(bl_eq(exp, in));
+    ASSERT_GE(logger->get(l_bluestore_tier_read_bytes), 0x40000u);
+  }
+
+  // small writes go to the tier, past the high watermark the coldest
+  // objects are moved off it again
+  for (unsigned i = 1; i <= 80; ++i) {
+    ObjectStore::Transaction t;
+    bufferlist bl = data(i, 0x10000);
+    t.write(cid, oid(i), 0, bl.length(), bl);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  ASSERT_EQ(80u * 0x10000, logger->get(l_bluestore_tier_write_bytes));
+  ASSERT_TRUE(wait_for([&] {
+    return logger->get(l_bluestore_tier_demoted_objects) > 0 &&
+      logger->get(l_bluestore_tier_used_bytes) <= (4u << 20);
+  }));
+  for (unsigned i = 0; i <= 80; ++i) {
+    unsigned len = i ? 0x10000 : 0x40000;
+    bufferlist in;
+    ASSERT_EQ((int)len, store->read(ch, oid(i), 0, len, in));
+    bufferlist exp = data(i, len);
+    ASSERT_TRUE(bl_eq(exp, in));
+  }
+
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+  ASSERT_EQ(store->fsck(true), 0);
+  EXPECT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  {
+    ObjectStore::Transaction t;
+    for (unsigned i = 0; i <= 80; ++i) {
+      t.remove(cid, oid(i));
+    }
+    t.remove_collection(cid);
+    int r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
 #endif // WITH_BLUESTORE
 
 TEST_P(StoreTest, AttrSynthetic) {
@@ -5292,6 +5805,69 @@ TEST_P(StoreTest, OMapIterator) {
   }
 }
 
+TEST_P(StoreTest, OMapIteratorBatch) {
+  coll_t cid;
+  ghobject_t hoid(hobject_t("tesomap", "", CEPH_NOSNAP, 0, 0, ""));
+  ghobject_t hoid2(hobject_t("tesomap2", "", CEPH_NOSNAP, 0, 0, ""));
+  auto ch = store->create_new_collection(cid);
+  int r;
+  map<string, bufferlist> attrs;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    map<string, bufferlist> other;
+    for (unsigned i = 0; i < 100; ++i) {
+      bufferlist bl;
+      bl.append("value" + stringify(i));
+      attrs["key-" + stringify(i)] = bl;
+      other["key-" + stringify(i)] = bl;
+    }
+    // a neighbour with omap of its own that the batches must not run into
+    t.touch(cid, hoid);
+    t.omap_setkeys(cid, hoid, attrs);
+    t.touch(cid, hoid2);
+    t.omap_setkeys(cid, hoid2, other);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    ObjectMap::ObjectMapIterator iter = store->get_omap_iterator(ch, hoid);
+    KeyValueDB::IteratorBatch batch;
+    iter->seek_to_first();
+    auto p = attrs.begin();
+    size_t n;
+    do {
+      batch.clear();
+      n = iter->next_batch(7, 1 << 20, &batch);
+      ASSERT_EQ(n, batch.size());
+      for (size_t i = 0; i < batch.size(); ++i, ++p) {
+	ASSERT_TRUE(p != attrs.end());
+	ASSERT_EQ(p->first, batch.key(i));
+	ASSERT_EQ(p->second.to_str(), batch.value(i));
+      }
+    } while (n);
+    ASSERT_TRUE(p == attrs.end());
+    ASSERT_FALSE(iter->valid());
+
+    // picks up where lower_bound left it
+    iter->lower_bound("key-50");
+    batch.clear();
+    ASSERT_EQ(3u, iter->next_batch(3, 1 << 20, &batch));
+    ASSERT_EQ("key-50", batch.key(0));
+    ASSERT_EQ("key-52", batch.key(2));
+    ASSERT_TRUE(iter->valid());
+    ASSERT_EQ("key-53", iter->key());
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove(cid, hoid2);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, XattrTest) {
   coll_t cid;
   ghobject_t hoid(hobject_t("tesomap", "", CEPH_NOSNAP, 0, 0, ""));
@@ -7462,6 +8038,59 @@ TEST_P(StoreTestSpecificAUSize, BluestoreRepairTest) {
 
 }
 
+TEST_P(StoreTestSpecificAUSize, BluestoreParallelFsck) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  SetVal(g_conf(), "bluestore_fsck_on_mount", "false");
+  SetVal(g_conf(), "bluestore_fsck_on_umount", "false");
+  SetVal(g_conf(), "bluestore_fsck_threads", "4");
+  StartDeferred(0x10000);
+
+  BlueStore* bstore = dynamic_cast<BlueStore*> (store.get());
+
+  // a few collections so the keyspace splits into several ranges
+  const unsigned pools = 6;
+  vector<coll_t> cids;
+  vector<ghobject_t> oids;
+  bufferlist bl;
+  bl.append(std::string(0x10000, 'a'));
+  for (unsigned i = 0; i < pools; ++i) {
+    const uint64_t pool = 555 + i;
+    coll_t cid(spg_t(pg_t(0, pool), shard_id_t::NO_SHARD));
+    auto ch = store->create_new_collection(cid);
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    for (unsigned j = 0; j < 8; ++j) {
+      ghobject_t hoid = make_object(
+        ("Object " + stringify(j)).c_str(), pool);
+      t.write(cid, hoid, 0, bl.length(), bl);
+      t.omap_setkeys(cid, hoid, {{"key", bl}});
+      if (j == 0) {
+        ghobject_t clone = hoid;
+        clone.hobj.snap = 1;
+        t.clone(cid, hoid, clone);
+      }
+      cids.push_back(cid);
+      oids.push_back(hoid);
+    }
+    ASSERT_EQ(queue_transaction(store, ch, std::move(t)), 0);
+  }
+  bstore->umount();
+  ASSERT_EQ(bstore->fsck(false), 0);
+  ASSERT_EQ(bstore->fsck(true), 0);
+
+  // extents shared between objects of different collections are only
+  // seen when the per-thread bitmaps are merged
+  bstore->mount();
+  bstore->inject_misreference(cids.front(), oids.front(),
+                              cids.back(), oids.back(), 0);
+  bstore->umount();
+  ASSERT_GT(bstore->fsck(false), 0);
+  ASSERT_EQ(bstore->repair(false), 0);
+  ASSERT_EQ(bstore->fsck(true), 0);
+  bstore->mount();
+}
+
 TEST_P(StoreTest, BluestoreRepairGlobalStats)
 {
   if (string(GetParam()) != "bluestore")
@@ -7640,6 +8269,73 @@ TEST_P(StoreTest, BluestoreStatistics) {
   cout << std::endl;
 }
 
+TEST_P(StoreTest, BluestorePoolIO) {
+  if (string(GetParam()) != "bluestore")
+    return;
+
+  int poolid = 4374;
+  coll_t cid = coll_t(spg_t(pg_t(0, poolid), shard_id_t::NO_SHARD));
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP),
+			    string(), 0, poolid, string()));
+  auto ch = store->create_new_collection(cid);
+  int r;
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  struct store_statfs_t before;
+  bool per_pool_omap;
+  r = store->pool_statfs(poolid, &before, &per_pool_omap);
+  ASSERT_EQ(r, 0);
+
+  bufferlist bl;
+  bl.append(std::string(0x40000, 'a'));
+  map<string, bufferlist> omap;
+  omap["key"].append("value");
+  {
+    ObjectStore::Transaction t;
+    t.write(cid, hoid, 0, bl.length(), bl);
+    t.omap_setkeys(cid, hoid, omap);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  struct store_statfs_t after;
+  r = store->pool_statfs(poolid, &after, &per_pool_omap);
+  ASSERT_EQ(r, 0);
+  ASSERT_EQ(before.io_written + bl.length() + 8, after.io_written);
+  ASSERT_GE(after.io_data_written + after.io_deferred_written,
+	    before.io_data_written + before.io_deferred_written + bl.length());
+  ASSERT_GT(after.io_kv_written, before.io_kv_written);
+
+  // drop the cache so the read has to go to the device
+  ch.reset();
+  EXPECT_EQ(store->umount(), 0);
+  EXPECT_EQ(store->mount(), 0);
+  ch = store->open_collection(cid);
+  {
+    bufferlist readback;
+    r = store->read(ch, hoid, 0, bl.length(), readback);
+    ASSERT_EQ(static_cast<int>(bl.length()), r);
+    ASSERT_TRUE(bl_eq(bl, readback));
+  }
+  before = after;
+  r = store->pool_statfs(poolid, &after, &per_pool_omap);
+  ASSERT_EQ(r, 0);
+  ASSERT_EQ(before.io_read + bl.length(), after.io_read);
+  ASSERT_GE(after.io_data_read, before.io_data_read + bl.length());
+  ASSERT_EQ(before.io_written, after.io_written);
+
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = queue_transaction(store, ch, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+}
+
 TEST_P(StoreTest, BluestorePerPoolOmapFixOnMount)
 {
   if (string(GetParam()) != "bluestore")
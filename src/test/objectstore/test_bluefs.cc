@@ -641,6 +641,118 @@ TEST(BlueFS, test_compaction_async) {
   fs.umount();
 }
 
+TEST(BlueFS, test_compaction_async_concurrent_fsync) {
+  uint64_t size = 1048576 * 128;
+  TempBdev bdev{size};
+  g_ceph_context->_conf.set_val(
+    "bluefs_alloc_size",
+    "65536");
+  g_ceph_context->_conf.set_val(
+    "bluefs_compact_log_sync",
+    "false");
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, bdev.path, false));
+  fs.add_block_extent(BlueFS::BDEV_DB, 1048576, size - 1048576);
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid, { BlueFS::BDEV_DB, false, false }));
+  ASSERT_EQ(0, fs.mount());
+  {
+    // keep compacting while the writers fsync; the writers must make
+    // progress and the log must stay replayable
+    std::atomic<bool> done = false;
+    std::thread compactor([&fs, &done] {
+      while (!done) {
+        fs.compact_log();
+      }
+    });
+    std::vector<std::thread> write_threads;
+    uint64_t effective_size = size - (32 * 1048576); // leaving the last 32 MB for log compaction
+    uint64_t per_thread_bytes = (effective_size/(NUM_WRITERS));
+    for (int i=0; i<NUM_WRITERS; i++) {
+      write_threads.push_back(std::thread(write_data, std::ref(fs), per_thread_bytes));
+    }
+    join_all(write_threads);
+    done = true;
+    compactor.join();
+  }
+  vector<string> dirs;
+  ASSERT_EQ(0, fs.readdir("", &dirs));
+  fs.umount();
+  ASSERT_EQ(0, fs.mount());
+  vector<string> replayed_dirs;
+  ASSERT_EQ(0, fs.readdir("", &replayed_dirs));
+  ASSERT_EQ(dirs, replayed_dirs);
+  fs.umount();
+}
+
+TEST(BlueFS, test_concurrent_writers) {
+  uint64_t size = 1048576 * 256;
+  TempBdev bdev{size};
+  g_ceph_context->_conf.set_val(
+    "bluefs_alloc_size",
+    "65536");
+
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, bdev.path, false));
+  fs.add_block_extent(BlueFS::BDEV_DB, 1048576, size - 1048576);
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid, { BlueFS::BDEV_DB, false, false }));
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0, fs.mkdir("dir"));
+
+  // each thread appends to and fsyncs its own file, the way rocksdb
+  // writes its WAL and flushes SSTs side by side; every thread count
+  // writes the same total so the rates compare
+  const uint64_t total_bytes = 64 * 1048576;
+  const uint64_t chunk = 16384;
+  const uint64_t sync_every = 262144;
+  std::unique_ptr<char[]> buf = gen_buffer(chunk);
+  for (unsigned nthreads : {1, 2, 4, 8}) {
+    uint64_t per_thread = total_bytes / nthreads;
+    auto writer = [&](unsigned t) {
+      string file = "file." + stringify(nthreads) + "." + stringify(t);
+      BlueFS::FileWriter *h;
+      ASSERT_EQ(0, fs.open_for_write("dir", file, &h, false));
+      for (uint64_t pos = 0; pos < per_thread; pos += chunk) {
+        h->append(buf.get(), chunk);
+        fs.flush(h);
+        if ((pos + chunk) % sync_every == 0) {
+          ASSERT_EQ(0, fs.fsync(h));
+        }
+      }
+      ASSERT_EQ(0, fs.fsync(h));
+      fs.close_writer(h);
+    };
+    auto start = mono_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < nthreads; ++t) {
+      threads.push_back(std::thread(writer, t));
+    }
+    join_all(threads);
+    double elapsed = std::chrono::duration<double>(
+      mono_clock::now() - start).count();
+    std::cout << nthreads << " writer(s): "
+              << (total_bytes / 1048576) / elapsed << " MB/s" << std::endl;
+
+    for (unsigned t = 0; t < nthreads; ++t) {
+      string file = "file." + stringify(nthreads) + "." + stringify(t);
+      BlueFS::FileReader *h;
+      ASSERT_EQ(0, fs.open_for_read("dir", file, &h));
+      ASSERT_EQ(per_thread, h->file->fnode.size);
+      for (uint64_t pos = 0; pos < per_thread; pos += chunk) {
+        bufferlist bl;
+        ASSERT_EQ((int)chunk, fs.read(h, &h->buf, pos, chunk, &bl, NULL));
+        ASSERT_EQ(0, memcmp(buf.get(), bl.c_str(), chunk));
+      }
+      delete h;
+      ASSERT_EQ(0, fs.unlink("dir", file));
+    }
+    fs.sync_metadata();
+  }
+  fs.umount();
+}
+
 TEST(BlueFS, test_replay) {
   uint64_t size = 1048576 * 128;
   TempBdev bdev{size};
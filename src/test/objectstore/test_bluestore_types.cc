@@ -306,6 +306,52 @@ TEST(bluestore_blob_t, calc_csum)
   }
 }
 
+TEST(bluestore_blob_t, calc_csum_fragmented)
+{
+  // same data in one buffer and in pieces that don't line up with the
+  // csum blocks, so both the batched and the per block path are taken
+  bufferptr bp(16 * 4096);
+  for (unsigned i = 0; i < bp.length(); ++i) {
+    bp.c_str()[i] = (i * 13) & 0xff;
+  }
+  bufferlist whole;
+  whole.append(bp);
+  bufferlist pieces;
+  for (unsigned off = 0, len = 1000; off < bp.length(); off += len) {
+    len = std::min<unsigned>(len + 3000, bp.length() - off);
+    pieces.append(bp, off, len);
+  }
+  ASSERT_EQ(whole.length(), pieces.length());
+  ASSERT_GT(pieces.get_num_buffers(), 1u);
+
+  for (unsigned csum_type = Checksummer::CSUM_NONE + 1;
+       csum_type < Checksummer::CSUM_MAX;
+       ++csum_type) {
+    cout << "csum_type " << Checksummer::get_csum_type_string(csum_type)
+	 << std::endl;
+    bluestore_blob_t a, b;
+    a.init_csum(csum_type, 12, whole.length());
+    b.init_csum(csum_type, 12, whole.length());
+    a.calc_csum(0, whole);
+    b.calc_csum(0, pieces);
+    ASSERT_EQ(0, memcmp(a.csum_data.c_str(), b.csum_data.c_str(),
+			a.csum_data.length()));
+
+    int bad_off;
+    uint64_t bad_csum;
+    ASSERT_EQ(0, a.verify_csum(0, pieces, &bad_off, &bad_csum));
+    ASSERT_EQ(-1, bad_off);
+
+    bufferlist bad, tail;
+    bad.substr_of(pieces, 0, 4096 * 9);
+    bad.append('x');
+    tail.substr_of(pieces, 4096 * 9 + 1, pieces.length() - 4096 * 9 - 1);
+    bad.claim_append(tail);
+    ASSERT_EQ(-1, a.verify_csum(0, bad, &bad_off, &bad_csum));
+    ASSERT_EQ(4096 * 9, bad_off);
+  }
+}
+
 TEST(bluestore_blob_t, csum_bench)
 {
   bufferlist bl;
@@ -1497,6 +1543,69 @@ TEST(GarbageCollector, BasicTest)
   }
 }
 
+TEST(TinyLfuOnodeCacheShard, scan_resistance)
+{
+  PerfCountersBuilder plb(g_ceph_context, "bluestore_test",
+			  l_bluestore_first, l_bluestore_last);
+  plb.add_u64_counter(l_bluestore_onode_hits, "onode_hits");
+  plb.add_u64_counter(l_bluestore_onode_misses, "onode_misses");
+  plb.add_u64_counter(l_bluestore_onode_ghost_hits, "onode_ghost_hits");
+  std::unique_ptr<PerfCounters> logger(plb.create_perf_counters());
+
+  BlueStore store(g_ceph_context, "", 4096);
+  BlueStore::OnodeCacheShard *oc = BlueStore::OnodeCacheShard::create(
+    g_ceph_context, "tinylfu", logger.get());
+  BlueStore::BufferCacheShard *bc = BlueStore::BufferCacheShard::create(
+    g_ceph_context, "tinylfu", logger.get());
+  auto coll = ceph::make_ref<BlueStore::Collection>(&store, oc, bc, coll_t());
+  oc->set_max(100);
+
+  auto access = [&](int i) {
+    ghobject_t oid(hobject_t(sobject_t("obj" + stringify(i), CEPH_NOSNAP)));
+    BlueStore::OnodeRef o = coll->onode_map.lookup(oid);
+    if (o) {
+      return true;
+    }
+    coll->onode_map.add(oid, BlueStore::OnodeRef(
+      new BlueStore::Onode(coll.get(), oid, "")));
+    return false;
+  };
+
+  // a hot set of half the cache size
+  for (int round = 0; round < 10; ++round) {
+    for (int i = 0; i < 50; ++i) {
+      access(i);
+    }
+  }
+  ASSERT_LE(oc->_get_num(), 100u);
+  // one pass over many cold objects, e.g. deep-scrub
+  for (int i = 1000; i < 3000; ++i) {
+    ASSERT_FALSE(access(i));
+  }
+  ASSERT_LE(oc->_get_num(), 100u);
+  int hits = 0;
+  for (int i = 0; i < 50; ++i) {
+    hits += access(i);
+  }
+  ASSERT_GE(hits, 45);
+
+  // objects seen before but evicted since count as ghost hits
+  for (int i = 5000; i < 5200; ++i) {
+    access(i);
+    access(i);
+  }
+  uint64_t ghosts = logger->get(l_bluestore_onode_ghost_hits);
+  int misses = 0;
+  for (int i = 5000; i < 5200; ++i) {
+    misses += !access(i);
+  }
+  ASSERT_GT(misses, 0);
+  ASSERT_GT(logger->get(l_bluestore_onode_ghost_hits), ghosts);
+
+  coll->onode_map.clear();
+  ASSERT_EQ(0u, oc->_get_num());
+}
+
 TEST(BlueStoreRepairer, StoreSpaceTracker)
 {
   BlueStoreRepairer::StoreSpaceTracker bmap0;
@@ -16,8 +16,11 @@
 #include <string.h>
 #include <iostream>
 #include <time.h>
+#include <atomic>
+#include <thread>
 #include <sys/mount.h>
 #include "kv/KeyValueDB.h"
+#include "kv/RocksDBStore.h"
 #include "include/Context.h"
 #include "common/ceph_argparse.h"
 #include "global/global_init.h"
@@ -49,11 +52,17 @@ public:
 
   void init() {
     cout << "Creating " << string(GetParam()) << "\n";
-    db.reset(KeyValueDB::create(g_ceph_context, string(GetParam()),
+    string type = GetParam();
+    if (type == "memdb_skiplist") {
+      g_ceph_context->_conf.set_val("memdb_skiplist", "true");
+      type = "memdb";
+    }
+    db.reset(KeyValueDB::create(g_ceph_context, type,
 				"kv_test_temp_dir"));
   }
   void fini() {
     db.reset(NULL);
+    g_ceph_context->_conf.set_val("memdb_skiplist", "false");
   }
 
   void SetUp() override {
@@ -116,6 +125,173 @@ TEST_P(KVTest, OpenWriteRead) {
   fini();
 }
 
+TEST_P(KVTest, SnapshotIterator) {
+  if (string(GetParam()) == "memdb") {
+    // the map mode follows the live map
+    return;
+  }
+  ASSERT_EQ(0, db->create_and_open(cout));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < 10; ++i) {
+      bufferlist value;
+      value.append("value" + stringify(i));
+      t->set("prefix", "key" + stringify(i), value);
+    }
+    db->submit_transaction_sync(t);
+  }
+  KeyValueDB::Iterator it = db->get_iterator("prefix");
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist value;
+    value.append("new");
+    t->set("prefix", "key0", value);
+    t->set("prefix", "key10", value);
+    t->rmkey("prefix", "key5");
+    db->submit_transaction_sync(t);
+  }
+  unsigned n = 0;
+  for (it->seek_to_first(); it->valid(); it->next(), ++n) {
+    ASSERT_EQ("key" + stringify(n), it->key());
+    ASSERT_EQ("value" + stringify(n), _bl_to_str(it->value()));
+  }
+  ASSERT_EQ(10u, n);
+  it->seek_to_last();
+  ASSERT_TRUE(it->valid());
+  ASSERT_EQ("key9", it->key());
+  it->prev();
+  ASSERT_EQ("key8", it->key());
+
+  it = db->get_iterator("prefix");
+  it->lower_bound("key5");
+  ASSERT_EQ("key6", it->key());
+  bufferlist v;
+  ASSERT_EQ(0, db->get("prefix", "key0", &v));
+  ASSERT_EQ("new", _bl_to_str(v));
+  fini();
+}
+
+TEST_P(KVTest, ConcurrentReads) {
+  if (string(GetParam()) != "memdb_skiplist")
+    return;
+  ASSERT_EQ(0, db->create_and_open(cout));
+  const unsigned keys = 1000;
+  std::atomic<bool> stop = {false};
+  std::atomic<unsigned> errors = {0};
+  vector<std::thread> readers;
+  for (unsigned r = 0; r < 4; ++r) {
+    readers.emplace_back([&] {
+      while (!stop) {
+	// every transaction rewrites all keys with the same round, so a
+	// snapshot sees either none of them or one round throughout
+	KeyValueDB::Iterator it = db->get_iterator("prefix");
+	string round;
+	unsigned n = 0;
+	for (it->seek_to_first(); it->valid(); it->next(), ++n) {
+	  string v = _bl_to_str(it->value());
+	  if (round.empty()) {
+	    round = v;
+	  } else if (v != round) {
+	    ++errors;
+	  }
+	}
+	if (n != 0 && n != keys) {
+	  ++errors;
+	}
+      }
+    });
+  }
+  for (unsigned round = 0; round < 100; ++round) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    bufferlist value;
+    value.append(stringify(round));
+    for (unsigned i = 0; i < keys; ++i) {
+      t->set("prefix", stringify(i), value);
+    }
+    db->submit_transaction_sync(t);
+  }
+  stop = true;
+  for (auto& r : readers) {
+    r.join();
+  }
+  ASSERT_EQ(0u, errors);
+  fini();
+}
+
+TEST_P(KVTest, ConcurrentRemoves) {
+  if (string(GetParam()) != "memdb_skiplist")
+    return;
+  ASSERT_EQ(0, db->create_and_open(cout));
+  const unsigned keys = 1000;
+  bufferlist value;
+  value.append("value");
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < keys; ++i) {
+      t->set("prefix", stringify(i), value);
+    }
+    db->submit_transaction_sync(t);
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 1; i < keys; i += 2) {
+      t->rmkey("prefix", stringify(i));
+    }
+    db->submit_transaction_sync(t);
+  }
+  // an iterator whose snapshot has the odd keys removed stays on its key
+  // while their nodes are unlinked around it
+  {
+    KeyValueDB::Iterator it = db->get_iterator("prefix");
+    it->seek_to_first();
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->set("other", "key", value);
+    db->submit_transaction_sync(t);
+    unsigned n = 0;
+    for (; it->valid(); it->next()) {
+      ++n;
+    }
+    ASSERT_EQ(keys / 2, n);
+  }
+  std::atomic<bool> stop = {false};
+  std::atomic<unsigned> errors = {0};
+  vector<std::thread> readers;
+  for (unsigned r = 0; r < 4; ++r) {
+    readers.emplace_back([&] {
+      while (!stop) {
+	// odd keys come and go, even ones always stay
+	KeyValueDB::Iterator it = db->get_iterator("prefix");
+	unsigned n = 0;
+	for (it->seek_to_first(); it->valid(); it->next()) {
+	  if (atoi(it->key().c_str()) % 2 == 0) {
+	    ++n;
+	  }
+	}
+	if (n != keys / 2) {
+	  ++errors;
+	}
+      }
+    });
+  }
+  for (unsigned round = 0; round < 100; ++round) {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 1; i < keys; i += 2) {
+      if (round % 2 == 0) {
+	t->set("prefix", stringify(i), value);
+      } else {
+	t->rmkey("prefix", stringify(i));
+      }
+    }
+    db->submit_transaction_sync(t);
+  }
+  stop = true;
+  for (auto& r : readers) {
+    r.join();
+  }
+  ASSERT_EQ(0u, errors);
+  fini();
+}
+
 TEST_P(KVTest, PutReopen) {
   ASSERT_EQ(0, db->create_and_open(cout));
   {
@@ -309,6 +485,60 @@ TEST_P(KVTest, RMRange) {
   fini();
 }
 
+TEST_P(KVTest, IteratorBatch) {
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  if (string(GetParam()) == "rocksdb") {
+    cfs.push_back(KeyValueDB::ColumnFamily("cf1", ""));
+    ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  }
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (auto prefix : {"a", "prefix", "z", "cf1"}) {
+      for (unsigned i = 0; i < 10; ++i) {
+	bufferlist value;
+	value.append(string(prefix) + "value" + stringify(i));
+	t->set(prefix, "key" + stringify(i), value);
+      }
+    }
+    db->submit_transaction_sync(t);
+  }
+  for (auto prefix : {"prefix", "cf1"}) {
+    KeyValueDB::Iterator it = db->get_iterator(prefix);
+    KeyValueDB::IteratorBatch batch;
+    it->seek_to_first();
+    ASSERT_EQ(4u, it->next_batch(4, 1 << 20, &batch));
+    ASSERT_EQ(4u, batch.size());
+    ASSERT_EQ("key0", batch.key(0));
+    ASSERT_EQ(string(prefix) + "value3", batch.value(3));
+    ASSERT_TRUE(it->valid());
+    ASSERT_EQ("key4", it->key());
+
+    // stops once max_bytes is crossed, and appends
+    ASSERT_EQ(1u, it->next_batch(100, batch.bytes() + 1, &batch));
+    ASSERT_EQ(5u, batch.size());
+    ASSERT_EQ("key4", batch.key(4));
+
+    // stops at end
+    ASSERT_EQ(3u, it->next_batch_until("key8", 100, 1 << 20, &batch));
+    ASSERT_EQ("key7", batch.key(7));
+    ASSERT_EQ("key8", it->key());
+
+    // stops at the end of the prefix
+    batch.clear();
+    ASSERT_EQ(2u, it->next_batch(100, 1 << 20, &batch));
+    ASSERT_EQ("key9", batch.key(1));
+    ASSERT_FALSE(it->valid());
+    ASSERT_EQ(0u, it->next_batch(100, 1 << 20, &batch));
+
+    batch.trim_keys(1, 3);
+    ASSERT_EQ("key8", batch.key(0));
+    ASSERT_EQ("9", batch.key(1));
+    ASSERT_EQ(string(prefix) + "value9", batch.value(1));
+  }
+  fini();
+}
+
 TEST_P(KVTest, RocksDBColumnFamilyTest) {
   if(string(GetParam()) != "rocksdb")
     return;
@@ -464,6 +694,86 @@ TEST_P(KVTest, RocksDBCFMerge) {
   fini();
 }
 
+TEST_P(KVTest, RocksDBShardedCF) {
+  if(string(GetParam()) != "rocksdb")
+    return;
+
+  std::vector<KeyValueDB::ColumnFamily> cfs;
+  cfs.push_back(KeyValueDB::ColumnFamily("cf1(4)", ""));
+  cfs.push_back(KeyValueDB::ColumnFamily("cf2(3,0-2)", ""));
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  cout << "creating two sharded column families and opening them" << std::endl;
+  ASSERT_EQ(0, db->create_and_open(cout, cfs));
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    for (unsigned i = 0; i < 100; ++i) {
+      bufferlist bl;
+      bl.append(stringify(i));
+      t->set("cf1", stringify(1000 + i), bl);
+      t->set("cf2", stringify(1000 + i), bl);
+      t->set("prefix", stringify(1000 + i), bl);
+    }
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  auto check = [&](const string& prefix, unsigned n) {
+    unsigned i = 0;
+    KeyValueDB::Iterator iter = db->get_iterator(prefix);
+    for (iter->seek_to_first(); iter->valid(); iter->next(), ++i) {
+      ASSERT_EQ(stringify(1000 + i), iter->key());
+      ASSERT_EQ(stringify(i), _bl_to_str(iter->value()));
+    }
+    ASSERT_EQ(n, i);
+    for (iter->seek_to_last(); iter->valid(); iter->prev()) {
+      --i;
+      ASSERT_EQ(stringify(1000 + i), iter->key());
+    }
+    ASSERT_EQ(0u, i);
+    bufferlist v;
+    ASSERT_EQ(0, db->get(prefix, "1042", &v));
+    ASSERT_EQ("42", _bl_to_str(v));
+  };
+  cout << "iterating the shards in key order" << std::endl;
+  check("cf1", 100);
+  check("cf2", 100);
+  {
+    KeyValueDB::Iterator iter = db->get_iterator("cf1");
+    iter->lower_bound("1050");
+    ASSERT_EQ("1050", iter->key());
+    iter->prev();
+    ASSERT_EQ("1049", iter->key());
+    iter->next();
+    ASSERT_EQ("1050", iter->key());
+    iter->upper_bound("1050");
+    ASSERT_EQ("1051", iter->key());
+  }
+  {
+    KeyValueDB::Transaction t = db->get_transaction();
+    t->rm_range_keys("cf1", "1090", "1100");
+    t->rmkey("cf2", "1099");
+    ASSERT_EQ(0, db->submit_transaction_sync(t));
+  }
+  check("cf1", 90);
+  fini();
+
+  cout << "resharding" << std::endl;
+  init();
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  RocksDBStore *rdb = static_cast<RocksDBStore*>(db.get());
+  ASSERT_EQ(0, rdb->reshard("cf1 cf2(5) prefix(2)", cout));
+  check("cf1", 90);
+  check("cf2", 99);
+  check("prefix", 100);
+  fini();
+
+  init();
+  ASSERT_EQ(0, db->init(g_conf()->bluestore_rocksdb_options));
+  ASSERT_EQ(0, db->open(cout, cfs));
+  check("cf1", 90);
+  check("cf2", 99);
+  check("prefix", 100);
+  fini();
+}
+
 TEST_P(KVTest, RocksDB_estimate_size) {
   if(string(GetParam()) != "rocksdb")
     GTEST_SKIP();
@@ -533,7 +843,7 @@ TEST_P(KVTest, RocksDB_estimate_size_column_family) {
 INSTANTIATE_TEST_SUITE_P(
   KeyValueDB,
   KVTest,
-  ::testing::Values("leveldb", "rocksdb", "memdb"));
+  ::testing::Values("leveldb", "rocksdb", "memdb", "memdb_skiplist"));
 
 int main(int argc, char **argv) {
   vector<const char*> args;
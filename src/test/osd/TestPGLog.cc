@@ -2214,6 +2214,52 @@ TEST_F(PGLogTest, get_request) {
   }
 }
 
+TEST_F(PGLogTest, index) {
+  PGLogIndex<hobject_t, pg_log_entry_t, entry_soid_t> objects;
+  EXPECT_EQ(0u, objects.count(mk_obj(1)));
+  EXPECT_EQ(nullptr, objects[mk_obj(1)]);
+
+  const unsigned num = 1000;
+  vector<pg_log_entry_t> entries;
+  entries.reserve(num * 2);
+  for (unsigned i = 0; i < num; ++i) {
+    entries.push_back(mk_ple_mod(mk_obj(i), mk_evt(10, i + 1), mk_evt(0, 0)));
+    objects.insert(&entries.back());
+  }
+  EXPECT_EQ(num, objects.size());
+  // a pointer and a hash per slot, at no less than 3/8 load
+  EXPECT_LE(objects.get_bytes(), num * 16 * 8 / 3);
+
+  // erasing has to leave everything colliding with the hole findable
+  for (unsigned i = 0; i < num; i += 2) {
+    auto p = objects.find(mk_obj(i));
+    ASSERT_NE(objects.end(), p);
+    EXPECT_EQ(mk_obj(i), p->first);
+    EXPECT_EQ(&entries[i], p->second);
+    objects.erase(p);
+  }
+  EXPECT_EQ(num / 2, objects.size());
+  for (unsigned i = 0; i < num; ++i) {
+    EXPECT_EQ(i % 2, objects.count(mk_obj(i)));
+  }
+
+  // a newer entry for an indexed object replaces it
+  for (unsigned i = 1; i < num; i += 2) {
+    entries.push_back(mk_ple_mod(mk_obj(i), mk_evt(20, i + 1), mk_evt(10, i + 1)));
+    objects.insert(&entries.back());
+  }
+  EXPECT_EQ(num / 2, objects.size());
+  for (unsigned i = 1; i < num; i += 2) {
+    ASSERT_NE(nullptr, objects[mk_obj(i)]);
+    EXPECT_EQ(mk_evt(20, i + 1), objects[mk_obj(i)]->version);
+  }
+
+  objects.clear();
+  EXPECT_TRUE(objects.empty());
+  EXPECT_EQ(0u, objects.get_bytes());
+  EXPECT_EQ(0u, objects.count(mk_obj(1)));
+}
+
 TEST_F(PGLogTest, ErrorNotIndexedByObject) {
   clear();
 
@@ -2744,6 +2790,62 @@ TEST_F(PGLogTrimTest, TestPartialTrim)
 }
 
 
+TEST_F(PGLogTrimTest, TestBudgetedTrim)
+{
+  SetUp(20);
+  PGLog::IndexedLog log;
+  log.head = mk_evt(24, 0);
+  log.skip_can_rollback_to_to_head();
+  log.head = mk_evt(9, 0);
+
+  log.add(mk_ple_mod(mk_obj(1), mk_evt(10, 100), mk_evt(8, 70)));
+  log.add(mk_ple_dt(mk_obj(2), mk_evt(15, 150), mk_evt(10, 100)));
+  log.add(mk_ple_mod_rb(mk_obj(3), mk_evt(15, 155), mk_evt(15, 150)));
+  log.add(mk_ple_mod(mk_obj(1), mk_evt(19, 160), mk_evt(25, 152)));
+  log.add(mk_ple_mod(mk_obj(4), mk_evt(21, 165), mk_evt(26, 160)));
+  log.add(mk_ple_dt_rb(mk_obj(5), mk_evt(21, 167), mk_evt(31, 166)));
+
+  std::set<eversion_t> trimmed;
+  std::set<std::string> trimmed_dups;
+  eversion_t write_from_dups = eversion_t::max();
+
+  // the tail only advances as far as the budget allows
+  EXPECT_EQ(8u, log.trim(cct, mk_evt(19, 157), &trimmed, &trimmed_dups,
+			 &write_from_dups, 1));
+  EXPECT_EQ(mk_evt(10, 100), log.tail);
+  EXPECT_EQ(5u, log.log.size());
+  EXPECT_EQ(1u, trimmed.size());
+  EXPECT_EQ(0u, log.dups.size());
+
+  EXPECT_EQ(3u, log.trim(cct, mk_evt(19, 157), &trimmed, &trimmed_dups,
+			 &write_from_dups, 1));
+  EXPECT_EQ(mk_evt(15, 150), log.tail);
+  EXPECT_EQ(4u, log.log.size());
+  EXPECT_EQ(1u, log.dups.size());
+
+  EXPECT_EQ(0u, log.trim(cct, mk_evt(19, 157), &trimmed, &trimmed_dups,
+			 &write_from_dups));
+  EXPECT_EQ(mk_evt(19, 157), log.tail);
+  EXPECT_EQ(3u, log.log.size());
+  EXPECT_EQ(3u, trimmed.size());
+  EXPECT_EQ(2u, log.dups.size());
+  EXPECT_EQ(eversion_t(15, 150), write_from_dups);
+
+  // dups left over are trimmed without any log entries to trim
+  SetUp(5);
+  EXPECT_EQ(8u, log.trim(cct, eversion_t(), &trimmed, &trimmed_dups,
+			 &write_from_dups, 1));
+  EXPECT_EQ(1u, log.dups.size());
+  EXPECT_EQ(1u, trimmed_dups.size());
+  EXPECT_EQ(0u, log.trim(cct, eversion_t(), &trimmed, &trimmed_dups,
+			 &write_from_dups, 1));
+  EXPECT_EQ(0u, log.dups.size());
+  EXPECT_EQ(2u, trimmed_dups.size());
+  EXPECT_EQ(mk_evt(19, 157), log.tail);
+  EXPECT_EQ(3u, log.log.size());
+}
+
+
 TEST_F(PGLogTrimTest, TestTrimNoTrimmed) {
   SetUp(20);
   PGLog::IndexedLog log;
@@ -15,6 +15,7 @@
 #include <gtest/gtest.h>
 #include "osd/PGTransaction.h"
 #include "osd/ECTransaction.h"
+#include "erasure-code/ErasureCodePlugin.h"
 
 #include "test/unit.cc"
 
@@ -122,3 +123,203 @@ TEST(ectransaction, many_writes)
   ASSERT_EQ(0u, plan.to_read.size());
   ASSERT_EQ(1u, plan.will_write.size());
 }
+
+TEST(ectransaction, parity_delta)
+{
+  ECUtil::stripe_info_t sinfo(2, 8192);
+  auto get_hinfo = [&](const hobject_t &i) {
+    ECUtil::HashInfoRef ref(new ECUtil::HashInfo(3));
+    ref->set_projected_total_logical_size(sinfo, 3 * 8192);
+    return ref;
+  };
+  hobject_t h;
+  bufferlist a;
+  a.append_zero(1000);
+
+  // within the first chunk of the second stripe
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 8192 + 100, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, true);
+    ASSERT_EQ(1u, plan.to_read.size());
+    ASSERT_TRUE(plan.parity_delta);
+    ASSERT_EQ(h, plan.parity_delta->oid);
+    ASSERT_EQ(8192u, plan.parity_delta->stripe_off);
+    ASSERT_EQ(set<int>{0}, plan.parity_delta->data_chunks);
+  }
+  // across both chunks
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 8192 + 4000, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, true);
+    ASSERT_TRUE(plan.parity_delta);
+    ASSERT_EQ((set<int>{0, 1}), plan.parity_delta->data_chunks);
+  }
+  // not unless asked for
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 8192 + 100, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp);
+    ASSERT_EQ(1u, plan.to_read.size());
+    ASSERT_FALSE(plan.parity_delta);
+  }
+  // nor across stripes
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 8192 - 100, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, true);
+    ASSERT_FALSE(plan.parity_delta);
+  }
+  // nor past the end of the object
+  {
+    PGTransactionUPtr t(new PGTransaction);
+    t->write(h, 3 * 8192 - 100, a.length(), a, 0);
+    auto plan = ECTransaction::get_write_plan(
+      sinfo, std::move(t), get_hinfo, &dpp, true);
+    ASSERT_FALSE(plan.parity_delta);
+  }
+}
+
+static ErasureCodeInterfaceRef make_ec_impl(const std::string &plugin)
+{
+  ErasureCodeProfile profile;
+  profile["k"] = "4";
+  profile["m"] = "2";
+  ErasureCodeInterfaceRef ec_impl;
+  ErasureCodePluginRegistry::instance().factory(
+    plugin, g_conf().get_val<std::string>("erasure_code_dir"),
+    profile, &ec_impl, &cerr);
+  return ec_impl;
+}
+
+/*
+ * Overwrite parts of the second stripe of a three stripe object by
+ * parity delta, and check that what is written to the shards is what
+ * encoding the new object in full gives.
+ */
+static void check_write_parity_delta(ErasureCodeInterfaceRef ec_impl)
+{
+  const int k = ec_impl->get_data_chunk_count();
+  const int n = ec_impl->get_chunk_count();
+  const uint64_t chunk_size = ec_impl->get_chunk_size(4096 * k);
+  ECUtil::stripe_info_t sinfo(k, chunk_size * k);
+  const uint64_t sw = sinfo.get_stripe_width();
+  const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+  auto shard_of = [&](int chunk) {
+    return (int)chunk_mapping.size() > chunk ? chunk_mapping[chunk] : chunk;
+  };
+  set<int> want;
+  for (int i = 0; i < n; ++i) {
+    want.insert(i);
+  }
+
+  bufferlist old_data;
+  for (uint64_t i = 0; i < 3 * sw; ++i) {
+    old_data.append((char)(i * 7 + i / 13));
+  }
+  map<int, bufferlist> old_shards;
+  ASSERT_EQ(0, ECUtil::encode(sinfo, ec_impl, old_data, want, &old_shards));
+
+  struct update_t {
+    uint64_t off, len;
+    bool zero;
+  };
+  const vector<vector<update_t>> cases = {
+    // unaligned, within one chunk
+    {{sw + 100, 1000, false}},
+    // unaligned, across two chunks
+    {{sw + chunk_size - 100, 300, false}},
+    // a write and a zero in different chunks
+    {{sw + 10, 20, false}, {sw + 2 * chunk_size + 5, 700, true}},
+    // a whole chunk zeroed
+    {{sw + chunk_size, chunk_size, true}},
+  };
+  hobject_t h;
+  for (auto &updates : cases) {
+    bufferlist new_data;
+    new_data.append(old_data.c_str(), old_data.length());
+    char *p = new_data.c_str();
+    PGTransaction t;
+    ECTransaction::ParityDelta pd;
+    pd.oid = h;
+    pd.stripe_off = sw;
+    for (auto &u : updates) {
+      if (u.zero) {
+	t.zero(h, u.off, u.len);
+	memset(p + u.off, 0, u.len);
+      } else {
+	bufferlist bl;
+	for (uint64_t i = 0; i < u.len; ++i) {
+	  bl.append((char)(i * 31 + 1));
+	}
+	bl.begin().copy(u.len, p + u.off);
+	t.write(h, u.off, u.len, bl);
+      }
+      for (uint64_t c = (u.off - sw) / chunk_size;
+	   c <= (u.off + u.len - 1 - sw) / chunk_size;
+	   ++c) {
+	pd.data_chunks.insert(c);
+      }
+    }
+
+    // what the shards return for the stripe
+    for (int c = 0; c < n; ++c) {
+      if (c < k && !pd.data_chunks.count(c)) {
+	continue;
+      }
+      int shard = shard_of(c);
+      pd.old_chunks[shard].substr_of(old_shards[shard], chunk_size, chunk_size);
+    }
+
+    map<shard_id_t, ObjectStore::Transaction> transactions;
+    for (int i = 0; i < n; ++i) {
+      transactions[shard_id_t(i)];
+    }
+    ECTransaction::write_parity_delta(
+      pg_t(), sinfo, ec_impl, pd, t.op_map[h].buffer_updates,
+      &transactions, &dpp);
+
+    map<int, bufferlist> new_shards;
+    ASSERT_EQ(0, ECUtil::encode(sinfo, ec_impl, new_data, want, &new_shards));
+    for (int c = 0; c < n; ++c) {
+      int shard = shard_of(c);
+      bufferlist expected;
+      expected.substr_of(new_shards[shard], chunk_size, chunk_size);
+      unsigned writes = 0;
+      auto i = transactions[shard_id_t(shard)].begin();
+      while (i.have_op()) {
+	auto op = i.decode_op();
+	ASSERT_EQ((int)ObjectStore::Transaction::OP_WRITE, (int)op->op);
+	bufferlist bl;
+	i.decode_bl(bl);
+	ASSERT_EQ(chunk_size, op->off);
+	ASSERT_EQ(chunk_size, op->len);
+	ASSERT_TRUE(bl.contents_equal(expected)) << "chunk " << c;
+	++writes;
+      }
+      // the data chunks not written are left alone
+      ASSERT_EQ((c < k && !pd.data_chunks.count(c)) ? 0u : 1u, writes)
+	<< "chunk " << c;
+    }
+  }
+}
+
+TEST(ectransaction, write_parity_delta_jerasure)
+{
+  auto ec_impl = make_ec_impl("jerasure");
+  ASSERT_TRUE(ec_impl);
+  check_write_parity_delta(ec_impl);
+}
+
+TEST(ectransaction, write_parity_delta_isa)
+{
+  auto ec_impl = make_ec_impl("isa");
+  if (!ec_impl) {
+    GTEST_SKIP() << "isa plugin not built";
+  }
+  check_write_parity_delta(ec_impl);
+}
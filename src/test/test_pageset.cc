@@ -1,7 +1,10 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
+#include <thread>
+
 #include "gtest/gtest.h"
 
+#include "os/memstore/HugePageSet.h"
 #include "os/memstore/PageSet.h"
 
 template <typename T>
@@ -281,3 +284,98 @@ TEST(PageSet, FreeHoles)
   pages.get_range(0, 8, range);
   ASSERT_EQ(0u, range.size());
 }
+
+TEST(HugePageSet, AllocGetFree)
+{
+  HugePageSet pages(2);
+  HugePageSet::page_vector range;
+
+  // back of first page to front of third
+  pages.alloc_range(1, 4, range);
+  ASSERT_EQ(3u, range.size());
+  ASSERT_EQ(0u, range[0]->offset);
+  ASSERT_EQ(2u, range[1]->offset);
+  ASSERT_EQ(4u, range[2]->offset);
+  range.clear();
+
+  // far enough out to grow the radix tree by several levels
+  pages.alloc_range(1ull << 40, 1, range);
+  ASSERT_EQ(1u, range.size());
+  range.clear();
+  ASSERT_EQ(4u, pages.size());
+
+  pages.get_range(3, 1ull << 41, range);
+  ASSERT_EQ(3u, range.size());
+  ASSERT_EQ(2u, range[0]->offset);
+  ASSERT_EQ(4u, range[1]->offset);
+  ASSERT_EQ(1ull << 40, range[2]->offset);
+  range.clear();
+
+  // keeps the page offset 3 falls in
+  pages.free_pages_after(3);
+  ASSERT_EQ(2u, pages.size());
+  pages.get_range(0, 1ull << 41, range);
+  ASSERT_EQ(2u, range.size());
+  ASSERT_EQ(2u, range[1]->offset);
+  range.clear();
+
+  pages.free_pages_after(0);
+  ASSERT_TRUE(pages.empty());
+}
+
+TEST(HugePageSet, EncodeAsPageSet)
+{
+  PageSet pages(4096);
+  PageSet::page_vector range;
+  for (uint64_t i : {0, 3, 1000})
+    pages.alloc_range(i * 4096, 4096, range);
+  for (auto& p : range)
+    std::fill(p->data, p->data + 4096, (char)p->offset);
+  range.clear();
+  bufferlist bl;
+  pages.encode(bl);
+
+  HugePageSet huge(4096);
+  auto p = bl.cbegin();
+  huge.decode(p);
+  ASSERT_EQ(3u, huge.size());
+  HugePageSet::page_vector huge_range;
+  huge.get_range(0, 1001 * 4096, huge_range);
+  ASSERT_EQ(3u, huge_range.size());
+  ASSERT_EQ(3u * 4096, huge_range[1]->offset);
+  ASSERT_EQ((char)(3 * 4096), huge_range[1]->data[100]);
+  huge_range.clear();
+
+  // and back
+  bufferlist bl2;
+  huge.encode(bl2);
+  ASSERT_TRUE(bl.contents_equal(bl2));
+}
+
+TEST(HugePageSet, Concurrent)
+{
+  const uint64_t page_size = 4096;
+  HugePageSet pages(page_size);
+  std::vector<std::thread> threads;
+  std::atomic<unsigned> errors = {0};
+  for (unsigned t = 0; t < 8; ++t) {
+    threads.emplace_back([&, t] {
+      HugePageSet::page_vector range;
+      for (uint64_t i = 0; i < 2000; ++i) {
+	// each thread owns every 8th page
+	uint64_t offset = (i * 8 + t) * page_size;
+	pages.alloc_range(offset, page_size, range);
+	std::fill(range[0]->data, range[0]->data + page_size, (char)t);
+	range.clear();
+	pages.get_range(offset, page_size, range);
+	if (range.size() != 1 || range[0]->data[page_size - 1] != (char)t)
+	  ++errors;
+	range.clear();
+      }
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+  ASSERT_EQ(0u, errors);
+  ASSERT_EQ(8u * 2000, pages.size());
+}